@@ -72,10 +72,10 @@ avl_count_nodes (const struct avl_node *node)
 
 /* Comparison for insertion */
 static int
-comp_value (const void *key, struct avl_node *node)
+comp_value (const void *key, const struct avl_node *node)
 {
   int val = *(const int *) key;
-  struct test_node *n = avl_entry (node, struct test_node, node);
+  const struct test_node *n = avl_entry (node, struct test_node, node);
   if (val < n->value)
     return -1;
   if (val > n->value)
@@ -110,19 +110,8 @@ insert_value (struct avl_root *tree, int value)
 static struct test_node *
 find_value (struct avl_root *tree, int value)
 {
-  struct avl_node *node = tree->avl_node;
-
-  while (node != NULL)
-    {
-      int c = comp_value (&value, node);
-      if (c < 0)
-        node = node->avl_left;
-      else if (c > 0)
-        node = node->avl_right;
-      else
-        return avl_entry (node, struct test_node, node);
-    }
-  return NULL;
+  struct avl_node *node = avl_find (&value, tree, comp_value);
+  return node ? avl_entry (node, struct test_node, node) : NULL;
 }
 
 /* Delete a value from tree */
@@ -553,6 +542,405 @@ TEST (alternating_insert_delete)
   ASSERT (avl_count_nodes (tree.avl_node) == 50);
 }
 
+TEST (lower_upper_bound)
+{
+  struct avl_root tree = AVL_ROOT_INIT;
+  struct avl_node *node;
+  int key;
+  int i;
+
+  for (i = 0; i < 100; i++)
+    insert_value (&tree, i * 10);
+
+  key = 0;
+  node = avl_lower_bound (&key, &tree, comp_value);
+  ASSERT (node && avl_entry (node, struct test_node, node)->value == 0);
+
+  key = 15;
+  node = avl_lower_bound (&key, &tree, comp_value);
+  ASSERT (node && avl_entry (node, struct test_node, node)->value == 20);
+
+  key = 20;
+  node = avl_lower_bound (&key, &tree, comp_value);
+  ASSERT (node && avl_entry (node, struct test_node, node)->value == 20);
+  node = avl_upper_bound (&key, &tree, comp_value);
+  ASSERT (node && avl_entry (node, struct test_node, node)->value == 30);
+
+  key = -5;
+  node = avl_upper_bound (&key, &tree, comp_value);
+  ASSERT (node && avl_entry (node, struct test_node, node)->value == 0);
+
+  key = 990;
+  ASSERT (avl_lower_bound (&key, &tree, comp_value) != NULL);
+  ASSERT (avl_upper_bound (&key, &tree, comp_value) == NULL);
+  key = 991;
+  ASSERT (avl_lower_bound (&key, &tree, comp_value) == NULL);
+}
+
+TEST (range_iteration)
+{
+  struct avl_root tree = AVL_ROOT_INIT;
+  struct avl_node *node;
+  struct test_node *pos;
+  int first = 95, last = 305;
+  int expected = 100;
+  int count = 0;
+  int i;
+
+  for (i = 0; i < 100; i++)
+    insert_value (&tree, i * 10);
+
+  avl_for_each_in_range (node, &first, &last, &tree, comp_value)
+  {
+    ASSERT (avl_entry (node, struct test_node, node)->value == expected);
+    expected += 10;
+    count++;
+  }
+  ASSERT (count == 21);
+
+  count = 0;
+  first = 300;
+  last = 300;
+  avl_for_each_entry_in_range (pos, &first, &last, &tree, comp_value, node)
+  {
+    ASSERT (pos->value == 300);
+    count++;
+  }
+  ASSERT (count == 1);
+
+  count = 0;
+  first = 2000;
+  last = 3000;
+  avl_for_each_in_range (node, &first, &last, &tree, comp_value)
+    count++;
+  ASSERT (count == 0);
+}
+
+struct walk_state
+{
+  int next;
+  int stop_at;
+  int calls;
+};
+
+static int
+walk_check (struct avl_node **nodes, size_t n, void *arg)
+{
+  struct walk_state *st = arg;
+  size_t i;
+
+  ASSERT (n > 0 && n <= AVL_WALK_BATCH);
+  st->calls++;
+  for (i = 0; i < n; i++)
+    {
+      ASSERT (avl_entry (nodes[i], struct test_node, node)->value
+              == st->next);
+      if (st->next++ == st->stop_at)
+        return 1;
+    }
+  return 0;
+}
+
+TEST (walk)
+{
+  struct avl_root tree = AVL_ROOT_INIT;
+  struct walk_state st = { 0, -1, 0 };
+  int i;
+
+  ASSERT (avl_walk (&tree, walk_check, &st) == 0);
+  ASSERT (st.calls == 0);
+
+  for (i = 0; i < 1000; i++)
+    insert_value (&tree, (i * 37) % 1000);
+
+  ASSERT (avl_walk (&tree, walk_check, &st) == 0);
+  ASSERT (st.next == 1000);
+  ASSERT (st.calls == (1000 + AVL_WALK_BATCH - 1) / AVL_WALK_BATCH);
+
+  st.next = 0;
+  st.stop_at = 500;
+  ASSERT (avl_walk (&tree, walk_check, &st) == 1);
+  ASSERT (st.next == 501);
+}
+
+TEST (postorder_iteration)
+{
+  struct avl_root tree = AVL_ROOT_INIT;
+  struct avl_node *node, *tmp;
+  struct test_node *pos, *n;
+  char visited[200] = { 0 };
+  int count = 0;
+  int i;
+
+  avl_for_each_postorder_safe (node, tmp, &tree)
+    count++;
+  ASSERT (count == 0);
+
+  for (i = 0; i < 200; i++)
+    insert_value (&tree, (i * 67) % 200);
+
+  /* every node is visited after both of its children */
+  avl_for_each_postorder_safe (node, tmp, &tree)
+  {
+    if (node->avl_left)
+      ASSERT (visited[avl_entry (node->avl_left, struct test_node, node)->value]);
+    if (node->avl_right)
+      ASSERT (visited[avl_entry (node->avl_right, struct test_node, node)->value]);
+    visited[avl_entry (node, struct test_node, node)->value] = 1;
+    count++;
+  }
+  ASSERT (count == 200);
+
+  count = 0;
+  avl_for_each_entry_postorder_safe (pos, n, &tree, node)
+  {
+    free (pos);
+    count++;
+  }
+  ASSERT (count == 200);
+}
+
+static int freed_count;
+
+static void
+free_node (struct avl_node *node)
+{
+  freed_count++;
+  free (avl_entry (node, struct test_node, node));
+}
+
+TEST (destroy)
+{
+  struct avl_root tree = AVL_ROOT_INIT;
+  int i;
+
+  freed_count = 0;
+  avl_destroy (&tree, free_node);
+  ASSERT (freed_count == 0);
+
+  srand (99);
+  for (i = 0; i < 5000; i++)
+    insert_value (&tree, rand ());
+
+  avl_destroy (&tree, free_node);
+  ASSERT (freed_count == 5000);
+  ASSERT (avl_empty (&tree));
+}
+
+static void
+avl_check_parents (const struct avl_node *node)
+{
+  if (node == NULL)
+    return;
+  if (node->avl_left)
+    ASSERT (node->avl_left->avl_parent == node);
+  if (node->avl_right)
+    ASSERT (node->avl_right->avl_parent == node);
+  avl_check_parents (node->avl_left);
+  avl_check_parents (node->avl_right);
+}
+
+/* Checks that tree holds exactly the values first, first + step, ... < end */
+static void
+check_sequence (struct avl_root *tree, int first, int step, int end)
+{
+  struct test_node *pos;
+  int expected = first;
+
+  avl_validate (tree);
+  if (tree->avl_node)
+    ASSERT (tree->avl_node->avl_parent == NULL);
+  avl_check_parents (tree->avl_node);
+  avl_for_each_entry (pos, tree, node)
+  {
+    ASSERT (pos->value == expected);
+    expected += step;
+  }
+  ASSERT (expected >= end && expected - step < end);
+}
+
+static void
+destroy_tree (struct avl_root *tree)
+{
+  struct test_node *pos, *n;
+
+  avl_for_each_entry_postorder_safe (pos, n, tree, node)
+    free (pos);
+  tree->avl_node = NULL;
+}
+
+TEST (join)
+{
+  static const int sizes[] = { 0, 1, 2, 5, 31, 100, 1000 };
+  size_t i, j;
+  int v;
+
+  for (i = 0; i < sizeof (sizes) / sizeof (sizes[0]); i++)
+    for (j = 0; j < sizeof (sizes) / sizeof (sizes[0]); j++)
+      {
+        struct avl_root left = AVL_ROOT_INIT;
+        struct avl_root right = AVL_ROOT_INIT;
+        struct avl_root out = AVL_ROOT_INIT;
+        struct test_node *mid = malloc (sizeof (*mid));
+
+        ASSERT (mid != NULL);
+        for (v = 0; v < sizes[i]; v++)
+          insert_value (&left, v);
+        mid->value = sizes[i];
+        for (v = 0; v < sizes[j]; v++)
+          insert_value (&right, sizes[i] + 1 + v);
+
+        avl_join (&left, &mid->node, &right, &out);
+        ASSERT (avl_empty (&left) && avl_empty (&right));
+        check_sequence (&out, 0, 1, sizes[i] + sizes[j] + 1);
+
+        /* concat the two halves of a split back together */
+        v = sizes[i] / 2;
+        avl_split (&out, &v, comp_value, &left, &right);
+        check_sequence (&left, 0, 1, v);
+        check_sequence (&right, v, 1, sizes[i] + sizes[j] + 1);
+        avl_concat (&left, &right, &left);
+        ASSERT (avl_empty (&right));
+        check_sequence (&left, 0, 1, sizes[i] + sizes[j] + 1);
+        destroy_tree (&left);
+      }
+}
+
+TEST (split)
+{
+  static const int keys[] = { -1, 0, 1, 500, 501, 998, 999, 1000, 2000 };
+  size_t i;
+  int v;
+
+  for (i = 0; i < sizeof (keys) / sizeof (keys[0]); i++)
+    {
+      struct avl_root tree = AVL_ROOT_INIT;
+      struct avl_root left = AVL_ROOT_INIT;
+      struct avl_root right = AVL_ROOT_INIT;
+      int key = keys[i];
+      int mid = key < 0 ? 0 : key > 1000 ? 1000 : key;
+
+      for (v = 0; v < 1000; v++)
+        insert_value (&tree, (v * 7) % 1000);
+
+      avl_split (&tree, &key, comp_value, &left, &right);
+      ASSERT (avl_empty (&tree));
+      check_sequence (&left, 0, 1, mid);
+      check_sequence (&right, mid, 1, 1000);
+      ASSERT (avl_count_nodes (left.avl_node) == mid);
+      ASSERT (avl_count_nodes (right.avl_node) == 1000 - mid);
+      destroy_tree (&left);
+      destroy_tree (&right);
+    }
+}
+
+static int
+node_comp (const struct avl_node *a, const struct avl_node *b)
+{
+  return comp_value (&avl_entry (a, struct test_node, node)->value, b);
+}
+
+static int dropped;
+
+static void
+drop_node (struct avl_node *node)
+{
+  __atomic_fetch_add (&dropped, 1, __ATOMIC_RELAXED);
+  free (avl_entry (node, struct test_node, node));
+}
+
+/* a = multiples of 2 below 2 * n, b = multiples of 3 below 3 * n */
+static void
+build_sets (struct avl_root *a, struct avl_root *b, int n)
+{
+  int i;
+
+  for (i = 0; i < n; i++)
+    {
+      insert_value (a, (i * 37 % n) * 2);
+      insert_value (b, (i * 41 % n) * 3);
+    }
+}
+
+static void
+check_set (struct avl_root *tree, bool (*member) (int), int end)
+{
+  struct test_node *pos;
+  int expected = 0;
+
+  avl_validate (tree);
+  if (tree->avl_node)
+    ASSERT (tree->avl_node->avl_parent == NULL);
+  avl_check_parents (tree->avl_node);
+  avl_for_each_entry (pos, tree, node)
+  {
+    while (expected < end && !member (expected))
+      expected++;
+    ASSERT (pos->value == expected);
+    expected++;
+  }
+  while (expected < end && !member (expected))
+    expected++;
+  ASSERT (expected == end);
+}
+
+static int set_n;
+
+static bool
+in_union (int v)
+{
+  return (v % 2 == 0 && v < 2 * set_n) || (v % 3 == 0 && v < 3 * set_n);
+}
+
+static bool
+in_intersection (int v)
+{
+  return v % 6 == 0 && v < 2 * set_n;
+}
+
+static bool
+in_difference (int v)
+{
+  return v % 2 == 0 && v % 3 != 0 && v < 2 * set_n;
+}
+
+TEST (set_operations)
+{
+  static const int sizes[] = { 0, 1, 10, 1000, 20000 };
+  static const unsigned int threads[] = { 1, 4 };
+  size_t i, j;
+
+  for (i = 0; i < sizeof (sizes) / sizeof (sizes[0]); i++)
+    for (j = 0; j < sizeof (threads) / sizeof (threads[0]); j++)
+      {
+        struct avl_root a = AVL_ROOT_INIT;
+        struct avl_root b = AVL_ROOT_INIT;
+        int n = set_n = sizes[i];
+
+        build_sets (&a, &b, n);
+        dropped = 0;
+        avl_union (&a, &b, node_comp, drop_node, threads[j], &a);
+        ASSERT (avl_empty (&b));
+        check_set (&a, in_union, 3 * n);
+        ASSERT (dropped == (n + 2) / 3);
+        destroy_tree (&a);
+
+        build_sets (&a, &b, n);
+        dropped = 0;
+        avl_intersection (&a, &b, node_comp, drop_node, threads[j], &a);
+        check_set (&a, in_intersection, 2 * n);
+        ASSERT (dropped + avl_count_nodes (a.avl_node) == 2 * n);
+        destroy_tree (&a);
+
+        build_sets (&a, &b, n);
+        dropped = 0;
+        avl_difference (&a, &b, node_comp, drop_node, threads[j], &a);
+        check_set (&a, in_difference, 2 * n);
+        ASSERT (dropped + avl_count_nodes (a.avl_node) == 2 * n);
+        destroy_tree (&a);
+      }
+}
+
 int
 main (void)
 {
@@ -581,6 +969,14 @@ main (void)
   RUN_TEST (stress_random);
   RUN_TEST (tree_balance);
   RUN_TEST (alternating_insert_delete);
+  RUN_TEST (lower_upper_bound);
+  RUN_TEST (range_iteration);
+  RUN_TEST (walk);
+  RUN_TEST (postorder_iteration);
+  RUN_TEST (destroy);
+  RUN_TEST (join);
+  RUN_TEST (split);
+  RUN_TEST (set_operations);
 
   fprintf(stderr, "\n=== Results ===\n");
   fprintf(stderr, "Passed: %d/%d\n", pass_count, test_count);
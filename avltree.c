@@ -20,6 +20,7 @@
 
 #include "avltree.h"
 #include <assert.h>
+#include <pthread.h>
 
 static void
 avl_rotate_right (struct avl_node *x, struct avl_root *tree)
@@ -92,17 +93,17 @@ avl_rotate_left (struct avl_node *x, struct avl_root *tree)
   y->avl_left = x;
 }
 
-void
-avl_balance_insert (struct avl_node *node, struct avl_root *tree)
+/* Rebalances after the subtree rooted at node grew by one level.
+   Returns true if the whole tree grew.  */
+static bool
+avl_grow (struct avl_node *node, struct avl_root *tree)
 {
-  assert (node->avl_balance == 0);
-
   for (;;)
     {
       struct avl_node *parent = node->avl_parent;
 
       if (node == tree->avl_node)
-        break;
+        return true;
 
       assert (parent != NULL);
 
@@ -111,7 +112,7 @@ avl_balance_insert (struct avl_node *node, struct avl_root *tree)
           ++parent->avl_balance;
 
           if (parent->avl_balance == 0)
-            break;
+            return false;
 
           if (parent->avl_balance == +1)
             {
@@ -150,7 +151,7 @@ avl_balance_insert (struct avl_node *node, struct avl_root *tree)
                     }
                   tmp->avl_balance = 0;
                 }
-              break;
+              return false;
             }
         }
       else
@@ -158,7 +159,7 @@ avl_balance_insert (struct avl_node *node, struct avl_root *tree)
           --parent->avl_balance;
 
           if (parent->avl_balance == 0)
-            break;
+            return false;
 
           if (parent->avl_balance == -1)
             {
@@ -214,12 +215,19 @@ avl_balance_insert (struct avl_node *node, struct avl_root *tree)
                     }
                   tmp->avl_balance = 0;
                 }
-              break;
+              return false;
             }
         }
     }
 }
 
+void
+avl_balance_insert (struct avl_node *node, struct avl_root *tree)
+{
+  assert (node->avl_balance == 0);
+  avl_grow (node, tree);
+}
+
 void
 avl_erase (struct avl_node *x, struct avl_root *tree)
 {
@@ -301,15 +309,17 @@ avl_erase (struct avl_node *x, struct avl_root *tree)
 
   for (;;)
     {
-      if (p == NULL || p == tree->avl_node)
+      if (p == NULL)
         break;
-      assert (p->avl_parent != 0);
 
       if (p->avl_balance == 0)
         {
           struct avl_node *tmp;
 
+          /* the root may still need a rotation, so stop only here */
           tmp = p->avl_parent;
+          if (tmp == NULL)
+            break;
           if (tmp->avl_left == p)
             tmp->avl_balance++;
           else
@@ -342,8 +352,8 @@ avl_erase (struct avl_node *x, struct avl_root *tree)
                *      p   b
                *     / \
                *     c a
-               * avl_rotate_left (p, tree);
 	       */
+              avl_rotate_left (p, tree);
               w->avl_balance = -1;
               p->avl_balance = +1;
               break;
@@ -359,6 +369,8 @@ avl_erase (struct avl_node *x, struct avl_root *tree)
               w->avl_balance = 0;
               p->avl_balance = 0;
               p = w->avl_parent;
+              if (p == NULL)
+                break;
               if (p->avl_left == w)
                 p->avl_balance += 1;
               else
@@ -405,6 +417,8 @@ avl_erase (struct avl_node *x, struct avl_root *tree)
 
               a->avl_balance = 0;
               p = a->avl_parent;
+              if (p == NULL)
+                break;
               if (p->avl_left == a)
                 p->avl_balance += 1;
               else
@@ -430,6 +444,8 @@ avl_erase (struct avl_node *x, struct avl_root *tree)
               w->avl_balance = 0;
               p->avl_balance = 0;
               p = w->avl_parent;
+              if (p == NULL)
+                break;
               if (p->avl_left == w)
                 p->avl_balance += 1;
               else
@@ -463,6 +479,8 @@ avl_erase (struct avl_node *x, struct avl_root *tree)
 
               a->avl_balance = 0;
               p = a->avl_parent;
+              if (p == NULL)
+                break;
               if (p->avl_left == a)
                 p->avl_balance += 1;
               else
@@ -471,3 +489,477 @@ avl_erase (struct avl_node *x, struct avl_root *tree)
         }
     }
 }
+
+void
+avl_destroy (struct avl_root *tree, void (*free_fn) (struct avl_node *))
+{
+  struct avl_node *pos;
+  struct avl_node *n;
+
+  avl_for_each_postorder_safe (pos, n, tree)
+    free_fn (pos);
+  tree->avl_node = NULL;
+}
+
+int
+avl_walk (struct avl_root *root,
+          int (*fn) (struct avl_node **nodes, size_t n, void *arg),
+          void *arg)
+{
+  struct avl_node *stack[AVL_MAX_HEIGHT];
+  struct avl_node *batch[AVL_WALK_BATCH];
+  struct avl_node *node = root->avl_node;
+  size_t depth = 0;
+  size_t n = 0;
+  int ret;
+
+  for (;;)
+    {
+      while (node != NULL)
+        {
+          assert (depth < AVL_MAX_HEIGHT);
+          __builtin_prefetch (node->avl_right);
+          stack[depth++] = node;
+          node = node->avl_left;
+        }
+
+      if (depth == 0)
+        break;
+
+      node = stack[--depth];
+      batch[n++] = node;
+      node = node->avl_right;
+
+      if (n == AVL_WALK_BATCH)
+        {
+          ret = fn (batch, n, arg);
+          if (ret)
+            return ret;
+          n = 0;
+        }
+    }
+
+  return n ? fn (batch, n, arg) : 0;
+}
+
+/* Returns the height of the subtree rooted at x, following the taller
+   child at each level.  */
+static int
+avl_height_of (const struct avl_node *x)
+{
+  int h = 0;
+
+  while (x != NULL)
+    {
+      ++h;
+      x = x->avl_balance < 0 ? x->avl_left : x->avl_right;
+    }
+  return h;
+}
+
+/* Detaches x from its parent and returns it as the root of a subtree. */
+static inline struct avl_node *
+avl_detach (struct avl_node *x)
+{
+  if (x != NULL)
+    x->avl_parent = NULL;
+  return x;
+}
+
+/* Joins the subtrees l and r, with heights hl and hr, using k as the middle
+   node.  Every node in l must be less than k and every node in r greater.
+   Returns the new root and stores its height in *hp.  The cost is
+   O(|hl - hr|).  */
+static struct avl_node *
+avl_join_node (struct avl_node *l, int hl, struct avl_node *k,
+               struct avl_node *r, int hr, int *hp)
+{
+  struct avl_root tree;
+  struct avl_node *c;
+  struct avl_node *p = NULL;
+  int h;
+
+  if (hl > hr + 1)
+    {
+      /* descend the right spine of l to a subtree of height hr or hr + 1 */
+      c = l;
+      h = hl;
+      while (h > hr + 1)
+        {
+          h -= c->avl_balance < 0 ? 2 : 1;
+          p = c;
+          c = c->avl_right;
+        }
+
+      k->avl_left = c;
+      if (c)
+        c->avl_parent = k;
+      k->avl_right = r;
+      if (r)
+        r->avl_parent = k;
+      k->avl_balance = hr - h;
+      k->avl_parent = p;
+      p->avl_right = k;
+
+      /* k is one level taller than the subtree it replaced */
+      tree.avl_node = l;
+      *hp = hl + avl_grow (k, &tree);
+      return tree.avl_node;
+    }
+
+  if (hr > hl + 1)
+    {
+      c = r;
+      h = hr;
+      while (h > hl + 1)
+        {
+          h -= c->avl_balance > 0 ? 2 : 1;
+          p = c;
+          c = c->avl_left;
+        }
+
+      k->avl_right = c;
+      if (c)
+        c->avl_parent = k;
+      k->avl_left = l;
+      if (l)
+        l->avl_parent = k;
+      k->avl_balance = h - hl;
+      k->avl_parent = p;
+      p->avl_left = k;
+
+      tree.avl_node = r;
+      *hp = hr + avl_grow (k, &tree);
+      return tree.avl_node;
+    }
+
+  k->avl_left = l;
+  if (l)
+    l->avl_parent = k;
+  k->avl_right = r;
+  if (r)
+    r->avl_parent = k;
+  k->avl_parent = NULL;
+  k->avl_balance = hr - hl;
+  *hp = (hl > hr ? hl : hr) + 1;
+  return k;
+}
+
+/* Same as avl_join_node without a middle node. */
+static struct avl_node *
+avl_concat_node (struct avl_node *l, int hl, struct avl_node *r, int hr,
+                 int *hp)
+{
+  struct avl_root tree;
+  struct avl_node *k;
+
+  if (l == NULL)
+    {
+      *hp = hr;
+      return r;
+    }
+  if (r == NULL)
+    {
+      *hp = hl;
+      return l;
+    }
+
+  tree.avl_node = l;
+  k = avl_max (l);
+  avl_erase (k, &tree);
+  return avl_join_node (tree.avl_node, avl_height_of (tree.avl_node), k, r,
+                        hr, hp);
+}
+
+/* Splits the subtree t of height h into nodes that compare less than key
+   and the rest.  If take_equal is set, the first node found to compare
+   equal to key is removed and returned; it goes to the right otherwise.  */
+static struct avl_node *
+avl_split_node (struct avl_node *t, int h, const void *key,
+                int (*comp) (const void *, const struct avl_node *),
+                bool take_equal, struct avl_node **lp, int *hlp,
+                struct avl_node **rp, int *hrp)
+{
+  struct avl_node *left;
+  struct avl_node *right;
+  struct avl_node *mid;
+  struct avl_node *found;
+  int hleft, hright, hmid;
+  int c;
+
+  if (t == NULL)
+    {
+      *lp = *rp = NULL;
+      *hlp = *hrp = 0;
+      return NULL;
+    }
+
+  hleft = t->avl_balance > 0 ? h - 2 : h - 1;
+  hright = t->avl_balance < 0 ? h - 2 : h - 1;
+  left = avl_detach (t->avl_left);
+  right = avl_detach (t->avl_right);
+
+  c = comp (key, t);
+  if (c == 0 && take_equal)
+    {
+      *lp = left;
+      *hlp = hleft;
+      *rp = right;
+      *hrp = hright;
+      return t;
+    }
+
+  if (c <= 0)
+    {
+      found = avl_split_node (left, hleft, key, comp, take_equal, lp, hlp,
+                              &mid, &hmid);
+      *rp = avl_join_node (mid, hmid, t, right, hright, hrp);
+    }
+  else
+    {
+      found = avl_split_node (right, hright, key, comp, take_equal, &mid,
+                              &hmid, rp, hrp);
+      *lp = avl_join_node (left, hleft, t, mid, hmid, hlp);
+    }
+  return found;
+}
+
+void
+avl_join (struct avl_root *left, struct avl_node *node,
+          struct avl_root *right, struct avl_root *out)
+{
+  struct avl_node *l = left->avl_node;
+  struct avl_node *r = right->avl_node;
+  int h;
+
+  left->avl_node = NULL;
+  right->avl_node = NULL;
+  out->avl_node = avl_join_node (l, avl_height_of (l), node, r,
+                                 avl_height_of (r), &h);
+}
+
+void
+avl_concat (struct avl_root *left, struct avl_root *right,
+            struct avl_root *out)
+{
+  struct avl_node *l = left->avl_node;
+  struct avl_node *r = right->avl_node;
+  int h;
+
+  left->avl_node = NULL;
+  right->avl_node = NULL;
+  out->avl_node
+      = avl_concat_node (l, avl_height_of (l), r, avl_height_of (r), &h);
+}
+
+void
+avl_split (struct avl_root *tree, const void *key,
+           int (*comp) (const void *, const struct avl_node *),
+           struct avl_root *left, struct avl_root *right)
+{
+  struct avl_node *t = tree->avl_node;
+  struct avl_node *l;
+  struct avl_node *r;
+  int hl, hr;
+
+  tree->avl_node = NULL;
+  avl_split_node (t, avl_height_of (t), key, comp, false, &l, &hl, &r, &hr);
+  left->avl_node = l;
+  right->avl_node = r;
+}
+
+/* Set operations only hand a subproblem to another thread when the heights
+   of its trees add up to at least this, about 2^10 nodes each.  */
+#define AVL_SETOP_PAR_HEIGHT 20
+
+enum avl_setop_kind
+{
+  AVL_UNION,
+  AVL_INTERSECTION,
+  AVL_DIFFERENCE,
+};
+
+struct avl_setop
+{
+  enum avl_setop_kind kind;
+  int (*cmp) (const struct avl_node *, const struct avl_node *);
+  void (*drop) (struct avl_node *);
+};
+
+/* the key passed to avl_split_node by set operations */
+struct avl_setop_key
+{
+  const struct avl_setop *op;
+  const struct avl_node *node;
+};
+
+static int
+avl_setop_comp (const void *key, const struct avl_node *node)
+{
+  const struct avl_setop_key *k = key;
+  return k->op->cmp (k->node, node);
+}
+
+static void
+avl_setop_drop_all (const struct avl_setop *op, struct avl_node *t)
+{
+  struct avl_node *pos;
+  struct avl_node *n;
+  struct avl_root tree = { t };
+
+  if (op->drop == NULL)
+    return;
+  avl_for_each_postorder_safe (pos, n, &tree)
+    op->drop (pos);
+}
+
+struct avl_setop_task
+{
+  const struct avl_setop *op;
+  struct avl_node *a;
+  int ha;
+  struct avl_node *b;
+  int hb;
+  unsigned int nthreads;
+  struct avl_node *result;
+  int height;
+};
+
+static void avl_setop_run (struct avl_setop_task *task);
+
+static void *
+avl_setop_thread (void *arg)
+{
+  avl_setop_run (arg);
+  return NULL;
+}
+
+/* The join-based algorithms of Blelloch, Ferizovic and Sun: split a at the
+   root of b, recurse on both halves, then join the results back with the
+   root of b.  The two recursive calls are independent and run on
+   different threads while nthreads allows it.  */
+static void
+avl_setop_run (struct avl_setop_task *task)
+{
+  const struct avl_setop *op = task->op;
+  struct avl_setop_task lt;
+  struct avl_setop_task rt;
+  struct avl_setop_key key;
+  struct avl_node *k = task->b;
+  struct avl_node *found;
+  pthread_t thread;
+  bool threaded = false;
+
+  if (task->a == NULL || task->b == NULL)
+    {
+      switch (op->kind)
+        {
+        case AVL_UNION:
+          task->result = task->a ? task->a : task->b;
+          task->height = task->a ? task->ha : task->hb;
+          break;
+        case AVL_INTERSECTION:
+          avl_setop_drop_all (op, task->a);
+          avl_setop_drop_all (op, task->b);
+          task->result = NULL;
+          task->height = 0;
+          break;
+        case AVL_DIFFERENCE:
+          avl_setop_drop_all (op, task->b);
+          task->result = task->a;
+          task->height = task->ha;
+          break;
+        }
+      return;
+    }
+
+  lt.op = rt.op = op;
+  lt.b = avl_detach (k->avl_left);
+  lt.hb = k->avl_balance > 0 ? task->hb - 2 : task->hb - 1;
+  rt.b = avl_detach (k->avl_right);
+  rt.hb = k->avl_balance < 0 ? task->hb - 2 : task->hb - 1;
+
+  key.op = op;
+  key.node = k;
+  found = avl_split_node (task->a, task->ha, &key, avl_setop_comp, true,
+                          &lt.a, &lt.ha, &rt.a, &rt.ha);
+
+  if (task->nthreads > 1 && task->ha + task->hb >= AVL_SETOP_PAR_HEIGHT)
+    {
+      lt.nthreads = task->nthreads / 2;
+      rt.nthreads = task->nthreads - lt.nthreads;
+      threaded = pthread_create (&thread, NULL, avl_setop_thread, &lt) == 0;
+    }
+  if (!threaded)
+    {
+      lt.nthreads = rt.nthreads = task->nthreads;
+      avl_setop_run (&lt);
+    }
+  avl_setop_run (&rt);
+  if (threaded)
+    pthread_join (thread, NULL);
+
+  if (found && op->drop)
+    op->drop (found);
+
+  if (op->kind == AVL_UNION || (op->kind == AVL_INTERSECTION && found))
+    task->result = avl_join_node (lt.result, lt.height, k, rt.result,
+                                  rt.height, &task->height);
+  else
+    {
+      if (op->drop)
+        op->drop (k);
+      task->result = avl_concat_node (lt.result, lt.height, rt.result,
+                                      rt.height, &task->height);
+    }
+}
+
+static void
+avl_setop (enum avl_setop_kind kind, struct avl_root *a, struct avl_root *b,
+           int (*cmp) (const struct avl_node *, const struct avl_node *),
+           void (*drop) (struct avl_node *), unsigned int nthreads,
+           struct avl_root *out)
+{
+  struct avl_setop op = { kind, cmp, drop };
+  struct avl_setop_task task;
+
+  task.op = &op;
+  task.a = a->avl_node;
+  task.ha = avl_height_of (task.a);
+  task.b = b->avl_node;
+  task.hb = avl_height_of (task.b);
+  task.nthreads = nthreads ? nthreads : 1;
+  a->avl_node = NULL;
+  b->avl_node = NULL;
+
+  avl_setop_run (&task);
+  out->avl_node = task.result;
+}
+
+void
+avl_union (struct avl_root *a, struct avl_root *b,
+           int (*cmp) (const struct avl_node *, const struct avl_node *),
+           void (*drop) (struct avl_node *), unsigned int nthreads,
+           struct avl_root *out)
+{
+  avl_setop (AVL_UNION, a, b, cmp, drop, nthreads, out);
+}
+
+void
+avl_intersection (struct avl_root *a, struct avl_root *b,
+                  int (*cmp) (const struct avl_node *,
+                              const struct avl_node *),
+                  void (*drop) (struct avl_node *), unsigned int nthreads,
+                  struct avl_root *out)
+{
+  avl_setop (AVL_INTERSECTION, a, b, cmp, drop, nthreads, out);
+}
+
+void
+avl_difference (struct avl_root *a, struct avl_root *b,
+                int (*cmp) (const struct avl_node *, const struct avl_node *),
+                void (*drop) (struct avl_node *), unsigned int nthreads,
+                struct avl_root *out)
+{
+  avl_setop (AVL_DIFFERENCE, a, b, cmp, drop, nthreads, out);
+}
@@ -119,6 +119,45 @@ avl_next (const struct avl_node *x)
   return p;
 }
 
+/* Returns the first node in post-order, i.e. the deepest leftmost node. */
+static inline struct avl_node *
+avl_left_deepest (const struct avl_node *x)
+{
+  for (;;)
+    {
+      if (x->avl_left != NULL)
+        x = x->avl_left;
+      else if (x->avl_right != NULL)
+        x = x->avl_right;
+      else
+        return (struct avl_node *)x;
+    }
+}
+
+static inline struct avl_node *
+avl_first_postorder (const struct avl_root *tree)
+{
+  if (tree->avl_node == NULL)
+    return NULL;
+  return avl_left_deepest (tree->avl_node);
+}
+
+/* Returns the node after x in post-order.  Children come before their
+   parent, so x may be freed once the next node has been computed.  */
+static inline struct avl_node *
+avl_next_postorder (const struct avl_node *x)
+{
+  struct avl_node *p;
+
+  if (x == NULL)
+    return NULL;
+
+  p = x->avl_parent;
+  if (p != NULL && p->avl_left == x && p->avl_right != NULL)
+    return avl_left_deepest (p->avl_right);
+  return p;
+}
+
 /* Link node x to parent. */
 static inline void
 avl_link_node (struct avl_node *x, struct avl_node *parent,
@@ -175,6 +214,157 @@ avl_empty (const struct avl_root *tree)
               && ((n) = avl_next_entry (pos, member)));                       \
        (pos); (void)(((pos) = (n)) && ((n) = avl_next_entry (pos, member))))
 
+#define avl_first_postorder_entry(type, tree, member)                         \
+  avl_entry_safe (avl_first_postorder (tree), type, member)
+
+#define avl_next_postorder_entry(pos, member)                                 \
+  avl_entry_safe (avl_next_postorder (&(pos)->member), typeof (*pos), member)
+
+/* Post-order iteration, which allows pos to be freed in the body.  This
+   does not rebalance, so the tree must be discarded afterwards.  */
+#define avl_for_each_postorder_safe(pos, n, tree)                             \
+  for ((void)(((pos) = avl_first_postorder (tree))                            \
+              && ((n) = avl_next_postorder (pos)));                           \
+       (pos) != NULL;                                                         \
+       (void)(((pos) = (n)) && ((n) = avl_next_postorder (pos))))
+
+#define avl_for_each_entry_postorder_safe(pos, n, tree, member)               \
+  for ((void)(((pos) = avl_first_postorder_entry (typeof (*pos), tree,        \
+                                                  member))                    \
+              && ((n) = avl_next_postorder_entry (pos, member)));             \
+       (pos);                                                                 \
+       (void)(((pos) = (n)) && ((n) = avl_next_postorder_entry (pos, member))))
+
+static inline struct avl_node *
+avl_find (const void *__restrict key, struct avl_root *root,
+          int (*comp) (const void *, const struct avl_node *))
+{
+  struct avl_node *node = root->avl_node;
+
+  while (node != NULL)
+    {
+      int c = comp (key, node);
+
+      if (c < 0)
+        node = node->avl_left;
+      else if (c > 0)
+        node = node->avl_right;
+      else
+        return node;
+    }
+  return NULL;
+}
+
+/* Returns the first node that does not compare less than key. */
+static inline struct avl_node *
+avl_lower_bound (const void *__restrict key, struct avl_root *root,
+                 int (*comp) (const void *, const struct avl_node *))
+{
+  struct avl_node *node = root->avl_node;
+  struct avl_node *result = NULL;
+
+  while (node != NULL)
+    {
+      if (comp (key, node) <= 0)
+        {
+          result = node;
+          node = node->avl_left;
+        }
+      else
+        node = node->avl_right;
+    }
+  return result;
+}
+
+/* Returns the first node that compares greater than key. */
+static inline struct avl_node *
+avl_upper_bound (const void *__restrict key, struct avl_root *root,
+                 int (*comp) (const void *, const struct avl_node *))
+{
+  struct avl_node *node = root->avl_node;
+  struct avl_node *result = NULL;
+
+  while (node != NULL)
+    {
+      if (comp (key, node) < 0)
+        {
+          result = node;
+          node = node->avl_left;
+        }
+      else
+        node = node->avl_right;
+    }
+  return result;
+}
+
+/* Iterates over nodes in [first, last] with a single descent. */
+#define avl_for_each_in_range(pos, first, last, tree, compare)                \
+  for ((pos) = avl_lower_bound (first, tree, compare);                        \
+       (pos) != NULL && (compare) (last, pos) >= 0; (pos) = avl_next ((pos)))
+
+#define avl_for_each_entry_in_range(pos, first, last, tree, compare, member)  \
+  for ((pos) = avl_entry_safe (avl_lower_bound (first, tree, compare),        \
+                               typeof (*pos), member);                        \
+       (pos) != NULL && (compare) (last, &(pos)->member) >= 0;                \
+       (pos) = avl_next_entry (pos, member))
+
+
+/* Empties the tree in O(n) without rebalancing, passing every node to
+   free_fn in post-order.  */
+void avl_destroy (struct avl_root *tree,
+                  void (*free_fn) (struct avl_node *));
+
+/* Joins left, node and right into out in O(log n).  Every node in left must
+   be less than node, and every node in right greater.  left and right are
+   left empty; out may be either of them.  */
+void avl_join (struct avl_root *left, struct avl_node *node,
+               struct avl_root *right, struct avl_root *out);
+
+/* Same as avl_join without a middle node. */
+void avl_concat (struct avl_root *left, struct avl_root *right,
+                 struct avl_root *out);
+
+/* Moves the nodes of tree that compare less than key to left and the rest
+   to right in O(log n).  tree is left empty and may be left or right.  */
+void avl_split (struct avl_root *tree, const void *key,
+                int (*comp) (const void *, const struct avl_node *),
+                struct avl_root *left, struct avl_root *right);
+
+/* Set operations on trees without duplicate nodes, using the join-based
+   algorithms of Blelloch et al.  a and b are consumed and the result is
+   stored in out.  When both trees contain equal nodes, the node from b is
+   kept.  Every node left out of the result is passed to drop, if it is not
+   NULL.  Up to nthreads threads work on independent subtrees, so drop must
+   be thread-safe when nthreads > 1.  */
+void avl_union (struct avl_root *a, struct avl_root *b,
+                int (*cmp) (const struct avl_node *, const struct avl_node *),
+                void (*drop) (struct avl_node *), unsigned int nthreads,
+                struct avl_root *out);
+
+void avl_intersection (struct avl_root *a, struct avl_root *b,
+                       int (*cmp) (const struct avl_node *,
+                                   const struct avl_node *),
+                       void (*drop) (struct avl_node *),
+                       unsigned int nthreads, struct avl_root *out);
+
+/* Keeps the nodes of a that are not in b. */
+void avl_difference (struct avl_root *a, struct avl_root *b,
+                     int (*cmp) (const struct avl_node *,
+                                 const struct avl_node *),
+                     void (*drop) (struct avl_node *), unsigned int nthreads,
+                     struct avl_root *out);
+
+/* Maximum height of an AVL tree with 2^64 nodes. */
+#define AVL_MAX_HEIGHT 96
+
+/* Number of nodes passed to a avl_walk callback at once. */
+#define AVL_WALK_BATCH 32
+
+/* Visits all nodes in order, passing them to fn up to AVL_WALK_BATCH at a
+   time.  See rb_walk.  */
+int avl_walk (struct avl_root *root,
+              int (*fn) (struct avl_node **nodes, size_t n, void *arg),
+              void *arg);
 
 void avl_balance_insert (struct avl_node *node, struct avl_root *tree);
 
@@ -0,0 +1,79 @@
+/* bench.c
+ *
+ * Copyright 2026 Zhengyi Fu <i@fuzy.me>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "bench.h"
+#include <math.h>
+#include <stdio.h>
+#include <time.h>
+
+double
+bench_now (void)
+{
+  struct timespec ts;
+
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+void
+bench_report (const char *name, const char *op, double start,
+              unsigned long n)
+{
+  printf ("%-10s %-10s %10.1f ns/op\n", name, op, (bench_now () - start) / n);
+}
+
+void
+bench_uniform_fill (unsigned long *out, unsigned long count, unsigned long n,
+                    uint64_t *state)
+{
+  unsigned long i;
+
+  for (i = 0; i < count; i++)
+    out[i] = bench_rand (state) % n;
+}
+
+void
+bench_zipf_fill (unsigned long *out, unsigned long count, unsigned long n,
+                 double theta, uint64_t *state)
+{
+  double zetan = 0, zeta2, alpha, eta;
+  unsigned long i;
+
+  for (i = 1; i <= n; i++)
+    zetan += 1.0 / pow (i, theta);
+  zeta2 = 1.0 + 1.0 / pow (2, theta);
+  alpha = 1.0 / (1.0 - theta);
+  eta = (1.0 - pow (2.0 / n, 1.0 - theta)) / (1.0 - zeta2 / zetan);
+
+  for (i = 0; i < count; i++)
+    {
+      double u = (bench_rand (state) >> 11) * 0x1.0p-53;
+      double uz = u * zetan;
+      unsigned long r;
+
+      if (uz < 1.0)
+        r = 0;
+      else if (uz < zeta2)
+        r = 1;
+      else
+        r = n * pow (eta * u - eta + 1.0, alpha);
+      out[i] = r < n ? r : n - 1;
+    }
+}
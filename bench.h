@@ -0,0 +1,63 @@
+/* bench.h
+ *
+ * Copyright 2026 Zhengyi Fu <i@fuzy.me>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef BENCH_H
+#define BENCH_H
+
+#include <stdint.h>
+
+#include "defs.h"
+
+C_DECL_BEGIN
+
+/* Helpers shared by the *-bench programs. */
+
+/* Returns a monotonic time in nanoseconds. */
+double bench_now (void);
+
+/* Prints the ns per operation since start, as "name op ns/op". */
+void bench_report (const char *name, const char *op, double start,
+                   unsigned long n);
+
+/* xorshift64; *state must not be 0. */
+static inline uint64_t
+bench_rand (uint64_t *state)
+{
+  uint64_t x = *state;
+
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  return *state = x;
+}
+
+/* Fills out[] with count uniform ranks in [0, n). */
+void bench_uniform_fill (unsigned long *out, unsigned long count,
+                         unsigned long n, uint64_t *state);
+
+/* Fills out[] with count Zipf(theta) ranks in [0, n), using the method of
+   Gray et al., "Quickly Generating Billion-Record Synthetic Databases".
+   theta must be in (0, 1).  */
+void bench_zipf_fill (unsigned long *out, unsigned long count,
+                      unsigned long n, double theta, uint64_t *state);
+
+C_DECL_END
+
+#endif // !BENCH_H
@@ -0,0 +1,222 @@
+/* Copyright © 2026  Zhengyi Fu <i@fuzy.me> */
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Compares btree against rbtree and avltree on random 64-bit keys. */
+
+#include "avltree.h"
+#include "bench.h"
+#include "btree.h"
+#include "rbtree.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+struct rb_item
+{
+  uint64_t key;
+  struct rb_node node;
+};
+
+struct avl_item
+{
+  uint64_t key;
+  struct avl_node node;
+};
+
+static bool
+rb_item_less (const struct rb_node *a, const struct rb_node *b)
+{
+  return rb_entry (a, struct rb_item, node)->key
+         < rb_entry (b, struct rb_item, node)->key;
+}
+
+static int
+rb_item_comp (const void *key, const struct rb_node *node)
+{
+  uint64_t k = *(const uint64_t *)key;
+  uint64_t nk = rb_entry (node, struct rb_item, node)->key;
+
+  return k < nk ? -1 : k > nk;
+}
+
+static void
+bench_rbtree (const uint64_t *keys, unsigned long n)
+{
+  struct rb_root root = RB_ROOT_INIT;
+  struct rb_item *items = malloc (n * sizeof (*items));
+  struct rb_item *pos;
+  unsigned long i, found = 0;
+  uint64_t sum = 0;
+  double t;
+
+  if (!items)
+    abort ();
+
+  t = bench_now ();
+  for (i = 0; i < n; i++)
+    {
+      items[i].key = keys[i];
+      rb_add (&items[i].node, &root, rb_item_less);
+    }
+  bench_report ("rbtree", "insert", t, n);
+
+  t = bench_now ();
+  for (i = 0; i < n; i++)
+    found += rb_find (&keys[(i * 7919) % n], &root, rb_item_comp) != NULL;
+  bench_report ("rbtree", "find", t, n);
+
+  t = bench_now ();
+  rb_for_each_entry (pos, &root, node)
+    sum += pos->key;
+  bench_report ("rbtree", "scan", t, n);
+
+  if (found != n || sum == 0)
+    fprintf (stderr, "rbtree: inconsistent result\n");
+  free (items);
+}
+
+static void
+bench_avltree (const uint64_t *keys, unsigned long n)
+{
+  struct avl_root root = AVL_ROOT_INIT;
+  struct avl_item *items = malloc (n * sizeof (*items));
+  struct avl_item *pos;
+  unsigned long i, found = 0;
+  uint64_t sum = 0;
+  double t;
+
+  if (!items)
+    abort ();
+
+  t = bench_now ();
+  for (i = 0; i < n; i++)
+    {
+      struct avl_node *parent = NULL;
+      struct avl_node **link = &root.avl_node;
+
+      items[i].key = keys[i];
+      while (*link)
+        {
+          parent = *link;
+          if (keys[i] < avl_entry (parent, struct avl_item, node)->key)
+            link = &parent->avl_left;
+          else
+            link = &parent->avl_right;
+        }
+      avl_link_node (&items[i].node, parent, link);
+      avl_balance_insert (&items[i].node, &root);
+    }
+  bench_report ("avltree", "insert", t, n);
+
+  t = bench_now ();
+  for (i = 0; i < n; i++)
+    {
+      uint64_t k = keys[(i * 7919) % n];
+      struct avl_node *node = root.avl_node;
+
+      while (node)
+        {
+          uint64_t nk = avl_entry (node, struct avl_item, node)->key;
+
+          if (k < nk)
+            node = node->avl_left;
+          else if (k > nk)
+            node = node->avl_right;
+          else
+            break;
+        }
+      found += node != NULL;
+    }
+  bench_report ("avltree", "find", t, n);
+
+  t = bench_now ();
+  avl_for_each_entry (pos, &root, node)
+    sum += pos->key;
+  bench_report ("avltree", "scan", t, n);
+
+  if (found != n || sum == 0)
+    fprintf (stderr, "avltree: inconsistent result\n");
+  free (items);
+}
+
+static void
+bench_btree (const uint64_t *keys, unsigned long n)
+{
+  struct btree bt = BTREE_INIT;
+  struct btree_iter it;
+  unsigned long i, found = 0;
+  uint64_t sum = 0;
+  double t;
+
+  t = bench_now ();
+  for (i = 0; i < n; i++)
+    if (btree_insert (&bt, keys[i], (void *)&keys[i]) != 0)
+      abort ();
+  bench_report ("btree", "insert", t, n);
+
+  t = bench_now ();
+  for (i = 0; i < n; i++)
+    found += btree_find (&bt, keys[(i * 7919) % n]) != NULL;
+  bench_report ("btree", "find", t, n);
+
+  t = bench_now ();
+  btree_for_each (&bt, it)
+    sum += btree_iter_key (&it);
+  bench_report ("btree", "scan", t, n);
+
+  if (found != n || sum == 0)
+    fprintf (stderr, "btree: inconsistent result\n");
+  btree_destroy (&bt);
+}
+
+int
+main (int argc, char *argv[])
+{
+  unsigned long n = 1000000;
+  uint64_t *keys;
+  unsigned long i;
+
+  if (argc > 2)
+    {
+      fprintf (stderr, "Usage: %s [count]\n", argv[0]);
+      return 1;
+    }
+  if (argc == 2)
+    n = strtoul (argv[1], NULL, 0);
+  if (n == 0)
+    return 0;
+
+  keys = malloc (n * sizeof (*keys));
+  if (!keys)
+    {
+      perror ("malloc");
+      return 1;
+    }
+
+  /* multiplying by an odd constant is a bijection, so the keys are distinct
+     and scattered over the whole key space */
+  for (i = 0; i < n; i++)
+    keys[i] = (i + 1) * 0x9E3779B97F4A7C15ull;
+
+  printf ("%lu keys\n", n);
+  bench_rbtree (keys, n);
+  bench_avltree (keys, n);
+  bench_btree (keys, n);
+
+  free (keys);
+  return 0;
+}
@@ -0,0 +1,369 @@
+/* Copyright © 2026  Zhengyi Fu <i@fuzy.me> */
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "btree.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "test.h"
+
+#define VALUE(k) ((void *)(uintptr_t)((k) * 2 + 1))
+
+/* Validation: check B+-tree properties, returns the number of keys */
+static unsigned long
+bt_check_node (struct btree_node *node, int height, bool is_root,
+               uint64_t lo, uint64_t hi, bool has_hi)
+{
+  unsigned int i;
+  unsigned long count = 0;
+
+  if (height == 1)
+    {
+      struct btree_leaf *leaf = (struct btree_leaf *)node;
+
+      if (!node->bt_is_leaf)
+        FAIL ("Inner node at leaf level");
+      if (!is_root && node->bt_nkeys < BTREE_LEAF_KEYS / 2)
+        FAIL ("Leaf underflow");
+      for (i = 0; i < node->bt_nkeys; ++i)
+        {
+          if (leaf->bt_keys[i] < lo || (has_hi && leaf->bt_keys[i] >= hi))
+            FAIL ("Leaf key out of range");
+          if (i > 0 && leaf->bt_keys[i - 1] >= leaf->bt_keys[i])
+            FAIL ("Leaf keys not sorted");
+        }
+      return node->bt_nkeys;
+    }
+  else
+    {
+      struct btree_inner *inner = (struct btree_inner *)node;
+
+      if (node->bt_is_leaf)
+        FAIL ("Leaf above leaf level");
+      if (!is_root && node->bt_nkeys < BTREE_INNER_KEYS / 2)
+        FAIL ("Inner node underflow");
+      if (is_root && node->bt_nkeys == 0)
+        FAIL ("Root has a single child");
+
+      for (i = 0; i <= node->bt_nkeys; ++i)
+        {
+          uint64_t clo = i > 0 ? inner->bt_keys[i - 1] : lo;
+          uint64_t chi = i < node->bt_nkeys ? inner->bt_keys[i] : hi;
+          bool chas_hi = i < node->bt_nkeys ? true : has_hi;
+
+          count += bt_check_node (inner->bt_children[i], height - 1, false,
+                                  clo, chi, chas_hi);
+        }
+      return count;
+    }
+}
+
+static void
+bt_validate (struct btree *bt)
+{
+  struct btree_iter it;
+  unsigned long n = 0;
+
+  if (!bt->bt_root)
+    {
+      ASSERT (bt->bt_size == 0);
+      ASSERT (bt->bt_height == 0);
+      return;
+    }
+
+  ASSERT (bt_check_node (bt->bt_root, bt->bt_height, true, 0, 0, false)
+          == bt->bt_size);
+
+  /* the leaf chain must agree with the tree */
+  btree_for_each (bt, it)
+    n++;
+  ASSERT (n == bt->bt_size);
+  n = 0;
+  btree_for_each_reverse (bt, it)
+    n++;
+  ASSERT (n == bt->bt_size);
+}
+
+static void
+shuffle (uint64_t *a, unsigned long n)
+{
+  unsigned long i;
+
+  for (i = n - 1; i > 0; i--)
+    {
+      unsigned long j = rand () % (i + 1);
+      uint64_t t = a[i];
+      a[i] = a[j];
+      a[j] = t;
+    }
+}
+
+/* ========== TESTS ========== */
+
+TEST (empty_tree)
+{
+  struct btree bt = BTREE_INIT;
+  struct btree_iter it;
+
+  ASSERT (btree_empty (&bt));
+  ASSERT (btree_find (&bt, 0) == NULL);
+  ASSERT (btree_erase (&bt, 0) == NULL);
+  ASSERT (!btree_first (&bt, &it));
+  ASSERT (!btree_last (&bt, &it));
+  ASSERT (!btree_lower_bound (&bt, 0, &it));
+  bt_validate (&bt);
+  btree_destroy (&bt);
+}
+
+TEST (insert_find)
+{
+  struct btree bt = BTREE_INIT;
+  uint64_t i;
+
+  for (i = 0; i < 10000; i++)
+    ASSERT (btree_insert (&bt, i * 3, VALUE (i * 3)) == 0);
+  bt_validate (&bt);
+  ASSERT (btree_size (&bt) == 10000);
+
+  for (i = 0; i < 30000; i++)
+    {
+      if (i % 3 == 0)
+        ASSERT (btree_find (&bt, i) == VALUE (i));
+      else
+        ASSERT (btree_find (&bt, i) == NULL);
+    }
+
+  btree_destroy (&bt);
+  ASSERT (btree_empty (&bt));
+}
+
+TEST (insert_duplicate)
+{
+  struct btree bt = BTREE_INIT;
+
+  ASSERT (btree_insert (&bt, 7, VALUE (7)) == 0);
+  ASSERT (btree_insert (&bt, 7, VALUE (8)) == -EEXIST);
+  ASSERT (btree_find (&bt, 7) == VALUE (7));
+  ASSERT (btree_size (&bt) == 1);
+  btree_destroy (&bt);
+}
+
+TEST (extreme_keys)
+{
+  struct btree bt = BTREE_INIT;
+  struct btree_iter it;
+
+  ASSERT (btree_insert (&bt, UINT64_MAX, VALUE (1)) == 0);
+  ASSERT (btree_insert (&bt, 0, VALUE (0)) == 0);
+  ASSERT (btree_find (&bt, UINT64_MAX) == VALUE (1));
+  ASSERT (btree_find (&bt, 0) == VALUE (0));
+  ASSERT (btree_lower_bound (&bt, 1, &it));
+  ASSERT (btree_iter_key (&it) == UINT64_MAX);
+  ASSERT (!btree_upper_bound (&bt, UINT64_MAX, &it));
+  btree_destroy (&bt);
+}
+
+TEST (random_insert_erase)
+{
+  struct btree bt = BTREE_INIT;
+  unsigned long n = 20000;
+  uint64_t *keys = malloc (n * sizeof (*keys));
+  unsigned long i;
+
+  ASSERT (keys != NULL);
+  srand (42);
+  for (i = 0; i < n; i++)
+    keys[i] = i * 7 + 1;
+  shuffle (keys, n);
+
+  for (i = 0; i < n; i++)
+    ASSERT (btree_insert (&bt, keys[i], VALUE (keys[i])) == 0);
+  bt_validate (&bt);
+
+  shuffle (keys, n);
+  for (i = 0; i < n; i++)
+    {
+      ASSERT (btree_erase (&bt, keys[i]) == VALUE (keys[i]));
+      ASSERT (btree_find (&bt, keys[i]) == NULL);
+      if (i % 997 == 0)
+        bt_validate (&bt);
+    }
+
+  ASSERT (btree_empty (&bt));
+  bt_validate (&bt);
+  free (keys);
+}
+
+TEST (ordered_iteration)
+{
+  struct btree bt = BTREE_INIT;
+  struct btree_iter it;
+  uint64_t *keys;
+  uint64_t prev = 0;
+  unsigned long n = 5000, i, count = 0;
+
+  keys = malloc (n * sizeof (*keys));
+  ASSERT (keys != NULL);
+  for (i = 0; i < n; i++)
+    keys[i] = i + 1;
+  srand (7);
+  shuffle (keys, n);
+  for (i = 0; i < n; i++)
+    btree_insert (&bt, keys[i], VALUE (keys[i]));
+
+  btree_for_each (&bt, it)
+  {
+    ASSERT (btree_iter_key (&it) > prev);
+    ASSERT (btree_iter_value (&it) == VALUE (btree_iter_key (&it)));
+    prev = btree_iter_key (&it);
+    count++;
+  }
+  ASSERT (count == n);
+
+  prev = n + 1;
+  btree_for_each_reverse (&bt, it)
+  {
+    ASSERT (btree_iter_key (&it) == prev - 1);
+    prev--;
+  }
+  ASSERT (prev == 1);
+
+  btree_destroy (&bt);
+  free (keys);
+}
+
+TEST (lower_upper_bound)
+{
+  struct btree bt = BTREE_INIT;
+  struct btree_iter it;
+  uint64_t i;
+
+  for (i = 1; i <= 1000; i++)
+    btree_insert (&bt, i * 10, VALUE (i * 10));
+
+  ASSERT (btree_lower_bound (&bt, 0, &it));
+  ASSERT (btree_iter_key (&it) == 10);
+  ASSERT (btree_lower_bound (&bt, 10, &it));
+  ASSERT (btree_iter_key (&it) == 10);
+  ASSERT (btree_lower_bound (&bt, 11, &it));
+  ASSERT (btree_iter_key (&it) == 20);
+  ASSERT (btree_upper_bound (&bt, 10, &it));
+  ASSERT (btree_iter_key (&it) == 20);
+  ASSERT (btree_lower_bound (&bt, 10000, &it));
+  ASSERT (btree_iter_key (&it) == 10000);
+  ASSERT (!btree_lower_bound (&bt, 10001, &it));
+  ASSERT (!btree_upper_bound (&bt, 10000, &it));
+
+  /* every lower bound must land on the next multiple of ten */
+  for (i = 0; i < 10000; i++)
+    {
+      ASSERT (btree_lower_bound (&bt, i, &it));
+      ASSERT (btree_iter_key (&it) == (i + 9) / 10 * 10
+              || (i == 0 && btree_iter_key (&it) == 10));
+    }
+
+  btree_destroy (&bt);
+}
+
+TEST (range_scan)
+{
+  struct btree bt = BTREE_INIT;
+  struct btree_iter it;
+  uint64_t i, expect;
+  unsigned long count = 0;
+
+  for (i = 0; i < 10000; i++)
+    btree_insert (&bt, i * 2, VALUE (i * 2));
+
+  expect = 1000;
+  btree_for_each_range (&bt, it, 999, 3001)
+  {
+    ASSERT (btree_iter_key (&it) == expect);
+    expect += 2;
+    count++;
+  }
+  ASSERT (count == 1001);
+
+  count = 0;
+  btree_for_each_range (&bt, it, 30000, 40000)
+    count++;
+  ASSERT (count == 0);
+
+  btree_destroy (&bt);
+}
+
+TEST (stress_mixed)
+{
+  struct btree bt = BTREE_INIT;
+  unsigned long i;
+  unsigned char *present = calloc (4096, 1);
+  unsigned long size = 0;
+
+  ASSERT (present != NULL);
+  srand (1234);
+  for (i = 0; i < 200000; i++)
+    {
+      uint64_t k = rand () % 4096;
+
+      if (rand () % 2)
+        {
+          int r = btree_insert (&bt, k, VALUE (k));
+          ASSERT (r == (present[k] ? -EEXIST : 0));
+          if (!present[k])
+            size++;
+          present[k] = 1;
+        }
+      else
+        {
+          void *v = btree_erase (&bt, k);
+          ASSERT (v == (present[k] ? VALUE (k) : NULL));
+          if (present[k])
+            size--;
+          present[k] = 0;
+        }
+      if (i % 10007 == 0)
+        bt_validate (&bt);
+    }
+  bt_validate (&bt);
+  ASSERT (btree_size (&bt) == size);
+
+  btree_destroy (&bt);
+  free (present);
+}
+
+int
+main (void)
+{
+  fprintf (stderr, "=== B+-Tree Comprehensive Test Suite ===\n\n");
+
+  RUN_TEST (empty_tree);
+  RUN_TEST (insert_find);
+  RUN_TEST (insert_duplicate);
+  RUN_TEST (extreme_keys);
+  RUN_TEST (random_insert_erase);
+  RUN_TEST (ordered_iteration);
+  RUN_TEST (lower_upper_bound);
+  RUN_TEST (range_scan);
+  RUN_TEST (stress_mixed);
+
+  fprintf (stderr, "\n=== Results ===\n");
+  fprintf (stderr, "Passed: %d/%d\n", pass_count, test_count);
+
+  return (pass_count == test_count) ? 0 : 1;
+}
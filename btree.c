@@ -0,0 +1,661 @@
+/* btree.c
+ *
+ * Copyright 2026 Zhengyi Fu <i@fuzy.me>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "btree.h"
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* minimum number of keys in a non-root node */
+#define BTREE_LEAF_MIN (BTREE_LEAF_KEYS / 2)
+#define BTREE_INNER_MIN (BTREE_INNER_KEYS / 2)
+
+_Static_assert (sizeof (struct btree_leaf) == BTREE_NODE_SIZE,
+                "struct btree_leaf does not fill a node");
+_Static_assert (sizeof (struct btree_inner) == BTREE_NODE_SIZE,
+                "struct btree_inner does not fill a node");
+
+static inline struct btree_leaf *
+btree_to_leaf (struct btree_node *node)
+{
+  assert (node->bt_is_leaf);
+  return (struct btree_leaf *)node;
+}
+
+static inline struct btree_inner *
+btree_to_inner (struct btree_node *node)
+{
+  assert (!node->bt_is_leaf);
+  return (struct btree_inner *)node;
+}
+
+#if defined(__GNUC__) && !defined(BTREE_NO_SIMD)
+typedef uint64_t btree_vec __attribute__ ((__vector_size__ (32)));
+typedef int64_t btree_mask __attribute__ ((__vector_size__ (32)));
+#define BTREE_VEC_KEYS (sizeof (btree_vec) / sizeof (uint64_t))
+#endif
+
+/* Returns the number of keys in keys[0..n) that are less than key.
+
+   Keys in a node are sorted, so this is the lower bound of key.  Instead of
+   a branchy binary search, compare a whole vector of keys at a time and sum
+   the comparison masks; a node is only a few vectors long.  */
+static inline unsigned int __pure
+btree_rank (const uint64_t *keys, unsigned int n, uint64_t key)
+{
+  unsigned int i = 0;
+  unsigned int r = 0;
+
+#ifdef BTREE_VEC_KEYS
+  btree_vec k = { key, key, key, key };
+  btree_mask acc = { 0, 0, 0, 0 };
+
+  for (; i + BTREE_VEC_KEYS <= n; i += BTREE_VEC_KEYS)
+    {
+      btree_vec v;
+
+      memcpy (&v, &keys[i], sizeof (v));
+      /* each lane is -1 if true, 0 if false */
+      acc += (btree_mask)(v < k);
+    }
+  r = (unsigned int)-(acc[0] + acc[1] + acc[2] + acc[3]);
+#endif
+
+  for (; i < n; ++i)
+    r += keys[i] < key;
+  return r;
+}
+
+/* Returns the index of the child of inner that may contain key. */
+static inline unsigned int
+btree_child_index (const struct btree_inner *inner, uint64_t key)
+{
+  unsigned int n = inner->bt_node.bt_nkeys;
+  unsigned int i = btree_rank (inner->bt_keys, n, key);
+
+  if (i < n && inner->bt_keys[i] == key)
+    ++i;
+  return i;
+}
+
+static struct btree_leaf *
+btree_alloc_leaf (void)
+{
+  struct btree_leaf *leaf
+      = aligned_alloc (BTREE_CACHE_LINE, sizeof (struct btree_leaf));
+  if (!leaf)
+    return NULL;
+  memset (leaf, 0, sizeof (*leaf));
+  leaf->bt_node.bt_is_leaf = true;
+  return leaf;
+}
+
+static struct btree_inner *
+btree_alloc_inner (void)
+{
+  struct btree_inner *inner
+      = aligned_alloc (BTREE_CACHE_LINE, sizeof (struct btree_inner));
+  if (!inner)
+    return NULL;
+  memset (inner, 0, sizeof (*inner));
+  return inner;
+}
+
+static void
+btree_free_node (struct btree_node *node, int height)
+{
+  if (height > 1)
+    {
+      struct btree_inner *inner = btree_to_inner (node);
+      unsigned int i;
+
+      for (i = 0; i <= inner->bt_node.bt_nkeys; ++i)
+        btree_free_node (inner->bt_children[i], height - 1);
+    }
+  free (node);
+}
+
+void
+btree_destroy (struct btree *bt)
+{
+  if (bt->bt_root)
+    btree_free_node (bt->bt_root, bt->bt_height);
+  btree_init (bt);
+}
+
+static struct btree_leaf *
+btree_find_leaf (const struct btree *bt, uint64_t key)
+{
+  struct btree_node *node = bt->bt_root;
+
+  if (!node)
+    return NULL;
+
+  while (!node->bt_is_leaf)
+    {
+      struct btree_inner *inner = btree_to_inner (node);
+      node = inner->bt_children[btree_child_index (inner, key)];
+    }
+  return btree_to_leaf (node);
+}
+
+void *
+btree_find (const struct btree *bt, uint64_t key)
+{
+  struct btree_leaf *leaf = btree_find_leaf (bt, key);
+  unsigned int i;
+
+  if (!leaf)
+    return NULL;
+
+  i = btree_rank (leaf->bt_keys, leaf->bt_node.bt_nkeys, key);
+  if (i < leaf->bt_node.bt_nkeys && leaf->bt_keys[i] == key)
+    return leaf->bt_values[i];
+  return NULL;
+}
+
+static bool
+btree_iter_fixup (struct btree_iter *it)
+{
+  if (it->bi_leaf && it->bi_pos >= it->bi_leaf->bt_node.bt_nkeys)
+    {
+      it->bi_leaf = it->bi_leaf->bt_next;
+      it->bi_pos = 0;
+    }
+  return it->bi_leaf != NULL;
+}
+
+bool
+btree_lower_bound (const struct btree *bt, uint64_t key,
+                   struct btree_iter *it)
+{
+  struct btree_leaf *leaf = btree_find_leaf (bt, key);
+
+  it->bi_leaf = leaf;
+  it->bi_pos = 0;
+  if (leaf)
+    it->bi_pos = btree_rank (leaf->bt_keys, leaf->bt_node.bt_nkeys, key);
+  return btree_iter_fixup (it);
+}
+
+bool
+btree_upper_bound (const struct btree *bt, uint64_t key,
+                   struct btree_iter *it)
+{
+  if (!btree_lower_bound (bt, key, it))
+    return false;
+  if (btree_iter_key (it) == key)
+    return btree_iter_next (it);
+  return true;
+}
+
+bool
+btree_first (const struct btree *bt, struct btree_iter *it)
+{
+  struct btree_node *node = bt->bt_root;
+
+  it->bi_leaf = NULL;
+  it->bi_pos = 0;
+  if (!node)
+    return false;
+
+  while (!node->bt_is_leaf)
+    node = btree_to_inner (node)->bt_children[0];
+  it->bi_leaf = btree_to_leaf (node);
+  return true;
+}
+
+bool
+btree_last (const struct btree *bt, struct btree_iter *it)
+{
+  struct btree_node *node = bt->bt_root;
+
+  it->bi_leaf = NULL;
+  it->bi_pos = 0;
+  if (!node)
+    return false;
+
+  while (!node->bt_is_leaf)
+    {
+      struct btree_inner *inner = btree_to_inner (node);
+      node = inner->bt_children[inner->bt_node.bt_nkeys];
+    }
+  it->bi_leaf = btree_to_leaf (node);
+  it->bi_pos = it->bi_leaf->bt_node.bt_nkeys - 1;
+  return true;
+}
+
+/* Inserts key and its right-hand child at position pos of inner, which must
+   not be full.  */
+static void
+btree_inner_insert (struct btree_inner *inner, unsigned int pos,
+                    uint64_t key, struct btree_node *child)
+{
+  unsigned int n = inner->bt_node.bt_nkeys;
+
+  assert (n < BTREE_INNER_KEYS);
+  memmove (&inner->bt_keys[pos + 1], &inner->bt_keys[pos],
+           (n - pos) * sizeof (uint64_t));
+  memmove (&inner->bt_children[pos + 2], &inner->bt_children[pos + 1],
+           (n - pos) * sizeof (struct btree_node *));
+  inner->bt_keys[pos] = key;
+  inner->bt_children[pos + 1] = child;
+  inner->bt_node.bt_nkeys = n + 1;
+}
+
+static void
+btree_leaf_insert (struct btree_leaf *leaf, unsigned int pos, uint64_t key,
+                   void *value)
+{
+  unsigned int n = leaf->bt_node.bt_nkeys;
+
+  assert (n < BTREE_LEAF_KEYS);
+  memmove (&leaf->bt_keys[pos + 1], &leaf->bt_keys[pos],
+           (n - pos) * sizeof (uint64_t));
+  memmove (&leaf->bt_values[pos + 1], &leaf->bt_values[pos],
+           (n - pos) * sizeof (void *));
+  leaf->bt_keys[pos] = key;
+  leaf->bt_values[pos] = value;
+  leaf->bt_node.bt_nkeys = n + 1;
+}
+
+/* Moves the upper half of full leaf into the empty leaf right and inserts
+   key into the half it belongs to.  Returns the separator.  */
+static uint64_t
+btree_split_leaf (struct btree_leaf *leaf, struct btree_leaf *right,
+                  unsigned int pos, uint64_t key, void *value)
+{
+  const unsigned int half = (BTREE_LEAF_KEYS + 1) / 2;
+  unsigned int move = BTREE_LEAF_KEYS - half;
+
+  memcpy (right->bt_keys, &leaf->bt_keys[half], move * sizeof (uint64_t));
+  memcpy (right->bt_values, &leaf->bt_values[half], move * sizeof (void *));
+  right->bt_node.bt_nkeys = move;
+  leaf->bt_node.bt_nkeys = half;
+
+  right->bt_next = leaf->bt_next;
+  right->bt_prev = leaf;
+  if (leaf->bt_next)
+    leaf->bt_next->bt_prev = right;
+  leaf->bt_next = right;
+
+  if (pos <= half)
+    btree_leaf_insert (leaf, pos, key, value);
+  else
+    btree_leaf_insert (right, pos - half, key, value);
+  return right->bt_keys[0];
+}
+
+/* Same as btree_split_leaf for inner nodes.  The middle key moves up and is
+   returned.  */
+static uint64_t
+btree_split_inner (struct btree_inner *inner, struct btree_inner *right,
+                   unsigned int pos, uint64_t key, struct btree_node *child)
+{
+  uint64_t keys[BTREE_INNER_KEYS + 1];
+  struct btree_node *children[BTREE_INNER_KEYS + 2];
+  const unsigned int n = BTREE_INNER_KEYS + 1;
+  const unsigned int mid = n / 2;
+
+  memcpy (keys, inner->bt_keys, pos * sizeof (uint64_t));
+  keys[pos] = key;
+  memcpy (&keys[pos + 1], &inner->bt_keys[pos],
+          (BTREE_INNER_KEYS - pos) * sizeof (uint64_t));
+
+  memcpy (children, inner->bt_children,
+          (pos + 1) * sizeof (struct btree_node *));
+  children[pos + 1] = child;
+  memcpy (&children[pos + 2], &inner->bt_children[pos + 1],
+          (BTREE_INNER_KEYS - pos) * sizeof (struct btree_node *));
+
+  memcpy (inner->bt_keys, keys, mid * sizeof (uint64_t));
+  memcpy (inner->bt_children, children,
+          (mid + 1) * sizeof (struct btree_node *));
+  inner->bt_node.bt_nkeys = mid;
+
+  memcpy (right->bt_keys, &keys[mid + 1], (n - mid - 1) * sizeof (uint64_t));
+  memcpy (right->bt_children, &children[mid + 1],
+          (n - mid) * sizeof (struct btree_node *));
+  right->bt_node.bt_nkeys = n - mid - 1;
+
+  return keys[mid];
+}
+
+int
+btree_insert (struct btree *bt, uint64_t key, void *value)
+{
+  struct btree_inner *path[BTREE_MAX_HEIGHT];
+  unsigned int slot[BTREE_MAX_HEIGHT];
+  struct btree_node *spare[BTREE_MAX_HEIGHT + 1];
+  struct btree_node *node = bt->bt_root;
+  struct btree_leaf *leaf;
+  struct btree_node *child;
+  unsigned int pos;
+  int depth = 0;
+  int nspare = 0;
+  int i;
+  uint64_t sep;
+
+  if (!node)
+    {
+      leaf = btree_alloc_leaf ();
+      if (!leaf)
+        return -ENOMEM;
+      leaf->bt_keys[0] = key;
+      leaf->bt_values[0] = value;
+      leaf->bt_node.bt_nkeys = 1;
+      bt->bt_root = &leaf->bt_node;
+      bt->bt_height = 1;
+      bt->bt_size = 1;
+      return 0;
+    }
+
+  while (!node->bt_is_leaf)
+    {
+      struct btree_inner *inner = btree_to_inner (node);
+
+      path[depth] = inner;
+      slot[depth] = btree_child_index (inner, key);
+      node = inner->bt_children[slot[depth]];
+      ++depth;
+    }
+
+  leaf = btree_to_leaf (node);
+  pos = btree_rank (leaf->bt_keys, leaf->bt_node.bt_nkeys, key);
+  if (pos < leaf->bt_node.bt_nkeys && leaf->bt_keys[pos] == key)
+    return -EEXIST;
+
+  if (leaf->bt_node.bt_nkeys < BTREE_LEAF_KEYS)
+    {
+      btree_leaf_insert (leaf, pos, key, value);
+      bt->bt_size++;
+      return 0;
+    }
+
+  /* Allocate every node the split will need up front, so that running out
+     of memory leaves the tree untouched.  */
+  if (bt->bt_height >= BTREE_MAX_HEIGHT)
+    return -ENOMEM;
+  spare[nspare] = (struct btree_node *)btree_alloc_leaf ();
+  if (!spare[nspare++])
+    goto nomem;
+  for (i = depth - 1; i >= 0; --i)
+    {
+      if (path[i]->bt_node.bt_nkeys < BTREE_INNER_KEYS)
+        break;
+      spare[nspare] = (struct btree_node *)btree_alloc_inner ();
+      if (!spare[nspare++])
+        goto nomem;
+    }
+  if (i < 0)
+    {
+      /* the root splits, too */
+      spare[nspare] = (struct btree_node *)btree_alloc_inner ();
+      if (!spare[nspare++])
+        goto nomem;
+    }
+
+  nspare = 0;
+  child = spare[nspare++];
+  sep = btree_split_leaf (leaf, btree_to_leaf (child), pos, key, value);
+
+  for (i = depth - 1; i >= 0; --i)
+    {
+      struct btree_inner *inner = path[i];
+      struct btree_inner *right;
+
+      if (inner->bt_node.bt_nkeys < BTREE_INNER_KEYS)
+        {
+          btree_inner_insert (inner, slot[i], sep, child);
+          bt->bt_size++;
+          return 0;
+        }
+
+      right = btree_to_inner (spare[nspare++]);
+      sep = btree_split_inner (inner, right, slot[i], sep, child);
+      child = &right->bt_node;
+    }
+
+  {
+    struct btree_inner *root = btree_to_inner (spare[nspare++]);
+
+    root->bt_keys[0] = sep;
+    root->bt_children[0] = bt->bt_root;
+    root->bt_children[1] = child;
+    root->bt_node.bt_nkeys = 1;
+    bt->bt_root = &root->bt_node;
+    bt->bt_height++;
+  }
+  bt->bt_size++;
+  return 0;
+
+nomem:
+  while (nspare > 0)
+    free (spare[--nspare]);
+  return -ENOMEM;
+}
+
+static void
+btree_leaf_remove (struct btree_leaf *leaf, unsigned int pos)
+{
+  unsigned int n = leaf->bt_node.bt_nkeys - 1;
+
+  memmove (&leaf->bt_keys[pos], &leaf->bt_keys[pos + 1],
+           (n - pos) * sizeof (uint64_t));
+  memmove (&leaf->bt_values[pos], &leaf->bt_values[pos + 1],
+           (n - pos) * sizeof (void *));
+  leaf->bt_node.bt_nkeys = n;
+}
+
+/* Removes key pos and the child to its right from inner. */
+static void
+btree_inner_remove (struct btree_inner *inner, unsigned int pos)
+{
+  unsigned int n = inner->bt_node.bt_nkeys - 1;
+
+  memmove (&inner->bt_keys[pos], &inner->bt_keys[pos + 1],
+           (n - pos) * sizeof (uint64_t));
+  memmove (&inner->bt_children[pos + 1], &inner->bt_children[pos + 2],
+           (n - pos) * sizeof (struct btree_node *));
+  inner->bt_node.bt_nkeys = n;
+}
+
+/* Refills the underflowing leaf, which is child i of parent, from one of
+   its siblings.  */
+static void
+btree_fix_leaf (struct btree_inner *parent, unsigned int i,
+                struct btree_leaf *leaf)
+{
+  struct btree_leaf *left
+      = i > 0 ? btree_to_leaf (parent->bt_children[i - 1]) : NULL;
+  struct btree_leaf *right = i < parent->bt_node.bt_nkeys
+                                 ? btree_to_leaf (parent->bt_children[i + 1])
+                                 : NULL;
+
+  if (left && left->bt_node.bt_nkeys > BTREE_LEAF_MIN)
+    {
+      unsigned int ln = --left->bt_node.bt_nkeys;
+
+      btree_leaf_insert (leaf, 0, left->bt_keys[ln], left->bt_values[ln]);
+      parent->bt_keys[i - 1] = leaf->bt_keys[0];
+    }
+  else if (right && right->bt_node.bt_nkeys > BTREE_LEAF_MIN)
+    {
+      btree_leaf_insert (leaf, leaf->bt_node.bt_nkeys, right->bt_keys[0],
+                         right->bt_values[0]);
+      btree_leaf_remove (right, 0);
+      parent->bt_keys[i] = right->bt_keys[0];
+    }
+  else
+    {
+      unsigned int ln;
+
+      /* merge into the left one of the pair */
+      if (!left)
+        {
+          left = leaf;
+          leaf = right;
+          ++i;
+        }
+      ln = left->bt_node.bt_nkeys;
+      memcpy (&left->bt_keys[ln], leaf->bt_keys,
+              leaf->bt_node.bt_nkeys * sizeof (uint64_t));
+      memcpy (&left->bt_values[ln], leaf->bt_values,
+              leaf->bt_node.bt_nkeys * sizeof (void *));
+      left->bt_node.bt_nkeys = ln + leaf->bt_node.bt_nkeys;
+
+      left->bt_next = leaf->bt_next;
+      if (leaf->bt_next)
+        leaf->bt_next->bt_prev = left;
+
+      btree_inner_remove (parent, i - 1);
+      free (leaf);
+    }
+}
+
+/* Same as btree_fix_leaf for inner nodes. */
+static void
+btree_fix_inner (struct btree_inner *parent, unsigned int i,
+                 struct btree_inner *node)
+{
+  struct btree_inner *left
+      = i > 0 ? btree_to_inner (parent->bt_children[i - 1]) : NULL;
+  struct btree_inner *right
+      = i < parent->bt_node.bt_nkeys
+            ? btree_to_inner (parent->bt_children[i + 1])
+            : NULL;
+  unsigned int n = node->bt_node.bt_nkeys;
+
+  if (left && left->bt_node.bt_nkeys > BTREE_INNER_MIN)
+    {
+      unsigned int ln = left->bt_node.bt_nkeys;
+
+      memmove (&node->bt_keys[1], node->bt_keys, n * sizeof (uint64_t));
+      memmove (&node->bt_children[1], node->bt_children,
+               (n + 1) * sizeof (struct btree_node *));
+      node->bt_keys[0] = parent->bt_keys[i - 1];
+      node->bt_children[0] = left->bt_children[ln];
+      node->bt_node.bt_nkeys = n + 1;
+      parent->bt_keys[i - 1] = left->bt_keys[ln - 1];
+      left->bt_node.bt_nkeys = ln - 1;
+    }
+  else if (right && right->bt_node.bt_nkeys > BTREE_INNER_MIN)
+    {
+      unsigned int rn = right->bt_node.bt_nkeys;
+
+      node->bt_keys[n] = parent->bt_keys[i];
+      node->bt_children[n + 1] = right->bt_children[0];
+      node->bt_node.bt_nkeys = n + 1;
+      parent->bt_keys[i] = right->bt_keys[0];
+      memmove (right->bt_keys, &right->bt_keys[1],
+               (rn - 1) * sizeof (uint64_t));
+      memmove (right->bt_children, &right->bt_children[1],
+               rn * sizeof (struct btree_node *));
+      right->bt_node.bt_nkeys = rn - 1;
+    }
+  else
+    {
+      unsigned int ln;
+
+      if (!left)
+        {
+          left = node;
+          node = right;
+          ++i;
+        }
+      ln = left->bt_node.bt_nkeys;
+      n = node->bt_node.bt_nkeys;
+      left->bt_keys[ln] = parent->bt_keys[i - 1];
+      memcpy (&left->bt_keys[ln + 1], node->bt_keys, n * sizeof (uint64_t));
+      memcpy (&left->bt_children[ln + 1], node->bt_children,
+              (n + 1) * sizeof (struct btree_node *));
+      left->bt_node.bt_nkeys = ln + 1 + n;
+
+      btree_inner_remove (parent, i - 1);
+      free (node);
+    }
+}
+
+void *
+btree_erase (struct btree *bt, uint64_t key)
+{
+  struct btree_inner *path[BTREE_MAX_HEIGHT];
+  unsigned int slot[BTREE_MAX_HEIGHT];
+  struct btree_node *node = bt->bt_root;
+  struct btree_leaf *leaf;
+  unsigned int pos;
+  int depth = 0;
+  void *value;
+
+  if (!node)
+    return NULL;
+
+  while (!node->bt_is_leaf)
+    {
+      struct btree_inner *inner = btree_to_inner (node);
+
+      path[depth] = inner;
+      slot[depth] = btree_child_index (inner, key);
+      node = inner->bt_children[slot[depth]];
+      ++depth;
+    }
+
+  leaf = btree_to_leaf (node);
+  pos = btree_rank (leaf->bt_keys, leaf->bt_node.bt_nkeys, key);
+  if (pos >= leaf->bt_node.bt_nkeys || leaf->bt_keys[pos] != key)
+    return NULL;
+
+  value = leaf->bt_values[pos];
+  btree_leaf_remove (leaf, pos);
+  bt->bt_size--;
+
+  if (depth == 0)
+    {
+      if (leaf->bt_node.bt_nkeys == 0)
+        {
+          free (leaf);
+          btree_init (bt);
+        }
+      return value;
+    }
+
+  if (leaf->bt_node.bt_nkeys >= BTREE_LEAF_MIN)
+    return value;
+
+  btree_fix_leaf (path[depth - 1], slot[depth - 1], leaf);
+  while (--depth > 0)
+    {
+      struct btree_inner *inner = path[depth];
+
+      if (inner->bt_node.bt_nkeys >= BTREE_INNER_MIN)
+        return value;
+      btree_fix_inner (path[depth - 1], slot[depth - 1], inner);
+    }
+
+  /* shrink the tree if the root has a single child */
+  if (path[0]->bt_node.bt_nkeys == 0)
+    {
+      bt->bt_root = path[0]->bt_children[0];
+      bt->bt_height--;
+      free (path[0]);
+    }
+  return value;
+}
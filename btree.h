@@ -0,0 +1,213 @@
+/* btree.h
+ *
+ * Copyright 2026 Zhengyi Fu <i@fuzy.me>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef BTREE_H
+#define BTREE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "defs.h"
+
+C_DECL_BEGIN
+
+/* A B+-tree mapping 64-bit integer keys to pointers.
+
+   Every node occupies BTREE_NODE_SIZE bytes and is aligned to a cache
+   line, so a lookup touches a handful of lines per level instead of one
+   line per binary level as with rb_node or avl_node.  Values live only in
+   the leaves, which are doubly linked for ordered iteration.  */
+
+/* size of a node in bytes */
+#define BTREE_NODE_SIZE 512
+
+/* alignment of a node */
+#define BTREE_CACHE_LINE 64
+
+/* maximum number of keys in a leaf */
+#define BTREE_LEAF_KEYS                                                       \
+  ((BTREE_NODE_SIZE - 3 * sizeof (void *)) / (sizeof (uint64_t) + sizeof (void *)))
+
+/* maximum number of keys in an inner node */
+#define BTREE_INNER_KEYS                                                      \
+  ((BTREE_NODE_SIZE - 2 * sizeof (void *)) / (sizeof (uint64_t) + sizeof (void *)))
+
+/* maximum depth of the tree */
+#define BTREE_MAX_HEIGHT 16
+
+struct btree_node
+{
+  unsigned short bt_nkeys;
+  bool bt_is_leaf;
+};
+
+struct btree_leaf
+{
+  struct btree_node bt_node;
+  struct btree_leaf *bt_prev;
+  struct btree_leaf *bt_next;
+  uint64_t bt_keys[BTREE_LEAF_KEYS];
+  void *bt_values[BTREE_LEAF_KEYS];
+} __aligned (BTREE_CACHE_LINE);
+
+struct btree_inner
+{
+  struct btree_node bt_node;
+  /* bt_keys[i] is the smallest key that may appear in bt_children[i + 1] */
+  uint64_t bt_keys[BTREE_INNER_KEYS];
+  struct btree_node *bt_children[BTREE_INNER_KEYS + 1];
+} __aligned (BTREE_CACHE_LINE);
+
+struct btree
+{
+  /* pointer to the root node */
+  struct btree_node *bt_root;
+
+  /* number of keys in the tree */
+  unsigned long bt_size;
+
+  /* number of levels, 0 for an empty tree */
+  int bt_height;
+};
+
+/* A position in the tree.  The iterator is at the end when bi_leaf is
+   NULL.  */
+struct btree_iter
+{
+  struct btree_leaf *bi_leaf;
+  unsigned int bi_pos;
+};
+
+/* clang-format off */
+#define BTREE_INIT { NULL, 0, 0 }
+/* clang-format on */
+
+static inline void
+btree_init (struct btree *bt)
+{
+  bt->bt_root = NULL;
+  bt->bt_size = 0;
+  bt->bt_height = 0;
+}
+
+static inline bool
+btree_empty (const struct btree *bt)
+{
+  return bt->bt_root == NULL;
+}
+
+static inline unsigned long
+btree_size (const struct btree *bt)
+{
+  return bt->bt_size;
+}
+
+/* Frees all nodes of the tree.  The values are not touched. */
+void btree_destroy (struct btree *bt);
+
+/* Inserts key with value.
+   Returns 0 on success, -EEXIST if the key is already present or -ENOMEM.
+   The tree is unchanged on failure.  */
+int btree_insert (struct btree *bt, uint64_t key, void *value);
+
+/* Returns the value associated with key, or NULL. */
+void *btree_find (const struct btree *bt, uint64_t key);
+
+/* Removes key from the tree and returns its value, or NULL if the key is
+   absent.  */
+void *btree_erase (struct btree *bt, uint64_t key);
+
+/* Positions it at the first key not less than key.
+   Returns false if there is no such key.  */
+bool btree_lower_bound (const struct btree *bt, uint64_t key,
+                        struct btree_iter *it);
+
+/* Positions it at the first key greater than key.
+   Returns false if there is no such key.  */
+bool btree_upper_bound (const struct btree *bt, uint64_t key,
+                        struct btree_iter *it);
+
+/* Positions it at the smallest key. */
+bool btree_first (const struct btree *bt, struct btree_iter *it);
+
+/* Positions it at the largest key. */
+bool btree_last (const struct btree *bt, struct btree_iter *it);
+
+static inline bool
+btree_iter_valid (const struct btree_iter *it)
+{
+  return it->bi_leaf != NULL;
+}
+
+static inline uint64_t
+btree_iter_key (const struct btree_iter *it)
+{
+  return it->bi_leaf->bt_keys[it->bi_pos];
+}
+
+static inline void *
+btree_iter_value (const struct btree_iter *it)
+{
+  return it->bi_leaf->bt_values[it->bi_pos];
+}
+
+static inline bool
+btree_iter_next (struct btree_iter *it)
+{
+  if (++it->bi_pos >= it->bi_leaf->bt_node.bt_nkeys)
+    {
+      it->bi_leaf = it->bi_leaf->bt_next;
+      it->bi_pos = 0;
+    }
+  return it->bi_leaf != NULL;
+}
+
+static inline bool
+btree_iter_prev (struct btree_iter *it)
+{
+  if (it->bi_pos == 0)
+    {
+      it->bi_leaf = it->bi_leaf->bt_prev;
+      if (it->bi_leaf)
+        it->bi_pos = it->bi_leaf->bt_node.bt_nkeys;
+    }
+  if (it->bi_leaf)
+    --it->bi_pos;
+  return it->bi_leaf != NULL;
+}
+
+#define btree_for_each(bt, it)                                                \
+  for (btree_first ((bt), &(it)); btree_iter_valid (&(it));                  \
+       btree_iter_next (&(it)))
+
+#define btree_for_each_reverse(bt, it)                                        \
+  for (btree_last ((bt), &(it)); btree_iter_valid (&(it));                   \
+       btree_iter_prev (&(it)))
+
+/* Iterates over keys in [first, last]. */
+#define btree_for_each_range(bt, it, first, last)                             \
+  for (btree_lower_bound ((bt), (first), &(it));                              \
+       btree_iter_valid (&(it)) && btree_iter_key (&(it)) <= (last);          \
+       btree_iter_next (&(it)))
+
+C_DECL_END
+
+#endif // !BTREE_H
@@ -1,6 +1,8 @@
 #ifndef FLS_H
 #define FLS_H
 
+#include <stdint.h>
+
 /**
  * fls - find last (most-significant) bit set
  * @x: the word to search
@@ -11,6 +13,9 @@
 
 static inline int __attribute__ ((const)) fls (unsigned int x)
 {
+#ifdef __GNUC__
+  return x ? 32 - __builtin_clz (x) : 0;
+#else
   int r = 32;
 
   if (!x)
@@ -41,6 +46,57 @@ static inline int __attribute__ ((const)) fls (unsigned int x)
       r -= 1;
     }
   return r;
+#endif
+}
+
+/**
+ * fls64 - find last bit set in a 64-bit word
+ * @x: the word to search
+ *
+ * Note fls64(0) = 0, fls64(1) = 1, fls64(1ull << 63) = 64.
+ */
+
+static inline int __attribute__ ((const)) fls64 (uint64_t x)
+{
+#ifdef __GNUC__
+  return x ? 64 - __builtin_clzll (x) : 0;
+#else
+  uint32_t h = x >> 32;
+
+  return h ? fls (h) + 32 : fls ((uint32_t)x);
+#endif
+}
+
+/**
+ * __fls64 - find the index of the last bit set
+ * @x: the word to search, which must not be 0
+ *
+ * __fls64(1) = 0, __fls64(1ull << 63) = 63.
+ */
+
+static inline int __attribute__ ((const)) __fls64 (uint64_t x)
+{
+#ifdef __GNUC__
+  return 63 - __builtin_clzll (x);
+#else
+  return fls64 (x) - 1;
+#endif
+}
+
+/**
+ * __ffs64 - find the index of the first bit set
+ * @x: the word to search, which must not be 0
+ *
+ * __ffs64(1) = 0, __ffs64(1ull << 63) = 63.
+ */
+
+static inline int __attribute__ ((const)) __ffs64 (uint64_t x)
+{
+#ifdef __GNUC__
+  return __builtin_ctzll (x);
+#else
+  return fls64 (x & -x) - 1;
+#endif
 }
 
 #endif /* FLS_H */
@@ -0,0 +1,183 @@
+/* Copyright © 2026  Zhengyi Fu <i@fuzy.me> */
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "hbitmap.h"
+#include "fls.h"
+#include "ilog2.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "test.h"
+
+/* Checks the searches from x against a linear scan of present. */
+static void
+check_searches (const struct hbitmap *hb, const bool *present,
+                unsigned long x)
+{
+  unsigned long n = hb->hb_size, y, i;
+  bool found;
+
+  for (i = x; i < n && !present[i]; i++)
+    ;
+  y = x;
+  found = hb_find (hb, &y);
+  ASSERT (found == (i < n) && (!found || y == i));
+
+  for (i = x + 1; i < n && !present[i]; i++)
+    ;
+  y = x;
+  found = hb_find_after (hb, &y);
+  ASSERT (found == (i < n) && (!found || y == i));
+
+  for (i = x < n ? x + 1 : n; i > 0 && !present[i - 1]; i--)
+    ;
+  y = x;
+  found = hb_find_prev (hb, &y);
+  ASSERT (found == (i > 0) && (!found || y == i - 1));
+
+  for (i = x < n ? x : n; i > 0 && !present[i - 1]; i--)
+    ;
+  y = x;
+  found = hb_find_before (hb, &y);
+  ASSERT (found == (i > 0) && (!found || y == i - 1));
+}
+
+/* ========== TESTS ========== */
+
+TEST (fls64)
+{
+  int i;
+
+  ASSERT (fls (0) == 0 && fls (1) == 1 && fls (0x80000000u) == 32);
+  ASSERT (fls64 (0) == 0 && fls64 (1) == 1);
+  for (i = 0; i < 64; i++)
+    {
+      uint64_t bit = 1ull << i;
+
+      ASSERT (fls64 (bit) == i + 1 && fls64 (bit | (bit - 1)) == i + 1);
+      ASSERT (__fls64 (bit) == i && __fls64 (bit | 1) == i);
+      ASSERT (__ffs64 (bit) == i && __ffs64 (bit | 1ull << 63) == i);
+      ASSERT (ilog2_u64 (bit) == i);
+    }
+  ASSERT (ilog2_u32 (4096) == 12);
+}
+
+TEST (alloc)
+{
+  static const unsigned long sizes[] = { 1, 64, 65, 4096, 4097, 1ul << 18 };
+  struct hbitmap *hb;
+  unsigned int i;
+
+  errno = 0;
+  ASSERT (hb_alloc (0) == NULL && errno == EINVAL);
+  for (i = 0; i < sizeof (sizes) / sizeof (sizes[0]); i++)
+    {
+      unsigned long x;
+
+      hb = hb_alloc (sizes[i]);
+      ASSERT (hb != NULL && hb_empty (hb));
+      ASSERT (hb->hb_depth == (unsigned int)(i + 2) / 2);
+      x = 0;
+      ASSERT (!hb_find (hb, &x));
+      x = sizes[i] - 1;
+      ASSERT (!hb_find_prev (hb, &x));
+
+      /* the last value reaches the last word of every level */
+      ASSERT (hb_insert (hb, sizes[i] - 1) && !hb_insert (hb, sizes[i] - 1));
+      ASSERT (hb_test (hb, sizes[i] - 1) && !hb_test (hb, sizes[i]));
+      x = 0;
+      ASSERT (hb_find (hb, &x) && x == sizes[i] - 1);
+      x = ~0ul;
+      ASSERT (hb_find_prev (hb, &x) && x == sizes[i] - 1);
+      ASSERT (!hb_erase (hb, sizes[i]) && hb_erase (hb, sizes[i] - 1));
+      ASSERT (hb_empty (hb) && !hb_erase (hb, sizes[i] - 1));
+      hb_free (hb);
+    }
+}
+
+TEST (random)
+{
+  static const unsigned long sizes[] = { 1, 63, 64, 65, 200, 4097, 300000 };
+  unsigned int s;
+
+  srand (50);
+  for (s = 0; s < sizeof (sizes) / sizeof (sizes[0]); s++)
+    {
+      unsigned long n = sizes[s], i, x, count = 0;
+      struct hbitmap *hb = hb_alloc (n);
+      bool *present = calloc (n, sizeof (bool));
+
+      ASSERT (hb != NULL && present != NULL);
+      for (i = 0; i < 20000; i++)
+        {
+          /* clusters at word and level boundaries, and sparse values */
+          x = rand () % 2 ? (unsigned long)rand () % n
+                          : ((unsigned long)rand () % (n / 64 + 1)) * 64
+                                + rand () % 3 - 1;
+          if (x >= n)
+            continue;
+          if (rand () % 3)
+            {
+              ASSERT (hb_insert (hb, x) == !present[x]);
+              count += !present[x];
+              present[x] = true;
+            }
+          else
+            {
+              ASSERT (hb_erase (hb, x) == present[x]);
+              count -= present[x];
+              present[x] = false;
+            }
+          ASSERT (hb_test (hb, x) == present[x]);
+          check_searches (hb, present, rand () % (n + 2));
+        }
+      ASSERT (hb_empty (hb) == (count == 0));
+
+      i = 0;
+      hb_for_each (hb, x)
+        {
+          ASSERT (present[x]);
+          i++;
+        }
+      ASSERT (i == count);
+      for (x = 0; x < n + 2 && x < 5000; x++)
+        check_searches (hb, present, x);
+
+      hb_clear (hb);
+      ASSERT (hb_empty (hb));
+      for (x = 0; x < n; x++)
+        ASSERT (!hb_test (hb, x));
+      hb_free (hb);
+      free (present);
+    }
+}
+
+int
+main (void)
+{
+  fprintf (stderr, "=== Hierarchical Bitmap Test Suite ===\n\n");
+
+  RUN_TEST (fls64);
+  RUN_TEST (alloc);
+  RUN_TEST (random);
+
+  fprintf (stderr, "\n=== Results ===\n");
+  fprintf (stderr, "Passed: %d/%d\n", pass_count, test_count);
+
+  return (pass_count == test_count) ? 0 : 1;
+}
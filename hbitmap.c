@@ -0,0 +1,171 @@
+/* hbitmap.c
+ *
+ * Copyright 2026 Zhengyi Fu <i@fuzy.me>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "hbitmap.h"
+#include "fls.h"
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* words in a level of n bits */
+static unsigned long
+hb_words (unsigned long n)
+{
+  return (n >> HB_BITS) + (n % HB_WORD_BITS != 0);
+}
+
+struct hbitmap *
+hb_alloc (unsigned long size)
+{
+  unsigned long words[HB_MAX_DEPTH];
+  unsigned long total = 0, n = size;
+  unsigned int depth = 0, l;
+  struct hbitmap *hb;
+  uint64_t *p;
+
+  if (size == 0)
+    {
+      errno = EINVAL;
+      return NULL;
+    }
+
+  /* count the words of each level from the leaves up */
+  do
+    {
+      n = hb_words (n);
+      words[depth++] = n;
+      total += n;
+    }
+  while (n > 1);
+
+  if (total > (SIZE_MAX - sizeof (*hb)) / sizeof (uint64_t))
+    {
+      errno = ENOMEM;
+      return NULL;
+    }
+  hb = calloc (1, sizeof (*hb) + total * sizeof (uint64_t));
+  if (hb == NULL)
+    return NULL;
+
+  hb->hb_size = size;
+  hb->hb_depth = depth;
+  for (l = 0, p = hb->hb_words; l < depth; l++)
+    {
+      hb->hb_level[l] = p;
+      p += words[depth - 1 - l];
+    }
+  return hb;
+}
+
+void
+hb_free (struct hbitmap *hb)
+{
+  free (hb);
+}
+
+void
+hb_clear (struct hbitmap *hb)
+{
+  const uint64_t *end = hb->hb_level[hb->hb_depth - 1]
+                        + hb_words (hb->hb_size);
+
+  memset (hb->hb_words, 0, (end - hb->hb_words) * sizeof (uint64_t));
+}
+
+bool
+hb_find (const struct hbitmap *hb, unsigned long *xp)
+{
+  unsigned long x = *xp;
+  int l = hb->hb_depth - 1;
+  uint64_t w;
+
+  if (x >= hb->hb_size)
+    return false;
+
+  /* climb until a word has a bit at or after the position of x */
+  w = hb->hb_level[l][x >> HB_BITS] & ~0ull << (x % HB_WORD_BITS);
+  while (w == 0)
+    {
+      if (l-- == 0)
+        return false;
+      x >>= HB_BITS;
+      w = hb->hb_level[l][x >> HB_BITS] & (~0ull << (x % HB_WORD_BITS) << 1);
+    }
+
+  /* then take the first bit of each level on the way down */
+  x = (x & ~(unsigned long)(HB_WORD_BITS - 1)) | __ffs64 (w);
+  while (++l < (int)hb->hb_depth)
+    x = x << HB_BITS | __ffs64 (hb->hb_level[l][x]);
+  *xp = x;
+  return true;
+}
+
+bool
+hb_find_after (const struct hbitmap *hb, unsigned long *xp)
+{
+  unsigned long x = *xp + 1;
+
+  if (x == 0 || !hb_find (hb, &x))
+    return false;
+  *xp = x;
+  return true;
+}
+
+bool
+hb_find_prev (const struct hbitmap *hb, unsigned long *xp)
+{
+  unsigned long x = *xp;
+  int l = hb->hb_depth - 1;
+  uint64_t w;
+
+  if (x >= hb->hb_size)
+    x = hb->hb_size - 1;
+
+  w = hb->hb_level[l][x >> HB_BITS] & ~0ull >> (63 - x % HB_WORD_BITS);
+  while (w == 0)
+    {
+      if (l-- == 0)
+        return false;
+      x >>= HB_BITS;
+      w = hb->hb_level[l][x >> HB_BITS]
+          & ((1ull << (x % HB_WORD_BITS)) - 1);
+    }
+
+  x = (x & ~(unsigned long)(HB_WORD_BITS - 1)) | __fls64 (w);
+  while (++l < (int)hb->hb_depth)
+    x = x << HB_BITS | __fls64 (hb->hb_level[l][x]);
+  *xp = x;
+  return true;
+}
+
+bool
+hb_find_before (const struct hbitmap *hb, unsigned long *xp)
+{
+  unsigned long x = *xp;
+
+  if (x == 0)
+    return false;
+  x--;
+  if (!hb_find_prev (hb, &x))
+    return false;
+  *xp = x;
+  return true;
+}
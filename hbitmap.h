@@ -0,0 +1,143 @@
+/* hbitmap.h
+ *
+ * Copyright 2026 Zhengyi Fu <i@fuzy.me>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef HBITMAP_H
+#define HBITMAP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "defs.h"
+
+C_DECL_BEGIN
+
+/* Hierarchical bitmap: a set of integers below a size fixed at
+   allocation, for small universes such as ports, CPU ids or slot
+   numbers.  The leaves are a plain bitmap, and bit i of a word in the
+   level above is set when word i of the level below is non-zero, up to a
+   single top word.  Every operation touches one word per level, so it
+   costs O(log64 size) with at most HB_MAX_DEPTH words: three levels
+   cover 2^18 values.  Successor and predecessor searches use ctz and clz
+   to skip empty words.  */
+
+#define HB_BITS 6
+
+#define HB_WORD_BITS (1 << HB_BITS)
+
+/* enough levels for any unsigned long size */
+#define HB_MAX_DEPTH ((64 + HB_BITS - 1) / HB_BITS)
+
+struct hbitmap
+{
+  unsigned long hb_size;          /* the values are below hb_size */
+  unsigned int hb_depth;          /* levels, the leaves last */
+  uint64_t *hb_level[HB_MAX_DEPTH];
+  uint64_t hb_words[];
+};
+
+/* Returns an empty set of the values below size, or NULL with errno set
+   if size is 0 or memory runs out.  */
+struct hbitmap *hb_alloc (unsigned long size);
+
+void hb_free (struct hbitmap *hb);
+
+/* Removes every value. */
+void hb_clear (struct hbitmap *hb);
+
+static inline bool
+hb_test (const struct hbitmap *hb, unsigned long x)
+{
+  const uint64_t *leaf = hb->hb_level[hb->hb_depth - 1];
+
+  return x < hb->hb_size && (leaf[x >> HB_BITS] >> (x % HB_WORD_BITS) & 1);
+}
+
+/* Adds x, which must be below hb_size.  Returns false if it was already
+   there.  Stops at the first level whose word was already non-zero.  */
+static inline bool
+hb_insert (struct hbitmap *hb, unsigned long x)
+{
+  int l = hb->hb_depth - 1;
+  uint64_t *w = &hb->hb_level[l][x >> HB_BITS];
+  uint64_t bit = 1ull << (x % HB_WORD_BITS);
+  uint64_t old = *w;
+
+  if (old & bit)
+    return false;
+  *w = old | bit;
+  while (old == 0 && l-- > 0)
+    {
+      x >>= HB_BITS;
+      w = &hb->hb_level[l][x >> HB_BITS];
+      old = *w;
+      *w = old | 1ull << (x % HB_WORD_BITS);
+    }
+  return true;
+}
+
+/* Removes x.  Returns false if it was not there. */
+static inline bool
+hb_erase (struct hbitmap *hb, unsigned long x)
+{
+  int l = hb->hb_depth - 1;
+  uint64_t *w;
+  uint64_t bit = 1ull << (x % HB_WORD_BITS);
+
+  if (x >= hb->hb_size)
+    return false;
+  w = &hb->hb_level[l][x >> HB_BITS];
+  if (!(*w & bit))
+    return false;
+  *w &= ~bit;
+  while (*w == 0 && l-- > 0)
+    {
+      x >>= HB_BITS;
+      w = &hb->hb_level[l][x >> HB_BITS];
+      *w &= ~(1ull << (x % HB_WORD_BITS));
+    }
+  return true;
+}
+
+static inline bool
+hb_empty (const struct hbitmap *hb)
+{
+  return hb->hb_level[0][0] == 0;
+}
+
+/* Find the smallest value not below *xp, or above it, and store it in
+   *xp.  Return false if there is none.  */
+bool hb_find (const struct hbitmap *hb, unsigned long *xp);
+
+bool hb_find_after (const struct hbitmap *hb, unsigned long *xp);
+
+/* The mirrors of hb_find and hb_find_after: find the largest value not
+   above *xp, or below it.  */
+bool hb_find_prev (const struct hbitmap *hb, unsigned long *xp);
+
+bool hb_find_before (const struct hbitmap *hb, unsigned long *xp);
+
+#define hb_for_each(hb, x)                                                    \
+  for ((x) = 0, (void)(hb_find ((hb), &(x)) || ((x) = (hb)->hb_size));        \
+       (x) < (hb)->hb_size;                                                   \
+       (void)(hb_find_after ((hb), &(x)) || ((x) = (hb)->hb_size)))
+
+C_DECL_END
+
+#endif // !HBITMAP_H
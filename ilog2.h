@@ -9,4 +9,9 @@ static inline int __attribute__ ((const)) ilog2_u32 (uint32_t val)
   return fls (val) - 1;
 }
 
+static inline int __attribute__ ((const)) ilog2_u64 (uint64_t val)
+{
+  return fls64 (val) - 1;
+}
+
 #endif /* ILOG2_H */
@@ -0,0 +1,265 @@
+/* Copyright © 2026  Zhengyi Fu <i@fuzy.me> */
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "latchtree.h"
+#include "rcu.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "test.h"
+
+struct item
+{
+  uint64_t key;
+  struct latch_tree_node node;
+};
+
+static bool
+item_less (const struct latch_tree_node *a, const struct latch_tree_node *b)
+{
+  return latch_tree_entry (a, struct item, node)->key
+         < latch_tree_entry (b, struct item, node)->key;
+}
+
+static int
+item_comp (const void *key, const struct latch_tree_node *node)
+{
+  uint64_t k = *(const uint64_t *)key;
+  uint64_t nk = latch_tree_entry (node, struct item, node)->key;
+
+  return k < nk ? -1 : k > nk;
+}
+
+static const struct latch_tree_ops item_ops = {
+  .less = item_less,
+  .comp = item_comp,
+};
+
+static struct item *
+item_new (uint64_t key)
+{
+  struct item *it = malloc (sizeof (*it));
+
+  if (!it)
+    abort ();
+  it->key = key;
+  return it;
+}
+
+static struct item *
+find_item (struct latch_tree_root *root, uint64_t key)
+{
+  struct latch_tree_node *node = latch_tree_find (&key, root, &item_ops);
+
+  return node ? latch_tree_entry (node, struct item, node) : NULL;
+}
+
+/* Both copies must hold the same keys in the same order. */
+static unsigned long
+lt_validate (struct latch_tree_root *root)
+{
+  struct rb_node *a = rb_first (&root->lt_tree[0]);
+  struct rb_node *b = rb_first (&root->lt_tree[1]);
+  unsigned long n = 0;
+  uint64_t prev = 0;
+
+  while (a && b)
+    {
+      struct item *ia = rb_entry (a, struct item, node.lt_node[0]);
+      struct item *ib = rb_entry (b, struct item, node.lt_node[1]);
+
+      ASSERT (ia == ib);
+      ASSERT (n == 0 || prev < ia->key);
+      prev = ia->key;
+      n++;
+      a = rb_next (a);
+      b = rb_next (b);
+    }
+  ASSERT (a == NULL && b == NULL);
+  return n;
+}
+
+static void
+lt_destroy (struct latch_tree_root *root)
+{
+  struct rb_node *pos, *n;
+
+  rb_for_each_postorder_safe (pos, n, &root->lt_tree[0])
+    free (rb_entry (pos, struct item, node.lt_node[0]));
+  latch_tree_root_init (root);
+}
+
+/* ========== TESTS ========== */
+
+TEST (empty_tree)
+{
+  struct latch_tree_root root = LATCH_TREE_ROOT_INIT;
+
+  ASSERT (find_item (&root, 0) == NULL);
+  ASSERT (find_item (&root, 12345) == NULL);
+  ASSERT (lt_validate (&root) == 0);
+}
+
+TEST (insert_find)
+{
+  struct latch_tree_root root = LATCH_TREE_ROOT_INIT;
+  uint64_t k;
+
+  for (k = 0; k < 1000; ++k)
+    latch_tree_insert (&item_new ((k * 7919) % 1000 * 2)->node, &root,
+                       &item_ops);
+  ASSERT (lt_validate (&root) == 1000);
+
+  for (k = 0; k < 2000; ++k)
+    {
+      struct item *it = find_item (&root, k);
+
+      if (k % 2 == 0)
+        ASSERT (it && it->key == k);
+      else
+        ASSERT (it == NULL);
+    }
+  /* each insert bumps the sequence twice */
+  ASSERT (root.lt_seq == 2000);
+  lt_destroy (&root);
+}
+
+TEST (erase)
+{
+  struct latch_tree_root root = LATCH_TREE_ROOT_INIT;
+  uint64_t k;
+
+  for (k = 0; k < 500; ++k)
+    latch_tree_insert (&item_new (k)->node, &root, &item_ops);
+  for (k = 0; k < 500; k += 3)
+    {
+      struct item *it = find_item (&root, k);
+
+      ASSERT (it);
+      latch_tree_erase (&it->node, &root);
+      free (it);
+    }
+  ASSERT (lt_validate (&root) == 500 - 167);
+  for (k = 0; k < 500; ++k)
+    ASSERT ((find_item (&root, k) != NULL) == (k % 3 != 0));
+  lt_destroy (&root);
+}
+
+/* Concurrent readers look up keys that are always present while a writer
+   churns the others and frees them after a grace period.  */
+
+#define STRESS_READERS 4
+#define STRESS_KEYS 1024
+#define STRESS_ROUNDS 20000
+#define STRESS_RETIRE 64
+
+static struct latch_tree_root stress_root = LATCH_TREE_ROOT_INIT;
+static bool stress_done;
+
+static void *
+stress_reader (void *arg)
+{
+  unsigned int seed = (uintptr_t)arg + 1;
+  unsigned long errors = 0;
+
+  while (!__atomic_load_n (&stress_done, __ATOMIC_ACQUIRE))
+    {
+      uint64_t k = rand_r (&seed) % (STRESS_KEYS * 2);
+      struct item *it;
+
+      rcu_read_lock ();
+      it = find_item (&stress_root, k);
+      if (k % 2 == 0 && (it == NULL || it->key != k))
+        errors++;
+      if (k % 2 == 1 && it != NULL && it->key != k)
+        errors++;
+      rcu_read_unlock ();
+    }
+  return (void *)(uintptr_t)errors;
+}
+
+TEST (concurrent_readers)
+{
+  pthread_t readers[STRESS_READERS];
+  static struct item *odd[STRESS_KEYS];
+  struct item *retired[STRESS_RETIRE];
+  unsigned int seed = 42;
+  int nretired = 0;
+  uintptr_t i;
+  uint64_t k;
+
+  for (k = 0; k < STRESS_KEYS; ++k)
+    latch_tree_insert (&item_new (k * 2)->node, &stress_root, &item_ops);
+
+  for (i = 0; i < STRESS_READERS; ++i)
+    ASSERT (pthread_create (&readers[i], NULL, stress_reader, (void *)i)
+            == 0);
+
+  for (i = 0; i < STRESS_ROUNDS; ++i)
+    {
+      k = rand_r (&seed) % STRESS_KEYS;
+      if (odd[k] == NULL)
+        {
+          odd[k] = item_new (k * 2 + 1);
+          latch_tree_insert (&odd[k]->node, &stress_root, &item_ops);
+        }
+      else
+        {
+          latch_tree_erase (&odd[k]->node, &stress_root);
+          retired[nretired++] = odd[k];
+          odd[k] = NULL;
+        }
+      if (nretired == STRESS_RETIRE)
+        {
+          synchronize_rcu ();
+          while (nretired > 0)
+            free (retired[--nretired]);
+        }
+    }
+
+  __atomic_store_n (&stress_done, true, __ATOMIC_RELEASE);
+  for (i = 0; i < STRESS_READERS; ++i)
+    {
+      void *errors;
+
+      pthread_join (readers[i], &errors);
+      ASSERT (errors == NULL);
+    }
+  while (nretired > 0)
+    free (retired[--nretired]);
+
+  lt_validate (&stress_root);
+  lt_destroy (&stress_root);
+}
+
+int
+main (void)
+{
+  fprintf (stderr, "=== Latch Tree Test Suite ===\n\n");
+
+  RUN_TEST (empty_tree);
+  RUN_TEST (insert_find);
+  RUN_TEST (erase);
+  RUN_TEST (concurrent_readers);
+
+  fprintf (stderr, "\n=== Results ===\n");
+  fprintf (stderr, "Passed: %d/%d\n", pass_count, test_count);
+
+  return (pass_count == test_count) ? 0 : 1;
+}
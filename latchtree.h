@@ -0,0 +1,179 @@
+/* latchtree.h
+ *
+ * Copyright 2026 Zhengyi Fu <i@fuzy.me>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef LATCHTREE_H
+#define LATCHTREE_H
+
+#include <stdbool.h>
+
+#include "container_of.h"
+#include "defs.h"
+#include "rbtree.h"
+
+C_DECL_BEGIN
+
+/* A latched red-black tree for read-mostly lookups.
+
+   Every object is linked into two rbtrees.  The low bit of a sequence
+   counter tells readers which copy is stable.  A writer bumps the counter
+   to move readers to the second copy, modifies the first, bumps it again
+   and modifies the second.  Lookups take no locks and only load the
+   counter twice; a lookup that raced with a writer retries.
+
+   Writers must be serialized by the caller.  Readers may still be
+   walking an erased node, so free it only after synchronize_rcu.  */
+
+struct latch_tree_node
+{
+  struct rb_node lt_node[2];
+};
+
+struct latch_tree_root
+{
+  unsigned int lt_seq;
+  struct rb_root lt_tree[2];
+};
+
+/* clang-format off */
+#define LATCH_TREE_ROOT_INIT { 0, { RB_ROOT_INIT, RB_ROOT_INIT } }
+/* clang-format on */
+
+struct latch_tree_ops
+{
+  bool (*less) (const struct latch_tree_node *a,
+                const struct latch_tree_node *b);
+  int (*comp) (const void *key, const struct latch_tree_node *node);
+};
+
+#define latch_tree_entry(ptr, type, member) container_of (ptr, type, member)
+
+static inline void
+latch_tree_root_init (struct latch_tree_root *root)
+{
+  root->lt_seq = 0;
+  rb_root_init (&root->lt_tree[0]);
+  rb_root_init (&root->lt_tree[1]);
+}
+
+static inline struct latch_tree_node *
+__lt_from_rb (struct rb_node *node, int idx)
+{
+  return container_of (node, struct latch_tree_node, lt_node[idx]);
+}
+
+/* Moves readers to the other copy.  Stores before the bump are visible
+   to readers that see it, and stores after it are not visible to readers
+   that do not.  */
+static inline void
+__lt_latch (struct latch_tree_root *root)
+{
+  __atomic_store_n (&root->lt_seq, root->lt_seq + 1, __ATOMIC_RELEASE);
+  __atomic_thread_fence (__ATOMIC_RELEASE);
+}
+
+static inline void
+__lt_insert (struct latch_tree_node *ltn, struct latch_tree_root *root,
+             int idx, const struct latch_tree_ops *ops)
+{
+  struct rb_node *node = &ltn->lt_node[idx];
+  struct rb_node *parent = NULL;
+  struct rb_node **link = &root->lt_tree[idx].rb_node;
+
+  while (*link != NULL)
+    {
+      parent = *link;
+      if (ops->less (ltn, __lt_from_rb (parent, idx)))
+        link = &parent->rb_left;
+      else
+        link = &parent->rb_right;
+    }
+
+  rb_link_node_rcu (node, parent, link);
+  rb_balance_insert_rcu (node, &root->lt_tree[idx]);
+}
+
+static inline void
+latch_tree_insert (struct latch_tree_node *node, struct latch_tree_root *root,
+                   const struct latch_tree_ops *ops)
+{
+  __lt_latch (root);
+  __lt_insert (node, root, 0, ops);
+  __lt_latch (root);
+  __lt_insert (node, root, 1, ops);
+}
+
+static inline void
+latch_tree_erase (struct latch_tree_node *node, struct latch_tree_root *root)
+{
+  __lt_latch (root);
+  rb_erase_rcu (&node->lt_node[0], &root->lt_tree[0]);
+  __lt_latch (root);
+  rb_erase_rcu (&node->lt_node[1], &root->lt_tree[1]);
+}
+
+/* Looks up key in one copy.  The copy may be under modification, so the
+   walk gives up after more steps than a valid tree can take and lets the
+   caller retry.  */
+static inline struct latch_tree_node *
+__lt_find (const void *key, struct latch_tree_root *root, int idx,
+           const struct latch_tree_ops *ops)
+{
+  struct rb_node *node
+      = __atomic_load_n (&root->lt_tree[idx].rb_node, __ATOMIC_ACQUIRE);
+  int depth;
+
+  for (depth = 0; node != NULL && depth < RB_MAX_HEIGHT; ++depth)
+    {
+      struct latch_tree_node *ltn = __lt_from_rb (node, idx);
+      int c = ops->comp (key, ltn);
+
+      if (c < 0)
+        node = __atomic_load_n (&node->rb_left, __ATOMIC_ACQUIRE);
+      else if (c > 0)
+        node = __atomic_load_n (&node->rb_right, __ATOMIC_ACQUIRE);
+      else
+        return ltn;
+    }
+  return NULL;
+}
+
+/* Returns the node comparing equal to key, or NULL.  Must be called inside
+   rcu_read_lock if nodes are freed concurrently.  */
+static inline struct latch_tree_node *
+latch_tree_find (const void *key, struct latch_tree_root *root,
+                 const struct latch_tree_ops *ops)
+{
+  struct latch_tree_node *node;
+  unsigned int seq;
+
+  do
+    {
+      seq = __atomic_load_n (&root->lt_seq, __ATOMIC_ACQUIRE);
+      node = __lt_find (key, root, seq & 1, ops);
+      __atomic_thread_fence (__ATOMIC_ACQUIRE);
+    }
+  while (__atomic_load_n (&root->lt_seq, __ATOMIC_RELAXED) != seq);
+
+  return node;
+}
+
+C_DECL_END
+
+#endif // !LATCHTREE_H
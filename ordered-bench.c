@@ -0,0 +1,696 @@
+/* Copyright © 2026  Zhengyi Fu <i@fuzy.me> */
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Runs every ordered container through the same workloads and reports
+   ns/op, cache misses/op (when perf_event_open is permitted) and the
+   resident memory the container holds.  All containers are driven through
+   the same function table, so the call overhead is the same for each and
+   only the relative numbers are meaningful.
+
+   Workloads, over n 64-bit keys scattered across the key space:
+
+     insert_seq    n ascending keys into an empty container
+     insert_rand   n keys in random order into an empty container
+     find_hit      n uniform lookups of present keys
+     find_miss     n lookups of absent keys
+     find_zipf     n Zipf(0.99) lookups of present keys
+     scan          n / 100 range scans of 100 keys from a random start
+     churn         n steps, each erasing a random key and inserting a new one
+     insert_zipf   n Zipf(0.99) upserts into an empty container
+
+   Usage: ordered-bench [-f text|csv|json] [-c container] [count]  */
+
+#include "avltree.h"
+#include "bench.h"
+#include "btree.h"
+#include "rbtree.h"
+#include "skiplist.h"
+#include "splaytree.h"
+#include "wavltree.h"
+#include <linux/perf_event.h>
+#include <malloc.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#define ZIPF_THETA 0.99
+#define SCAN_LEN 100
+
+struct container_ops
+{
+  const char *name;
+  void *(*create) (void);
+  void (*destroy) (void *c);
+  /* returns false if key is already present */
+  bool (*insert) (void *c, uint64_t key);
+  bool (*find) (void *c, uint64_t key);
+  bool (*erase) (void *c, uint64_t key);
+  /* visits up to len keys starting at the first key not less than from */
+  uint64_t (*scan) (void *c, uint64_t from, unsigned long len);
+};
+
+/* ========== BINARY SEARCH TREES ========== */
+
+/* The four binary trees share their node layout up to the prefix of the
+   field names, so one template covers them.  lookup and lower_bound are the
+   tree's own functions, which for the splay tree also splay.  */
+
+#define BST_OPS(t, lookup, lower_bound)                                       \
+  struct t##_item                                                             \
+  {                                                                           \
+    uint64_t key;                                                             \
+    struct t##_node node;                                                     \
+  };                                                                          \
+                                                                              \
+  static int t##_item_comp (const void *key, const struct t##_node *node)     \
+  {                                                                           \
+    uint64_t k = *(const uint64_t *)key;                                      \
+    uint64_t v = t##_entry (node, struct t##_item, node)->key;                \
+                                                                              \
+    return (k > v) - (k < v);                                                 \
+  }                                                                           \
+                                                                              \
+  static void *t##_bench_create (void)                                        \
+  {                                                                           \
+    struct t##_root *root = malloc (sizeof (*root));                          \
+                                                                              \
+    if (!root)                                                                \
+      abort ();                                                               \
+    t##_root_init (root);                                                     \
+    return root;                                                              \
+  }                                                                           \
+                                                                              \
+  /* Rotates left children up until the root has none, then frees it. */      \
+  static void t##_bench_destroy (void *c)                                     \
+  {                                                                           \
+    struct t##_root *root = c;                                                \
+    struct t##_node *x = root->t##_node;                                      \
+                                                                              \
+    while (x)                                                                 \
+      {                                                                       \
+        struct t##_node *l = x->t##_left;                                     \
+                                                                              \
+        if (l)                                                                \
+          {                                                                   \
+            x->t##_left = l->t##_right;                                       \
+            l->t##_right = x;                                                 \
+            x = l;                                                            \
+          }                                                                   \
+        else                                                                  \
+          {                                                                   \
+            struct t##_node *r = x->t##_right;                                \
+                                                                              \
+            free (t##_entry (x, struct t##_item, node));                      \
+            x = r;                                                            \
+          }                                                                   \
+      }                                                                       \
+    free (root);                                                              \
+  }                                                                           \
+                                                                              \
+  static bool t##_bench_insert (void *c, uint64_t key)                        \
+  {                                                                           \
+    struct t##_root *root = c;                                                \
+    struct t##_node *parent = NULL;                                           \
+    struct t##_node **link = &root->t##_node;                                 \
+    struct t##_item *it;                                                      \
+                                                                              \
+    while (*link)                                                             \
+      {                                                                       \
+        uint64_t k;                                                           \
+                                                                              \
+        parent = *link;                                                       \
+        k = t##_entry (parent, struct t##_item, node)->key;                   \
+        if (key < k)                                                          \
+          link = &parent->t##_left;                                           \
+        else if (key > k)                                                     \
+          link = &parent->t##_right;                                          \
+        else                                                                  \
+          return false;                                                       \
+      }                                                                       \
+                                                                              \
+    it = malloc (sizeof (*it));                                               \
+    if (!it)                                                                  \
+      abort ();                                                               \
+    it->key = key;                                                            \
+    t##_link_node (&it->node, parent, link);                                  \
+    t##_balance_insert (&it->node, root);                                     \
+    return true;                                                              \
+  }                                                                           \
+                                                                              \
+  static bool t##_bench_find (void *c, uint64_t key)                          \
+  {                                                                           \
+    return lookup (&key, c, t##_item_comp) != NULL;                           \
+  }                                                                           \
+                                                                              \
+  static bool t##_bench_erase (void *c, uint64_t key)                         \
+  {                                                                           \
+    struct t##_node *x = lookup (&key, c, t##_item_comp);                     \
+                                                                              \
+    if (!x)                                                                   \
+      return false;                                                           \
+    t##_erase (x, c);                                                         \
+    free (t##_entry (x, struct t##_item, node));                              \
+    return true;                                                              \
+  }                                                                           \
+                                                                              \
+  static uint64_t t##_bench_scan (void *c, uint64_t from, unsigned long len)  \
+  {                                                                           \
+    struct t##_node *x = lower_bound (&from, c, t##_item_comp);               \
+    uint64_t sum = 0;                                                         \
+                                                                              \
+    for (; x && len; x = t##_next (x), len--)                                 \
+      sum += t##_entry (x, struct t##_item, node)->key;                       \
+    return sum;                                                               \
+  }                                                                           \
+                                                                              \
+  static const struct container_ops t##_ops = {                               \
+    .name = #t "tree",                                                        \
+    .create = t##_bench_create,                                               \
+    .destroy = t##_bench_destroy,                                             \
+    .insert = t##_bench_insert,                                               \
+    .find = t##_bench_find,                                                   \
+    .erase = t##_bench_erase,                                                 \
+    .scan = t##_bench_scan,                                                   \
+  };
+
+BST_OPS (rb, rb_find, rb_lower_bound)
+BST_OPS (avl, avl_find, avl_lower_bound)
+BST_OPS (wavl, wavl_find, wavl_lower_bound)
+BST_OPS (splay, splay_find, splay_lower_bound)
+
+/* ========== B+-TREE ========== */
+
+static void *
+bt_create (void)
+{
+  struct btree *bt = malloc (sizeof (*bt));
+
+  if (!bt)
+    abort ();
+  btree_init (bt);
+  return bt;
+}
+
+static void
+bt_destroy (void *c)
+{
+  btree_destroy (c);
+  free (c);
+}
+
+/* The values are unused, but NULL means absent. */
+static bool
+bt_insert (void *c, uint64_t key)
+{
+  return btree_insert (c, key, c) == 0;
+}
+
+static bool
+bt_find (void *c, uint64_t key)
+{
+  return btree_find (c, key) != NULL;
+}
+
+static bool
+bt_erase (void *c, uint64_t key)
+{
+  return btree_erase (c, key) != NULL;
+}
+
+static uint64_t
+bt_scan (void *c, uint64_t from, unsigned long len)
+{
+  struct btree_iter it;
+  uint64_t sum = 0;
+
+  if (!btree_lower_bound (c, from, &it))
+    return 0;
+  do
+    sum += btree_iter_key (&it);
+  while (--len && btree_iter_next (&it));
+  return sum;
+}
+
+static const struct container_ops bt_ops = {
+  .name = "btree",
+  .create = bt_create,
+  .destroy = bt_destroy,
+  .insert = bt_insert,
+  .find = bt_find,
+  .erase = bt_erase,
+  .scan = bt_scan,
+};
+
+/* ========== SKIP LIST ========== */
+
+/* Single-threaded, so erased nodes can be freed at once and lookups need
+   no rcu_read_lock.  */
+
+struct sl_item
+{
+  uint64_t key;
+  struct sl_node node;
+};
+
+struct sl_bench
+{
+  struct skiplist sl;
+  struct sl_item *spare;
+};
+
+static int
+sl_item_comp (const void *key, const struct sl_node *node)
+{
+  uint64_t k = *(const uint64_t *)key;
+  uint64_t v = sl_entry (node, struct sl_item, node)->key;
+
+  return (k > v) - (k < v);
+}
+
+static void *
+sl_create (void)
+{
+  struct sl_bench *b = malloc (sizeof (*b));
+
+  if (!b)
+    abort ();
+  sl_init (&b->sl);
+  b->spare = NULL;
+  return b;
+}
+
+static void
+sl_destroy (void *c)
+{
+  struct sl_bench *b = c;
+  struct sl_node *x = b->sl.sl_head.sl_next[0];
+
+  while (x)
+    {
+      struct sl_node *next = x->sl_next[0];
+
+      free (sl_entry (x, struct sl_item, node));
+      x = next;
+    }
+  free (b->spare);
+  free (b);
+}
+
+/* The tower height is drawn when a node is allocated, and a node that lost
+   to an existing key is kept for the next insert.  */
+static bool
+sl_insert (void *c, uint64_t key)
+{
+  struct sl_bench *b = c;
+
+  if (!b->spare)
+    {
+      int level = sl_random_level ();
+
+      b->spare = malloc (sizeof (*b->spare) + sl_tower_size (level));
+      if (!b->spare)
+        abort ();
+      sl_node_init (&b->spare->node, level);
+    }
+  b->spare->key = key;
+  if (sl_find_or_insert (&key, &b->sl, &b->spare->node, sl_item_comp))
+    return false;
+  b->spare = NULL;
+  return true;
+}
+
+static bool
+sl_bench_find (void *c, uint64_t key)
+{
+  return sl_find (&key, &((struct sl_bench *)c)->sl, sl_item_comp) != NULL;
+}
+
+static bool
+sl_bench_erase (void *c, uint64_t key)
+{
+  struct sl_node *x;
+
+  x = sl_erase (&key, &((struct sl_bench *)c)->sl, sl_item_comp);
+  if (!x)
+    return false;
+  free (sl_entry (x, struct sl_item, node));
+  return true;
+}
+
+static uint64_t
+sl_scan (void *c, uint64_t from, unsigned long len)
+{
+  struct sl_node *x;
+  uint64_t sum = 0;
+
+  x = sl_lower_bound (&from, &((struct sl_bench *)c)->sl, sl_item_comp);
+  for (; x && len; x = sl_next (x), len--)
+    sum += sl_entry (x, struct sl_item, node)->key;
+  return sum;
+}
+
+static const struct container_ops sl_ops = {
+  .name = "skiplist",
+  .create = sl_create,
+  .destroy = sl_destroy,
+  .insert = sl_insert,
+  .find = sl_bench_find,
+  .erase = sl_bench_erase,
+  .scan = sl_scan,
+};
+
+static const struct container_ops *const containers[] = {
+  &rb_ops, &avl_ops, &wavl_ops, &splay_ops, &bt_ops, &sl_ops,
+};
+
+/* ========== MEASUREMENT ========== */
+
+enum format
+{
+  FORMAT_TEXT,
+  FORMAT_CSV,
+  FORMAT_JSON,
+};
+
+static enum format format = FORMAT_TEXT;
+static int nrows;
+static int perf_fd = -1;
+static long rss_base;
+
+/* Counts last-level cache misses of this thread in user space.  Leaves
+   perf_fd at -1 if the kernel does not allow it.  */
+static void
+perf_open (void)
+{
+  struct perf_event_attr attr;
+
+  memset (&attr, 0, sizeof (attr));
+  attr.size = sizeof (attr);
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.config = PERF_COUNT_HW_CACHE_MISSES;
+  attr.disabled = 1;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  perf_fd = syscall (SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/* Resident set size in KiB, or -1. */
+static long
+rss_kb (void)
+{
+  FILE *f = fopen ("/proc/self/statm", "r");
+  long size, resident;
+
+  if (!f)
+    return -1;
+  if (fscanf (f, "%ld %ld", &size, &resident) != 2)
+    resident = -1;
+  fclose (f);
+  return resident < 0 ? -1 : resident * (sysconf (_SC_PAGESIZE) / 1024);
+}
+
+/* Starts a container's run: memory it allocates counts against it. */
+static void
+rss_reset (void)
+{
+  malloc_trim (0);
+  rss_base = rss_kb ();
+}
+
+struct sample
+{
+  double start;
+};
+
+static struct sample
+sample_begin (void)
+{
+  struct sample s;
+
+  if (perf_fd >= 0)
+    {
+      ioctl (perf_fd, PERF_EVENT_IOC_RESET, 0);
+      ioctl (perf_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+  s.start = bench_now ();
+  return s;
+}
+
+static void
+sample_end (struct sample s, const char *container, const char *workload,
+            unsigned long ops)
+{
+  double ns = (bench_now () - s.start) / ops;
+  double misses = -1;
+  long rss = rss_base < 0 ? -1 : rss_kb () - rss_base;
+  uint64_t count;
+
+  if (perf_fd >= 0)
+    {
+      ioctl (perf_fd, PERF_EVENT_IOC_DISABLE, 0);
+      if (read (perf_fd, &count, sizeof (count)) == sizeof (count))
+        misses = (double)count / ops;
+    }
+
+  switch (format)
+    {
+    case FORMAT_TEXT:
+      printf ("%-10s %-12s %10.1f ns/op", container, workload, ns);
+      if (misses >= 0)
+        printf (" %8.2f misses/op", misses);
+      printf (" %10ld KiB\n", rss);
+      break;
+    case FORMAT_CSV:
+      printf ("%s,%s,%lu,%.1f,", container, workload, ops, ns);
+      if (misses >= 0)
+        printf ("%.2f", misses);
+      printf (",%ld\n", rss);
+      break;
+    case FORMAT_JSON:
+      printf ("%s\n  {\"container\": \"%s\", \"workload\": \"%s\", "
+              "\"ops\": %lu, \"ns_per_op\": %.1f, ",
+              nrows ? "," : "[", container, workload, ops, ns);
+      if (misses >= 0)
+        printf ("\"cache_misses_per_op\": %.2f, ", misses);
+      else
+        printf ("\"cache_misses_per_op\": null, ");
+      printf ("\"rss_kb\": %ld}", rss);
+      break;
+    }
+  nrows++;
+}
+
+/* ========== WORKLOADS ========== */
+
+struct workload_data
+{
+  unsigned long n;
+  uint64_t *keys;        /* 2n distinct even keys; the first n are loaded */
+  uint64_t *seq;         /* the first n keys, sorted */
+  unsigned long *uniform; /* n uniform indices into the first n keys */
+  unsigned long *zipf;    /* n Zipf ranks into the first n keys */
+  unsigned long *slot;    /* churn: 2n key indices, live then spare */
+};
+
+static int
+key_cmp (const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+  return (x > y) - (x < y);
+}
+
+static void
+check (bool ok, const char *container, const char *what)
+{
+  if (!ok)
+    {
+      fprintf (stderr, "%s: %s failed\n", container, what);
+      abort ();
+    }
+}
+
+static void
+run_container (const struct container_ops *ops, struct workload_data *w)
+{
+  unsigned long n = w->n, i, ok, scans;
+  uint64_t sum;
+  struct sample s;
+  void *c;
+
+  rss_reset ();
+  c = ops->create ();
+  s = sample_begin ();
+  for (i = ok = 0; i < n; i++)
+    ok += ops->insert (c, w->seq[i]);
+  sample_end (s, ops->name, "insert_seq", n);
+  check (ok == n, ops->name, "insert_seq");
+  ops->destroy (c);
+
+  rss_reset ();
+  c = ops->create ();
+  s = sample_begin ();
+  for (i = ok = 0; i < n; i++)
+    ok += ops->insert (c, w->keys[i]);
+  sample_end (s, ops->name, "insert_rand", n);
+  check (ok == n, ops->name, "insert_rand");
+
+  s = sample_begin ();
+  for (i = ok = 0; i < n; i++)
+    ok += ops->find (c, w->keys[w->uniform[i]]);
+  sample_end (s, ops->name, "find_hit", n);
+  check (ok == n, ops->name, "find_hit");
+
+  s = sample_begin ();
+  for (i = ok = 0; i < n; i++)
+    ok += ops->find (c, w->keys[w->uniform[i]] | 1);
+  sample_end (s, ops->name, "find_miss", n);
+  check (ok == 0, ops->name, "find_miss");
+
+  s = sample_begin ();
+  for (i = ok = 0; i < n; i++)
+    ok += ops->find (c, w->keys[w->zipf[i]]);
+  sample_end (s, ops->name, "find_zipf", n);
+  check (ok == n, ops->name, "find_zipf");
+
+  scans = n / SCAN_LEN ? n / SCAN_LEN : 1;
+  s = sample_begin ();
+  for (i = sum = 0; i < scans; i++)
+    sum += ops->scan (c, w->keys[w->uniform[i]], SCAN_LEN);
+  sample_end (s, ops->name, "scan", scans);
+  check (sum != 0, ops->name, "scan");
+
+  /* slot[0, n) hold the indices of the live keys and slot[n, 2n) the
+     spare ones; each step swaps a random live key for a spare  */
+  for (i = 0; i < 2 * n; i++)
+    w->slot[i] = i;
+  s = sample_begin ();
+  for (i = ok = 0; i < n; i++)
+    {
+      unsigned long j = w->uniform[i];
+      unsigned long fresh = w->slot[n + i];
+
+      ok += ops->erase (c, w->keys[w->slot[j]]);
+      ok += ops->insert (c, w->keys[fresh]);
+      w->slot[n + i] = w->slot[j];
+      w->slot[j] = fresh;
+    }
+  sample_end (s, ops->name, "churn", n);
+  check (ok == 2 * n, ops->name, "churn");
+  ops->destroy (c);
+
+  rss_reset ();
+  c = ops->create ();
+  s = sample_begin ();
+  for (i = 0; i < n; i++)
+    ops->insert (c, w->keys[w->zipf[i]]);
+  sample_end (s, ops->name, "insert_zipf", n);
+  ops->destroy (c);
+}
+
+int
+main (int argc, char *argv[])
+{
+  const char *only = NULL;
+  struct workload_data w;
+  uint64_t state = 88172645463325252ull;
+  unsigned long i;
+  size_t k;
+  int opt;
+
+  while ((opt = getopt (argc, argv, "f:c:")) != -1)
+    switch (opt)
+      {
+      case 'f':
+        if (strcmp (optarg, "text") == 0)
+          format = FORMAT_TEXT;
+        else if (strcmp (optarg, "csv") == 0)
+          format = FORMAT_CSV;
+        else if (strcmp (optarg, "json") == 0)
+          format = FORMAT_JSON;
+        else
+          goto usage;
+        break;
+      case 'c':
+        only = optarg;
+        break;
+      default:
+        goto usage;
+      }
+  if (argc - optind > 1)
+    goto usage;
+
+  w.n = 1000000;
+  if (optind < argc)
+    w.n = strtoul (argv[optind], NULL, 0);
+  if (w.n < 2)
+    return 0;
+
+  w.keys = malloc (2 * w.n * sizeof (*w.keys));
+  w.seq = malloc (w.n * sizeof (*w.seq));
+  w.uniform = malloc (w.n * sizeof (*w.uniform));
+  w.zipf = malloc (w.n * sizeof (*w.zipf));
+  w.slot = malloc (2 * w.n * sizeof (*w.slot));
+  if (!w.keys || !w.seq || !w.uniform || !w.zipf || !w.slot)
+    {
+      perror ("malloc");
+      return 1;
+    }
+
+  /* multiplying by an odd constant is a bijection, and the low bit is
+     cleared so that key | 1 is always a miss  */
+  for (i = 0; i < 2 * w.n; i++)
+    w.keys[i] = ((i + 1) * 0x9E3779B97F4A7C15ull) & ~1ull;
+  memcpy (w.seq, w.keys, w.n * sizeof (*w.seq));
+  qsort (w.seq, w.n, sizeof (*w.seq), key_cmp);
+  for (i = 0; i < w.n; i++)
+    w.uniform[i] = bench_rand (&state) % w.n;
+  bench_zipf_fill (w.zipf, w.n, w.n, ZIPF_THETA, &state);
+
+  perf_open ();
+
+  if (format == FORMAT_CSV)
+    printf ("container,workload,ops,ns_per_op,cache_misses_per_op,rss_kb\n");
+  else if (format == FORMAT_TEXT)
+    printf ("%lu keys%s\n", w.n,
+            perf_fd < 0 ? ", cache misses unavailable" : "");
+
+  for (k = 0; k < sizeof (containers) / sizeof (containers[0]); k++)
+    if (!only || strcmp (only, containers[k]->name) == 0)
+      run_container (containers[k], &w);
+
+  if (format == FORMAT_JSON)
+    printf ("%s\n]\n", nrows ? "" : "[");
+
+  if (perf_fd >= 0)
+    close (perf_fd);
+  free (w.slot);
+  free (w.zipf);
+  free (w.uniform);
+  free (w.seq);
+  free (w.keys);
+  return 0;
+
+usage:
+  fprintf (stderr, "Usage: %s [-f text|csv|json] [-c container] [count]\n",
+           argv[0]);
+  return 1;
+}
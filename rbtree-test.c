@@ -507,6 +507,469 @@ TEST (tree_height)
   ASSERT (bh <= 12); /* log2(1000) ≈ 10 */
 }
 
+TEST (lower_upper_bound)
+{
+  struct rb_root tree = RB_ROOT_INIT;
+  struct rb_node *node;
+  int key;
+  int i;
+
+  for (i = 0; i < 100; i++)
+    insert_value (&tree, i * 10);
+  /* duplicates: the lower bound must be the first of them */
+  insert_value (&tree, 50);
+  insert_value (&tree, 50);
+
+  key = 15;
+  node = rb_lower_bound (&key, &tree, comp_value);
+  ASSERT (node && rb_entry (node, struct test_node, node)->value == 20);
+
+  key = 50;
+  node = rb_lower_bound (&key, &tree, comp_value);
+  ASSERT (node && rb_entry (node, struct test_node, node)->value == 50);
+  node = rb_prev (node);
+  ASSERT (node && rb_entry (node, struct test_node, node)->value == 40);
+
+  node = rb_upper_bound (&key, &tree, comp_value);
+  ASSERT (node && rb_entry (node, struct test_node, node)->value == 60);
+
+  key = -1;
+  node = rb_lower_bound (&key, &tree, comp_value);
+  ASSERT (node && rb_entry (node, struct test_node, node)->value == 0);
+
+  key = 990;
+  ASSERT (rb_lower_bound (&key, &tree, comp_value) != NULL);
+  ASSERT (rb_upper_bound (&key, &tree, comp_value) == NULL);
+  key = 991;
+  ASSERT (rb_lower_bound (&key, &tree, comp_value) == NULL);
+}
+
+TEST (range_iteration)
+{
+  struct rb_root tree = RB_ROOT_INIT;
+  struct rb_node *node;
+  struct test_node *pos;
+  int first = 95, last = 305;
+  int expected = 100;
+  int count = 0;
+  int i;
+
+  for (i = 0; i < 100; i++)
+    insert_value (&tree, i * 10);
+
+  rb_for_each_in_range (node, &first, &last, &tree, comp_value)
+  {
+    ASSERT (rb_entry (node, struct test_node, node)->value == expected);
+    expected += 10;
+    count++;
+  }
+  ASSERT (count == 21);
+
+  count = 0;
+  first = 300;
+  last = 300;
+  rb_for_each_entry_in_range (pos, &first, &last, &tree, comp_value, node)
+  {
+    ASSERT (pos->value == 300);
+    count++;
+  }
+  ASSERT (count == 1);
+
+  count = 0;
+  first = 2000;
+  last = 3000;
+  rb_for_each_in_range (node, &first, &last, &tree, comp_value)
+    count++;
+  ASSERT (count == 0);
+}
+
+struct walk_state
+{
+  int next;
+  int stop_at;
+  int calls;
+};
+
+static int
+walk_check (struct rb_node **nodes, size_t n, void *arg)
+{
+  struct walk_state *st = arg;
+  size_t i;
+
+  ASSERT (n > 0 && n <= RB_WALK_BATCH);
+  st->calls++;
+  for (i = 0; i < n; i++)
+    {
+      ASSERT (rb_entry (nodes[i], struct test_node, node)->value
+              == st->next);
+      if (st->next++ == st->stop_at)
+        return 1;
+    }
+  return 0;
+}
+
+TEST (walk)
+{
+  struct rb_root tree = RB_ROOT_INIT;
+  struct walk_state st = { 0, -1, 0 };
+  int i;
+
+  ASSERT (rb_walk (&tree, walk_check, &st) == 0);
+  ASSERT (st.calls == 0);
+
+  for (i = 0; i < 1000; i++)
+    insert_value (&tree, (i * 37) % 1000);
+
+  ASSERT (rb_walk (&tree, walk_check, &st) == 0);
+  ASSERT (st.next == 1000);
+  ASSERT (st.calls == (1000 + RB_WALK_BATCH - 1) / RB_WALK_BATCH);
+
+  st.next = 0;
+  st.stop_at = 500;
+  ASSERT (rb_walk (&tree, walk_check, &st) == 1);
+  ASSERT (st.next == 501);
+}
+
+TEST (postorder_iteration)
+{
+  struct rb_root tree = RB_ROOT_INIT;
+  struct rb_node *node, *tmp;
+  struct test_node *pos, *n;
+  char visited[200] = { 0 };
+  int count = 0;
+  int i;
+
+  rb_for_each_postorder_safe (node, tmp, &tree)
+    count++;
+  ASSERT (count == 0);
+
+  for (i = 0; i < 200; i++)
+    insert_value (&tree, (i * 67) % 200);
+
+  /* every node is visited after both of its children */
+  rb_for_each_postorder_safe (node, tmp, &tree)
+  {
+    if (node->rb_left)
+      ASSERT (visited[rb_entry (node->rb_left, struct test_node, node)->value]);
+    if (node->rb_right)
+      ASSERT (visited[rb_entry (node->rb_right, struct test_node, node)->value]);
+    visited[rb_entry (node, struct test_node, node)->value] = 1;
+    count++;
+  }
+  ASSERT (count == 200);
+
+  count = 0;
+  rb_for_each_entry_postorder_safe (pos, n, &tree, node)
+  {
+    free (pos);
+    count++;
+  }
+  ASSERT (count == 200);
+}
+
+static int freed_count;
+
+static void
+free_node (struct rb_node *node)
+{
+  freed_count++;
+  free (rb_entry (node, struct test_node, node));
+}
+
+TEST (destroy)
+{
+  struct rb_root tree = RB_ROOT_INIT;
+  int i;
+
+  freed_count = 0;
+  rb_destroy (&tree, free_node);
+  ASSERT (freed_count == 0);
+
+  srand (99);
+  for (i = 0; i < 5000; i++)
+    insert_value (&tree, rand ());
+
+  rb_destroy (&tree, free_node);
+  ASSERT (freed_count == 5000);
+  ASSERT (rb_empty (&tree));
+}
+
+static void
+rb_check_parents (const struct rb_node *node)
+{
+  if (node == NULL)
+    return;
+  if (node->rb_left)
+    ASSERT (node->rb_left->rb_parent == node);
+  if (node->rb_right)
+    ASSERT (node->rb_right->rb_parent == node);
+  rb_check_parents (node->rb_left);
+  rb_check_parents (node->rb_right);
+}
+
+/* Checks that tree holds exactly the values first, first + step, ... < end */
+static void
+check_sequence (struct rb_root *tree, int first, int step, int end)
+{
+  struct test_node *pos;
+  int expected = first;
+
+  rb_validate (tree);
+  if (tree->rb_node)
+    ASSERT (tree->rb_node->rb_parent == NULL);
+  rb_check_parents (tree->rb_node);
+  rb_for_each_entry (pos, tree, node)
+  {
+    ASSERT (pos->value == expected);
+    expected += step;
+  }
+  ASSERT (expected >= end && expected - step < end);
+}
+
+static void
+destroy_tree (struct rb_root *tree)
+{
+  struct test_node *pos, *n;
+
+  rb_for_each_entry_postorder_safe (pos, n, tree, node)
+    free (pos);
+  tree->rb_node = NULL;
+}
+
+TEST (join)
+{
+  static const int sizes[] = { 0, 1, 2, 5, 31, 100, 1000 };
+  size_t i, j;
+  int v;
+
+  for (i = 0; i < sizeof (sizes) / sizeof (sizes[0]); i++)
+    for (j = 0; j < sizeof (sizes) / sizeof (sizes[0]); j++)
+      {
+        struct rb_root left = RB_ROOT_INIT;
+        struct rb_root right = RB_ROOT_INIT;
+        struct rb_root out = RB_ROOT_INIT;
+        struct test_node *mid = malloc (sizeof (*mid));
+
+        ASSERT (mid != NULL);
+        for (v = 0; v < sizes[i]; v++)
+          insert_value (&left, v);
+        mid->value = sizes[i];
+        for (v = 0; v < sizes[j]; v++)
+          insert_value (&right, sizes[i] + 1 + v);
+
+        rb_join (&left, &mid->node, &right, &out);
+        ASSERT (rb_empty (&left) && rb_empty (&right));
+        check_sequence (&out, 0, 1, sizes[i] + sizes[j] + 1);
+
+        /* concat the two halves of a split back together */
+        v = sizes[i] / 2;
+        rb_split (&out, &v, comp_value, &left, &right);
+        check_sequence (&left, 0, 1, v);
+        check_sequence (&right, v, 1, sizes[i] + sizes[j] + 1);
+        rb_concat (&left, &right, &left);
+        ASSERT (rb_empty (&right));
+        check_sequence (&left, 0, 1, sizes[i] + sizes[j] + 1);
+        destroy_tree (&left);
+      }
+}
+
+TEST (split)
+{
+  static const int keys[] = { -1, 0, 1, 500, 501, 998, 999, 1000, 2000 };
+  size_t i;
+  int v;
+
+  for (i = 0; i < sizeof (keys) / sizeof (keys[0]); i++)
+    {
+      struct rb_root tree = RB_ROOT_INIT;
+      struct rb_root left = RB_ROOT_INIT;
+      struct rb_root right = RB_ROOT_INIT;
+      int key = keys[i];
+      int mid = key < 0 ? 0 : key > 1000 ? 1000 : key;
+
+      for (v = 0; v < 1000; v++)
+        insert_value (&tree, (v * 7) % 1000);
+
+      rb_split (&tree, &key, comp_value, &left, &right);
+      ASSERT (rb_empty (&tree));
+      check_sequence (&left, 0, 1, mid);
+      check_sequence (&right, mid, 1, 1000);
+      ASSERT (rb_count_nodes (left.rb_node) == mid);
+      ASSERT (rb_count_nodes (right.rb_node) == 1000 - mid);
+      destroy_tree (&left);
+      destroy_tree (&right);
+    }
+}
+
+static int
+node_comp (const struct rb_node *a, const struct rb_node *b)
+{
+  return comp_value (&rb_entry (a, struct test_node, node)->value, b);
+}
+
+static int dropped;
+
+static void
+drop_node (struct rb_node *node)
+{
+  __atomic_fetch_add (&dropped, 1, __ATOMIC_RELAXED);
+  free (rb_entry (node, struct test_node, node));
+}
+
+/* a = multiples of 2 below 2 * n, b = multiples of 3 below 3 * n */
+static void
+build_sets (struct rb_root *a, struct rb_root *b, int n)
+{
+  int i;
+
+  for (i = 0; i < n; i++)
+    {
+      insert_value (a, (i * 37 % n) * 2);
+      insert_value (b, (i * 41 % n) * 3);
+    }
+}
+
+static void
+check_set (struct rb_root *tree, bool (*member) (int), int end)
+{
+  struct test_node *pos;
+  int expected = 0;
+
+  rb_validate (tree);
+  if (tree->rb_node)
+    ASSERT (tree->rb_node->rb_parent == NULL);
+  rb_check_parents (tree->rb_node);
+  rb_for_each_entry (pos, tree, node)
+  {
+    while (expected < end && !member (expected))
+      expected++;
+    ASSERT (pos->value == expected);
+    expected++;
+  }
+  while (expected < end && !member (expected))
+    expected++;
+  ASSERT (expected == end);
+}
+
+static int set_n;
+
+static bool
+in_union (int v)
+{
+  return (v % 2 == 0 && v < 2 * set_n) || (v % 3 == 0 && v < 3 * set_n);
+}
+
+static bool
+in_intersection (int v)
+{
+  return v % 6 == 0 && v < 2 * set_n;
+}
+
+static bool
+in_difference (int v)
+{
+  return v % 2 == 0 && v % 3 != 0 && v < 2 * set_n;
+}
+
+TEST (set_operations)
+{
+  static const int sizes[] = { 0, 1, 10, 1000, 20000 };
+  static const unsigned int threads[] = { 1, 4 };
+  size_t i, j;
+
+  for (i = 0; i < sizeof (sizes) / sizeof (sizes[0]); i++)
+    for (j = 0; j < sizeof (threads) / sizeof (threads[0]); j++)
+      {
+        struct rb_root a = RB_ROOT_INIT;
+        struct rb_root b = RB_ROOT_INIT;
+        int n = set_n = sizes[i];
+
+        build_sets (&a, &b, n);
+        dropped = 0;
+        rb_union (&a, &b, node_comp, drop_node, threads[j], &a);
+        ASSERT (rb_empty (&b));
+        check_set (&a, in_union, 3 * n);
+        ASSERT (dropped == (n + 2) / 3);
+        destroy_tree (&a);
+
+        build_sets (&a, &b, n);
+        dropped = 0;
+        rb_intersection (&a, &b, node_comp, drop_node, threads[j], &a);
+        check_set (&a, in_intersection, 2 * n);
+        ASSERT (dropped + rb_count_nodes (a.rb_node) == 2 * n);
+        destroy_tree (&a);
+
+        build_sets (&a, &b, n);
+        dropped = 0;
+        rb_difference (&a, &b, node_comp, drop_node, threads[j], &a);
+        check_set (&a, in_difference, 2 * n);
+        ASSERT (dropped + rb_count_nodes (a.rb_node) == 2 * n);
+        destroy_tree (&a);
+      }
+}
+
+#define TEST_NODE_KEY(n) ((n)->value)
+
+RB_DECLARE (tn, struct test_node, node, TEST_NODE_KEY, RB_CMP_NUMERIC)
+
+TEST (typed_api)
+{
+  struct rb_root tree = RB_ROOT_INIT;
+  struct test_node nodes[300], dup;
+  struct test_node *pos;
+  int i, prev = -1;
+
+  for (i = 0; i < 300; i++)
+    {
+      nodes[i].value = (i * 7) % 300 * 2;
+      ASSERT (tn_insert (&tree, &nodes[i]) == NULL);
+    }
+  rb_validate (&tree);
+  ASSERT (rb_count_nodes (tree.rb_node) == 300);
+
+  dup.value = 42;
+  ASSERT (tn_insert (&tree, &dup) != NULL);
+  ASSERT (tn_insert (&tree, &dup)->value == 42);
+  tn_add (&tree, &dup);
+  ASSERT (rb_count_nodes (tree.rb_node) == 301);
+  ASSERT (rb_next (&tn_lower_bound (&tree, 42)->node) == &dup.node);
+  tn_erase (&tree, &dup);
+
+  rb_for_each_entry (pos, &tree, node)
+    {
+      ASSERT (pos->value > prev);
+      prev = pos->value;
+    }
+
+  for (i = -1; i < 601; i++)
+    {
+      struct test_node *found = tn_find (&tree, i);
+      struct test_node *lb = tn_lower_bound (&tree, i);
+      struct test_node *ub = tn_upper_bound (&tree, i);
+
+      if (i >= 0 && i < 600 && i % 2 == 0)
+        ASSERT (found && found->value == i);
+      else
+        ASSERT (found == NULL);
+
+      if (i < 599)
+        ASSERT (lb && lb->value == (i < 0 ? 0 : (i + 1) / 2 * 2));
+      else
+        ASSERT (lb == NULL);
+      if (i < 598)
+        ASSERT (ub && ub->value == (i < 0 ? 0 : i / 2 * 2 + 2));
+      else
+        ASSERT (ub == NULL);
+    }
+
+  for (i = 0; i < 300; i += 2)
+    tn_erase (&tree, &nodes[i]);
+  rb_validate (&tree);
+  ASSERT (rb_count_nodes (tree.rb_node) == 150);
+  for (i = 0; i < 300; i++)
+    ASSERT ((tn_find (&tree, nodes[i].value) != NULL) == (i % 2 == 1));
+}
+
 int
 main (void)
 {
@@ -532,6 +995,15 @@ main (void)
   RUN_TEST (first_last);
   RUN_TEST (stress_random);
   RUN_TEST (tree_height);
+  RUN_TEST (lower_upper_bound);
+  RUN_TEST (range_iteration);
+  RUN_TEST (walk);
+  RUN_TEST (postorder_iteration);
+  RUN_TEST (destroy);
+  RUN_TEST (join);
+  RUN_TEST (split);
+  RUN_TEST (set_operations);
+  RUN_TEST (typed_api);
 
   fprintf (stderr, "\n=== Results ===\n");
   fprintf (stderr, "Passed: %d/%d\n", pass_count, test_count);
@@ -20,9 +20,35 @@
 
 #include "rbtree.h"
 #include <assert.h>
+#include <pthread.h>
+
+/* Stores a child pointer.  With rcu, the store has release semantics, so
+   a lockless reader that loads the pointer with acquire semantics also
+   sees the node it points to, as rcu_assign_pointer does.  */
+static inline void
+rb_set_child (struct rb_node **link, struct rb_node *node, bool rcu)
+{
+  if (rcu)
+    __atomic_store_n (link, node, __ATOMIC_RELEASE);
+  else
+    *link = node;
+}
+
+/* Replaces old by new_node in the child link of parent, or at the root. */
+static inline void
+rb_change_child (struct rb_node *old, struct rb_node *new_node,
+                 struct rb_node *parent, struct rb_root *root, bool rcu)
+{
+  if (!parent)
+    rb_set_child (&root->rb_node, new_node, rcu);
+  else if (parent->rb_left == old)
+    rb_set_child (&parent->rb_left, new_node, rcu);
+  else
+    rb_set_child (&parent->rb_right, new_node, rcu);
+}
 
 static void
-rb_rotate_right (struct rb_node *x, struct rb_root *tree)
+rb_rotate_right (struct rb_node *x, struct rb_root *tree, bool rcu)
 {
   /*
    *     x           y
@@ -39,27 +65,17 @@ rb_rotate_right (struct rb_node *x, struct rb_root *tree)
   assert (x != NULL && x->rb_left != NULL);
   y = x->rb_left;
   parent = y->rb_parent = x->rb_parent;
-
-  if (!parent)
-    {
-      tree->rb_node = y;
-    }
-  else
-    {
-      if (parent->rb_left == x)
-        parent->rb_left = y;
-      else
-        parent->rb_right = y;
-    }
+  rb_change_child (x, y, parent, tree, rcu);
   x->rb_parent = y;
-  right = x->rb_left = y->rb_right;
+  right = y->rb_right;
+  rb_set_child (&x->rb_left, right, rcu);
   if (right)
     right->rb_parent = x;
-  y->rb_right = x;
+  rb_set_child (&y->rb_right, x, rcu);
 }
 
 static void
-rb_rotate_left (struct rb_node *x, struct rb_root *tree)
+rb_rotate_left (struct rb_node *x, struct rb_root *tree, bool rcu)
 {
   /*
    *   x             y
@@ -76,29 +92,22 @@ rb_rotate_left (struct rb_node *x, struct rb_root *tree)
   assert (x != NULL && x->rb_right != NULL);
   y = x->rb_right;
   parent = y->rb_parent = x->rb_parent;
-  if (!parent)
-    {
-      tree->rb_node = y;
-    }
-  else
-    {
-      if (parent->rb_left == x)
-        parent->rb_left = y;
-      else
-        parent->rb_right = y;
-    }
+  rb_change_child (x, y, parent, tree, rcu);
   x->rb_parent = y;
-  left = x->rb_right = y->rb_left;
+  left = y->rb_left;
+  rb_set_child (&x->rb_right, left, rcu);
   if (left)
     left->rb_parent = x;
-  y->rb_left = x;
+  rb_set_child (&y->rb_left, x, rcu);
 }
 
-/* Rebalance after inserting node x into tree root. */
-void
-rb_balance_insert (struct rb_node *x, struct rb_root *root)
+/* Rebalance after linking the red node x into tree root.
+   Returns true if the black height of the tree grew.  */
+static bool
+rb_insert_fixup (struct rb_node *x, struct rb_root *root, bool rcu)
 {
   struct rb_node *parent = x->rb_parent;
+  bool grew = false;
 
   x->rb_is_black = x == root->rb_node;
   while (x != root->rb_node && !parent->rb_is_black)
@@ -129,6 +138,7 @@ rb_balance_insert (struct rb_node *x, struct rb_root *root)
               parent->rb_is_black = true;
               y->rb_is_black = true;
               gparent->rb_is_black = gparent == root->rb_node;
+              grew = gparent->rb_is_black;
               x = gparent;
               parent = x->rb_parent;
             }
@@ -152,7 +162,7 @@ rb_balance_insert (struct rb_node *x, struct rb_root *root)
                   tmp = x;
                   x = parent;
                   parent = tmp;
-                  rb_rotate_left (x, root);
+                  rb_rotate_left (x, root, rcu);
                 }
 
               /*
@@ -173,7 +183,7 @@ rb_balance_insert (struct rb_node *x, struct rb_root *root)
 
               parent->rb_is_black = true;
               gparent->rb_is_black = false;
-              rb_rotate_right (gparent, root);
+              rb_rotate_right (gparent, root, rcu);
               break;
             }
         }
@@ -186,6 +196,7 @@ rb_balance_insert (struct rb_node *x, struct rb_root *root)
               parent->rb_is_black = true;
               y->rb_is_black = true;
               gparent->rb_is_black = gparent == root->rb_node;
+              grew = gparent->rb_is_black;
               x = gparent;
               parent = x->rb_parent;
             }
@@ -196,19 +207,34 @@ rb_balance_insert (struct rb_node *x, struct rb_root *root)
                   tmp = x;
                   x = parent;
                   parent = tmp;
-                  rb_rotate_right (x, root);
+                  rb_rotate_right (x, root, rcu);
                 }
               parent->rb_is_black = true;
               gparent->rb_is_black = false;
-              rb_rotate_left (gparent, root);
+              rb_rotate_left (gparent, root, rcu);
               break;
             }
         }
     } /* while (x != root && !x->rb_parent->rb_is_black) */
+
+  return grew;
 }
 
+/* Rebalance after inserting node x into tree root. */
 void
-rb_erase (struct rb_node *x, struct rb_root *root)
+rb_balance_insert (struct rb_node *x, struct rb_root *root)
+{
+  rb_insert_fixup (x, root, false);
+}
+
+void
+rb_balance_insert_rcu (struct rb_node *x, struct rb_root *root)
+{
+  rb_insert_fixup (x, root, true);
+}
+
+static void
+rb_erase_node (struct rb_node *x, struct rb_root *root, bool rcu)
 {
   /*
     y is either x or x's successor,
@@ -252,41 +278,19 @@ rb_erase (struct rb_node *x, struct rb_root *root)
   /* remove y */
   if (z != NULL)
     z->rb_parent = parent;
-  if (!parent)
-    {
-      root->rb_node = z;
-    }
-  else
-    {
-      if (parent->rb_left == (y))
-        parent->rb_left = z;
-      else
-        parent->rb_right = z;
-    }
+  rb_change_child (y, z, parent, root, rcu);
 
   if (x != y)
     {
       /* replace x by y */
-      y->rb_left = x->rb_left;
+      rb_set_child (&y->rb_left, x->rb_left, rcu);
       if (x->rb_left)
         x->rb_left->rb_parent = y;
-      y->rb_right = x->rb_right;
+      rb_set_child (&y->rb_right, x->rb_right, rcu);
       if (x->rb_right)
         x->rb_right->rb_parent = y;
       y->rb_parent = x->rb_parent;
-
-      parent = x->rb_parent;
-      if (!parent)
-        {
-          root->rb_node = y;
-        }
-      else
-        {
-          if (parent->rb_left == (x))
-            parent->rb_left = y;
-          else
-            parent->rb_right = y;
-        }
+      rb_change_child (x, y, x->rb_parent, root, rcu);
       y->rb_is_black = x->rb_is_black;
     }
 
@@ -334,9 +338,9 @@ rb_erase (struct rb_node *x, struct rb_root *root)
               struct rb_node *p = w->rb_parent;
 
               if (p->rb_left == (w))
-                rb_rotate_right (p, root);
+                rb_rotate_right (p, root, rcu);
               else
-                rb_rotate_left (p, root);
+                rb_rotate_left (p, root, rcu);
 
               p->rb_is_black = false;
               p->rb_parent->rb_is_black = true;
@@ -390,7 +394,7 @@ rb_erase (struct rb_node *x, struct rb_root *root)
 
                       w->rb_is_black = false;
                       w->rb_left->rb_is_black = true;
-                      rb_rotate_right (w, root);
+                      rb_rotate_right (w, root, rcu);
                       w = w->rb_parent;
                     }
 
@@ -408,7 +412,7 @@ rb_erase (struct rb_node *x, struct rb_root *root)
                   w = w->rb_parent;
                   assert (w != NULL);
                   w->rb_is_black = true;
-                  rb_rotate_left (w, root);
+                  rb_rotate_left (w, root, rcu);
                   break;
                 }
               else
@@ -418,7 +422,7 @@ rb_erase (struct rb_node *x, struct rb_root *root)
                     {
                       w->rb_is_black = false;
                       w->rb_right->rb_is_black = true;
-                      rb_rotate_left (w, root);
+                      rb_rotate_left (w, root, rcu);
                       w = w->rb_parent;
                     }
 
@@ -427,7 +431,7 @@ rb_erase (struct rb_node *x, struct rb_root *root)
                   w = w->rb_parent;
                   assert (w != NULL);
                   w->rb_is_black = true;
-                  rb_rotate_right (w, root);
+                  rb_rotate_right (w, root, rcu);
                   break;
                 }
             }
@@ -435,6 +439,18 @@ rb_erase (struct rb_node *x, struct rb_root *root)
     }
 }
 
+void
+rb_erase (struct rb_node *x, struct rb_root *root)
+{
+  rb_erase_node (x, root, false);
+}
+
+void
+rb_erase_rcu (struct rb_node *x, struct rb_root *root)
+{
+  rb_erase_node (x, root, true);
+}
+
 void
 rb_replace_node (struct rb_node *old, struct rb_node *new_node,
                  struct rb_root *tree)
@@ -470,3 +486,471 @@ rb_replace_node (struct rb_node *old, struct rb_node *new_node,
   old->rb_right = NULL;
   old->rb_is_black = false;
 }
+
+void
+rb_destroy (struct rb_root *root, void (*free_fn) (struct rb_node *))
+{
+  struct rb_node *pos;
+  struct rb_node *n;
+
+  rb_for_each_postorder_safe (pos, n, root)
+    free_fn (pos);
+  root->rb_node = NULL;
+}
+
+int
+rb_walk (struct rb_root *root,
+         int (*fn) (struct rb_node **nodes, size_t n, void *arg), void *arg)
+{
+  struct rb_node *stack[RB_MAX_HEIGHT];
+  struct rb_node *batch[RB_WALK_BATCH];
+  struct rb_node *node = root->rb_node;
+  size_t depth = 0;
+  size_t n = 0;
+  int ret;
+
+  for (;;)
+    {
+      while (node != NULL)
+        {
+          assert (depth < RB_MAX_HEIGHT);
+          __builtin_prefetch (node->rb_right);
+          stack[depth++] = node;
+          node = node->rb_left;
+        }
+
+      if (depth == 0)
+        break;
+
+      node = stack[--depth];
+      batch[n++] = node;
+      node = node->rb_right;
+
+      if (n == RB_WALK_BATCH)
+        {
+          ret = fn (batch, n, arg);
+          if (ret)
+            return ret;
+          n = 0;
+        }
+    }
+
+  return n ? fn (batch, n, arg) : 0;
+}
+
+/* Returns the black height of the subtree rooted at x. */
+static int
+rb_black_height_of (const struct rb_node *x)
+{
+  int h = 0;
+
+  for (; x != NULL; x = x->rb_left)
+    h += x->rb_is_black;
+  return h;
+}
+
+/* Detaches x from its parent and returns it as the root of a subtree of
+   black height *hp.  A red root is painted black, which adds one to *hp.  */
+static inline struct rb_node *
+rb_detach (struct rb_node *x, int *hp)
+{
+  if (x != NULL)
+    {
+      x->rb_parent = NULL;
+      if (!x->rb_is_black)
+        {
+          x->rb_is_black = true;
+          ++*hp;
+        }
+    }
+  return x;
+}
+
+/* Joins the subtrees l and r, with black roots and black heights hl and hr,
+   using k as the middle node.  Every node in l must be less than k and
+   every node in r greater.  Returns the new root and stores its black
+   height in *hp.  The cost is O(|hl - hr|).  */
+static struct rb_node *
+rb_join_node (struct rb_node *l, int hl, struct rb_node *k, struct rb_node *r,
+              int hr, int *hp)
+{
+  struct rb_root tree;
+  struct rb_node *c;
+  struct rb_node *p = NULL;
+  int h;
+
+  if (hl == hr)
+    {
+      k->rb_left = l;
+      if (l)
+        l->rb_parent = k;
+      k->rb_right = r;
+      if (r)
+        r->rb_parent = k;
+      k->rb_parent = NULL;
+      k->rb_is_black = true;
+      *hp = hl + 1;
+      return k;
+    }
+
+  /* Descend the spine of the taller tree to a black node with the black
+     height of the shorter one, and hang k there as a red node.  */
+  if (hl > hr)
+    {
+      c = l;
+      h = hl;
+      while (c != NULL && (!c->rb_is_black || h > hr))
+        {
+          h -= c->rb_is_black;
+          p = c;
+          c = c->rb_right;
+        }
+      p->rb_right = k;
+      tree.rb_node = l;
+      h = hl;
+    }
+  else
+    {
+      c = r;
+      h = hr;
+      while (c != NULL && (!c->rb_is_black || h > hl))
+        {
+          h -= c->rb_is_black;
+          p = c;
+          c = c->rb_left;
+        }
+      p->rb_left = k;
+      tree.rb_node = r;
+      h = hr;
+    }
+
+  k->rb_parent = p;
+  k->rb_left = hl > hr ? c : l;
+  k->rb_right = hl > hr ? r : c;
+  if (k->rb_left)
+    k->rb_left->rb_parent = k;
+  if (k->rb_right)
+    k->rb_right->rb_parent = k;
+  k->rb_is_black = false;
+
+  *hp = h + rb_insert_fixup (k, &tree, false);
+  return tree.rb_node;
+}
+
+/* Same as rb_join_node without a middle node. */
+static struct rb_node *
+rb_concat_node (struct rb_node *l, int hl, struct rb_node *r, int hr,
+                int *hp)
+{
+  struct rb_root tree;
+  struct rb_node *k;
+
+  if (l == NULL)
+    {
+      *hp = hr;
+      return r;
+    }
+  if (r == NULL)
+    {
+      *hp = hl;
+      return l;
+    }
+
+  tree.rb_node = l;
+  k = rb_max (l);
+  rb_erase (k, &tree);
+  l = tree.rb_node;
+  hl = rb_black_height_of (l);
+  return rb_join_node (l, hl, k, r, hr, hp);
+}
+
+/* Splits the subtree t of black height h into nodes that compare less than
+   key and the rest.  If take_equal is set, the first node found to compare
+   equal to key is removed and returned; it goes to the right otherwise.  */
+static struct rb_node *
+rb_split_node (struct rb_node *t, int h, const void *key,
+               int (*comp) (const void *, const struct rb_node *),
+               bool take_equal, struct rb_node **lp, int *hlp,
+               struct rb_node **rp, int *hrp)
+{
+  struct rb_node *left;
+  struct rb_node *right;
+  struct rb_node *mid;
+  struct rb_node *found;
+  int hleft, hright, hmid;
+  int c;
+
+  if (t == NULL)
+    {
+      *lp = *rp = NULL;
+      *hlp = *hrp = 0;
+      return NULL;
+    }
+
+  hleft = hright = h - t->rb_is_black;
+  left = rb_detach (t->rb_left, &hleft);
+  right = rb_detach (t->rb_right, &hright);
+
+  c = comp (key, t);
+  if (c == 0 && take_equal)
+    {
+      *lp = left;
+      *hlp = hleft;
+      *rp = right;
+      *hrp = hright;
+      return t;
+    }
+
+  if (c <= 0)
+    {
+      found = rb_split_node (left, hleft, key, comp, take_equal, lp, hlp,
+                             &mid, &hmid);
+      *rp = rb_join_node (mid, hmid, t, right, hright, hrp);
+    }
+  else
+    {
+      found = rb_split_node (right, hright, key, comp, take_equal, &mid,
+                             &hmid, rp, hrp);
+      *lp = rb_join_node (left, hleft, t, mid, hmid, hlp);
+    }
+  return found;
+}
+
+void
+rb_join (struct rb_root *left, struct rb_node *node, struct rb_root *right,
+         struct rb_root *out)
+{
+  struct rb_node *l = left->rb_node;
+  struct rb_node *r = right->rb_node;
+  int h;
+
+  left->rb_node = NULL;
+  right->rb_node = NULL;
+  out->rb_node = rb_join_node (l, rb_black_height_of (l), node, r,
+                               rb_black_height_of (r), &h);
+}
+
+void
+rb_concat (struct rb_root *left, struct rb_root *right, struct rb_root *out)
+{
+  struct rb_node *l = left->rb_node;
+  struct rb_node *r = right->rb_node;
+  int h;
+
+  left->rb_node = NULL;
+  right->rb_node = NULL;
+  out->rb_node
+      = rb_concat_node (l, rb_black_height_of (l), r, rb_black_height_of (r),
+                        &h);
+}
+
+void
+rb_split (struct rb_root *tree, const void *key,
+          int (*comp) (const void *, const struct rb_node *),
+          struct rb_root *left, struct rb_root *right)
+{
+  struct rb_node *t = tree->rb_node;
+  struct rb_node *l;
+  struct rb_node *r;
+  int hl, hr;
+
+  tree->rb_node = NULL;
+  rb_split_node (t, rb_black_height_of (t), key, comp, false, &l, &hl, &r,
+                 &hr);
+  left->rb_node = l;
+  right->rb_node = r;
+}
+
+/* Set operations only hand a subproblem to another thread when the black
+   heights of its trees add up to at least this, about 2^10 nodes each.  */
+#define RB_SETOP_PAR_HEIGHT 12
+
+enum rb_setop_kind
+{
+  RB_UNION,
+  RB_INTERSECTION,
+  RB_DIFFERENCE,
+};
+
+struct rb_setop
+{
+  enum rb_setop_kind kind;
+  int (*cmp) (const struct rb_node *, const struct rb_node *);
+  void (*drop) (struct rb_node *);
+};
+
+/* the key passed to rb_split_node by set operations */
+struct rb_setop_key
+{
+  const struct rb_setop *op;
+  const struct rb_node *node;
+};
+
+static int
+rb_setop_comp (const void *key, const struct rb_node *node)
+{
+  const struct rb_setop_key *k = key;
+  return k->op->cmp (k->node, node);
+}
+
+static void
+rb_setop_drop_all (const struct rb_setop *op, struct rb_node *t)
+{
+  struct rb_node *pos;
+  struct rb_node *n;
+  struct rb_root tree = { t };
+
+  if (op->drop == NULL)
+    return;
+  rb_for_each_postorder_safe (pos, n, &tree)
+    op->drop (pos);
+}
+
+struct rb_setop_task
+{
+  const struct rb_setop *op;
+  struct rb_node *a;
+  int ha;
+  struct rb_node *b;
+  int hb;
+  unsigned int nthreads;
+  struct rb_node *result;
+  int height;
+};
+
+static void rb_setop_run (struct rb_setop_task *task);
+
+static void *
+rb_setop_thread (void *arg)
+{
+  rb_setop_run (arg);
+  return NULL;
+}
+
+/* The join-based algorithms of Blelloch, Ferizovic and Sun: split a at the
+   root of b, recurse on both halves, then join the results back with the
+   root of b.  The two recursive calls are independent and run on
+   different threads while nthreads allows it.  */
+static void
+rb_setop_run (struct rb_setop_task *task)
+{
+  const struct rb_setop *op = task->op;
+  struct rb_setop_task lt;
+  struct rb_setop_task rt;
+  struct rb_setop_key key;
+  struct rb_node *k = task->b;
+  struct rb_node *found;
+  pthread_t thread;
+  bool threaded = false;
+
+  if (task->a == NULL || task->b == NULL)
+    {
+      switch (op->kind)
+        {
+        case RB_UNION:
+          task->result = task->a ? task->a : task->b;
+          task->height = task->a ? task->ha : task->hb;
+          break;
+        case RB_INTERSECTION:
+          rb_setop_drop_all (op, task->a);
+          rb_setop_drop_all (op, task->b);
+          task->result = NULL;
+          task->height = 0;
+          break;
+        case RB_DIFFERENCE:
+          rb_setop_drop_all (op, task->b);
+          task->result = task->a;
+          task->height = task->ha;
+          break;
+        }
+      return;
+    }
+
+  lt.op = rt.op = op;
+  lt.hb = rt.hb = task->hb - k->rb_is_black;
+  lt.b = rb_detach (k->rb_left, &lt.hb);
+  rt.b = rb_detach (k->rb_right, &rt.hb);
+
+  key.op = op;
+  key.node = k;
+  found = rb_split_node (task->a, task->ha, &key, rb_setop_comp, true, &lt.a,
+                         &lt.ha, &rt.a, &rt.ha);
+
+  if (task->nthreads > 1 && task->ha + task->hb >= RB_SETOP_PAR_HEIGHT)
+    {
+      lt.nthreads = task->nthreads / 2;
+      rt.nthreads = task->nthreads - lt.nthreads;
+      threaded = pthread_create (&thread, NULL, rb_setop_thread, &lt) == 0;
+    }
+  if (!threaded)
+    {
+      lt.nthreads = rt.nthreads = task->nthreads;
+      rb_setop_run (&lt);
+    }
+  rb_setop_run (&rt);
+  if (threaded)
+    pthread_join (thread, NULL);
+
+  if (found && op->drop)
+    op->drop (found);
+
+  if (op->kind == RB_UNION || (op->kind == RB_INTERSECTION && found))
+    task->result = rb_join_node (lt.result, lt.height, k, rt.result,
+                                 rt.height, &task->height);
+  else
+    {
+      if (op->drop)
+        op->drop (k);
+      task->result = rb_concat_node (lt.result, lt.height, rt.result,
+                                     rt.height, &task->height);
+    }
+}
+
+static void
+rb_setop (enum rb_setop_kind kind, struct rb_root *a, struct rb_root *b,
+          int (*cmp) (const struct rb_node *, const struct rb_node *),
+          void (*drop) (struct rb_node *), unsigned int nthreads,
+          struct rb_root *out)
+{
+  struct rb_setop op = { kind, cmp, drop };
+  struct rb_setop_task task;
+
+  task.op = &op;
+  task.a = a->rb_node;
+  task.ha = rb_black_height_of (task.a);
+  task.b = b->rb_node;
+  task.hb = rb_black_height_of (task.b);
+  task.nthreads = nthreads ? nthreads : 1;
+  a->rb_node = NULL;
+  b->rb_node = NULL;
+
+  rb_setop_run (&task);
+  out->rb_node = task.result;
+}
+
+void
+rb_union (struct rb_root *a, struct rb_root *b,
+          int (*cmp) (const struct rb_node *, const struct rb_node *),
+          void (*drop) (struct rb_node *), unsigned int nthreads,
+          struct rb_root *out)
+{
+  rb_setop (RB_UNION, a, b, cmp, drop, nthreads, out);
+}
+
+void
+rb_intersection (struct rb_root *a, struct rb_root *b,
+                 int (*cmp) (const struct rb_node *, const struct rb_node *),
+                 void (*drop) (struct rb_node *), unsigned int nthreads,
+                 struct rb_root *out)
+{
+  rb_setop (RB_INTERSECTION, a, b, cmp, drop, nthreads, out);
+}
+
+void
+rb_difference (struct rb_root *a, struct rb_root *b,
+               int (*cmp) (const struct rb_node *, const struct rb_node *),
+               void (*drop) (struct rb_node *), unsigned int nthreads,
+               struct rb_root *out)
+{
+  rb_setop (RB_DIFFERENCE, a, b, cmp, drop, nthreads, out);
+}
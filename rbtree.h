@@ -131,6 +131,45 @@ rb_last (const struct rb_root *tree)
   return rb_max (tree->rb_node);
 }
 
+/* Returns the first node in post-order, i.e. the deepest leftmost node. */
+static inline struct rb_node *
+rb_left_deepest (const struct rb_node *x)
+{
+  for (;;)
+    {
+      if (x->rb_left != NULL)
+        x = x->rb_left;
+      else if (x->rb_right != NULL)
+        x = x->rb_right;
+      else
+        return (struct rb_node *)x;
+    }
+}
+
+static inline struct rb_node *
+rb_first_postorder (const struct rb_root *tree)
+{
+  if (tree->rb_node == NULL)
+    return NULL;
+  return rb_left_deepest (tree->rb_node);
+}
+
+/* Returns the node after x in post-order.  Children come before their
+   parent, so x may be freed once the next node has been computed.  */
+static inline struct rb_node *
+rb_next_postorder (const struct rb_node *x)
+{
+  struct rb_node *p;
+
+  if (x == NULL)
+    return NULL;
+
+  p = x->rb_parent;
+  if (p != NULL && p->rb_left == x && p->rb_right != NULL)
+    return rb_left_deepest (p->rb_right);
+  return p;
+}
+
 /* Link node x to parent. */
 static inline void
 rb_link_node (struct rb_node *x, struct rb_node *parent, struct rb_node **link)
@@ -141,6 +180,18 @@ rb_link_node (struct rb_node *x, struct rb_node *parent, struct rb_node **link)
   x->rb_is_black = false;
 }
 
+/* Like rb_link_node, but initializes x before publishing it with a release
+   store, for trees walked by lockless readers.  */
+static inline void
+rb_link_node_rcu (struct rb_node *x, struct rb_node *parent,
+                  struct rb_node **link)
+{
+  x->rb_parent = parent;
+  x->rb_left = x->rb_right = NULL;
+  x->rb_is_black = false;
+  __atomic_store_n (link, x, __ATOMIC_RELEASE);
+}
+
 static inline bool
 rb_empty (const struct rb_root *tree)
 {
@@ -174,6 +225,27 @@ rb_empty (const struct rb_root *tree)
               && ((n) = rb_next_entry (pos, member)));			\
        (pos); (void)(((pos) = (n)) && ((n) = rb_next_entry (pos, member))))
 
+#define rb_first_postorder_entry(type, tree, member)		\
+  rb_entry_safe (rb_first_postorder (tree), type, member)
+
+#define rb_next_postorder_entry(pos, member)				\
+  rb_entry_safe (rb_next_postorder (&(pos)->member), typeof (*pos), member)
+
+/* Post-order iteration, which allows pos to be freed in the body.  This
+   does not rebalance, so the tree must be discarded afterwards.  */
+#define rb_for_each_postorder_safe(pos, n, tree)			\
+  for ((void)(((pos) = rb_first_postorder (tree))			\
+	      && ((n) = rb_next_postorder (pos)));			\
+       (pos) != NULL;							\
+       (void)(((pos) = (n)) && ((n) = rb_next_postorder (pos))))
+
+#define rb_for_each_entry_postorder_safe(pos, n, tree, member)		\
+  for ((void)(((pos) = rb_first_postorder_entry (typeof (*pos), tree,	\
+                                                 member))		\
+              && ((n) = rb_next_postorder_entry (pos, member)));	\
+       (pos);								\
+       (void)(((pos) = (n)) && ((n) = rb_next_postorder_entry (pos, member))))
+
 #define rb_for_each_equal(pos, key, tree, compare)		\
   for ((pos) = rb_find (key, tree, compare); (pos) != NULL;	\
        (pos) = rb_find_next (pos, key, compare))
@@ -184,10 +256,90 @@ rb_empty (const struct rb_root *tree)
        (pos) != NULL;							\
        (pos) = (n), (n) = rb_find_next ((pos), (key), (compare)))
 
+/* Iterates over nodes in [first, last] with a single descent. */
+#define rb_for_each_in_range(pos, first, last, tree, compare)		\
+  for ((pos) = rb_lower_bound (first, tree, compare);			\
+       (pos) != NULL && (compare) (last, pos) >= 0;			\
+       (pos) = rb_next ((pos)))
+
+#define rb_for_each_entry_in_range(pos, first, last, tree, compare, member) \
+  for ((pos) = rb_entry_safe (rb_lower_bound (first, tree, compare),	\
+                              typeof (*pos), member);			\
+       (pos) != NULL && (compare) (last, &(pos)->member) >= 0;		\
+       (pos) = rb_next_entry (pos, member))
+
+/* Empties the tree in O(n) without rebalancing, passing every node to
+   free_fn in post-order.  */
+void rb_destroy (struct rb_root *root, void (*free_fn) (struct rb_node *));
+
+/* Joins left, node and right into out in O(log n).  Every node in left must
+   be less than node, and every node in right greater.  left and right are
+   left empty; out may be either of them.  */
+void rb_join (struct rb_root *left, struct rb_node *node,
+              struct rb_root *right, struct rb_root *out);
+
+/* Same as rb_join without a middle node. */
+void rb_concat (struct rb_root *left, struct rb_root *right,
+                struct rb_root *out);
+
+/* Moves the nodes of tree that compare less than key to left and the rest
+   to right in O(log n).  tree is left empty and may be left or right.  */
+void rb_split (struct rb_root *tree, const void *key,
+               int (*comp) (const void *, const struct rb_node *),
+               struct rb_root *left, struct rb_root *right);
+
+/* Set operations on trees without duplicate nodes, using the join-based
+   algorithms of Blelloch et al.  a and b are consumed and the result is
+   stored in out.  When both trees contain equal nodes, the node from b is
+   kept.  Every node left out of the result is passed to drop, if it is not
+   NULL.  Up to nthreads threads work on independent subtrees, so drop must
+   be thread-safe when nthreads > 1.  */
+void rb_union (struct rb_root *a, struct rb_root *b,
+               int (*cmp) (const struct rb_node *, const struct rb_node *),
+               void (*drop) (struct rb_node *), unsigned int nthreads,
+               struct rb_root *out);
+
+void rb_intersection (struct rb_root *a, struct rb_root *b,
+                      int (*cmp) (const struct rb_node *,
+                                  const struct rb_node *),
+                      void (*drop) (struct rb_node *), unsigned int nthreads,
+                      struct rb_root *out);
+
+/* Keeps the nodes of a that are not in b. */
+void rb_difference (struct rb_root *a, struct rb_root *b,
+                    int (*cmp) (const struct rb_node *,
+                                const struct rb_node *),
+                    void (*drop) (struct rb_node *), unsigned int nthreads,
+                    struct rb_root *out);
+
+/* Maximum height of a red-black tree with 2^64 nodes. */
+#define RB_MAX_HEIGHT 128
+
+/* Number of nodes passed to a rb_walk callback at once. */
+#define RB_WALK_BATCH 32
+
+/* Visits all nodes in order, passing them to fn up to RB_WALK_BATCH at a
+   time.  Unlike rb_next, the walk keeps the path in a local stack instead of
+   climbing parent pointers, and prefetches each right subtree as soon as its
+   parent is reached.  fn must not modify the tree.  The walk stops when fn
+   returns nonzero, and that value is returned.  */
+int rb_walk (struct rb_root *root,
+             int (*fn) (struct rb_node **nodes, size_t n, void *arg),
+             void *arg);
+
 void rb_balance_insert (struct rb_node *x, struct rb_root *root);
 
 void rb_erase (struct rb_node *x, struct rb_root *root);
 
+/* Like rb_balance_insert and rb_erase, but every child pointer is stored
+   with release semantics.  A reader that loads child pointers with acquire
+   semantics, like the latch tree, never sees a torn pointer or a node
+   whose contents are not yet visible.  The tree may still be inconsistent
+   during the update, so such readers need a way to retry.  */
+void rb_balance_insert_rcu (struct rb_node *x, struct rb_root *root);
+
+void rb_erase_rcu (struct rb_node *x, struct rb_root *root);
+
 void rb_replace_node (struct rb_node *old, struct rb_node *__restrict new_node,
                       struct rb_root *tree);
 
@@ -248,6 +400,48 @@ rb_find_next (const struct rb_node *node, const void *__restrict key,
   return next;
 }
 
+/* Returns the first node that does not compare less than key. */
+static inline struct rb_node *
+rb_lower_bound (const void *__restrict key, struct rb_root *root,
+                int (*comp) (const void *, const struct rb_node *))
+{
+  struct rb_node *node = root->rb_node;
+  struct rb_node *result = NULL;
+
+  while (node != NULL)
+    {
+      if (comp (key, node) <= 0)
+        {
+          result = node;
+          node = node->rb_left;
+        }
+      else
+        node = node->rb_right;
+    }
+  return result;
+}
+
+/* Returns the first node that compares greater than key. */
+static inline struct rb_node *
+rb_upper_bound (const void *__restrict key, struct rb_root *root,
+                int (*comp) (const void *, const struct rb_node *))
+{
+  struct rb_node *node = root->rb_node;
+  struct rb_node *result = NULL;
+
+  while (node != NULL)
+    {
+      if (comp (key, node) < 0)
+        {
+          result = node;
+          node = node->rb_left;
+        }
+      else
+        node = node->rb_right;
+    }
+  return result;
+}
+
 static inline struct rb_node *
 rb_find_or_insert (const void *__restrict key, struct rb_root *root,
 		   struct rb_node *__restrict node,
@@ -274,6 +468,137 @@ rb_find_or_insert (const void *__restrict key, struct rb_root *root,
   return NULL;
 }
 
+/* Compares two scalar keys for RB_DECLARE. */
+#define RB_CMP_NUMERIC(a, b) (((a) > (b)) - ((a) < (b)))
+
+/* Declares a tree of type with an rb_node in member, and typed functions
+   that compare keys directly instead of through a function pointer.
+
+   key_expr (obj) yields the key of a const type *, and cmp_expr (a, b)
+   compares two keys, returning a negative, zero or positive int.  Either
+   may be a function or a function-like macro.  The generated functions
+   are:
+
+     type *name_find (struct rb_root *root, name_key_t key);
+     type *name_lower_bound (struct rb_root *root, name_key_t key);
+     type *name_upper_bound (struct rb_root *root, name_key_t key);
+     type *name_insert (struct rb_root *root, type *obj);
+     void name_add (struct rb_root *root, type *obj);
+     void name_erase (struct rb_root *root, type *obj);
+
+   name_insert returns the object already holding an equal key, or NULL
+   once obj has been inserted.  name_add inserts obj after any equal keys,
+   like rb_add.  */
+#define RB_DECLARE(name, type, member, key_expr, cmp_expr)		\
+  typedef __typeof__ (key_expr ((const type *)0)) name##_key_t;		\
+									\
+  static inline type *							\
+  name##_find (struct rb_root *root, name##_key_t key)			\
+  {									\
+    struct rb_node *node = root->rb_node;				\
+									\
+    while (node != NULL)						\
+      {									\
+	int c = cmp_expr (key, key_expr (rb_entry (node, type, member))); \
+									\
+	if (__builtin_expect (c == 0, 0))				\
+	  return rb_entry (node, type, member);				\
+	node = c < 0 ? node->rb_left : node->rb_right;			\
+      }									\
+    return NULL;							\
+  }									\
+									\
+  static inline type *							\
+  name##_lower_bound (struct rb_root *root, name##_key_t key)		\
+  {									\
+    struct rb_node *node = root->rb_node;				\
+    struct rb_node *result = NULL;					\
+									\
+    while (node != NULL)						\
+      {									\
+	if (cmp_expr (key, key_expr (rb_entry (node, type, member))) <= 0) \
+	  {								\
+	    result = node;						\
+	    node = node->rb_left;					\
+	  }								\
+	else								\
+	  node = node->rb_right;					\
+      }									\
+    return rb_entry_safe (result, type, member);			\
+  }									\
+									\
+  static inline type *							\
+  name##_upper_bound (struct rb_root *root, name##_key_t key)		\
+  {									\
+    struct rb_node *node = root->rb_node;				\
+    struct rb_node *result = NULL;					\
+									\
+    while (node != NULL)						\
+      {									\
+	if (cmp_expr (key, key_expr (rb_entry (node, type, member))) < 0) \
+	  {								\
+	    result = node;						\
+	    node = node->rb_left;					\
+	  }								\
+	else								\
+	  node = node->rb_right;					\
+      }									\
+    return rb_entry_safe (result, type, member);			\
+  }									\
+									\
+  static inline type *							\
+  name##_insert (struct rb_root *root, type *obj)			\
+  {									\
+    name##_key_t key = key_expr (obj);					\
+    struct rb_node *parent = NULL;					\
+    struct rb_node **link = &root->rb_node;				\
+									\
+    while (*link != NULL)						\
+      {									\
+	int c;								\
+									\
+	parent = *link;							\
+	c = cmp_expr (key, key_expr (rb_entry (parent, type, member)));	\
+	if (c < 0)							\
+	  link = &parent->rb_left;					\
+	else if (c > 0)							\
+	  link = &parent->rb_right;					\
+	else								\
+	  return rb_entry (parent, type, member);			\
+      }									\
+									\
+    rb_link_node (&obj->member, parent, link);				\
+    rb_balance_insert (&obj->member, root);				\
+    return NULL;							\
+  }									\
+									\
+  static inline void							\
+  name##_add (struct rb_root *root, type *obj)				\
+  {									\
+    name##_key_t key = key_expr (obj);					\
+    struct rb_node *parent = NULL;					\
+    struct rb_node **link = &root->rb_node;				\
+									\
+    while (*link != NULL)						\
+      {									\
+	parent = *link;							\
+	if (cmp_expr (key, key_expr (rb_entry (parent, type, member))) < 0) \
+	  link = &parent->rb_left;					\
+	else								\
+	  link = &parent->rb_right;					\
+      }									\
+									\
+    rb_link_node (&obj->member, parent, link);				\
+    rb_balance_insert (&obj->member, root);				\
+  }									\
+									\
+									\
+  static inline void							\
+  name##_erase (struct rb_root *root, type *obj)			\
+  {									\
+    rb_erase (&obj->member, root);					\
+  }
+
 C_DECL_END
 
 #endif // !RBTREE_H
@@ -0,0 +1,103 @@
+/* rcu.c
+ *
+ * Copyright 2026 Zhengyi Fu <i@fuzy.me>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "rcu.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+
+unsigned long rcu_gp_ctr = 1;
+__thread struct rcu_reader rcu_reader;
+
+/* all registered readers, protected by rcu_registry_lock */
+static struct rcu_reader *rcu_registry;
+static pthread_mutex_t rcu_registry_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t rcu_exit_key;
+static pthread_once_t rcu_exit_once = PTHREAD_ONCE_INIT;
+
+static void
+rcu_unregister_thread (void *arg)
+{
+  struct rcu_reader *self = arg;
+  struct rcu_reader **link;
+
+  pthread_mutex_lock (&rcu_registry_lock);
+  for (link = &rcu_registry; *link != NULL; link = &(*link)->next)
+    {
+      if (*link == self)
+        {
+          *link = self->next;
+          break;
+        }
+    }
+  pthread_mutex_unlock (&rcu_registry_lock);
+  self->registered = false;
+}
+
+static void
+rcu_init_exit_key (void)
+{
+  if (pthread_key_create (&rcu_exit_key, rcu_unregister_thread) != 0)
+    abort ();
+}
+
+void
+rcu_register_thread (void)
+{
+  pthread_once (&rcu_exit_once, rcu_init_exit_key);
+
+  pthread_mutex_lock (&rcu_registry_lock);
+  rcu_reader.next = rcu_registry;
+  rcu_registry = &rcu_reader;
+  rcu_reader.registered = true;
+  pthread_mutex_unlock (&rcu_registry_lock);
+
+  /* unregister when the thread exits */
+  pthread_setspecific (rcu_exit_key, &rcu_reader);
+}
+
+void
+synchronize_rcu (void)
+{
+  struct rcu_reader *r;
+  unsigned long gp;
+
+  pthread_mutex_lock (&rcu_registry_lock);
+
+  /* Readers entering from now on see the new counter and cannot reach
+     what the caller unpublished, so only older ones are waited for.  */
+  __atomic_thread_fence (__ATOMIC_SEQ_CST);
+  gp = __atomic_add_fetch (&rcu_gp_ctr, 1, __ATOMIC_SEQ_CST);
+
+  for (r = rcu_registry; r != NULL; r = r->next)
+    {
+      for (;;)
+        {
+          unsigned long ctr = __atomic_load_n (&r->ctr, __ATOMIC_ACQUIRE);
+
+          if (ctr == 0 || ctr >= gp)
+            break;
+          sched_yield ();
+        }
+    }
+
+  pthread_mutex_unlock (&rcu_registry_lock);
+  __atomic_thread_fence (__ATOMIC_SEQ_CST);
+}
@@ -0,0 +1,85 @@
+/* rcu.h
+ *
+ * Copyright 2026 Zhengyi Fu <i@fuzy.me>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef RCU_H
+#define RCU_H
+
+#include <stdbool.h>
+
+#include "defs.h"
+
+C_DECL_BEGIN
+
+/* A minimal userspace read-copy-update.
+
+   Readers bracket their accesses with rcu_read_lock and rcu_read_unlock,
+   which only touch a per-thread counter.  A writer unpublishes an object,
+   calls synchronize_rcu to wait until every reader that might still see it
+   has left its critical section, and then frees it.  Threads register
+   themselves on their first rcu_read_lock.  */
+
+struct rcu_reader
+{
+  /* grace period counter seen when entering, 0 when outside */
+  unsigned long ctr;
+  unsigned int nesting;
+  bool registered;
+  struct rcu_reader *next;
+};
+
+extern unsigned long rcu_gp_ctr;
+extern __thread struct rcu_reader rcu_reader;
+
+void rcu_register_thread (void);
+
+static inline void
+rcu_read_lock (void)
+{
+  if (rcu_reader.nesting++ != 0)
+    return;
+  if (!rcu_reader.registered)
+    rcu_register_thread ();
+  __atomic_store_n (&rcu_reader.ctr,
+                    __atomic_load_n (&rcu_gp_ctr, __ATOMIC_RELAXED),
+                    __ATOMIC_RELAXED);
+  /* order the counter store before any load in the critical section */
+  __atomic_thread_fence (__ATOMIC_SEQ_CST);
+}
+
+static inline void
+rcu_read_unlock (void)
+{
+  if (--rcu_reader.nesting == 0)
+    __atomic_store_n (&rcu_reader.ctr, 0, __ATOMIC_RELEASE);
+}
+
+/* Waits until all readers that entered before the call have left.
+   Must not be called inside a read-side critical section.  */
+void synchronize_rcu (void);
+
+/* Loads a pointer published with rcu_assign_pointer. */
+#define rcu_dereference(p) __atomic_load_n (&(p), __ATOMIC_ACQUIRE)
+
+/* Publishes a pointer after the object it points to is initialized. */
+#define rcu_assign_pointer(p, v) __atomic_store_n (&(p), (v), __ATOMIC_RELEASE)
+
+C_DECL_END
+
+#endif // !RCU_H
@@ -0,0 +1,272 @@
+/* Copyright © 2026  Zhengyi Fu <i@fuzy.me> */
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Measures throughput of the concurrent skip list against an rbtree
+   behind a pthread_rwlock for 1 to 64 threads.  Each thread performs a mix
+   of lookups, inserts and removals on a shared key range.  */
+
+#include "bench.h"
+#include "rbtree.h"
+#include "skiplist.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define KEY_RANGE (1 << 20)
+#define RETIRE_BATCH 256
+
+struct sl_item
+{
+  uint64_t key;
+  struct sl_node node;
+};
+
+struct rb_item
+{
+  uint64_t key;
+  struct rb_node node;
+};
+
+static struct skiplist sl;
+static struct rb_root rb_root = RB_ROOT_INIT;
+static pthread_rwlock_t rb_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static unsigned long ops_per_thread = 200000;
+static unsigned int update_percent = 10;
+
+static int
+sl_item_comp (const void *key, const struct sl_node *node)
+{
+  uint64_t k = *(const uint64_t *)key;
+  uint64_t nk = sl_entry (node, struct sl_item, node)->key;
+
+  return k < nk ? -1 : k > nk;
+}
+
+static bool
+rb_item_less (const struct rb_node *a, const struct rb_node *b)
+{
+  return rb_entry (a, struct rb_item, node)->key
+         < rb_entry (b, struct rb_item, node)->key;
+}
+
+static int
+rb_item_comp (const void *key, const struct rb_node *node)
+{
+  uint64_t k = *(const uint64_t *)key;
+  uint64_t nk = rb_entry (node, struct rb_item, node)->key;
+
+  return k < nk ? -1 : k > nk;
+}
+
+static struct sl_item *
+sl_item_new (uint64_t key)
+{
+  int level = sl_random_level ();
+  struct sl_item *it = malloc (sizeof (*it) + sl_tower_size (level));
+
+  if (!it)
+    abort ();
+  it->key = key;
+  sl_node_init (&it->node, level);
+  return it;
+}
+
+static void *
+sl_worker (void *arg)
+{
+  uint64_t state = (uintptr_t)arg * 0x9E3779B97F4A7C15ull + 1;
+  struct sl_item *retired[RETIRE_BATCH];
+  unsigned long hits = 0;
+  unsigned int nretired = 0;
+  unsigned long i;
+
+  for (i = 0; i < ops_per_thread; ++i)
+    {
+      uint64_t r = bench_rand (&state);
+      uint64_t key = (r >> 8) % KEY_RANGE;
+      unsigned int op = r % 100;
+
+      if (op >= update_percent)
+        {
+          rcu_read_lock ();
+          hits += sl_find (&key, &sl, sl_item_comp) != NULL;
+          rcu_read_unlock ();
+        }
+      else if (op % 2 == 0)
+        {
+          struct sl_item *it = sl_item_new (key);
+
+          if (sl_find_or_insert (&key, &sl, &it->node, sl_item_comp))
+            free (it);
+        }
+      else
+        {
+          struct sl_node *node = sl_erase (&key, &sl, sl_item_comp);
+
+          if (node == NULL)
+            continue;
+          /* amortize the grace period over a batch of removals */
+          retired[nretired++] = sl_entry (node, struct sl_item, node);
+          if (nretired == RETIRE_BATCH)
+            {
+              synchronize_rcu ();
+              while (nretired > 0)
+                free (retired[--nretired]);
+            }
+        }
+    }
+
+  synchronize_rcu ();
+  while (nretired > 0)
+    free (retired[--nretired]);
+  return (void *)hits;
+}
+
+static void *
+rb_worker (void *arg)
+{
+  uint64_t state = (uintptr_t)arg * 0x9E3779B97F4A7C15ull + 1;
+  unsigned long hits = 0;
+  unsigned long i;
+
+  for (i = 0; i < ops_per_thread; ++i)
+    {
+      uint64_t r = bench_rand (&state);
+      uint64_t key = (r >> 8) % KEY_RANGE;
+      unsigned int op = r % 100;
+
+      if (op >= update_percent)
+        {
+          pthread_rwlock_rdlock (&rb_lock);
+          hits += rb_find (&key, &rb_root, rb_item_comp) != NULL;
+          pthread_rwlock_unlock (&rb_lock);
+        }
+      else if (op % 2 == 0)
+        {
+          struct rb_item *it = malloc (sizeof (*it));
+
+          if (!it)
+            abort ();
+          it->key = key;
+          pthread_rwlock_wrlock (&rb_lock);
+          if (rb_find (&key, &rb_root, rb_item_comp) == NULL)
+            {
+              rb_add (&it->node, &rb_root, rb_item_less);
+              it = NULL;
+            }
+          pthread_rwlock_unlock (&rb_lock);
+          free (it);
+        }
+      else
+        {
+          struct rb_node *node;
+
+          pthread_rwlock_wrlock (&rb_lock);
+          node = rb_find (&key, &rb_root, rb_item_comp);
+          if (node)
+            rb_erase (node, &rb_root);
+          pthread_rwlock_unlock (&rb_lock);
+          if (node)
+            free (rb_entry (node, struct rb_item, node));
+        }
+    }
+  return (void *)hits;
+}
+
+static double
+run (void *(*worker) (void *), int nthreads)
+{
+  pthread_t threads[64];
+  double t = bench_now ();
+  int i;
+
+  for (i = 0; i < nthreads; ++i)
+    if (pthread_create (&threads[i], NULL, worker, (void *)(uintptr_t)i))
+      abort ();
+  for (i = 0; i < nthreads; ++i)
+    pthread_join (threads[i], NULL);
+  return (double)ops_per_thread * nthreads / (bench_now () - t) * 1e3;
+}
+
+static void
+populate (void)
+{
+  uint64_t key;
+
+  sl_init (&sl);
+  for (key = 0; key < KEY_RANGE; key += 2)
+    {
+      struct sl_item *s = sl_item_new (key);
+      struct rb_item *r = malloc (sizeof (*r));
+
+      if (!r)
+        abort ();
+      r->key = key;
+      sl_find_or_insert (&key, &sl, &s->node, sl_item_comp);
+      rb_add (&r->node, &rb_root, rb_item_less);
+    }
+}
+
+static void
+teardown (void)
+{
+  struct sl_node *pos = sl.sl_head.sl_next[0];
+  struct rb_item *item, *tmp;
+
+  while (pos)
+    {
+      struct sl_node *next = pos->sl_next[0];
+
+      free (sl_entry (pos, struct sl_item, node));
+      pos = next;
+    }
+  rb_for_each_entry_postorder_safe (item, tmp, &rb_root, node)
+    free (item);
+}
+
+int
+main (int argc, char *argv[])
+{
+  int nthreads;
+
+  if (argc > 3)
+    {
+      fprintf (stderr, "Usage: %s [ops-per-thread] [update-percent]\n",
+               argv[0]);
+      return 1;
+    }
+  if (argc >= 2)
+    ops_per_thread = strtoul (argv[1], NULL, 0);
+  if (argc == 3)
+    update_percent = strtoul (argv[2], NULL, 0);
+
+  populate ();
+  printf ("%d keys, %lu ops/thread, %u%% updates\n", KEY_RANGE / 2,
+          ops_per_thread, update_percent);
+  printf ("%-8s %14s %14s\n", "threads", "skiplist", "rbtree+rwlock");
+  for (nthreads = 1; nthreads <= 64; nthreads *= 2)
+    {
+      double s = run (sl_worker, nthreads);
+      double r = run (rb_worker, nthreads);
+
+      printf ("%-8d %9.2f Mops %9.2f Mops\n", nthreads, s, r);
+    }
+  teardown ();
+  return 0;
+}
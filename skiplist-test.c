@@ -0,0 +1,428 @@
+/* Copyright © 2026  Zhengyi Fu <i@fuzy.me> */
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "skiplist.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "test.h"
+
+struct item
+{
+  uint64_t key;
+  struct sl_node node;
+};
+
+static int
+item_comp (const void *key, const struct sl_node *node)
+{
+  uint64_t k = *(const uint64_t *)key;
+  uint64_t nk = sl_entry (node, struct item, node)->key;
+
+  return k < nk ? -1 : k > nk;
+}
+
+static struct item *
+item_new (uint64_t key)
+{
+  int level = sl_random_level ();
+  struct item *it = malloc (sizeof (*it) + sl_tower_size (level));
+
+  if (!it)
+    abort ();
+  it->key = key;
+  sl_node_init (&it->node, level);
+  return it;
+}
+
+static bool
+insert_key (struct skiplist *sl, uint64_t key)
+{
+  struct item *it = item_new (key);
+
+  if (sl_find_or_insert (&key, sl, &it->node, item_comp) != NULL)
+    {
+      free (it);
+      return false;
+    }
+  return true;
+}
+
+static bool
+erase_key (struct skiplist *sl, uint64_t key)
+{
+  struct sl_node *node = sl_erase (&key, sl, item_comp);
+
+  if (node == NULL)
+    return false;
+  synchronize_rcu ();
+  free (sl_entry (node, struct item, node));
+  return true;
+}
+
+static bool
+has_key (struct skiplist *sl, uint64_t key)
+{
+  bool found;
+
+  rcu_read_lock ();
+  found = sl_find (&key, sl, item_comp) != NULL;
+  rcu_read_unlock ();
+  return found;
+}
+
+/* Checks ordering and tower invariants, returns the number of nodes. */
+static unsigned long
+sl_validate (struct skiplist *sl)
+{
+  struct sl_node *pos, *prev = NULL;
+  unsigned long n = 0;
+  int l;
+
+  sl_for_each (pos, sl)
+    {
+      ASSERT (pos->sl_level >= 1 && pos->sl_level <= SL_MAX_LEVEL);
+      ASSERT (pos->sl_fully_linked && !pos->sl_marked && !pos->sl_lock);
+      if (prev)
+        ASSERT (sl_entry (prev, struct item, node)->key
+                < sl_entry (pos, struct item, node)->key);
+      prev = pos;
+      n++;
+    }
+
+  /* every upper level is a sorted sublist of the level below */
+  for (l = 1; l < SL_MAX_LEVEL; ++l)
+    {
+      struct sl_node *x = sl->sl_head.sl_next[l];
+      struct sl_node *y = sl->sl_head.sl_next[l - 1];
+
+      while (x)
+        {
+          while (y && y != x)
+            y = y->sl_next[l - 1];
+          ASSERT (y == x);
+          ASSERT (x->sl_level > l);
+          x = x->sl_next[l];
+        }
+    }
+  return n;
+}
+
+static void
+sl_destroy (struct skiplist *sl)
+{
+  struct sl_node *pos = sl->sl_head.sl_next[0];
+
+  while (pos)
+    {
+      struct sl_node *next = pos->sl_next[0];
+
+      free (sl_entry (pos, struct item, node));
+      pos = next;
+    }
+  sl_init (sl);
+}
+
+/* ========== TESTS ========== */
+
+TEST (empty_list)
+{
+  struct skiplist sl;
+  uint64_t key = 42;
+
+  sl_init (&sl);
+  ASSERT (sl_first (&sl) == NULL);
+  ASSERT (sl_find (&key, &sl, item_comp) == NULL);
+  ASSERT (sl_lower_bound (&key, &sl, item_comp) == NULL);
+  ASSERT (sl_erase (&key, &sl, item_comp) == NULL);
+  ASSERT (sl_validate (&sl) == 0);
+}
+
+TEST (random_level)
+{
+  unsigned long hist[SL_MAX_LEVEL + 1] = { 0 };
+  int i;
+
+  for (i = 0; i < 100000; ++i)
+    {
+      int level = sl_random_level ();
+
+      ASSERT (level >= 1 && level <= SL_MAX_LEVEL);
+      hist[level]++;
+    }
+  /* roughly three quarters of the towers have height one */
+  ASSERT (hist[1] > 70000 && hist[1] < 80000);
+  ASSERT (hist[2] > hist[3]);
+}
+
+TEST (insert_find)
+{
+  struct skiplist sl;
+  uint64_t k;
+
+  sl_init (&sl);
+  for (k = 0; k < 1000; ++k)
+    ASSERT (insert_key (&sl, k * 3));
+  ASSERT (sl_validate (&sl) == 1000);
+
+  for (k = 0; k < 3000; ++k)
+    {
+      struct sl_node *node = sl_find (&k, &sl, item_comp);
+
+      if (k % 3 == 0)
+        ASSERT (node && sl_entry (node, struct item, node)->key == k);
+      else
+        ASSERT (node == NULL);
+    }
+  sl_destroy (&sl);
+}
+
+TEST (insert_duplicate)
+{
+  struct skiplist sl;
+  struct item *a, *b;
+  uint64_t key = 7;
+
+  sl_init (&sl);
+  a = item_new (key);
+  b = item_new (key);
+  ASSERT (sl_find_or_insert (&key, &sl, &a->node, item_comp) == NULL);
+  ASSERT (sl_find_or_insert (&key, &sl, &b->node, item_comp) == &a->node);
+  ASSERT (sl_validate (&sl) == 1);
+  free (b);
+  sl_destroy (&sl);
+}
+
+TEST (erase)
+{
+  struct skiplist sl;
+  uint64_t k;
+
+  sl_init (&sl);
+  for (k = 0; k < 500; ++k)
+    ASSERT (insert_key (&sl, k));
+  for (k = 0; k < 500; k += 2)
+    ASSERT (erase_key (&sl, k));
+  for (k = 0; k < 500; k += 2)
+    ASSERT (!erase_key (&sl, k));
+  ASSERT (sl_validate (&sl) == 250);
+  for (k = 0; k < 500; ++k)
+    ASSERT (has_key (&sl, k) == (k % 2 == 1));
+
+  /* reinsert after removal */
+  ASSERT (insert_key (&sl, 10));
+  ASSERT (has_key (&sl, 10));
+  ASSERT (sl_validate (&sl) == 251);
+  sl_destroy (&sl);
+}
+
+TEST (range_iteration)
+{
+  struct skiplist sl;
+  struct sl_node *pos;
+  uint64_t k, first, last, expect;
+
+  sl_init (&sl);
+  for (k = 0; k < 200; ++k)
+    ASSERT (insert_key (&sl, k * 10));
+
+  first = 95;
+  last = 300;
+  expect = 100;
+  sl_for_each_in_range (pos, &first, &last, &sl, item_comp)
+    {
+      ASSERT (sl_entry (pos, struct item, node)->key == expect);
+      expect += 10;
+    }
+  ASSERT (expect == 310);
+
+  first = 2000;
+  last = 5000;
+  sl_for_each_in_range (pos, &first, &last, &sl, item_comp)
+    FAIL ("Range past the end is not empty");
+
+  k = 1995;
+  ASSERT (sl_lower_bound (&k, &sl, item_comp) == NULL);
+  k = 0;
+  ASSERT (sl_lower_bound (&k, &sl, item_comp) == sl_first (&sl));
+  sl_destroy (&sl);
+}
+
+TEST (random_operations)
+{
+  enum { N = 4096 };
+  static bool present[N];
+  struct skiplist sl;
+  unsigned long size = 0;
+  int i;
+
+  sl_init (&sl);
+  srand (12345);
+  for (i = 0; i < 100000; ++i)
+    {
+      uint64_t k = rand () % N;
+
+      if (rand () % 2)
+        {
+          ASSERT (insert_key (&sl, k) == !present[k]);
+          size += !present[k];
+          present[k] = true;
+        }
+      else
+        {
+          ASSERT (erase_key (&sl, k) == present[k]);
+          size -= present[k];
+          present[k] = false;
+        }
+      if (i % 9973 == 0)
+        ASSERT (sl_validate (&sl) == size);
+    }
+  ASSERT (sl_validate (&sl) == size);
+  sl_destroy (&sl);
+}
+
+/* Concurrent stress: writers churn disjoint key ranges while readers look
+   up keys that are never removed and walk the list checking its order.  */
+
+#define STRESS_WRITERS 4
+#define STRESS_READERS 4
+#define STRESS_KEYS 2048
+#define STRESS_ROUNDS 20000
+#define STRESS_RETIRE 64
+
+static struct skiplist stress_sl;
+static bool stress_done;
+
+static void *
+stress_writer (void *arg)
+{
+  uintptr_t id = (uintptr_t)arg;
+  struct sl_node *retired[STRESS_RETIRE];
+  unsigned int seed = id + 1;
+  int nretired = 0;
+  int i;
+
+  for (i = 0; i < STRESS_ROUNDS; ++i)
+    {
+      /* odd keys belong to the writers, even keys are permanent */
+      uint64_t k = (rand_r (&seed) % STRESS_KEYS) * STRESS_WRITERS + id;
+      k = k * 2 + 1;
+
+      if (rand_r (&seed) % 2)
+        insert_key (&stress_sl, k);
+      else if ((retired[nretired] = sl_erase (&k, &stress_sl, item_comp)))
+        nretired++;
+
+      /* one grace period for a whole batch of removed nodes */
+      if (nretired == STRESS_RETIRE || i == STRESS_ROUNDS - 1)
+        {
+          synchronize_rcu ();
+          while (nretired > 0)
+            free (sl_entry (retired[--nretired], struct item, node));
+        }
+    }
+  return NULL;
+}
+
+static void *
+stress_reader (void *arg)
+{
+  unsigned int seed = (uintptr_t)arg + 100;
+  unsigned long errors = 0;
+
+  while (!__atomic_load_n (&stress_done, __ATOMIC_ACQUIRE))
+    {
+      uint64_t k = (rand_r (&seed) % STRESS_KEYS) * 2;
+      struct sl_node *pos;
+      uint64_t prev = 0;
+      bool first = true;
+      int steps = 0;
+
+      rcu_read_lock ();
+      if (sl_find (&k, &stress_sl, item_comp) == NULL)
+        errors++;
+      sl_for_each_in_range (pos, &k, &(uint64_t){ k + 64 }, &stress_sl,
+                            item_comp)
+        {
+          uint64_t key = sl_entry (pos, struct item, node)->key;
+
+          if (!first && key <= prev)
+            errors++;
+          prev = key;
+          first = false;
+          if (++steps > 128)
+            break;
+        }
+      rcu_read_unlock ();
+    }
+  return (void *)(uintptr_t)errors;
+}
+
+TEST (concurrent_stress)
+{
+  pthread_t writers[STRESS_WRITERS], readers[STRESS_READERS];
+  uintptr_t i;
+  uint64_t k;
+
+  sl_init (&stress_sl);
+  for (k = 0; k < STRESS_KEYS; ++k)
+    ASSERT (insert_key (&stress_sl, k * 2));
+
+  for (i = 0; i < STRESS_READERS; ++i)
+    ASSERT (pthread_create (&readers[i], NULL, stress_reader, (void *)i)
+            == 0);
+  for (i = 0; i < STRESS_WRITERS; ++i)
+    ASSERT (pthread_create (&writers[i], NULL, stress_writer, (void *)i)
+            == 0);
+  for (i = 0; i < STRESS_WRITERS; ++i)
+    pthread_join (writers[i], NULL);
+  __atomic_store_n (&stress_done, true, __ATOMIC_RELEASE);
+  for (i = 0; i < STRESS_READERS; ++i)
+    {
+      void *errors;
+
+      pthread_join (readers[i], &errors);
+      ASSERT (errors == NULL);
+    }
+
+  ASSERT (sl_validate (&stress_sl) >= STRESS_KEYS);
+  for (k = 0; k < STRESS_KEYS; ++k)
+    ASSERT (has_key (&stress_sl, k * 2));
+  sl_destroy (&stress_sl);
+}
+
+int
+main (void)
+{
+  fprintf (stderr, "=== Skip List Test Suite ===\n\n");
+
+  RUN_TEST (empty_list);
+  RUN_TEST (random_level);
+  RUN_TEST (insert_find);
+  RUN_TEST (insert_duplicate);
+  RUN_TEST (erase);
+  RUN_TEST (range_iteration);
+  RUN_TEST (random_operations);
+  RUN_TEST (concurrent_stress);
+
+  fprintf (stderr, "\n=== Results ===\n");
+  fprintf (stderr, "Passed: %d/%d\n", pass_count, test_count);
+
+  return (pass_count == test_count) ? 0 : 1;
+}
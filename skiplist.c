@@ -0,0 +1,322 @@
+/* skiplist.c
+ *
+ * Copyright 2026 Zhengyi Fu <i@fuzy.me>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "skiplist.h"
+#include <assert.h>
+#include <sched.h>
+#include <stdint.h>
+
+static inline bool
+sl_is_marked (const struct sl_node *x)
+{
+  return __atomic_load_n (&x->sl_marked, __ATOMIC_ACQUIRE);
+}
+
+static inline bool
+sl_is_fully_linked (const struct sl_node *x)
+{
+  return __atomic_load_n (&x->sl_fully_linked, __ATOMIC_ACQUIRE);
+}
+
+static inline void
+sl_lock (struct sl_node *x)
+{
+  while (__atomic_test_and_set (&x->sl_lock, __ATOMIC_ACQUIRE))
+    {
+      while (__atomic_load_n (&x->sl_lock, __ATOMIC_RELAXED))
+        sched_yield ();
+    }
+}
+
+static inline void
+sl_unlock (struct sl_node *x)
+{
+  __atomic_clear (&x->sl_lock, __ATOMIC_RELEASE);
+}
+
+/* Unlocks preds[0..highest], each distinct node once. */
+static void
+sl_unlock_preds (struct sl_node **preds, int highest)
+{
+  struct sl_node *prev = NULL;
+  int l;
+
+  for (l = 0; l <= highest; ++l)
+    {
+      if (preds[l] != prev)
+        sl_unlock (preds[l]);
+      prev = preds[l];
+    }
+}
+
+int
+sl_random_level (void)
+{
+  static __thread uint64_t state;
+  uint64_t x = state;
+  int level = 1;
+
+  if (x == 0)
+    x = (uintptr_t)&state * 0x9E3779B97F4A7C15ull | 1;
+
+  /* xorshift64 */
+  x ^= x << 13;
+  x ^= x >> 7;
+  x ^= x << 17;
+  state = x;
+
+  /* two random bits per level give a branching factor of four */
+  while (level < SL_MAX_LEVEL && (x & 3) == 0)
+    {
+      ++level;
+      x >>= 2;
+    }
+  return level;
+}
+
+void
+sl_init (struct skiplist *sl)
+{
+  int l;
+
+  sl_node_init (&sl->sl_head, SL_MAX_LEVEL);
+  sl->sl_head.sl_fully_linked = true;
+  for (l = 0; l < SL_MAX_LEVEL; ++l)
+    sl->sl_head.sl_next[l] = NULL;
+}
+
+/* Fills preds and succs with the nodes around key at every level.
+   Returns the highest level at which a node equal to key was found, or
+   -1.  */
+static int
+sl_search (const void *key, struct skiplist *sl,
+           int (*comp) (const void *, const struct sl_node *),
+           struct sl_node **preds, struct sl_node **succs)
+{
+  struct sl_node *pred = &sl->sl_head;
+  int found = -1;
+  int l;
+
+  for (l = SL_MAX_LEVEL - 1; l >= 0; --l)
+    {
+      struct sl_node *curr = rcu_dereference (pred->sl_next[l]);
+      int c = 1;
+
+      while (curr != NULL && (c = comp (key, curr)) > 0)
+        {
+          pred = curr;
+          curr = rcu_dereference (pred->sl_next[l]);
+        }
+      if (found == -1 && curr != NULL && c == 0)
+        found = l;
+      preds[l] = pred;
+      succs[l] = curr;
+    }
+  return found;
+}
+
+struct sl_node *
+sl_lower_bound (const void *key, struct skiplist *sl,
+                int (*comp) (const void *, const struct sl_node *))
+{
+  struct sl_node *pred = &sl->sl_head;
+  struct sl_node *curr = NULL;
+  int l;
+
+  for (l = SL_MAX_LEVEL - 1; l >= 0; --l)
+    {
+      curr = rcu_dereference (pred->sl_next[l]);
+      while (curr != NULL && comp (key, curr) > 0)
+        {
+          pred = curr;
+          curr = rcu_dereference (pred->sl_next[l]);
+        }
+    }
+
+  while (curr != NULL && (sl_is_marked (curr) || !sl_is_fully_linked (curr)))
+    curr = rcu_dereference (curr->sl_next[0]);
+  return curr;
+}
+
+struct sl_node *
+sl_find (const void *key, struct skiplist *sl,
+         int (*comp) (const void *, const struct sl_node *))
+{
+  struct sl_node *node = sl_lower_bound (key, sl, comp);
+
+  if (node != NULL && comp (key, node) == 0)
+    return node;
+  return NULL;
+}
+
+struct sl_node *
+sl_next (const struct sl_node *x)
+{
+  struct sl_node *next = rcu_dereference (x->sl_next[0]);
+
+  while (next != NULL && (sl_is_marked (next) || !sl_is_fully_linked (next)))
+    next = rcu_dereference (next->sl_next[0]);
+  return next;
+}
+
+struct sl_node *
+sl_find_or_insert (const void *key, struct skiplist *sl,
+                   struct sl_node *node,
+                   int (*comp) (const void *, const struct sl_node *))
+{
+  struct sl_node *preds[SL_MAX_LEVEL];
+  struct sl_node *succs[SL_MAX_LEVEL];
+  int level = node->sl_level;
+
+  assert (level >= 1 && level <= SL_MAX_LEVEL);
+  rcu_read_lock ();
+  for (;;)
+    {
+      struct sl_node *prev = NULL;
+      int found = sl_search (key, sl, comp, preds, succs);
+      int highest = -1;
+      bool valid = true;
+      int l;
+
+      if (found >= 0)
+        {
+          struct sl_node *other = succs[found];
+
+          if (!sl_is_marked (other))
+            {
+              /* wait for a concurrent insert to finish */
+              while (!sl_is_fully_linked (other))
+                sched_yield ();
+              rcu_read_unlock ();
+              return other;
+            }
+          /* being removed; retry once it is unlinked */
+          continue;
+        }
+
+      for (l = 0; valid && l < level; ++l)
+        {
+          struct sl_node *pred = preds[l];
+          struct sl_node *succ = succs[l];
+
+          if (pred != prev)
+            {
+              sl_lock (pred);
+              highest = l;
+              prev = pred;
+            }
+          valid = !sl_is_marked (pred) && (succ == NULL || !sl_is_marked (succ))
+                  && pred->sl_next[l] == succ;
+        }
+
+      if (!valid)
+        {
+          sl_unlock_preds (preds, highest);
+          continue;
+        }
+
+      node->sl_marked = false;
+      node->sl_fully_linked = false;
+      for (l = 0; l < level; ++l)
+        node->sl_next[l] = succs[l];
+      for (l = 0; l < level; ++l)
+        rcu_assign_pointer (preds[l]->sl_next[l], node);
+      __atomic_store_n (&node->sl_fully_linked, true, __ATOMIC_RELEASE);
+
+      sl_unlock_preds (preds, highest);
+      rcu_read_unlock ();
+      return NULL;
+    }
+}
+
+struct sl_node *
+sl_erase (const void *key, struct skiplist *sl,
+          int (*comp) (const void *, const struct sl_node *))
+{
+  struct sl_node *preds[SL_MAX_LEVEL];
+  struct sl_node *succs[SL_MAX_LEVEL];
+  struct sl_node *victim = NULL;
+  int top = 0;
+
+  rcu_read_lock ();
+  for (;;)
+    {
+      struct sl_node *prev = NULL;
+      int found = sl_search (key, sl, comp, preds, succs);
+      int highest = -1;
+      bool valid = true;
+      int l;
+
+      if (victim == NULL)
+        {
+          struct sl_node *x;
+
+          /* only a fully linked node found at its top level can go */
+          if (found < 0)
+            break;
+          x = succs[found];
+          if (sl_is_marked (x))
+            break;
+          /* a concurrent insert has not finished yet */
+          if (!sl_is_fully_linked (x) || x->sl_level - 1 != found)
+            continue;
+
+          sl_lock (x);
+          if (sl_is_marked (x))
+            {
+              sl_unlock (x);
+              break;
+            }
+          __atomic_store_n (&x->sl_marked, true, __ATOMIC_RELEASE);
+          victim = x;
+          top = x->sl_level;
+        }
+
+      for (l = 0; valid && l < top; ++l)
+        {
+          struct sl_node *pred = preds[l];
+
+          if (pred != prev)
+            {
+              sl_lock (pred);
+              highest = l;
+              prev = pred;
+            }
+          valid = !sl_is_marked (pred) && pred->sl_next[l] == victim;
+        }
+
+      if (!valid)
+        {
+          sl_unlock_preds (preds, highest);
+          continue;
+        }
+
+      for (l = top - 1; l >= 0; --l)
+        rcu_assign_pointer (preds[l]->sl_next[l], victim->sl_next[l]);
+
+      sl_unlock (victim);
+      sl_unlock_preds (preds, highest);
+      rcu_read_unlock ();
+      return victim;
+    }
+
+  rcu_read_unlock ();
+  return NULL;
+}
@@ -0,0 +1,138 @@
+/* skiplist.h
+ *
+ * Copyright 2026 Zhengyi Fu <i@fuzy.me>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef SKIPLIST_H
+#define SKIPLIST_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "container_of.h"
+#include "defs.h"
+#include "rcu.h"
+
+C_DECL_BEGIN
+
+/* A concurrent ordered map based on the lazy skip list of Herlihy, Lev,
+   Luchangco and Shavit.
+
+   Lookups take no locks and never retry: they only follow next pointers
+   published with release semantics.  Writers lock just the predecessors
+   of the node they link or unlink, so updates to different parts of the
+   list proceed in parallel.  A removed node may still be seen by readers;
+   free it only after synchronize_rcu.
+
+   struct sl_node ends with a flexible array, so it must be the last member
+   of the containing structure, allocated with room for its tower:
+
+       struct item *it = malloc (sizeof (*it) + sl_tower_size (level));  */
+
+/* maximum height of a tower */
+#define SL_MAX_LEVEL 16
+
+struct sl_node
+{
+  unsigned char sl_level;
+  bool sl_lock;
+  bool sl_marked;       /* logically removed */
+  bool sl_fully_linked; /* linked at every level */
+  struct sl_node *sl_next[];
+};
+
+struct skiplist
+{
+  union
+  {
+    struct sl_node sl_head;
+    char sl_head_storage[sizeof (struct sl_node)
+                         + SL_MAX_LEVEL * sizeof (struct sl_node *)];
+  };
+};
+
+static inline size_t
+sl_tower_size (int level)
+{
+  return level * sizeof (struct sl_node *);
+}
+
+/* Returns a random tower height with P(level > k) = 4^-k. */
+int sl_random_level (void);
+
+void sl_init (struct skiplist *sl);
+
+/* Prepares a node allocated with room for level pointers. */
+static inline void
+sl_node_init (struct sl_node *node, int level)
+{
+  node->sl_level = level;
+  node->sl_lock = false;
+  node->sl_marked = false;
+  node->sl_fully_linked = false;
+}
+
+#define sl_entry(ptr, type, member) container_of (ptr, type, member)
+
+#define sl_entry_safe(ptr, type, member)                                      \
+  ((ptr) ? sl_entry (ptr, type, member) : NULL)
+
+/* The lookup functions must be called inside rcu_read_lock, and the
+   returned node may only be used until the matching rcu_read_unlock.  */
+
+struct sl_node *sl_find (const void *key, struct skiplist *sl,
+                         int (*comp) (const void *, const struct sl_node *));
+
+/* Returns the first node that does not compare less than key. */
+struct sl_node *sl_lower_bound (const void *key, struct skiplist *sl,
+                                int (*comp) (const void *,
+                                             const struct sl_node *));
+
+/* Returns the node after x that has not been removed. */
+struct sl_node *sl_next (const struct sl_node *x);
+
+static inline struct sl_node *
+sl_first (struct skiplist *sl)
+{
+  return sl_next (&sl->sl_head);
+}
+
+#define sl_for_each(pos, sl)                                                  \
+  for ((pos) = sl_first (sl); (pos) != NULL; (pos) = sl_next (pos))
+
+/* Iterates over nodes in [first, last] with a single descent. */
+#define sl_for_each_in_range(pos, first, last, sl, compare)                   \
+  for ((pos) = sl_lower_bound (first, sl, compare);                           \
+       (pos) != NULL && (compare) (last, pos) >= 0; (pos) = sl_next (pos))
+
+/* Inserts node unless a node comparing equal to key is present, in which
+   case that node is returned.  Returns NULL if node was inserted.  */
+struct sl_node *sl_find_or_insert (const void *key, struct skiplist *sl,
+                                   struct sl_node *node,
+                                   int (*comp) (const void *,
+                                                const struct sl_node *));
+
+/* Removes the node comparing equal to key and returns it, or NULL.  The
+   node may be freed after synchronize_rcu returns.  */
+struct sl_node *sl_erase (const void *key, struct skiplist *sl,
+                          int (*comp) (const void *,
+                                       const struct sl_node *));
+
+C_DECL_END
+
+#endif // !SKIPLIST_H
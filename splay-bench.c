@@ -0,0 +1,188 @@
+/* Copyright © 2026  Zhengyi Fu <i@fuzy.me> */
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Compares splay tree lookups against rbtree and avltree under uniform and
+   Zipf-distributed access.  Key ranks are scattered over the key space, so
+   the hot keys are not clustered in one subtree.  */
+
+#include "avltree.h"
+#include "bench.h"
+#include "rbtree.h"
+#include "splaytree.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+struct item
+{
+  uint64_t key;
+  struct rb_node rb;
+  struct avl_node avl;
+  struct splay_node splay;
+};
+
+static bool
+rb_item_less (const struct rb_node *a, const struct rb_node *b)
+{
+  return rb_entry (a, struct item, rb)->key < rb_entry (b, struct item, rb)->key;
+}
+
+static bool
+splay_item_less (const struct splay_node *a, const struct splay_node *b)
+{
+  return splay_entry (a, struct item, splay)->key
+         < splay_entry (b, struct item, splay)->key;
+}
+
+static int
+rb_item_comp (const void *key, const struct rb_node *node)
+{
+  uint64_t k = *(const uint64_t *)key;
+  uint64_t v = rb_entry (node, struct item, rb)->key;
+
+  return (k > v) - (k < v);
+}
+
+static int
+avl_item_comp (const void *key, const struct avl_node *node)
+{
+  uint64_t k = *(const uint64_t *)key;
+  uint64_t v = avl_entry (node, struct item, avl)->key;
+
+  return (k > v) - (k < v);
+}
+
+static int
+splay_item_comp (const void *key, const struct splay_node *node)
+{
+  uint64_t k = *(const uint64_t *)key;
+  uint64_t v = splay_entry (node, struct item, splay)->key;
+
+  return (k > v) - (k < v);
+}
+
+static void
+avl_item_add (struct item *it, struct avl_root *root)
+{
+  struct avl_node *parent = NULL;
+  struct avl_node **link = &root->avl_node;
+
+  while (*link)
+    {
+      parent = *link;
+      if (it->key < avl_entry (parent, struct item, avl)->key)
+        link = &parent->avl_left;
+      else
+        link = &parent->avl_right;
+    }
+  avl_link_node (&it->avl, parent, link);
+  avl_balance_insert (&it->avl, root);
+}
+
+static void
+bench_lookups (const char *dist, struct item *items, const unsigned long *ranks,
+               unsigned long count, struct rb_root *rb, struct avl_root *avl,
+               struct splay_root *splay)
+{
+  unsigned long i, found;
+  double t;
+
+  printf ("-- %s --\n", dist);
+
+  t = bench_now ();
+  for (i = found = 0; i < count; i++)
+    found += rb_find (&items[ranks[i]].key, rb, rb_item_comp) != NULL;
+  bench_report ("rbtree", "find", t, count);
+  if (found != count)
+    abort ();
+
+  t = bench_now ();
+  for (i = found = 0; i < count; i++)
+    found += avl_find (&items[ranks[i]].key, avl, avl_item_comp) != NULL;
+  bench_report ("avltree", "find", t, count);
+  if (found != count)
+    abort ();
+
+  t = bench_now ();
+  for (i = found = 0; i < count; i++)
+    found += splay_find (&items[ranks[i]].key, splay, splay_item_comp) != NULL;
+  bench_report ("splay", "find", t, count);
+  if (found != count)
+    abort ();
+}
+
+int
+main (int argc, char *argv[])
+{
+  struct rb_root rb = RB_ROOT_INIT;
+  struct avl_root avl = AVL_ROOT_INIT;
+  struct splay_root splay = SPLAY_ROOT_INIT;
+  unsigned long n = 1000000, count, i;
+  uint64_t state = 88172645463325252ull;
+  unsigned long *ranks;
+  struct item *items;
+  double t;
+
+  if (argc > 2)
+    {
+      fprintf (stderr, "Usage: %s [count]\n", argv[0]);
+      return 1;
+    }
+  if (argc == 2)
+    n = strtoul (argv[1], NULL, 0);
+  if (n < 2)
+    return 0;
+  count = 4 * n;
+
+  items = malloc (n * sizeof (*items));
+  ranks = calloc (count, sizeof (*ranks));
+  if (!items || !ranks)
+    {
+      perror ("malloc");
+      return 1;
+    }
+
+  printf ("%lu keys, %lu lookups\n", n, count);
+
+  for (i = 0; i < n; i++)
+    items[i].key = (i + 1) * 0x9E3779B97F4A7C15ull;
+
+  t = bench_now ();
+  for (i = 0; i < n; i++)
+    rb_add (&items[i].rb, &rb, rb_item_less);
+  bench_report ("rbtree", "insert", t, n);
+
+  t = bench_now ();
+  for (i = 0; i < n; i++)
+    avl_item_add (&items[i], &avl);
+  bench_report ("avltree", "insert", t, n);
+
+  t = bench_now ();
+  for (i = 0; i < n; i++)
+    splay_add (&items[i].splay, &splay, splay_item_less);
+  bench_report ("splay", "insert", t, n);
+
+  bench_uniform_fill (ranks, count, n, &state);
+  bench_lookups ("uniform", items, ranks, count, &rb, &avl, &splay);
+
+  bench_zipf_fill (ranks, count, n, 0.99, &state);
+  bench_lookups ("zipf 0.99", items, ranks, count, &rb, &avl, &splay);
+
+  free (ranks);
+  free (items);
+  return 0;
+}
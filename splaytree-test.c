@@ -0,0 +1,347 @@
+/* Copyright © 2026  Zhengyi Fu <i@fuzy.me> */
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "splaytree.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "test.h"
+
+struct test_node
+{
+  int value;
+  struct splay_node node;
+};
+
+static bool
+node_less (const struct splay_node *a, const struct splay_node *b)
+{
+  return splay_entry (a, struct test_node, node)->value
+         < splay_entry (b, struct test_node, node)->value;
+}
+
+static int
+comp_value (const void *key, const struct splay_node *node)
+{
+  int k = *(const int *)key;
+  int v = splay_entry (node, struct test_node, node)->value;
+
+  return (k > v) - (k < v);
+}
+
+static int
+value_of (const struct splay_node *node)
+{
+  return splay_entry (node, struct test_node, node)->value;
+}
+
+/* Validation: checks parent links and ordering, returns the node count */
+static int
+splay_check (const struct splay_node *x, const struct splay_node *parent)
+{
+  if (x == NULL)
+    return 0;
+  if (x->splay_parent != parent)
+    FAIL ("Bad parent pointer");
+  if (x->splay_left && value_of (x->splay_left) > value_of (x))
+    FAIL ("Left child is greater than its parent");
+  if (x->splay_right && value_of (x->splay_right) < value_of (x))
+    FAIL ("Right child is less than its parent");
+  return 1 + splay_check (x->splay_left, x) + splay_check (x->splay_right, x);
+}
+
+static int
+splay_validate (struct splay_root *tree)
+{
+  struct splay_node *pos;
+  int n = 0, prev = 0;
+
+  splay_for_each (pos, tree)
+    {
+      if (n > 0 && value_of (pos) < prev)
+        FAIL ("In-order traversal is not sorted");
+      prev = value_of (pos);
+      n++;
+    }
+  ASSERT (splay_check (tree->splay_node, NULL) == n);
+  return n;
+}
+
+static int
+node_depth (const struct splay_node *x)
+{
+  int d = 0;
+
+  while (x->splay_parent)
+    {
+      x = x->splay_parent;
+      d++;
+    }
+  return d;
+}
+
+static void
+shuffle (int *a, int n)
+{
+  int i;
+
+  for (i = n - 1; i > 0; i--)
+    {
+      int j = rand () % (i + 1);
+      int t = a[i];
+      a[i] = a[j];
+      a[j] = t;
+    }
+}
+
+/* ========== TESTS ========== */
+
+TEST (empty_tree)
+{
+  struct splay_root tree = SPLAY_ROOT_INIT;
+  int key = 3;
+
+  ASSERT (splay_empty (&tree));
+  ASSERT (splay_first (&tree) == NULL);
+  ASSERT (splay_find (&key, &tree, comp_value) == NULL);
+  ASSERT (splay_validate (&tree) == 0);
+}
+
+TEST (insert_splays_to_root)
+{
+  struct splay_root tree = SPLAY_ROOT_INIT;
+  static struct test_node nodes[1000];
+  int keys[1000];
+  int i;
+
+  for (i = 0; i < 1000; i++)
+    keys[i] = i;
+  srand (1);
+  shuffle (keys, 1000);
+  for (i = 0; i < 1000; i++)
+    {
+      nodes[i].value = keys[i];
+      splay_add (&nodes[i].node, &tree, node_less);
+      ASSERT (tree.splay_node == &nodes[i].node);
+    }
+  ASSERT (splay_validate (&tree) == 1000);
+}
+
+TEST (find)
+{
+  struct splay_root tree = SPLAY_ROOT_INIT;
+  static struct test_node nodes[500];
+  int i;
+
+  for (i = 0; i < 500; i++)
+    {
+      nodes[i].value = i * 2;
+      splay_add (&nodes[i].node, &tree, node_less);
+    }
+
+  for (i = 0; i < 1000; i++)
+    {
+      struct splay_node *n = splay_find (&i, &tree, comp_value);
+
+      if (i % 2 == 0)
+        {
+          ASSERT (n && value_of (n) == i);
+          ASSERT (tree.splay_node == n);
+        }
+      else
+        {
+          ASSERT (n == NULL);
+          /* a neighbour of the missing key was splayed */
+          ASSERT (abs (value_of (tree.splay_node) - i) == 1);
+        }
+    }
+  ASSERT (splay_validate (&tree) == 500);
+}
+
+TEST (hot_keys_stay_shallow)
+{
+  struct splay_root tree = SPLAY_ROOT_INIT;
+  static struct test_node nodes[4096];
+  int i, j;
+
+  /* ascending inserts leave a path of depth n - 1 */
+  for (i = 0; i < 4096; i++)
+    {
+      nodes[i].value = i;
+      splay_add (&nodes[i].node, &tree, node_less);
+    }
+  ASSERT (node_depth (&nodes[0].node) == 4095);
+
+  /* after repeated access, a small working set sits at the top */
+  for (j = 0; j < 10; j++)
+    for (i = 0; i < 4; i++)
+      {
+        int key = i * 1000;
+
+        splay_find (&key, &tree, comp_value);
+      }
+  for (i = 0; i < 4; i++)
+    ASSERT (node_depth (&nodes[i * 1000].node) < 4);
+  ASSERT (splay_validate (&tree) == 4096);
+}
+
+TEST (find_or_insert)
+{
+  struct splay_root tree = SPLAY_ROOT_INIT;
+  struct test_node a = { .value = 5 }, b = { .value = 5 };
+
+  ASSERT (splay_find_or_insert (&a.value, &tree, &a.node, comp_value)
+          == NULL);
+  ASSERT (splay_find_or_insert (&b.value, &tree, &b.node, comp_value)
+          == &a.node);
+  ASSERT (splay_validate (&tree) == 1);
+}
+
+TEST (erase)
+{
+  struct splay_root tree = SPLAY_ROOT_INIT;
+  static struct test_node nodes[2000];
+  int order[2000];
+  int i;
+
+  for (i = 0; i < 2000; i++)
+    {
+      nodes[i].value = i;
+      splay_add (&nodes[i].node, &tree, node_less);
+      order[i] = i;
+    }
+  srand (2);
+  shuffle (order, 2000);
+  for (i = 0; i < 2000; i++)
+    {
+      splay_erase (&nodes[order[i]].node, &tree);
+      if (i % 101 == 0)
+        ASSERT (splay_validate (&tree) == 2000 - i - 1);
+    }
+  ASSERT (splay_empty (&tree));
+}
+
+TEST (churn)
+{
+  enum { N = 2048 };
+  struct splay_root tree = SPLAY_ROOT_INIT;
+  static struct test_node nodes[N];
+  static bool present[N];
+  int i, size = 0;
+
+  srand (3);
+  for (i = 0; i < 100000; i++)
+    {
+      int k = rand () % N;
+
+      switch (rand () % 3)
+        {
+        case 0:
+          if (!present[k])
+            {
+              nodes[k].value = k;
+              splay_add (&nodes[k].node, &tree, node_less);
+              present[k] = true;
+              size++;
+            }
+          break;
+        case 1:
+          if (present[k])
+            {
+              splay_erase (&nodes[k].node, &tree);
+              present[k] = false;
+              size--;
+            }
+          break;
+        default:
+          ASSERT ((splay_find (&k, &tree, comp_value) != NULL) == present[k]);
+          break;
+        }
+      if (i % 9973 == 0)
+        ASSERT (splay_validate (&tree) == size);
+    }
+  ASSERT (splay_validate (&tree) == size);
+}
+
+TEST (lower_bound)
+{
+  struct splay_root tree = SPLAY_ROOT_INIT;
+  static struct test_node nodes[100];
+  int i;
+
+  for (i = 0; i < 100; i++)
+    {
+      nodes[i].value = i * 2;
+      splay_add (&nodes[i].node, &tree, node_less);
+    }
+  for (i = -1; i < 200; i++)
+    {
+      struct splay_node *n = splay_lower_bound (&i, &tree, comp_value);
+      int expect = i < 0 ? 0 : (i + 1) / 2 * 2;
+
+      if (expect > 198)
+        ASSERT (n == NULL);
+      else
+        ASSERT (n && value_of (n) == expect);
+    }
+  ASSERT (splay_validate (&tree) == 100);
+}
+
+TEST (iteration)
+{
+  struct splay_root tree = SPLAY_ROOT_INIT;
+  static struct test_node nodes[300];
+  struct test_node *pos, *tmp;
+  int i, expect = 0;
+
+  for (i = 0; i < 300; i++)
+    {
+      nodes[i].value = (i * 37) % 300;
+      splay_add (&nodes[i].node, &tree, node_less);
+    }
+  splay_for_each_entry (pos, &tree, node)
+    ASSERT (pos->value == expect++);
+  ASSERT (expect == 300);
+
+  splay_for_each_entry_safe (pos, tmp, &tree, node)
+    if (pos->value % 3)
+      splay_erase (&pos->node, &tree);
+  ASSERT (splay_validate (&tree) == 100);
+  ASSERT (value_of (splay_last (&tree)) == 297);
+  ASSERT (value_of (splay_prev (splay_last (&tree))) == 294);
+}
+
+int
+main (void)
+{
+  fprintf (stderr, "=== Splay Tree Test Suite ===\n\n");
+
+  RUN_TEST (empty_tree);
+  RUN_TEST (insert_splays_to_root);
+  RUN_TEST (find);
+  RUN_TEST (hot_keys_stay_shallow);
+  RUN_TEST (find_or_insert);
+  RUN_TEST (erase);
+  RUN_TEST (churn);
+  RUN_TEST (lower_bound);
+  RUN_TEST (iteration);
+
+  fprintf (stderr, "\n=== Results ===\n");
+  fprintf (stderr, "Passed: %d/%d\n", pass_count, test_count);
+
+  return (pass_count == test_count) ? 0 : 1;
+}
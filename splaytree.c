@@ -0,0 +1,127 @@
+/* splaytree.c
+ *
+ * Copyright 2026 Zhengyi Fu <i@fuzy.me>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "splaytree.h"
+#include <assert.h>
+
+/* Rotates x above its parent. */
+static inline void
+splay_rotate_up (struct splay_node *x, struct splay_root *tree)
+{
+  /*
+   *       p         x              p           x
+   *      / \       / \            / \         / \
+   *     x   c ->  a   p          a   x   ->  p   c
+   *    / \           / \            / \     / \
+   *   a   b         b   c          b   c   a   b
+   */
+
+  struct splay_node *p = x->splay_parent;
+  struct splay_node *g = p->splay_parent;
+  struct splay_node *b;
+
+  if (p->splay_left == x)
+    {
+      b = p->splay_left = x->splay_right;
+      x->splay_right = p;
+    }
+  else
+    {
+      b = p->splay_right = x->splay_left;
+      x->splay_left = p;
+    }
+  if (b)
+    b->splay_parent = p;
+  p->splay_parent = x;
+  x->splay_parent = g;
+
+  if (!g)
+    tree->splay_node = x;
+  else if (g->splay_left == p)
+    g->splay_left = x;
+  else
+    g->splay_right = x;
+}
+
+void
+splay (struct splay_node *x, struct splay_root *tree)
+{
+  for (;;)
+    {
+      struct splay_node *p = x->splay_parent;
+      struct splay_node *g;
+
+      if (p == NULL)
+        break;
+
+      g = p->splay_parent;
+      if (g == NULL)
+        {
+          /* zig */
+          splay_rotate_up (x, tree);
+          break;
+        }
+
+      if ((g->splay_left == p) == (p->splay_left == x))
+        {
+          /* zig-zig: rotate the parent first */
+          splay_rotate_up (p, tree);
+          splay_rotate_up (x, tree);
+        }
+      else
+        {
+          /* zig-zag */
+          splay_rotate_up (x, tree);
+          splay_rotate_up (x, tree);
+        }
+    }
+}
+
+void
+splay_erase (struct splay_node *x, struct splay_root *tree)
+{
+  struct splay_node *left, *right;
+
+  splay (x, tree);
+  assert (tree->splay_node == x);
+
+  left = x->splay_left;
+  right = x->splay_right;
+
+  if (left == NULL)
+    {
+      tree->splay_node = right;
+      if (right)
+        right->splay_parent = NULL;
+      return;
+    }
+
+  /* splay the largest node of the left subtree to its top, where it has no
+     right child, and hang the right subtree there  */
+  left->splay_parent = NULL;
+  tree->splay_node = left;
+  splay (splay_max (left), tree);
+
+  left = tree->splay_node;
+  assert (left->splay_right == NULL);
+  left->splay_right = right;
+  if (right)
+    right->splay_parent = left;
+}
@@ -0,0 +1,300 @@
+/* splaytree.h
+ *
+ * Copyright 2026 Zhengyi Fu <i@fuzy.me>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef SPLAYTREE_H
+#define SPLAYTREE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "container_of.h"
+#include "defs.h"
+
+C_DECL_BEGIN
+
+/* Splay tree (Sleator and Tarjan).  Every lookup moves the node it finds
+   to the root, so frequently accessed nodes stay near the top and skewed
+   workloads take far fewer than log n steps per lookup.  Operations are
+   O(log n) amortized, and lookups modify the tree, so even readers need
+   exclusive access.  */
+
+struct splay_node
+{
+  struct splay_node *splay_left;
+  struct splay_node *splay_right;
+  struct splay_node *splay_parent;
+};
+
+struct splay_root
+{
+  struct splay_node *splay_node;
+};
+
+/* clang-format off */
+#define SPLAY_ROOT_INIT { NULL }
+/* clang-format on */
+
+static inline void
+splay_root_init (struct splay_root *tree)
+{
+  tree->splay_node = NULL;
+}
+
+static inline struct splay_node *
+splay_min (const struct splay_node *x)
+{
+  struct splay_node *y = NULL;
+  while (x != NULL)
+    {
+      y = (struct splay_node *)x;
+      x = x->splay_left;
+    }
+  return y;
+}
+
+static inline struct splay_node *
+splay_max (const struct splay_node *x)
+{
+  struct splay_node *y = NULL;
+  while (x != NULL)
+    {
+      y = (struct splay_node *)x;
+      x = x->splay_right;
+    }
+  return y;
+}
+
+/* Iteration does not splay. */
+static inline struct splay_node *
+splay_prev (const struct splay_node *x)
+{
+  struct splay_node *p;
+
+  if (x == NULL)
+    return NULL;
+
+  if (x->splay_left != NULL)
+    return splay_max (x->splay_left);
+
+  p = x->splay_parent;
+  while (p && p->splay_left == x)
+    {
+      x = p;
+      p = x->splay_parent;
+    }
+
+  return p;
+}
+
+static inline struct splay_node *
+splay_next (const struct splay_node *x)
+{
+  struct splay_node *p;
+
+  if (x == NULL)
+    return NULL;
+
+  if (x->splay_right != NULL)
+    return splay_min (x->splay_right);
+
+  p = x->splay_parent;
+  while (p && p->splay_right == x)
+    {
+      x = p;
+      p = x->splay_parent;
+    }
+
+  return p;
+}
+
+static inline struct splay_node *
+splay_first (const struct splay_root *tree)
+{
+  return splay_min (tree->splay_node);
+}
+
+static inline struct splay_node *
+splay_last (const struct splay_root *tree)
+{
+  return splay_max (tree->splay_node);
+}
+
+static inline bool
+splay_empty (const struct splay_root *tree)
+{
+  return tree->splay_node == NULL;
+}
+
+/* Link node x to parent. */
+static inline void
+splay_link_node (struct splay_node *x, struct splay_node *parent,
+                 struct splay_node **link)
+{
+  *link = x;
+  x->splay_parent = parent;
+  x->splay_left = x->splay_right = NULL;
+}
+
+#define splay_for_each(pos, tree)                                             \
+  for ((pos) = splay_first (tree); (pos) != NULL; (pos) = splay_next ((pos)))
+
+#define splay_for_each_safe(pos, n, tree)                                     \
+  for ((void)(((pos) = splay_first (tree)) && ((n) = splay_next (pos)));      \
+       (pos) != NULL; (void)(((pos) = (n)) && ((n) = splay_next (pos))))
+
+#define splay_entry(ptr, type, member) container_of (ptr, type, member)
+
+#define splay_entry_safe(ptr, type, member)                                   \
+  ((ptr) ? splay_entry (ptr, type, member) : NULL)
+
+#define splay_first_entry(type, tree, member)                                 \
+  splay_entry_safe (splay_first (tree), type, member)
+
+#define splay_next_entry(pos, member)                                         \
+  splay_entry_safe (splay_next (&(pos)->member), typeof (*pos), member)
+
+#define splay_for_each_entry(pos, tree, member)                               \
+  for ((pos) = splay_first_entry (typeof (*pos), tree, member); (pos);        \
+       (pos) = splay_next_entry (pos, member))
+
+#define splay_for_each_entry_safe(pos, n, tree, member)                       \
+  for ((void)(((pos) = splay_first_entry (typeof (*pos), tree, member))       \
+              && ((n) = splay_next_entry (pos, member)));                     \
+       (pos); (void)(((pos) = (n)) && ((n) = splay_next_entry (pos, member))))
+
+/* Moves x to the root. */
+void splay (struct splay_node *x, struct splay_root *tree);
+
+void splay_erase (struct splay_node *x, struct splay_root *tree);
+
+/* Splays a node linked with splay_link_node to the root. */
+static inline void
+splay_balance_insert (struct splay_node *x, struct splay_root *tree)
+{
+  splay (x, tree);
+}
+
+static inline void
+splay_add (struct splay_node *__restrict x, struct splay_root *root,
+           bool (*less) (const struct splay_node *, const struct splay_node *))
+{
+  struct splay_node *parent = NULL;
+  struct splay_node **link = &root->splay_node;
+
+  while (*link != NULL)
+    {
+      parent = *link;
+
+      if (less (x, parent))
+        link = &parent->splay_left;
+      else
+        link = &parent->splay_right;
+    }
+
+  splay_link_node (x, parent, link);
+  splay (x, root);
+}
+
+/* Finds the node comparing equal to key and splays it to the root.  On a
+   miss the last node visited is splayed instead, which keeps the amortized
+   bound.  */
+static inline struct splay_node *
+splay_find (const void *__restrict key, struct splay_root *root,
+            int (*comp) (const void *, const struct splay_node *))
+{
+  struct splay_node *node = root->splay_node;
+  struct splay_node *last = NULL;
+
+  while (node != NULL)
+    {
+      int c = comp (key, node);
+
+      last = node;
+      if (c < 0)
+        node = node->splay_left;
+      else if (c > 0)
+        node = node->splay_right;
+      else
+        break;
+    }
+  if (last != NULL && last != root->splay_node)
+    splay (last, root);
+  return node;
+}
+
+/* Returns the first node that does not compare less than key, and splays
+   the last node visited.  */
+static inline struct splay_node *
+splay_lower_bound (const void *__restrict key, struct splay_root *root,
+                   int (*comp) (const void *, const struct splay_node *))
+{
+  struct splay_node *node = root->splay_node;
+  struct splay_node *last = NULL;
+  struct splay_node *result = NULL;
+
+  while (node != NULL)
+    {
+      last = node;
+      if (comp (key, node) <= 0)
+        {
+          result = node;
+          node = node->splay_left;
+        }
+      else
+        node = node->splay_right;
+    }
+  if (last != NULL && last != root->splay_node)
+    splay (last, root);
+  return result;
+}
+
+static inline struct splay_node *
+splay_find_or_insert (const void *__restrict key, struct splay_root *root,
+                      struct splay_node *__restrict node,
+                      int (*comp) (const void *, const struct splay_node *))
+{
+  struct splay_node *parent = NULL;
+  struct splay_node **link = &root->splay_node;
+
+  while (*link != NULL)
+    {
+      int c;
+
+      parent = *link;
+      c = comp (key, parent);
+      if (c < 0)
+        link = &parent->splay_left;
+      else if (c > 0)
+        link = &parent->splay_right;
+      else
+        {
+          splay (parent, root);
+          return parent;
+        }
+    }
+
+  splay_link_node (node, parent, link);
+  splay (node, root);
+  return NULL;
+}
+
+C_DECL_END
+
+#endif // !SPLAYTREE_H
@@ -0,0 +1,204 @@
+/* Copyright © 2026  Zhengyi Fu <i@fuzy.me> */
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Compares the comparator-pointer rbtree API against the functions
+   generated by RB_DECLARE.  The "opaque" rows use a comparator the compiler
+   cannot inline, as when it is defined in another translation unit.  */
+
+#include "bench.h"
+#include "rbtree.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+struct item
+{
+  uint64_t key;
+  struct rb_node node;
+};
+
+#define ITEM_KEY(it) ((it)->key)
+
+RB_DECLARE (item_tree, struct item, node, ITEM_KEY, RB_CMP_NUMERIC)
+
+static bool
+item_less (const struct rb_node *a, const struct rb_node *b)
+{
+  return rb_entry (a, struct item, node)->key
+         < rb_entry (b, struct item, node)->key;
+}
+
+static int
+item_comp (const void *key, const struct rb_node *node)
+{
+  uint64_t k = *(const uint64_t *)key;
+  uint64_t nk = rb_entry (node, struct item, node)->key;
+
+  return k < nk ? -1 : k > nk;
+}
+
+static noinline bool
+item_less_opaque (const struct rb_node *a, const struct rb_node *b)
+{
+  return item_less (a, b);
+}
+
+static noinline int
+item_comp_opaque (const void *key, const struct rb_node *node)
+{
+  return item_comp (key, node);
+}
+
+/* The comparators are passed through volatile pointers so that the
+   compiler cannot propagate them into the inlined rb_find.  */
+static bool (*volatile less_fn) (const struct rb_node *,
+                                 const struct rb_node *);
+static int (*volatile comp_fn) (const void *, const struct rb_node *);
+
+static void
+bench_funcptr (const char *api, struct item *items, const uint64_t *keys,
+               unsigned long n)
+{
+  struct rb_root root = RB_ROOT_INIT;
+  bool (*less) (const struct rb_node *, const struct rb_node *) = less_fn;
+  int (*comp) (const void *, const struct rb_node *) = comp_fn;
+  unsigned long i, found = 0;
+  double t;
+
+  t = bench_now ();
+  for (i = 0; i < n; i++)
+    {
+      items[i].key = keys[i];
+      rb_add (&items[i].node, &root, less);
+    }
+  bench_report (api, "insert", t, n);
+
+  t = bench_now ();
+  for (i = 0; i < n; i++)
+    found += rb_find (&keys[(i * 7919) % n], &root, comp) != NULL;
+  bench_report (api, "find", t, n);
+
+  t = bench_now ();
+  for (i = 0; i < n; i++)
+    found += rb_lower_bound (&keys[(i * 7919) % n], &root, comp) != NULL;
+  bench_report (api, "lower", t, n);
+
+  if (found < n)
+    fprintf (stderr, "%s: inconsistent result\n", api);
+}
+
+static void
+bench_inline (struct item *items, const uint64_t *keys, unsigned long n)
+{
+  struct rb_root root = RB_ROOT_INIT;
+  unsigned long i, found = 0;
+  double t;
+
+  t = bench_now ();
+  for (i = 0; i < n; i++)
+    {
+      items[i].key = keys[i];
+      rb_add (&items[i].node, &root, item_less);
+    }
+  bench_report ("inline", "insert", t, n);
+
+  t = bench_now ();
+  for (i = 0; i < n; i++)
+    found += rb_find (&keys[(i * 7919) % n], &root, item_comp) != NULL;
+  bench_report ("inline", "find", t, n);
+
+  t = bench_now ();
+  for (i = 0; i < n; i++)
+    found += rb_lower_bound (&keys[(i * 7919) % n], &root, item_comp)
+             != NULL;
+  bench_report ("inline", "lower", t, n);
+
+  if (found < n)
+    fprintf (stderr, "inline: inconsistent result\n");
+}
+
+static void
+bench_declare (struct item *items, const uint64_t *keys, unsigned long n)
+{
+  struct rb_root root = RB_ROOT_INIT;
+  unsigned long i, found = 0;
+  double t;
+
+  t = bench_now ();
+  for (i = 0; i < n; i++)
+    {
+      items[i].key = keys[i];
+      item_tree_add (&root, &items[i]);
+    }
+  bench_report ("RB_DECLARE", "insert", t, n);
+
+  t = bench_now ();
+  for (i = 0; i < n; i++)
+    found += item_tree_find (&root, keys[(i * 7919) % n]) != NULL;
+  bench_report ("RB_DECLARE", "find", t, n);
+
+  t = bench_now ();
+  for (i = 0; i < n; i++)
+    found += item_tree_lower_bound (&root, keys[(i * 7919) % n]) != NULL;
+  bench_report ("RB_DECLARE", "lower", t, n);
+
+  if (found < n)
+    fprintf (stderr, "RB_DECLARE: inconsistent result\n");
+}
+
+int
+main (int argc, char *argv[])
+{
+  unsigned long n = 1000000;
+  struct item *items;
+  uint64_t *keys;
+  unsigned long i;
+
+  if (argc > 2)
+    {
+      fprintf (stderr, "Usage: %s [count]\n", argv[0]);
+      return 1;
+    }
+  if (argc == 2)
+    n = strtoul (argv[1], NULL, 0);
+  if (n == 0)
+    return 0;
+
+  keys = malloc (n * sizeof (*keys));
+  items = malloc (n * sizeof (*items));
+  if (!keys || !items)
+    {
+      perror ("malloc");
+      return 1;
+    }
+  for (i = 0; i < n; i++)
+    keys[i] = (i + 1) * 0x9E3779B97F4A7C15ull;
+
+  printf ("%lu keys\n", n);
+  less_fn = item_less_opaque;
+  comp_fn = item_comp_opaque;
+  bench_funcptr ("opaque", items, keys, n);
+  less_fn = item_less;
+  comp_fn = item_comp;
+  bench_funcptr ("indirect", items, keys, n);
+  bench_inline (items, keys, n);
+  bench_declare (items, keys, n);
+
+  free (items);
+  free (keys);
+  return 0;
+}
@@ -0,0 +1,178 @@
+/* Copyright © 2026  Zhengyi Fu <i@fuzy.me> */
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Compares full in-order scans with rb_for_each_entry/avl_for_each_entry
+   against rb_walk/avl_walk.  Keys are assigned to nodes in random order, so
+   neighbours in the tree are far apart in memory.  */
+
+#include "avltree.h"
+#include "bench.h"
+#include "rbtree.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+struct rb_item
+{
+  uint64_t key;
+  struct rb_node node;
+};
+
+struct avl_item
+{
+  uint64_t key;
+  struct avl_node node;
+};
+
+static bool
+rb_item_less (const struct rb_node *a, const struct rb_node *b)
+{
+  return rb_entry (a, struct rb_item, node)->key
+         < rb_entry (b, struct rb_item, node)->key;
+}
+
+static int
+rb_sum (struct rb_node **nodes, size_t n, void *arg)
+{
+  uint64_t *sum = arg;
+  size_t i;
+
+  for (i = 0; i < n; i++)
+    *sum += rb_entry (nodes[i], struct rb_item, node)->key;
+  return 0;
+}
+
+static int
+avl_sum (struct avl_node **nodes, size_t n, void *arg)
+{
+  uint64_t *sum = arg;
+  size_t i;
+
+  for (i = 0; i < n; i++)
+    *sum += avl_entry (nodes[i], struct avl_item, node)->key;
+  return 0;
+}
+
+static void
+bench_rbtree (const uint64_t *keys, unsigned long n)
+{
+  struct rb_root root = RB_ROOT_INIT;
+  struct rb_item *items = malloc (n * sizeof (*items));
+  struct rb_item *pos;
+  uint64_t sum1 = 0, sum2 = 0;
+  unsigned long i;
+  double t;
+
+  if (!items)
+    abort ();
+  for (i = 0; i < n; i++)
+    {
+      items[i].key = keys[i];
+      rb_add (&items[i].node, &root, rb_item_less);
+    }
+
+  t = bench_now ();
+  rb_for_each_entry (pos, &root, node)
+    sum1 += pos->key;
+  bench_report ("rbtree", "for_each", t, n);
+
+  t = bench_now ();
+  rb_walk (&root, rb_sum, &sum2);
+  bench_report ("rbtree", "walk", t, n);
+
+  if (sum1 != sum2)
+    fprintf (stderr, "rbtree: inconsistent result\n");
+  free (items);
+}
+
+static void
+bench_avltree (const uint64_t *keys, unsigned long n)
+{
+  struct avl_root root = AVL_ROOT_INIT;
+  struct avl_item *items = malloc (n * sizeof (*items));
+  struct avl_item *pos;
+  uint64_t sum1 = 0, sum2 = 0;
+  unsigned long i;
+  double t;
+
+  if (!items)
+    abort ();
+  for (i = 0; i < n; i++)
+    {
+      struct avl_node *parent = NULL;
+      struct avl_node **link = &root.avl_node;
+
+      items[i].key = keys[i];
+      while (*link)
+        {
+          parent = *link;
+          if (keys[i] < avl_entry (parent, struct avl_item, node)->key)
+            link = &parent->avl_left;
+          else
+            link = &parent->avl_right;
+        }
+      avl_link_node (&items[i].node, parent, link);
+      avl_balance_insert (&items[i].node, &root);
+    }
+
+  t = bench_now ();
+  avl_for_each_entry (pos, &root, node)
+    sum1 += pos->key;
+  bench_report ("avltree", "for_each", t, n);
+
+  t = bench_now ();
+  avl_walk (&root, avl_sum, &sum2);
+  bench_report ("avltree", "walk", t, n);
+
+  if (sum1 != sum2)
+    fprintf (stderr, "avltree: inconsistent result\n");
+  free (items);
+}
+
+int
+main (int argc, char *argv[])
+{
+  unsigned long n = 4000000;
+  uint64_t *keys;
+  unsigned long i;
+
+  if (argc > 2)
+    {
+      fprintf (stderr, "Usage: %s [count]\n", argv[0]);
+      return 1;
+    }
+  if (argc == 2)
+    n = strtoul (argv[1], NULL, 0);
+  if (n == 0)
+    return 0;
+
+  keys = malloc (n * sizeof (*keys));
+  if (!keys)
+    {
+      perror ("malloc");
+      return 1;
+    }
+  for (i = 0; i < n; i++)
+    keys[i] = (i + 1) * 0x9E3779B97F4A7C15ull;
+
+  printf ("%lu nodes\n", n);
+  bench_rbtree (keys, n);
+  bench_avltree (keys, n);
+
+  free (keys);
+  return 0;
+}
@@ -0,0 +1,161 @@
+/* Copyright © 2026  Zhengyi Fu <i@fuzy.me> */
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Compares wavltree against avltree and rbtree on insert/delete mixes: a
+   bulk load, a churn phase where every step erases a random node and
+   inserts a fresh one, and a final drain.  */
+
+#include "avltree.h"
+#include "bench.h"
+#include "rbtree.h"
+#include "wavltree.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+struct item
+{
+  uint64_t key;
+  union
+  {
+    struct rb_node rb;
+    struct avl_node avl;
+    struct wavl_node wavl;
+  };
+};
+
+static bool
+rb_item_less (const struct rb_node *a, const struct rb_node *b)
+{
+  return rb_entry (a, struct item, rb)->key < rb_entry (b, struct item, rb)->key;
+}
+
+static bool
+wavl_item_less (const struct wavl_node *a, const struct wavl_node *b)
+{
+  return wavl_entry (a, struct item, wavl)->key
+         < wavl_entry (b, struct item, wavl)->key;
+}
+
+static void
+avl_item_add (struct item *it, struct avl_root *root)
+{
+  struct avl_node *parent = NULL;
+  struct avl_node **link = &root->avl_node;
+
+  while (*link)
+    {
+      parent = *link;
+      if (it->key < avl_entry (parent, struct item, avl)->key)
+        link = &parent->avl_left;
+      else
+        link = &parent->avl_right;
+    }
+  avl_link_node (&it->avl, parent, link);
+  avl_balance_insert (&it->avl, root);
+}
+
+/* Each tree is driven through the same sequence: slot[i] holds a live
+   item, and a churn step swaps a random one with a spare.  */
+
+#define BENCH(name, root_t, root_init, add, erase)                            \
+  static void bench_##name (struct item *items, unsigned long n,              \
+                            unsigned long churn)                              \
+  {                                                                           \
+    root_t root = root_init;                                                  \
+    struct item **slot = malloc (2 * n * sizeof (*slot));                     \
+    struct item **spare = slot + n;                                           \
+    uint64_t state = 88172645463325252ull;                                    \
+    unsigned long i;                                                          \
+    double t;                                                                 \
+                                                                              \
+    if (!slot)                                                                \
+      abort ();                                                               \
+                                                                              \
+    t = bench_now ();                                                               \
+    for (i = 0; i < n; i++)                                                   \
+      {                                                                       \
+        slot[i] = &items[i];                                                  \
+        slot[i]->key = bench_rand (&state);                                    \
+        add (slot[i], &root);                                                 \
+        spare[i] = &items[n + i];                                             \
+      }                                                                       \
+    bench_report (#name, "insert", t, n);                                           \
+                                                                              \
+    t = bench_now ();                                                               \
+    for (i = 0; i < churn; i++)                                               \
+      {                                                                       \
+        unsigned long j = bench_rand (&state) % n;                             \
+        struct item *fresh = spare[i % n];                                    \
+                                                                              \
+        erase (slot[j], &root);                                               \
+        fresh->key = bench_rand (&state);                                      \
+        add (fresh, &root);                                                   \
+        spare[i % n] = slot[j];                                               \
+        slot[j] = fresh;                                                      \
+      }                                                                       \
+    bench_report (#name, "churn", t, churn);                                        \
+                                                                              \
+    t = bench_now ();                                                               \
+    for (i = 0; i < n; i++)                                                   \
+      erase (slot[i], &root);                                                 \
+    bench_report (#name, "delete", t, n);                                           \
+                                                                              \
+    free (slot);                                                              \
+  }
+
+#define RB_ADD(it, root) rb_add (&(it)->rb, root, rb_item_less)
+#define RB_ERASE(it, root) rb_erase (&(it)->rb, root)
+#define AVL_ERASE(it, root) avl_erase (&(it)->avl, root)
+#define WAVL_ADD(it, root) wavl_add (&(it)->wavl, root, wavl_item_less)
+#define WAVL_ERASE(it, root) wavl_erase (&(it)->wavl, root)
+
+BENCH (rbtree, struct rb_root, RB_ROOT_INIT, RB_ADD, RB_ERASE)
+BENCH (avltree, struct avl_root, AVL_ROOT_INIT, avl_item_add, AVL_ERASE)
+BENCH (wavltree, struct wavl_root, WAVL_ROOT_INIT, WAVL_ADD, WAVL_ERASE)
+
+int
+main (int argc, char *argv[])
+{
+  unsigned long n = 1000000;
+  struct item *items;
+
+  if (argc > 2)
+    {
+      fprintf (stderr, "Usage: %s [count]\n", argv[0]);
+      return 1;
+    }
+  if (argc == 2)
+    n = strtoul (argv[1], NULL, 0);
+  if (n == 0)
+    return 0;
+
+  items = malloc (2 * n * sizeof (*items));
+  if (!items)
+    {
+      perror ("malloc");
+      return 1;
+    }
+
+  printf ("%lu keys, %lu churn steps\n", n, 2 * n);
+  bench_rbtree (items, n, 2 * n);
+  bench_avltree (items, n, 2 * n);
+  bench_wavltree (items, n, 2 * n);
+
+  free (items);
+  return 0;
+}
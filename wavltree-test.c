@@ -0,0 +1,354 @@
+/* Copyright © 2026  Zhengyi Fu <i@fuzy.me> */
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "wavltree.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "test.h"
+
+struct test_node
+{
+  int value;
+  struct wavl_node node;
+};
+
+static bool
+node_less (const struct wavl_node *a, const struct wavl_node *b)
+{
+  return wavl_entry (a, struct test_node, node)->value
+         < wavl_entry (b, struct test_node, node)->value;
+}
+
+static int
+comp_value (const void *key, const struct wavl_node *node)
+{
+  int k = *(const int *)key;
+  int v = wavl_entry (node, struct test_node, node)->value;
+
+  return (k > v) - (k < v);
+}
+
+/* Validation: recovers every rank from the parities and checks the WAVL
+   rules.  Returns the rank of x, -1 for NULL.  */
+static int
+wavl_rank (const struct wavl_node *x, int *height, int *count)
+{
+  int lrank, rrank, lheight, rheight, rank;
+
+  if (x == NULL)
+    {
+      *height = 0;
+      return -1;
+    }
+
+  if (x->wavl_left && x->wavl_left->wavl_parent != x)
+    FAIL ("Bad parent pointer");
+  if (x->wavl_right && x->wavl_right->wavl_parent != x)
+    FAIL ("Bad parent pointer");
+
+  lrank = wavl_rank (x->wavl_left, &lheight, count);
+  rrank = wavl_rank (x->wavl_right, &rheight, count);
+
+  /* children of the same rank parity as x are 2-children */
+  rank = lrank + ((lrank & 1) == x->wavl_parity ? 2 : 1);
+  if (rank != rrank + ((rrank & 1) == x->wavl_parity ? 2 : 1))
+    FAIL ("Rank difference is not 1 or 2");
+  if ((rank & 1) != x->wavl_parity)
+    FAIL ("Rank parity mismatch");
+  if (!x->wavl_left && !x->wavl_right && rank != 0)
+    FAIL ("Leaf rank is not 0");
+
+  *height = 1 + (lheight > rheight ? lheight : rheight);
+  ++*count;
+  return rank;
+}
+
+/* Checks the tree and returns its node count.  If avl is true, also checks
+   that it is height-balanced.  */
+static int
+wavl_validate (struct wavl_root *tree, bool avl)
+{
+  struct wavl_node *pos;
+  int height, count = 0, n = 0;
+  int prev = 0;
+
+  if (tree->wavl_node && tree->wavl_node->wavl_parent)
+    FAIL ("Root has a parent");
+  wavl_rank (tree->wavl_node, &height, &count);
+
+  wavl_for_each (pos, tree)
+    {
+      int v = wavl_entry (pos, struct test_node, node)->value;
+
+      if (n > 0 && v < prev)
+        FAIL ("In-order traversal is not sorted");
+      prev = v;
+      n++;
+    }
+  ASSERT (n == count);
+
+  if (avl)
+    {
+      wavl_for_each (pos, tree)
+        {
+          int lh, rh, c = 0;
+
+          wavl_rank (pos->wavl_left, &lh, &c);
+          wavl_rank (pos->wavl_right, &rh, &c);
+          if (lh - rh > 1 || rh - lh > 1)
+            FAIL ("Insert-only tree is not AVL balanced");
+        }
+    }
+  return count;
+}
+
+static int
+tree_height (const struct wavl_node *x)
+{
+  int lh, rh;
+
+  if (x == NULL)
+    return 0;
+  lh = tree_height (x->wavl_left);
+  rh = tree_height (x->wavl_right);
+  return 1 + (lh > rh ? lh : rh);
+}
+
+static void
+shuffle (int *a, int n)
+{
+  int i;
+
+  for (i = n - 1; i > 0; i--)
+    {
+      int j = rand () % (i + 1);
+      int t = a[i];
+      a[i] = a[j];
+      a[j] = t;
+    }
+}
+
+/* ========== TESTS ========== */
+
+TEST (empty_tree)
+{
+  struct wavl_root tree = WAVL_ROOT_INIT;
+  int key = 1;
+
+  ASSERT (wavl_empty (&tree));
+  ASSERT (wavl_first (&tree) == NULL);
+  ASSERT (wavl_last (&tree) == NULL);
+  ASSERT (wavl_find (&key, &tree, comp_value) == NULL);
+  ASSERT (wavl_validate (&tree, true) == 0);
+}
+
+TEST (insert_ascending)
+{
+  struct wavl_root tree = WAVL_ROOT_INIT;
+  static struct test_node nodes[1023];
+  int i;
+
+  for (i = 0; i < 1023; i++)
+    {
+      nodes[i].value = i;
+      wavl_add (&nodes[i].node, &tree, node_less);
+    }
+  ASSERT (wavl_validate (&tree, true) == 1023);
+  /* ascending inserts into an AVL tree give a perfect tree */
+  ASSERT (tree_height (tree.wavl_node) == 10);
+}
+
+TEST (insert_random)
+{
+  struct wavl_root tree = WAVL_ROOT_INIT;
+  static struct test_node nodes[5000];
+  int keys[5000];
+  int i;
+
+  for (i = 0; i < 5000; i++)
+    keys[i] = i;
+  srand (1);
+  shuffle (keys, 5000);
+  for (i = 0; i < 5000; i++)
+    {
+      nodes[i].value = keys[i];
+      wavl_add (&nodes[i].node, &tree, node_less);
+      if (i % 499 == 0)
+        wavl_validate (&tree, true);
+    }
+  ASSERT (wavl_validate (&tree, true) == 5000);
+
+  for (i = 0; i < 5000; i++)
+    {
+      struct wavl_node *n = wavl_find (&i, &tree, comp_value);
+
+      ASSERT (n && wavl_entry (n, struct test_node, node)->value == i);
+    }
+}
+
+TEST (delete_all)
+{
+  struct wavl_root tree = WAVL_ROOT_INIT;
+  static struct test_node nodes[2000];
+  int order[2000];
+  int i, n = 2000;
+
+  for (i = 0; i < n; i++)
+    {
+      nodes[i].value = i;
+      wavl_add (&nodes[i].node, &tree, node_less);
+      order[i] = i;
+    }
+  srand (2);
+  shuffle (order, n);
+  for (i = 0; i < n; i++)
+    {
+      wavl_erase (&nodes[order[i]].node, &tree);
+      if (i % 97 == 0)
+        ASSERT (wavl_validate (&tree, false) == n - i - 1);
+    }
+  ASSERT (wavl_empty (&tree));
+}
+
+TEST (delete_ascending)
+{
+  struct wavl_root tree = WAVL_ROOT_INIT;
+  static struct test_node nodes[1000];
+  int i;
+
+  for (i = 0; i < 1000; i++)
+    {
+      nodes[i].value = i;
+      wavl_add (&nodes[i].node, &tree, node_less);
+    }
+  for (i = 0; i < 1000; i++)
+    {
+      ASSERT (wavl_first (&tree) == &nodes[i].node);
+      wavl_erase (&nodes[i].node, &tree);
+      wavl_validate (&tree, false);
+    }
+  ASSERT (wavl_empty (&tree));
+}
+
+TEST (churn)
+{
+  enum { N = 4096 };
+  struct wavl_root tree = WAVL_ROOT_INIT;
+  static struct test_node nodes[N];
+  static bool present[N];
+  int i, size = 0;
+
+  srand (3);
+  for (i = 0; i < 200000; i++)
+    {
+      int k = rand () % N;
+
+      if (!present[k])
+        {
+          nodes[k].value = k;
+          wavl_add (&nodes[k].node, &tree, node_less);
+          size++;
+        }
+      else
+        {
+          wavl_erase (&nodes[k].node, &tree);
+          size--;
+        }
+      present[k] = !present[k];
+      if (i % 9973 == 0)
+        ASSERT (wavl_validate (&tree, false) == size);
+    }
+  ASSERT (wavl_validate (&tree, false) == size);
+
+  /* height stays within 2 log2 n */
+  ASSERT (tree_height (tree.wavl_node) <= 2 * 12);
+}
+
+TEST (lower_bound)
+{
+  struct wavl_root tree = WAVL_ROOT_INIT;
+  static struct test_node nodes[100];
+  int i;
+
+  for (i = 0; i < 100; i++)
+    {
+      nodes[i].value = i * 2;
+      wavl_add (&nodes[i].node, &tree, node_less);
+    }
+  for (i = -1; i < 200; i++)
+    {
+      struct wavl_node *n = wavl_lower_bound (&i, &tree, comp_value);
+      int expect = i < 0 ? 0 : (i + 1) / 2 * 2;
+
+      if (expect > 198)
+        ASSERT (n == NULL);
+      else
+        ASSERT (n && wavl_entry (n, struct test_node, node)->value == expect);
+    }
+}
+
+TEST (iteration)
+{
+  struct wavl_root tree = WAVL_ROOT_INIT;
+  static struct test_node nodes[300];
+  struct test_node *pos, *tmp;
+  int i, expect = 0;
+
+  for (i = 0; i < 300; i++)
+    {
+      nodes[i].value = (i * 37) % 300;
+      wavl_add (&nodes[i].node, &tree, node_less);
+    }
+  wavl_for_each_entry (pos, &tree, node)
+    ASSERT (pos->value == expect++);
+  ASSERT (expect == 300);
+
+  wavl_for_each_entry_safe (pos, tmp, &tree, node)
+    if (pos->value % 2)
+      wavl_erase (&pos->node, &tree);
+  ASSERT (wavl_validate (&tree, false) == 150);
+
+  expect = 298;
+  for (pos = wavl_entry_safe (wavl_last (&tree), struct test_node, node); pos;
+       pos = wavl_entry_safe (wavl_prev (&pos->node), struct test_node, node))
+    {
+      ASSERT (pos->value == expect);
+      expect -= 2;
+    }
+  ASSERT (expect == -2);
+}
+
+int
+main (void)
+{
+  fprintf (stderr, "=== WAVL Tree Test Suite ===\n\n");
+
+  RUN_TEST (empty_tree);
+  RUN_TEST (insert_ascending);
+  RUN_TEST (insert_random);
+  RUN_TEST (delete_all);
+  RUN_TEST (delete_ascending);
+  RUN_TEST (churn);
+  RUN_TEST (lower_bound);
+  RUN_TEST (iteration);
+
+  fprintf (stderr, "\n=== Results ===\n");
+  fprintf (stderr, "Passed: %d/%d\n", pass_count, test_count);
+
+  return (pass_count == test_count) ? 0 : 1;
+}
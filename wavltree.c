@@ -0,0 +1,364 @@
+/* wavltree.c
+ *
+ * Copyright 2026 Zhengyi Fu <i@fuzy.me>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#include "wavltree.h"
+#include <assert.h>
+
+/* A missing child has rank -1, which is odd. */
+static inline bool
+wavl_parity_of (const struct wavl_node *x)
+{
+  return x ? x->wavl_parity : true;
+}
+
+/* Rank differences are 1 or 2 in a valid tree, so equal parities mean the
+   child x of p is a 2-child.  */
+static inline bool
+wavl_is_2child (const struct wavl_node *x, const struct wavl_node *p)
+{
+  return wavl_parity_of (x) == p->wavl_parity;
+}
+
+static inline void
+wavl_flip (struct wavl_node *x)
+{
+  x->wavl_parity = !x->wavl_parity;
+}
+
+static void
+wavl_rotate_right (struct wavl_node *x, struct wavl_root *tree)
+{
+  /*
+   *     x           y
+   *    / \         / \
+   *   y   z   ->  a   x
+   *  / \             / \
+   * a   b           b   z
+   */
+
+  struct wavl_node *y;
+  struct wavl_node *parent;
+  struct wavl_node *right;
+
+  assert (x != NULL && x->wavl_left != NULL);
+  y = x->wavl_left;
+  parent = y->wavl_parent = x->wavl_parent;
+
+  if (!parent)
+    tree->wavl_node = y;
+  else
+    {
+      if (parent->wavl_left == x)
+        parent->wavl_left = y;
+      else
+        parent->wavl_right = y;
+    }
+  x->wavl_parent = y;
+  right = x->wavl_left = y->wavl_right;
+  if (right)
+    right->wavl_parent = x;
+  y->wavl_right = x;
+}
+
+static void
+wavl_rotate_left (struct wavl_node *x, struct wavl_root *tree)
+{
+  /*
+   *   x             y
+   *  / \           / \
+   * z   y    ->   x   b
+   *    / \       / \
+   *   a   b     z   a
+   */
+
+  struct wavl_node *y;
+  struct wavl_node *parent;
+  struct wavl_node *left;
+
+  assert (x != NULL && x->wavl_right != NULL);
+  y = x->wavl_right;
+  parent = y->wavl_parent = x->wavl_parent;
+  if (!parent)
+    tree->wavl_node = y;
+  else
+    {
+      if (parent->wavl_left == x)
+        parent->wavl_left = y;
+      else
+        parent->wavl_right = y;
+    }
+  x->wavl_parent = y;
+  left = x->wavl_right = y->wavl_left;
+  if (left)
+    left->wavl_parent = x;
+  y->wavl_left = x;
+}
+
+void
+wavl_balance_insert (struct wavl_node *x, struct wavl_root *tree)
+{
+  struct wavl_node *p = x->wavl_parent;
+
+  assert (!x->wavl_parity && !x->wavl_left && !x->wavl_right);
+
+  /* x is a 0-child of p while their parities agree: x starts as a leaf
+     and each promotion lowers the rank difference above it by one.  */
+  while (p != NULL && p->wavl_parity == x->wavl_parity)
+    {
+      if (p->wavl_left == x)
+        {
+          struct wavl_node *y;
+
+          if (!wavl_is_2child (p->wavl_right, p))
+            {
+              /* the sibling is a 1-child: promote p and go up */
+              wavl_flip (p);
+              x = p;
+              p = x->wavl_parent;
+              continue;
+            }
+
+          y = x->wavl_right;
+          if (wavl_is_2child (y, x))
+            {
+              /*
+               *       p            x
+               *      / \          / \
+               *     x   s  ->    a   p
+               *    / \              / \
+               *   a   y            y   s
+               */
+              wavl_rotate_right (p, tree);
+              wavl_flip (p);
+            }
+          else
+            {
+              /*
+               *       p              y
+               *      / \           /   \
+               *     x   s   ->    x     p
+               *    / \           / \   / \
+               *   a   y         a   b c   s
+               *      / \
+               *     b   c
+               */
+              wavl_rotate_left (x, tree);
+              wavl_rotate_right (p, tree);
+              wavl_flip (y);
+              wavl_flip (x);
+              wavl_flip (p);
+            }
+        }
+      else
+        {
+          struct wavl_node *y;
+
+          if (!wavl_is_2child (p->wavl_left, p))
+            {
+              wavl_flip (p);
+              x = p;
+              p = x->wavl_parent;
+              continue;
+            }
+
+          y = x->wavl_left;
+          if (wavl_is_2child (y, x))
+            {
+              wavl_rotate_left (p, tree);
+              wavl_flip (p);
+            }
+          else
+            {
+              wavl_rotate_right (x, tree);
+              wavl_rotate_left (p, tree);
+              wavl_flip (y);
+              wavl_flip (x);
+              wavl_flip (p);
+            }
+        }
+      break;
+    }
+}
+
+/* Demotes p and returns true if p became a 3-child of its parent. */
+static inline bool
+wavl_demote (struct wavl_node *p)
+{
+  struct wavl_node *g = p->wavl_parent;
+  bool three = g != NULL && wavl_is_2child (p, g);
+
+  wavl_flip (p);
+  return three;
+}
+
+/* Rebalances after x (possibly NULL) became a 3-child of p. */
+static void
+wavl_fix_3child (struct wavl_node *x, struct wavl_node *p,
+                 struct wavl_root *tree)
+{
+  for (;;)
+    {
+      /* the sibling of a 3-child has rank at least 0, so if x is NULL it
+         is the missing child  */
+      bool left = p->wavl_left == x;
+      struct wavl_node *y = left ? p->wavl_right : p->wavl_left;
+      bool three;
+
+      assert (y != NULL);
+      if (wavl_is_2child (y, p))
+        three = wavl_demote (p);
+      else if (wavl_is_2child (y->wavl_left, y)
+               && wavl_is_2child (y->wavl_right, y))
+        {
+          /* y is a 2,2 node: demote both */
+          wavl_flip (y);
+          three = wavl_demote (p);
+        }
+      else if (left)
+        {
+          struct wavl_node *w = y->wavl_right;
+
+          if (!wavl_is_2child (w, y))
+            {
+              /*
+               *     p              y
+               *    / \            / \
+               *   x   y    ->    p   w
+               *      / \        / \
+               *     v   w      x   v
+               */
+              wavl_rotate_left (p, tree);
+              wavl_flip (y);
+              /* demote p once, or twice if it became a leaf */
+              if (p->wavl_left != NULL || p->wavl_right != NULL)
+                wavl_flip (p);
+            }
+          else
+            {
+              /*
+               *     p                v
+               *    / \             /   \
+               *   x   y    ->     p     y
+               *      / \         / \   / \
+               *     v   w       x   a b   w
+               *    / \
+               *   a   b
+               */
+              wavl_rotate_right (y, tree);
+              wavl_rotate_left (p, tree);
+              wavl_flip (y);
+            }
+          return;
+        }
+      else
+        {
+          struct wavl_node *w = y->wavl_left;
+
+          if (!wavl_is_2child (w, y))
+            {
+              wavl_rotate_right (p, tree);
+              wavl_flip (y);
+              if (p->wavl_left != NULL || p->wavl_right != NULL)
+                wavl_flip (p);
+            }
+          else
+            {
+              wavl_rotate_left (y, tree);
+              wavl_rotate_right (p, tree);
+              wavl_flip (y);
+            }
+          return;
+        }
+
+      if (!three)
+        return;
+      x = p;
+      p = x->wavl_parent;
+    }
+}
+
+void
+wavl_erase (struct wavl_node *x, struct wavl_root *tree)
+{
+  /* y is either x or x's successor, which has at most one child */
+  struct wavl_node *y = x;
+  struct wavl_node *z;
+  struct wavl_node *p;
+  bool three;
+
+  if (x->wavl_left && x->wavl_right)
+    y = wavl_min (x->wavl_right);
+
+  z = y->wavl_left ? y->wavl_left : y->wavl_right;
+  p = y->wavl_parent;
+
+  /* z takes the place of y one rank lower */
+  three = p != NULL && wavl_is_2child (y, p);
+
+  /* remove y */
+  if (z != NULL)
+    z->wavl_parent = p;
+  if (!p)
+    tree->wavl_node = z;
+  else if (p->wavl_left == y)
+    p->wavl_left = z;
+  else
+    p->wavl_right = z;
+
+  if (x != y)
+    {
+      struct wavl_node *tmp;
+
+      /* replace x by y */
+      tmp = y->wavl_left = x->wavl_left;
+      if (tmp)
+        tmp->wavl_parent = y;
+      tmp = y->wavl_right = x->wavl_right;
+      if (tmp)
+        tmp->wavl_parent = y;
+      tmp = y->wavl_parent = x->wavl_parent;
+      if (!tmp)
+        tree->wavl_node = y;
+      else if (tmp->wavl_left == x)
+        tmp->wavl_left = y;
+      else
+        tmp->wavl_right = y;
+      y->wavl_parity = x->wavl_parity;
+
+      if (p == x)
+        p = y;
+    }
+
+  if (p == NULL)
+    return;
+
+  if (!three)
+    {
+      /* z is a 2-child now, which is only wrong if p is a leaf of rank 1 */
+      if (p->wavl_left != NULL || p->wavl_right != NULL)
+        return;
+      if (!wavl_demote (p))
+        return;
+      z = p;
+      p = z->wavl_parent;
+    }
+
+  wavl_fix_3child (z, p, tree);
+}
@@ -0,0 +1,253 @@
+/* wavltree.h
+ *
+ * Copyright 2026 Zhengyi Fu <i@fuzy.me>
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ * SPDX-License-Identifier: GPL-3.0-or-later
+ */
+
+#ifndef WAVLTREE_H
+#define WAVLTREE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "container_of.h"
+#include "defs.h"
+
+C_DECL_BEGIN
+
+/* Weak AVL tree (Haeupler, Sen and Tarjan, "Rank-Balanced Trees").
+
+   Every node has a rank, missing children have rank -1 and leaves rank 0,
+   and the rank difference between a parent and a child is 1 or 2.  Only
+   the parity of the rank is stored, which is enough to recover every rank
+   difference.  Built by insertions alone the tree is an AVL tree.  A
+   deletion does at most two rotations, against O(log n) for AVL.  */
+
+struct wavl_node
+{
+  struct wavl_node *wavl_left;
+  struct wavl_node *wavl_right;
+  struct wavl_node *wavl_parent;
+  bool wavl_parity; /* rank parity, missing children count as odd */
+};
+
+struct wavl_root
+{
+  struct wavl_node *wavl_node;
+};
+
+/* clang-format off */
+#define WAVL_ROOT_INIT { NULL }
+/* clang-format on */
+
+static inline void
+wavl_root_init (struct wavl_root *tree)
+{
+  tree->wavl_node = NULL;
+}
+
+static inline struct wavl_node *
+wavl_min (const struct wavl_node *x)
+{
+  struct wavl_node *y = NULL;
+  while (x != NULL)
+    {
+      y = (struct wavl_node *)x;
+      x = x->wavl_left;
+    }
+  return y;
+}
+
+static inline struct wavl_node *
+wavl_max (const struct wavl_node *x)
+{
+  struct wavl_node *y = NULL;
+  while (x != NULL)
+    {
+      y = (struct wavl_node *)x;
+      x = x->wavl_right;
+    }
+  return y;
+}
+
+static inline struct wavl_node *
+wavl_prev (const struct wavl_node *x)
+{
+  struct wavl_node *p;
+
+  if (x == NULL)
+    return NULL;
+
+  if (x->wavl_left != NULL)
+    return wavl_max (x->wavl_left);
+
+  p = x->wavl_parent;
+  while (p && p->wavl_left == x)
+    {
+      x = p;
+      p = x->wavl_parent;
+    }
+
+  return p;
+}
+
+static inline struct wavl_node *
+wavl_next (const struct wavl_node *x)
+{
+  struct wavl_node *p;
+
+  if (x == NULL)
+    return NULL;
+
+  if (x->wavl_right != NULL)
+    return wavl_min (x->wavl_right);
+
+  p = x->wavl_parent;
+  while (p && p->wavl_right == x)
+    {
+      x = p;
+      p = x->wavl_parent;
+    }
+
+  return p;
+}
+
+/* Link node x to parent. */
+static inline void
+wavl_link_node (struct wavl_node *x, struct wavl_node *parent,
+                struct wavl_node **link)
+{
+  *link = x;
+  x->wavl_parent = parent;
+  x->wavl_left = x->wavl_right = NULL;
+  x->wavl_parity = false;
+}
+
+static inline struct wavl_node *
+wavl_first (const struct wavl_root *tree)
+{
+  return wavl_min (tree->wavl_node);
+}
+
+static inline struct wavl_node *
+wavl_last (const struct wavl_root *tree)
+{
+  return wavl_max (tree->wavl_node);
+}
+
+static inline bool
+wavl_empty (const struct wavl_root *tree)
+{
+  return tree->wavl_node == NULL;
+}
+
+#define wavl_for_each(pos, tree)                                              \
+  for ((pos) = wavl_first ((tree)); (pos) != NULL; (pos) = wavl_next ((pos)))
+
+#define wavl_for_each_safe(pos, n, tree)                                      \
+  for ((void)(((pos) = wavl_first (tree)) && ((n) = wavl_next (pos)));        \
+       (pos) != NULL; (void)(((pos) = (n)) && ((n) = wavl_next (pos))))
+
+#define wavl_entry(ptr, type, member) container_of (ptr, type, member)
+
+#define wavl_entry_safe(ptr, type, member)                                    \
+  ((ptr) ? wavl_entry (ptr, type, member) : NULL)
+
+#define wavl_first_entry(type, tree, member)                                  \
+  wavl_entry_safe (wavl_first (tree), type, member)
+
+#define wavl_next_entry(pos, member)                                          \
+  wavl_entry_safe (wavl_next (&(pos)->member), typeof (*pos), member)
+
+#define wavl_for_each_entry(pos, tree, member)                                \
+  for ((pos) = wavl_first_entry (typeof (*pos), tree, member); (pos);         \
+       (pos) = wavl_next_entry (pos, member))
+
+#define wavl_for_each_entry_safe(pos, n, tree, member)                        \
+  for ((void)(((pos) = wavl_first_entry (typeof (*pos), tree, member))        \
+              && ((n) = wavl_next_entry (pos, member)));                      \
+       (pos); (void)(((pos) = (n)) && ((n) = wavl_next_entry (pos, member))))
+
+static inline struct wavl_node *
+wavl_find (const void *__restrict key, struct wavl_root *root,
+           int (*comp) (const void *, const struct wavl_node *))
+{
+  struct wavl_node *node = root->wavl_node;
+
+  while (node != NULL)
+    {
+      int c = comp (key, node);
+
+      if (c < 0)
+        node = node->wavl_left;
+      else if (c > 0)
+        node = node->wavl_right;
+      else
+        return node;
+    }
+  return NULL;
+}
+
+/* Returns the first node that does not compare less than key. */
+static inline struct wavl_node *
+wavl_lower_bound (const void *__restrict key, struct wavl_root *root,
+                  int (*comp) (const void *, const struct wavl_node *))
+{
+  struct wavl_node *node = root->wavl_node;
+  struct wavl_node *result = NULL;
+
+  while (node != NULL)
+    {
+      if (comp (key, node) <= 0)
+        {
+          result = node;
+          node = node->wavl_left;
+        }
+      else
+        node = node->wavl_right;
+    }
+  return result;
+}
+
+void wavl_balance_insert (struct wavl_node *node, struct wavl_root *tree);
+
+void wavl_erase (struct wavl_node *node, struct wavl_root *tree);
+
+static inline void
+wavl_add (struct wavl_node *__restrict x, struct wavl_root *root,
+          bool (*less) (const struct wavl_node *, const struct wavl_node *))
+{
+  struct wavl_node *parent = NULL;
+  struct wavl_node **link = &root->wavl_node;
+
+  while (*link != NULL)
+    {
+      parent = *link;
+
+      if (less (x, parent))
+        link = &parent->wavl_left;
+      else
+        link = &parent->wavl_right;
+    }
+
+  wavl_link_node (x, parent, link);
+  wavl_balance_insert (x, root);
+}
+
+C_DECL_END
+
+#endif // !WAVLTREE_H
@@ -0,0 +1,150 @@
+/* Copyright © 2026  Zhengyi Fu <i@fuzy.me> */
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+/* Compares the memory and lookup cost of the generic xarray against
+   arrays declared with XA_DECLARE for several fanouts, with 64-bit and
+   32-bit indices.  The dense set is 0 .. n - 1, the sparse one holds n
+   random 32-bit indices.  */
+
+#include "bench.h"
+#include "xarray.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define ENTRY(i) ((void *)(((unsigned long)(i) << 2) | 4))
+
+XA_DECLARE (xa4, unsigned long, 4)
+XA_DECLARE (xa6, unsigned long, 6)
+XA_DECLARE (xa8, unsigned long, 8)
+XA_DECLARE (xa4_32, uint32_t, 4)
+XA_DECLARE (xa6_32, uint32_t, 6)
+XA_DECLARE (xa8_32, uint32_t, 8)
+
+static void
+report (const char *api, const char *set, size_t bytes, double store,
+        double load, unsigned long n)
+{
+  printf ("%-8s %-7s %10.1f B/entry %8.1f ns/store %8.1f ns/load\n", api,
+          set, (double)bytes / n, store / n, load / n);
+}
+
+static void
+bench_xarray (const char *set, const uint32_t *keys, unsigned long n)
+{
+  struct xarray xa = XA_INIT;
+  unsigned long i, found = 0;
+  double t, store;
+
+  t = bench_now ();
+  for (i = 0; i < n; i++)
+    xa_store (&xa, keys[i], ENTRY (i));
+  store = bench_now () - t;
+
+  t = bench_now ();
+  for (i = 0; i < n; i++)
+    found += xa_load (&xa, keys[(i * 7919) % n]) != NULL;
+  report ("xarray", set, xa.xa_node_num * sizeof (struct xa_node), store,
+          bench_now () - t, n);
+
+  if (found < n)
+    fprintf (stderr, "xarray: inconsistent result\n");
+  xa_destroy (&xa);
+}
+
+/* Defines bench_name for an array declared with XA_DECLARE. */
+#define BENCH_DECLARE(name)						\
+  static void								\
+  bench_##name (const char *set, const uint32_t *keys, unsigned long n) \
+  {									\
+    struct name xa;							\
+    unsigned long i, found = 0;						\
+    double t, store;							\
+									\
+    name##_init (&xa);							\
+    t = bench_now ();							\
+    for (i = 0; i < n; i++)						\
+      name##_store (&xa, keys[i], ENTRY (i));				\
+    store = bench_now () - t;						\
+									\
+    t = bench_now ();							\
+    for (i = 0; i < n; i++)						\
+      found += name##_load (&xa, keys[(i * 7919) % n]) != NULL;		\
+    report (#name, set, name##_memory (&xa), store, bench_now () - t, n); \
+									\
+    if (found < n)							\
+      fprintf (stderr, #name ": inconsistent result\n");		\
+    name##_destroy (&xa);						\
+  }
+
+BENCH_DECLARE (xa4)
+BENCH_DECLARE (xa6)
+BENCH_DECLARE (xa8)
+BENCH_DECLARE (xa4_32)
+BENCH_DECLARE (xa6_32)
+BENCH_DECLARE (xa8_32)
+
+static void
+bench_all (const char *set, const uint32_t *keys, unsigned long n)
+{
+  bench_xarray (set, keys, n);
+  bench_xa4 (set, keys, n);
+  bench_xa6 (set, keys, n);
+  bench_xa8 (set, keys, n);
+  bench_xa4_32 (set, keys, n);
+  bench_xa6_32 (set, keys, n);
+  bench_xa8_32 (set, keys, n);
+}
+
+int
+main (int argc, char *argv[])
+{
+  unsigned long n = 1000000;
+  uint32_t *keys;
+  unsigned long i;
+
+  if (argc > 2)
+    {
+      fprintf (stderr, "Usage: %s [count]\n", argv[0]);
+      return 1;
+    }
+  if (argc == 2)
+    n = strtoul (argv[1], NULL, 0);
+  if (n == 0 || n > UINT32_MAX)
+    return 0;
+
+  keys = malloc (n * sizeof (*keys));
+  if (!keys)
+    {
+      perror ("malloc");
+      return 1;
+    }
+
+  printf ("%lu keys, sizeof (struct xa_node) = %zu\n", n,
+          sizeof (struct xa_node));
+  for (i = 0; i < n; i++)
+    keys[i] = i;
+  bench_all ("dense", keys, n);
+
+  /* distinct, since the multiplier is odd */
+  for (i = 0; i < n; i++)
+    keys[i] = (uint32_t)((i + 1) * 0x9E3779B1u);
+  bench_all ("sparse", keys, n);
+
+  free (keys);
+  return 0;
+}
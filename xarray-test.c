@@ -1,56 +1,1140 @@
+/* Copyright © 2026  Zhengyi Fu <i@fuzy.me> */
+
+/*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
 #include "xarray.h"
-#include <assert.h>
+#include "rcu.h"
+#include <errno.h>
 #include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 
-int
-main ()
+#include "test.h"
+
+/* Distinct non-NULL entries for index i. */
+#define ITEM(i) ((void *)(((unsigned long)(i) << 2) | 4))
+
+/* ========== TESTS ========== */
+
+TEST (store_load)
 {
-  unsigned long i;
+  unsigned long i, n = 0;
   struct xarray xa = XA_INIT;
   void *v;
 
   for (i = 0; i < 100; ++i)
+    ASSERT (xa_store (&xa, i * 10, &i) != XA_FAILED);
+
+  xa_for_each (&xa, i, v)
     {
-      if (xa_store (&xa, i * 10, &i) == XA_FAILED)
+      ASSERT (v != 0);
+      ASSERT (i <= 1000);
+      ASSERT (i % 10 == 0);
+      ASSERT (xa_load (&xa, i) == v);
+      n++;
+    }
+  ASSERT (n == 100);
+
+  i = 0;
+  ASSERT (xa_store (&xa, i, &i) != XA_FAILED);
+
+  i = 0xffffffff;
+  ASSERT (xa_store (&xa, i, &i) != XA_FAILED);
+  ASSERT (xa_size (&xa) == 101);
+  ASSERT (xa_load (&xa, i) == &i);
+
+  xa_erase (&xa, i);
+  xa_release (&xa);
+  ASSERT (xa_size (&xa) == 100);
+  ASSERT (xa_load (&xa, 0xffffffff) == NULL);
+  ASSERT (xa_load (&xa, 990) == &i);
+
+  xa_destroy (&xa);
+}
+
+TEST (marks)
+{
+  struct xarray xa = XA_INIT;
+  unsigned long i;
+
+  for (i = 0; i < 1000; i++)
+    xa_store (&xa, i, ITEM (i));
+
+  ASSERT (!xa_marked (&xa, XA_MARK_0));
+  xa_set_mark (&xa, 10, XA_MARK_0);
+  xa_set_mark (&xa, 500, XA_MARK_1);
+  ASSERT (xa_marked (&xa, XA_MARK_0));
+  ASSERT (xa_marked (&xa, XA_MARK_1));
+  ASSERT (!xa_marked (&xa, XA_MARK_2));
+  ASSERT (xa_get_mark (&xa, 10, XA_MARK_0));
+  ASSERT (!xa_get_mark (&xa, 10, XA_MARK_1));
+  ASSERT (!xa_get_mark (&xa, 11, XA_MARK_0));
+  ASSERT (xa_get_mark (&xa, 500, XA_MARK_1));
+
+  /* marks on absent entries are ignored */
+  xa_set_mark (&xa, 5000, XA_MARK_2);
+  ASSERT (!xa_get_mark (&xa, 5000, XA_MARK_2));
+  ASSERT (!xa_marked (&xa, XA_MARK_2));
+
+  /* replacing an entry keeps its marks, erasing it drops them */
+  xa_store (&xa, 10, ITEM (11));
+  ASSERT (xa_get_mark (&xa, 10, XA_MARK_0));
+  xa_erase (&xa, 10);
+  ASSERT (!xa_get_mark (&xa, 10, XA_MARK_0));
+  ASSERT (!xa_marked (&xa, XA_MARK_0));
+  xa_store (&xa, 10, ITEM (10));
+  ASSERT (!xa_get_mark (&xa, 10, XA_MARK_0));
+
+  xa_clear_mark (&xa, 500, XA_MARK_1);
+  ASSERT (!xa_marked (&xa, XA_MARK_1));
+
+  xa_destroy (&xa);
+}
+
+TEST (marks_survive_growth)
+{
+  struct xarray xa = XA_INIT;
+
+  xa_store (&xa, 3, ITEM (3));
+  xa_set_mark (&xa, 3, XA_MARK_2);
+  /* adds levels above the marked leaf */
+  xa_store (&xa, 1ul << 40, ITEM (1));
+  ASSERT (xa_get_mark (&xa, 3, XA_MARK_2));
+  ASSERT (xa_marked (&xa, XA_MARK_2));
+
+  xa_erase (&xa, 1ul << 40);
+  xa_release (&xa);
+  ASSERT (xa_get_mark (&xa, 3, XA_MARK_2));
+  ASSERT (xa_marked (&xa, XA_MARK_2));
+
+  xa_destroy (&xa);
+}
+
+TEST (for_each_marked)
+{
+  enum { N = 200000 };
+  struct xarray xa = XA_INIT;
+  static bool marked[N];
+  unsigned long i, index, n = 0, expect = 0;
+  void *v;
+
+  srand (1);
+  for (i = 0; i < N; i++)
+    {
+      xa_store (&xa, i, ITEM (i));
+      /* sparse and clustered marks */
+      marked[i] = rand () % 1000 == 0 || (i >= 70000 && i < 70100);
+      if (marked[i])
         {
-          printf ("failed to insert %li\n", i * 10);
+          xa_set_mark (&xa, i, XA_MARK_1);
+          expect++;
         }
     }
 
-  xa_for_each (&xa, i, v)
+  i = 0;
+  xa_for_each_marked (&xa, index, v, XA_MARK_1)
+    {
+      while (!marked[i])
+        i++;
+      ASSERT (index == i);
+      ASSERT (v == ITEM (i));
+      i++;
+      n++;
+    }
+  ASSERT (n == expect);
+
+  /* bounded range */
+  n = 0;
+  xa_for_each_marked_range (&xa, index, v, 69990, 70049, XA_MARK_1)
+    {
+      ASSERT (index >= 69990 && index <= 70049);
+      ASSERT (marked[index]);
+      n++;
+    }
+  for (i = 69990, expect = 0; i <= 70049; i++)
+    expect += marked[i];
+  ASSERT (n == expect);
+
+  /* no entry has the mark */
+  xa_for_each_marked (&xa, index, v, XA_MARK_0)
+    FAIL ("Found an entry without the mark");
+
+  /* clearing every mark leaves nothing to find */
+  for (i = 0; i < N; i++)
+    if (marked[i])
+      xa_clear_mark (&xa, i, XA_MARK_1);
+  ASSERT (!xa_marked (&xa, XA_MARK_1));
+  xa_for_each_marked (&xa, index, v, XA_MARK_1)
+    FAIL ("Found an entry after clearing all marks");
+
+  xa_destroy (&xa);
+}
+
+TEST (for_each_marked_sparse)
+{
+  struct xarray xa = XA_INIT;
+  static const unsigned long idx[]
+      = { 0, 63, 64, 4095, 4096, 1ul << 30, (1ul << 30) + 2, XA_INDEX_MAX };
+  const size_t n = sizeof (idx) / sizeof (idx[0]);
+  unsigned long index;
+  size_t i = 0;
+  void *v;
+
+  for (i = 0; i < n; i++)
     {
-      assert (v != 0);
-      assert (i <= 1000);
-      assert (xa_load (&xa, i) == v);
-      printf ("%lu = %p\n", i, v);
+      xa_store (&xa, idx[i], ITEM (i));
+      xa_store (&xa, idx[i] ^ 1, ITEM (i + 100));
+      xa_set_mark (&xa, idx[i], XA_MARK_0);
     }
 
   i = 0;
-  if (xa_store (&xa, i, &i) == XA_FAILED)
+  xa_for_each_marked (&xa, index, v, XA_MARK_0)
     {
-      perror ("failed to insert 0");
+      ASSERT (i < n);
+      ASSERT (index == idx[i]);
+      ASSERT (v == ITEM (i));
+      i++;
     }
+  ASSERT (i == n);
 
-  i = 0xffffffff;
-  if (xa_store (&xa, i, &i) == XA_FAILED)
+  xa_destroy (&xa);
+}
+
+TEST (value_entries)
+{
+  struct xarray xa = XA_INIT;
+  unsigned long index;
+  void *v;
+
+  ASSERT (xa_is_value (xa_mk_value (0)));
+  ASSERT (xa_to_value (xa_mk_value (0)) == 0);
+  ASSERT (xa_to_value (xa_mk_value (LONG_MAX)) == LONG_MAX);
+  ASSERT (!xa_is_value (ITEM (1)));
+
+  xa_store (&xa, 5, xa_mk_value (0));
+  xa_store (&xa, 6, ITEM (6));
+  ASSERT (xa_load (&xa, 5) == xa_mk_value (0));
+  ASSERT (xa_size (&xa) == 2);
+  xa_for_each (&xa, index, v)
+    ASSERT (index == 5 ? v == xa_mk_value (0) : v == ITEM (6));
+  xa_destroy (&xa);
+}
+
+static unsigned int
+leaf_width (const struct xarray *xa, unsigned long index)
+{
+  const struct xa_node *leaf = xa_find_node_by_index (xa, index);
+
+  ASSERT (leaf);
+  return leaf->xa_packed;
+}
+
+TEST (packed_leaves)
+{
+  enum { N = 10000 };
+  struct xarray xa = XA_INIT_FLAGS (XA_FLAGS_PACKED);
+  unsigned long i, index, n = 0;
+  void *v;
+
+  for (i = 0; i < N; i++)
+    ASSERT (xa_store (&xa, i, xa_mk_value (i % 200)) != XA_FAILED);
+  ASSERT (xa_size (&xa) == N);
+  ASSERT (leaf_width (&xa, 0) == 1);
+  ASSERT (leaf_width (&xa, N - 1) == 1);
+
+  xa_for_each (&xa, index, v)
     {
-      printf ("failed to insert %li\n", i * 1000);
+      ASSERT (v == xa_mk_value (index % 200));
+      n++;
     }
-  printf ("size: %lu\n", xa_size (&xa));
-  printf ("levels: %u\n", xa.xa_levels);
-  printf ("num_nodes: %lu\n", xa.xa_node_num);
+  ASSERT (n == N);
 
-  xa_erase (&xa, i);
+  /* widening keeps the other entries and the marks */
+  xa_set_mark (&xa, 65, XA_MARK_1);
+  ASSERT (xa_store (&xa, 70, xa_mk_value (1000)) == xa_mk_value (70));
+  ASSERT (leaf_width (&xa, 70) == 2);
+  ASSERT (xa_store (&xa, 71, xa_mk_value (1ul << 20)) == xa_mk_value (71));
+  ASSERT (leaf_width (&xa, 70) == 4);
+  ASSERT (xa_store (&xa, 72, ITEM (72)) == xa_mk_value (72));
+  ASSERT (leaf_width (&xa, 70) == 0);
+  ASSERT (leaf_width (&xa, 0) == 1);
+  for (i = 64; i < 128; i++)
+    {
+      void *expect = i == 70   ? xa_mk_value (1000)
+                     : i == 71 ? xa_mk_value (1ul << 20)
+                     : i == 72 ? ITEM (72)
+                               : xa_mk_value (i % 200);
+
+      ASSERT (xa_load (&xa, i) == expect);
+    }
+  ASSERT (xa_get_mark (&xa, 65, XA_MARK_1));
+  xa_for_each_marked (&xa, index, v, XA_MARK_1)
+    ASSERT (index == 65 && v == xa_mk_value (65));
+
+  /* erasing from a packed leaf */
+  ASSERT (xa_erase (&xa, 3) == xa_mk_value (3));
+  ASSERT (xa_load (&xa, 3) == NULL);
+  ASSERT (xa_size (&xa) == N - 1);
+  index = 0;
+  ASSERT (xa_insert (&xa, &index, xa_mk_value (9), N) == 0);
+  ASSERT (index == 3);
+  ASSERT (xa_load (&xa, 3) == xa_mk_value (9));
+
+  /* a leaf started with a pointer is not packed */
+  xa_store (&xa, 1ul << 20, ITEM (0));
+  ASSERT (leaf_width (&xa, 1ul << 20) == 0);
+
+  xa_release (&xa);
+  ASSERT (xa_load (&xa, 2) == xa_mk_value (2));
+  xa_destroy (&xa);
+}
+
+TEST (range_entries)
+{
+  struct xarray xa = XA_INIT;
+  unsigned long i, n = 0, first = 0, span = 1ul << (2 * XA_BITS);
+  void *v;
+
+  /* a range of 3 aligned slots and an unaligned head and tail */
+  ASSERT (xa_store_range (&xa, span - 5, 4 * span + 2, ITEM (1)) == 0);
+  ASSERT (xa_size (&xa) == 3 * span + 8);
+  ASSERT (xa_load (&xa, span - 6) == NULL);
+  ASSERT (xa_load (&xa, 4 * span + 3) == NULL);
+  for (i = span - 5; i <= 4 * span + 2; i++)
+    ASSERT (xa_load (&xa, i) == ITEM (1));
+  ASSERT (xa_get_order (&xa, span - 1) == 0);
+  ASSERT (xa_get_order (&xa, 2 * span + 7) == 2 * XA_BITS);
+  ASSERT (xa.xa_node_num < 8);
+
+  /* one visit per slot, at its first index inside the range */
+  xa_for_each (&xa, i, v)
+    {
+      if (n++ == 0)
+        first = i;
+      ASSERT (v == ITEM (1));
+    }
+  ASSERT (first == span - 5);
+  ASSERT (n == 5 + 3 + 3);
+
+  i = 2 * span + 7;
+  ASSERT (xa_find (&xa, &i, XA_INDEX_MAX) == ITEM (1) && i == 2 * span + 7);
+  ASSERT (xa_find_after (&xa, &i, XA_INDEX_MAX) == ITEM (1) && i == 3 * span);
+
+  /* a value range over existing entries replaces their subtrees */
+  for (i = 0; i < 100; i++)
+    xa_store (&xa, 5 * span + i, ITEM (i));
+  ASSERT (xa_store_range (&xa, 5 * span, 6 * span - 1, xa_mk_value (7)) == 0);
+  ASSERT (xa_load (&xa, 5 * span + 50) == xa_mk_value (7));
+  ASSERT (xa_size (&xa) == 4 * span + 8);
+
+  ASSERT (xa_store_range (&xa, 0, XA_INDEX_MAX / 2, NULL) == 0);
+  ASSERT (xa_size (&xa) == 0);
+  xa_release (&xa);
+  ASSERT (xa.xa_node_num == 0);
+
+  ASSERT (xa_store_range (&xa, 0, 0, (void *)2) == -1);
+
+  /* the whole index space has more values than xa_size can count */
+  ASSERT (xa_store_range (&xa, 0, XA_INDEX_MAX, ITEM (1)) == -1);
+  ASSERT (errno == EINVAL && xa_load (&xa, 0) == NULL);
+  ASSERT (xa_store_range (&xa, 1, XA_INDEX_MAX, ITEM (1)) == 0);
+  ASSERT (xa_size (&xa) == XA_INDEX_MAX);
+  ASSERT (xa_load (&xa, 0) == NULL && xa_load (&xa, XA_INDEX_MAX) == ITEM (1));
+  xa_destroy (&xa);
+}
+
+TEST (range_split)
+{
+  struct xarray xa = XA_INIT_FLAGS (XA_FLAGS_PACKED);
+  unsigned long i, span = 1ul << (2 * XA_BITS), n = 0;
+  void *v;
+
+  ASSERT (xa_store_range (&xa, 0, 2 * span - 1, xa_mk_value (3)) == 0);
+
+  /* marks apply to single indices */
+  xa_set_mark (&xa, 0, XA_MARK_0);
+  xa_set_mark (&xa, span, XA_MARK_1);
+  ASSERT (xa_get_order (&xa, 0) == 0);
+  ASSERT (xa_get_order (&xa, span - 1) == XA_BITS);
+  for (i = 0; i < 2 * span; i++)
+    {
+      ASSERT (xa_get_mark (&xa, i, XA_MARK_0) == (i == 0));
+      ASSERT (xa_get_mark (&xa, i, XA_MARK_1) == (i == span));
+    }
+
+  xa_erase (&xa, 100);
+  ASSERT (xa_store (&xa, span + 1, ITEM (1)) == xa_mk_value (3));
+  ASSERT (xa_load (&xa, 99) == xa_mk_value (3));
+  ASSERT (xa_load (&xa, 100) == NULL);
+  ASSERT (xa_load (&xa, 101) == xa_mk_value (3));
+  ASSERT (xa_load (&xa, span + 1) == ITEM (1));
+  ASSERT (xa_size (&xa) == 2 * span - 1);
+  ASSERT (xa_get_mark (&xa, span, XA_MARK_1));
+
+  /* a whole range keeps one mark bit per slot */
+  ASSERT (xa_store_range (&xa, 4 * span, 8 * span - 1, ITEM (2)) == 0);
+  xa_set_mark (&xa, 4 * span, XA_MARK_2);
+  xa_clear_mark (&xa, 4 * span, XA_MARK_2);
+  ASSERT (!xa_get_mark (&xa, 4 * span + 1, XA_MARK_2));
+  xa_for_each_marked (&xa, i, v, XA_MARK_2)
+    n++;
+  ASSERT (n == 0);
+  ASSERT (xa_store_range (&xa, 4 * span, 8 * span - 1, ITEM (2)) == 0);
+  ASSERT (xa_get_order (&xa, 4 * span) == 2 * XA_BITS);
+  xa_release (&xa);
+  ASSERT (xa_load (&xa, 5 * span) == ITEM (2));
+  xa_destroy (&xa);
+}
+
+TEST (node_cache)
+{
+  struct xarray xa = XA_INIT;
+  struct xa_stats st;
+  unsigned long i, allocs;
+
+  for (i = 0; i < 64 * 100; i++)
+    xa_store (&xa, i, ITEM (i));
+  xa_get_stats (&xa, &st);
+  ASSERT (st.xs_reused == 0 && st.xs_cached == 0);
+  allocs = st.xs_allocs;
+
+  /* the freed leaves are reused, up to the cache limit */
+  for (i = 0; i < 64 * 100; i++)
+    xa_erase (&xa, i);
+  xa_release (&xa);
+  xa_get_stats (&xa, &st);
+  ASSERT (st.xs_frees == allocs);
+  ASSERT (st.xs_cached == XA_CACHE_MAX);
+  for (i = 0; i < 64 * 100; i++)
+    xa_store (&xa, i, ITEM (i));
+  xa_get_stats (&xa, &st);
+  ASSERT (st.xs_reused == XA_CACHE_MAX);
+  ASSERT (st.xs_allocs == 2 * allocs);
+  ASSERT (st.xs_cached == 0);
+  ASSERT ((unsigned long)xa.xa_node_num == allocs);
+  xa_destroy (&xa);
+}
+
+struct test_allocator
+{
+  long live;
+  bool fail;
+};
+
+static void *
+counting_alloc (size_t size, void *priv)
+{
+  struct test_allocator *ta = priv;
+
+  if (ta->fail)
+    return NULL;
+  ta->live++;
+  return malloc (size);
+}
+
+static void
+counting_free (void *ptr, size_t size, void *priv)
+{
+  struct test_allocator *ta = priv;
+
+  (void)size;
+  ta->live--;
+  free (ptr);
+}
+
+TEST (reserve)
+{
+  struct test_allocator ta = { 0, false };
+  const struct xa_allocator alloc = { counting_alloc, counting_free, &ta };
+  struct xarray xa = XA_INIT_FLAGS (XA_FLAGS_PACKED);
+  unsigned long i, first = 1ul << 20;
+
+  xa_set_allocator (&xa, &alloc);
+  ASSERT (xa_store (&xa, 5, xa_mk_value (5)) != XA_FAILED);
+
+  ASSERT (xa_reserve (&xa, first, first + 1000) == 0);
+  ta.fail = true;
+  for (i = first; i <= first + 1000; i++)
+    ASSERT (xa_store (&xa, i, xa_mk_value (i & 0xff)) != XA_FAILED);
+  /* a leaf widened to pointers takes the spare node */
+  ASSERT (xa_store (&xa, first, ITEM (0)) != XA_FAILED);
+  ASSERT (xa_load (&xa, first + 1000) == xa_mk_value ((first + 1000) & 0xff));
+  ASSERT (xa_load (&xa, 5) == xa_mk_value (5));
+  ASSERT (xa_size (&xa) == 1002);
+
+  ASSERT (xa_store (&xa, 1ul << 30, ITEM (1)) == XA_FAILED);
+
+  ta.fail = false;
+  xa_destroy (&xa);
+  ASSERT (ta.live == 0);
+}
+
+TEST (cursor)
+{
+  struct xarray xa = XA_INIT_FLAGS (XA_FLAGS_PACKED);
+  XA_STATE (xas, &xa, 0);
+  struct xa_node *leaf = NULL;
+  unsigned long i, n = 0, moves = 0;
+  void *v;
+
+  /* values up to 4999 make the cursor's leaf repack under it */
+  for (i = 0; i < 5000; i++)
+    {
+      ASSERT (xas_store (&xas, xa_mk_value (i)) == NULL);
+      xas_next (&xas);
+    }
+  ASSERT (xa_size (&xa) == 5000);
+  ASSERT (xa_load (&xa, 4999) == xa_mk_value (4999));
+  ASSERT (xas.xas_index == 5000 && xas_load (&xas) == NULL);
+
+  /* a dense scan only moves to another node at leaf boundaries */
+  xas_set (&xas, 0);
+  xas_for_each (&xas, v, XA_INDEX_MAX)
+    {
+      ASSERT (v == xa_mk_value (xas.xas_index));
+      if (xas.xas_node != leaf)
+        moves++;
+      leaf = xas.xas_node;
+      n++;
+    }
+  ASSERT (n == 5000);
+  ASSERT (moves == (5000 + XA_MASK) / XA_SLOT_MAX);
+
+  ASSERT (xas.xas_index == 4999);
+  for (i = 4999; i > 0; i--)
+    ASSERT (xas_prev (&xas) == xa_mk_value (i - 1));
+  ASSERT (xas_prev (&xas) == NULL && xas.xas_index == XA_INDEX_MAX);
+
+  ASSERT (xa_store (&xa, 1ul << 40, ITEM (1)) != XA_FAILED);
+  ASSERT (xa_store_range (&xa, 1ul << 50, (1ul << 50) + 4095, ITEM (2)) == 0);
+  xas_set (&xas, 4990);
+  ASSERT (xas_find_after (&xas, XA_INDEX_MAX) == xa_mk_value (4991));
+  for (n = 0; xas_find_after (&xas, XA_INDEX_MAX); n++)
+    ;
+  ASSERT (n == 8 + 1 + 1);
+  ASSERT (xas.xas_index == 1ul << 50);
+  ASSERT (xas_next (&xas) == ITEM (2));
+  ASSERT (xas_store (&xas, NULL) == ITEM (2));
+  ASSERT (xa_load (&xa, (1ul << 50) + 1) == NULL);
+  ASSERT (xa_load (&xa, (1ul << 50) + 2) == ITEM (2));
+  xa_destroy (&xa);
+}
+
+TEST (store_batch)
+{
+  struct xarray xa = XA_INIT_FLAGS (XA_FLAGS_PACKED);
+  unsigned long indices[] = { 3, 1, 64, 65, 1ul << 33, 2, 3 };
+  void *items[] = { xa_mk_value (1), xa_mk_value (2), ITEM (64),
+                    xa_mk_value (65), ITEM (5), xa_mk_value (300), NULL };
+  static void *array[10000];
+  unsigned long i;
+
+  ASSERT (xa_store_batch (&xa, indices, items, 7) == 0);
+  ASSERT (xa_size (&xa) == 5);
+  ASSERT (xa_load (&xa, 3) == NULL);
+  ASSERT (xa_load (&xa, 1) == xa_mk_value (2));
+  ASSERT (xa_load (&xa, 2) == xa_mk_value (300));
+  ASSERT (xa_load (&xa, 64) == ITEM (64));
+  ASSERT (xa_load (&xa, 1ul << 33) == ITEM (5));
+  xa_destroy (&xa);
+
+  for (i = 0; i < 10000; i++)
+    array[i] = i % 7 ? xa_mk_value (i) : NULL;
+  ASSERT (xa_store_array (&xa, 100, array, 10000) == 0);
+  ASSERT (xa_size (&xa) == 10000 - 1429);
+  for (i = 0; i < 10000; i++)
+    ASSERT (xa_load (&xa, 100 + i) == array[i]);
+  ASSERT (xa_store_array (&xa, XA_INDEX_MAX, array, 2) == -1);
+  xa_destroy (&xa);
+}
+
+TEST (erase_range)
+{
+  struct xarray xa = XA_INIT;
+  unsigned long i, span = 1ul << (2 * XA_BITS);
+  long nodes;
+
+  for (i = 0; i < 4 * span; i++)
+    xa_store (&xa, i, ITEM (i));
+  xa_set_mark (&xa, 10, XA_MARK_0);
+  xa_set_mark (&xa, 2 * span, XA_MARK_0);
+  nodes = xa.xa_node_num;
+
+  /* whole subtrees go at once; the partial leaves keep their rest */
+  ASSERT (xa_erase_range (&xa, 11, 3 * span) == 0);
+  ASSERT (xa.xa_node_num < nodes - (long)span / XA_SLOT_MAX);
+  ASSERT (xa_size (&xa) == 4 * span - (3 * span - 10));
+  ASSERT (xa_load (&xa, 10) == ITEM (10));
+  ASSERT (xa_load (&xa, 11) == NULL);
+  ASSERT (xa_load (&xa, 3 * span) == NULL);
+  ASSERT (xa_load (&xa, 3 * span + 1) == ITEM (3 * span + 1));
+  ASSERT (xa_get_mark (&xa, 10, XA_MARK_0));
+  ASSERT (!xa_get_mark (&xa, 2 * span, XA_MARK_0));
+  i = 11;
+  ASSERT (xa_find_marked (&xa, &i, XA_INDEX_MAX, XA_MARK_0) == NULL);
+
+  /* a range entry is split where the erased range ends inside it */
+  ASSERT (xa_store_range (&xa, 8 * span, 12 * span - 1, ITEM (1)) == 0);
+  ASSERT (xa_erase_range (&xa, 9 * span + 5, 10 * span) == 0);
+  ASSERT (xa_load (&xa, 9 * span + 4) == ITEM (1));
+  ASSERT (xa_load (&xa, 9 * span + 5) == NULL);
+  ASSERT (xa_load (&xa, 10 * span) == NULL);
+  ASSERT (xa_load (&xa, 10 * span + 1) == ITEM (1));
+  ASSERT (xa_size (&xa) == 4 * span - (3 * span - 10) + 3 * span + 4);
+
+  ASSERT (xa_erase_range (&xa, 0, XA_INDEX_MAX) == 0);
+  ASSERT (xa_size (&xa) == 0);
   xa_release (&xa);
+  ASSERT (xa.xa_node_num == 0);
+  xa_destroy (&xa);
+}
+
+TEST (alloc)
+{
+  struct xarray xa = XA_INIT_FLAGS (XA_FLAGS_ALLOC);
+  unsigned long i, id, top, span = 1ul << (2 * XA_BITS);
+
+  for (i = 0; i < 3 * span; i++)
+    {
+      ASSERT (xa_alloc (&xa, &id, ITEM (i), 0, XA_INDEX_MAX) == 0);
+      ASSERT (id == i);
+    }
+
+  /* the lowest hole is found, wherever it is */
+  xa_erase (&xa, 2 * span + 7);
+  xa_erase (&xa, span + 3);
+  ASSERT (xa_alloc (&xa, &id, ITEM (0), 0, XA_INDEX_MAX) == 0 && id == span + 3);
+  ASSERT (xa_alloc (&xa, &id, ITEM (0), 0, XA_INDEX_MAX) == 0
+          && id == 2 * span + 7);
+  ASSERT (xa_alloc (&xa, &id, ITEM (0), 5, 3 * span - 1) == -1);
+  ASSERT (errno == EBUSY);
+  ASSERT (xa_alloc (&xa, &id, ITEM (0), 5, XA_INDEX_MAX) == 0 && id == 3 * span);
+
+  /* ranges and range erases keep the free mark in step */
+  ASSERT (xa_erase_range (&xa, 100, span - 1) == 0);
+  xa_release (&xa);
+  ASSERT (xa_alloc (&xa, &id, ITEM (0), 0, XA_INDEX_MAX) == 0 && id == 100);
+  ASSERT (xa_store_range (&xa, 101, span - 1, ITEM (0)) == 0);
+  ASSERT (xa_alloc (&xa, &id, ITEM (0), 0, XA_INDEX_MAX) == 0
+          && id == 3 * span + 1);
+  ASSERT (xa_alloc (&xa, &id, ITEM (0), 1ul << 40, XA_INDEX_MAX) == 0
+          && id == 1ul << 40);
+
+  /* the root has fewer slots than the mark has bits; once the last one
+     is full, the search must not run past it and wrap to 0 */
+  top = XA_INDEX_MAX << (XA_BITS * ((8 * sizeof (long) - 1) / XA_BITS));
+  ASSERT (xa_store_range (&xa, top, XA_INDEX_MAX, ITEM (0)) == 0);
+  ASSERT (xa_alloc (&xa, &id, ITEM (0), top, XA_INDEX_MAX) == -1);
+  ASSERT (errno == EBUSY);
+  xa_destroy (&xa);
+}
+
+TEST (alloc_cyclic)
+{
+  struct xarray xa = XA_INIT_FLAGS (XA_FLAGS_ALLOC);
+  unsigned long i, id, next = 0;
+
+  for (i = 0; i < 8; i++)
+    {
+      ASSERT (xa_alloc_cyclic (&xa, &id, ITEM (i), 0, 7, &next) == 0);
+      ASSERT (id == i);
+      if (i == 3)
+        xa_erase (&xa, 1);
+    }
+  /* 1 is only reused once the range wraps */
+  ASSERT (xa_alloc_cyclic (&xa, &id, ITEM (1), 0, 7, &next) == 0 && id == 1);
+  ASSERT (next == 2);
+  ASSERT (xa_alloc_cyclic (&xa, &id, ITEM (1), 0, 7, &next) == -1);
+  ASSERT (errno == EBUSY);
+  xa_destroy (&xa);
+}
+
+TEST (ida)
+{
+  struct ida ida = IDA_INIT;
+  unsigned long i, id;
+
+  for (i = 0; i < 1000; i++)
+    ASSERT (ida_alloc_range (&ida, &id, 1, 100000) == 0 && id == i + 1);
+  ida_free (&ida, 500);
+  ASSERT (ida_alloc_range (&ida, &id, 1, 100000) == 0 && id == 500);
+  ASSERT (ida_alloc_range (&ida, &id, 10, 20) == -1);
+  /* one byte per ID */
+  ASSERT ((unsigned long)ida.ida_xa.xa_node_num < 1000 / XA_SLOT_MAX + 4);
+  ida_destroy (&ida);
+}
+
+TEST (reverse)
+{
+  struct xarray xa = XA_INIT;
+  unsigned long i, n = 0, prev = XA_INDEX_MAX;
+  void *v;
+
+  ASSERT (xa_find_last (&xa, &i) == NULL);
+  for (i = 0; i < 1000; i++)
+    xa_store (&xa, i * 7, ITEM (i));
+  ASSERT (xa_find_last (&xa, &i) == ITEM (999) && i == 6993);
+
+  xa_for_each_reverse (&xa, i, v)
+    {
+      ASSERT (i < prev && i % 7 == 0);
+      ASSERT (v == ITEM (i / 7));
+      prev = i;
+      n++;
+    }
+  ASSERT (n == 1000 && prev == 0);
+
+  i = 700;
+  ASSERT (xa_find_prev (&xa, &i, 0) == ITEM (100) && i == 700);
+  ASSERT (xa_find_before (&xa, &i, 0) == ITEM (99) && i == 693);
+  ASSERT (xa_find_before (&xa, &i, 690) == NULL && i == 693);
+  i = 6;
+  ASSERT (xa_find_before (&xa, &i, 0) == ITEM (0) && i == 0);
+  ASSERT (xa_find_before (&xa, &i, 0) == NULL);
+
+  /* the tail survives erasing, and a far entry becomes the last */
+  xa_erase (&xa, 6993);
+  ASSERT (xa_find_last (&xa, &i) == ITEM (998) && i == 6986);
+  ASSERT (xa_store_range (&xa, 1ul << 40, (1ul << 41) - 1, ITEM (1)) == 0);
+  ASSERT (xa_find_last (&xa, &i) == ITEM (1) && i == (1ul << 41) - 1);
+  /* one visit per slot of the range: 2^40 indices are 16 slots */
+  for (n = 0; (v = xa_find_before (&xa, &i, 0)) == ITEM (1); n++)
+    ASSERT (i == (1ul << 40) + (15 - n) * (1ul << 36) - 1);
+  ASSERT (n == 15);
+  ASSERT (v == ITEM (998) && i == 6986);
+
+  n = 0;
+  xa_for_each_range_reverse (&xa, i, v, 10, 3 * 7)
+    n++;
+  ASSERT (n == 2);
+  xa_destroy (&xa);
+}
+
+TEST (eager_prune)
+{
+  struct xarray xa = XA_INIT;
+  struct xarray rcu_xa = XA_INIT_FLAGS (XA_FLAGS_RCU);
+  unsigned long i, span = 1ul << (2 * XA_BITS);
+  struct xa_stats st;
+  XA_STATE (xas, &xa, 0);
+  void *v;
+
+  for (i = 0; i < 2 * span; i++)
+    xa_store (&xa, i, ITEM (i));
+  xa_store (&xa, 1ul << 40, ITEM (1));
+  ASSERT (xa.xa_levels == 7);
+
+  /* the height drops back as soon as the far entry goes */
+  xa_erase (&xa, 1ul << 40);
+  ASSERT (xa.xa_levels == 3);
+  ASSERT (xa.xa_node_num == 1 + 2 + 2 * XA_SLOT_MAX);
+
+  /* a leaf goes with its last entry, also through a cursor */
+  xas_for_each (&xas, v, XA_SLOT_MAX - 1)
+    xas_store (&xas, NULL);
+  ASSERT (xa.xa_node_num == 1 + 2 + 2 * XA_SLOT_MAX - 1);
+  ASSERT (xa_load (&xa, XA_SLOT_MAX) == ITEM (XA_SLOT_MAX));
+
+  /* erasing an absent index builds nothing */
+  xa_erase (&xa, 5);
+  xa_erase (&xa, 1ul << 30);
+  ASSERT (xa.xa_levels == 3);
+  ASSERT (xa.xa_node_num == 1 + 2 + 2 * XA_SLOT_MAX - 1);
+
+  for (i = 0; i < 2 * span; i++)
+    xa_erase (&xa, i);
+  ASSERT (xa.xa_node_num == 0 && xa.xa_levels == 0 && xa.xa_slot == NULL);
+  xa_destroy (&xa);
+
+  /* with XA_FLAGS_RCU, unlinked nodes wait for xa_release */
+  for (i = 0; i < XA_SLOT_MAX; i++)
+    xa_store (&rcu_xa, i, ITEM (i));
+  xa_store (&rcu_xa, 1ul << 20, ITEM (1));
+  xa_erase (&rcu_xa, 1ul << 20);
+  ASSERT (rcu_xa.xa_levels == 1 && rcu_xa.xa_node_num == 1);
+  xa_get_stats (&rcu_xa, &st);
+  ASSERT (st.xs_frees == 0);
+  xa_release (&rcu_xa);
+  xa_get_stats (&rcu_xa, &st);
+  ASSERT (st.xs_frees == st.xs_allocs - 1);
+  xa_destroy (&rcu_xa);
+}
+
+TEST (serialize)
+{
+  struct xarray xa = XA_INIT;
+  struct xa_map map;
+  unsigned long i, j, n = 0;
+  FILE *f = tmpfile ();
+  void *v, *w;
+
+  ASSERT (f != NULL);
+
+  /* an empty array maps to an empty image */
+  ASSERT (xa_serialize (&xa, fileno (f)) == 0);
+  ASSERT (xa_map_readonly (&map, fileno (f)) == 0);
+  ASSERT (xa_map_size (&map) == 0 && xa_map_load (&map, 0) == NULL);
+  i = 0;
+  ASSERT (xa_map_find (&map, &i, XA_INDEX_MAX) == NULL);
+  xa_unmap (&map);
+
+  /* small values are packed, wide ones and ranges are kept as they are */
+  for (i = 0; i < 5000; i++)
+    xa_store (&xa, i * 3, xa_mk_value (i));
+  xa_store (&xa, 1ul << 40, xa_mk_value (1ul << 40));
+  ASSERT (xa_store_range (&xa, 1ul << 20, (1ul << 21) - 1, xa_mk_value (7))
+          == 0);
+  ASSERT (xa_serialize (&xa, fileno (f)) == 0);
+  ASSERT (xa_map_readonly (&map, fileno (f)) == 0);
+  ASSERT (xa_map_size (&map) == xa_size (&xa));
+  for (i = 0; i < 16000; i++)
+    ASSERT (xa_map_load (&map, i) == xa_load (&xa, i));
+  ASSERT (xa_map_load (&map, 1ul << 40) == xa_mk_value (1ul << 40));
+  ASSERT (xa_map_load (&map, (1ul << 20) + 12345) == xa_mk_value (7));
+  ASSERT (xa_map_load (&map, XA_INDEX_MAX) == NULL);
+
+  i = 4;
+  ASSERT (xa_map_find (&map, &i, XA_INDEX_MAX) == xa_mk_value (2) && i == 6);
+  i = (1ul << 20) + 5;
+  ASSERT (xa_map_find (&map, &i, XA_INDEX_MAX) == xa_mk_value (7)
+          && i == (1ul << 20) + 5);
+  ASSERT (xa_map_find_after (&map, &i, XA_INDEX_MAX) == xa_mk_value (7)
+          && i == (1ul << 20) + (1ul << 18));
+
+  /* the same entries in the same order as the array */
+  i = 0;
+  v = xa_find (&xa, &i, XA_INDEX_MAX);
+  xa_map_for_each (&map, j, w)
+    {
+      ASSERT (w == v && j == i);
+      v = xa_find_after (&xa, &i, XA_INDEX_MAX);
+      n++;
+    }
+  ASSERT (v == NULL && n > 5000);
+  xa_unmap (&map);
+
+  /* pointers mean nothing in another process */
+  xa_store (&xa, 3, ITEM (3));
+  ASSERT (xa_serialize (&xa, fileno (f)) == -1 && errno == EINVAL);
+  xa_destroy (&xa);
+  fclose (f);
+}
+
+struct par_sum
+{
+  unsigned long count;
+  unsigned long sum;
+};
 
-  printf ("size: %lu\n", xa_size (&xa));
-  printf ("levels: %u\n", xa.xa_levels);
-  printf ("num_nodes: %lu\n", xa.xa_node_num);
+static void
+par_add (unsigned long index, void *entry, void *acc, void *priv)
+{
+  struct par_sum *ps = acc;
+
+  (void)priv;
+  ps->count++;
+  ps->sum += index ^ (unsigned long)entry;
+}
+
+static void
+par_reduce (void *acc, void *priv)
+{
+  const struct par_sum *ps = acc;
+  struct par_sum *total = priv;
+
+  total->count += ps->count;
+  total->sum += ps->sum;
+}
+
+static struct par_sum
+sum_range (struct xarray *xa, unsigned long first, unsigned long last)
+{
+  struct par_sum ps = { 0, 0 };
+  unsigned long i;
+  void *v;
 
+  xa_for_each_range (xa, i, v, first, last)
+    par_add (i, v, &ps, NULL);
+  return ps;
+}
+
+TEST (parallel_for_each)
+{
+  struct xarray xa = XA_INIT;
+  struct par_sum total, want;
+  struct xa_parallel par
+      = { par_add, par_reduce, sizeof (struct par_sum), &total };
+  static const unsigned int threads[] = { 0, 1, 3, 16 };
+  static const unsigned long ranges[][2] = {
+    { 0, XA_INDEX_MAX },
+    { 1000, 50000 },
+    { 70000, 70000 },
+    { (1ul << 30) + 5, 1ul << 41 },
+  };
+  unsigned int t, r;
+  unsigned long i;
+
+  total = (struct par_sum){ 0, 0 };
+  ASSERT (xa_parallel_for_each (&xa, 0, XA_INDEX_MAX, 4, &par) == 0);
+  ASSERT (total.count == 0);
+  ASSERT (xa_parallel_for_each (&xa, 2, 1, 4, &par) == -1 && errno == EINVAL);
+
+  for (i = 0; i < 100000; i++)
+    xa_store (&xa, i, ITEM (i));
+  ASSERT (xa_store_range (&xa, 1ul << 30, (1ul << 31) - 1, ITEM (1)) == 0);
+  xa_store (&xa, 1ul << 40, ITEM (2));
+
+  for (t = 0; t < sizeof (threads) / sizeof (threads[0]); t++)
+    for (r = 0; r < sizeof (ranges) / sizeof (ranges[0]); r++)
+      {
+        total = (struct par_sum){ 0, 0 };
+        want = sum_range (&xa, ranges[r][0], ranges[r][1]);
+        ASSERT (xa_parallel_for_each (&xa, ranges[r][0], ranges[r][1],
+                                      threads[t], &par)
+                == 0);
+        ASSERT (total.count == want.count && total.sum == want.sum);
+      }
   xa_destroy (&xa);
+}
+
+XA_DECLARE (xa32, uint32_t, 4)
+XA_DECLARE (xa64, unsigned long, 8)
+
+TEST (declare)
+{
+  struct xarray ref = XA_INIT;
+  struct xa32 small;
+  struct xa64 wide;
+  unsigned long i, k, n;
+  uint32_t j;
+  void *v;
+
+  xa32_init (&small);
+  xa64_init (&wide);
+  ASSERT (xa32_load (&small, 0) == NULL && xa32_erase (&small, 5) == NULL);
+  j = 0;
+  ASSERT (xa32_find (&small, &j, UINT32_MAX) == NULL);
+
+  /* the 32-bit variant reaches UINT32_MAX in eight levels of 16 */
+  ASSERT (xa32_store (&small, UINT32_MAX, ITEM (1)) == NULL);
+  ASSERT (small.nodes == 8 && small.root->shift == 28);
+  ASSERT (xa32_load (&small, UINT32_MAX) == ITEM (1));
+  ASSERT (xa32_load (&small, UINT32_MAX - 16) == NULL);
+  ASSERT (xa32_erase (&small, UINT32_MAX) == ITEM (1));
+  ASSERT (small.root == NULL && xa32_memory (&small) == 0);
+
+  /* both variants follow the generic xarray */
+  srand (49);
+  for (i = 0; i < 200000; i++)
+    {
+      k = (unsigned long)rand () % (i % 3 ? 5000 : 1ul << 30);
+      v = rand () % 4 ? ITEM (i) : NULL;
+      ASSERT (xa32_store (&small, k, v) == xa_load (&ref, k));
+      ASSERT (xa64_store (&wide, k << 20, v) == xa_load (&ref, k));
+      xa_store (&ref, k, v);
+    }
+  n = 0;
+  j = 0;
+  i = 0;
+  for (v = xa32_find (&small, &j, UINT32_MAX); v != NULL;
+       v = xa32_find_after (&small, &j, UINT32_MAX), n++)
+    {
+      ASSERT (xa_find (&ref, &i, XA_INDEX_MAX) == v && i == j);
+      ASSERT (xa64_load (&wide, (unsigned long)j << 20) == v);
+      i++;
+    }
+  ASSERT (n == xa_size (&ref) && n > 0);
+  k = 0;
+  for (v = xa64_find (&wide, &k, XA_INDEX_MAX); v != NULL;
+       v = xa64_find_after (&wide, &k, XA_INDEX_MAX))
+    n--;
+  ASSERT (n == 0);
+  i = 4000;
+  k = (4000ul << 20) - 7;
+  ASSERT (xa_find (&ref, &i, 4999) != NULL);
+  ASSERT (xa64_find (&wide, &k, 4999ul << 20) != NULL && k == i << 20);
+  k = (i << 20) + 1;
+  ASSERT (xa64_find (&wide, &k, (i + 1) << 20) == NULL || k == (i + 1) << 20);
+
+  xa_for_each (&ref, i, v)
+    {
+      ASSERT (xa32_erase (&small, i) == v);
+      ASSERT (xa64_erase (&wide, i << 20) == v);
+    }
+  ASSERT (small.root == NULL && wide.root == NULL);
+  ASSERT (small.nodes == 0 && wide.nodes == 0);
+  xa_destroy (&ref);
+
+  for (i = 0; i < 1000; i++)
+    xa32_store (&small, i * 977, ITEM (i));
+  ASSERT (xa32_memory (&small) == small.nodes * sizeof (struct xa32_node));
+  xa32_destroy (&small);
+  ASSERT (small.root == NULL && small.nodes == 0);
+}
+
+/* Even indices below STABLE_KEYS stay present.  The writer churns odd
+   indices and a far index that makes the tree grow and shrink.  */
+#define STABLE_KEYS 4096
+#define FAR_INDEX (1ul << 40)
+#define STRESS_READERS 3
+
+static struct xarray stress_xa;
+static bool stress_done;
+
+/* With packed leaves the entries are values, and the odd ones are wide
+   enough that storing them repacks the leaves under the readers.  */
+static bool stress_packed;
+
+static void *
+stress_entry (unsigned long index)
+{
+  if (!stress_packed)
+    return ITEM (index);
+  return xa_mk_value (index % 2 ? index << 20 : index);
+}
+
+static void *
+stress_reader (void *arg)
+{
+  unsigned int seed = (uintptr_t)arg + 1;
+  unsigned long errors = 0;
+
+  while (!__atomic_load_n (&stress_done, __ATOMIC_ACQUIRE))
+    {
+      unsigned long index = rand_r (&seed) % STABLE_KEYS;
+      unsigned long start = index;
+      void *v;
+      int steps = 0;
+
+      rcu_read_lock ();
+      v = xa_load (&stress_xa, index);
+      if (index % 2 == 0 ? v != stress_entry (index) : v && v != stress_entry (index))
+        errors++;
+      if ((v = xa_load (&stress_xa, FAR_INDEX)) && v != stress_entry (FAR_INDEX))
+        errors++;
+      xa_for_each_range (&stress_xa, index, v, start, XA_INDEX_MAX)
+        {
+          if (v != stress_entry (index))
+            errors++;
+          if (++steps > 16)
+            break;
+        }
+      rcu_read_unlock ();
+    }
+  return (void *)(uintptr_t)errors;
+}
+
+static void
+stress_run (bool packed)
+{
+  pthread_t readers[STRESS_READERS];
+  unsigned int seed = 7;
+  unsigned long i;
+  uintptr_t t;
+
+  stress_packed = packed;
+  stress_done = false;
+  xa_init_flags (&stress_xa, XA_FLAGS_RCU | (packed ? XA_FLAGS_PACKED : 0));
+
+  for (i = 0; i < STABLE_KEYS; i += 2)
+    ASSERT (xa_store (&stress_xa, i, stress_entry (i)) != XA_FAILED);
+
+  for (t = 0; t < STRESS_READERS; t++)
+    ASSERT (pthread_create (&readers[t], NULL, stress_reader, (void *)t)
+            == 0);
+
+  for (i = 0; i < 200000; i++)
+    {
+      unsigned long index = (rand_r (&seed) % STABLE_KEYS) | 1;
+
+      if (rand_r (&seed) % 2)
+        ASSERT (xa_store (&stress_xa, index, stress_entry (index)) != XA_FAILED);
+      else
+        xa_erase (&stress_xa, index);
+
+      if (i % 4000 == 0)
+        {
+          /* grow above the stable keys, then shrink back */
+          if (xa_load (&stress_xa, FAR_INDEX))
+            xa_erase (&stress_xa, FAR_INDEX);
+          else
+            ASSERT (xa_store (&stress_xa, FAR_INDEX, stress_entry (FAR_INDEX))
+                    != XA_FAILED);
+          xa_release (&stress_xa);
+        }
+    }
+
+  __atomic_store_n (&stress_done, true, __ATOMIC_RELEASE);
+  for (t = 0; t < STRESS_READERS; t++)
+    {
+      void *errors;
+
+      pthread_join (readers[t], &errors);
+      ASSERT (errors == NULL);
+    }
+
+  for (i = 0; i < STABLE_KEYS; i += 2)
+    ASSERT (xa_load (&stress_xa, i) == stress_entry (i));
+  xa_destroy (&stress_xa);
+}
+
+TEST (concurrent_readers)
+{
+  stress_run (false);
+}
+
+TEST (concurrent_packed)
+{
+  stress_run (true);
+}
+
+int
+main (void)
+{
+  fprintf (stderr, "=== XArray Test Suite ===\n\n");
+
+  RUN_TEST (store_load);
+  RUN_TEST (marks);
+  RUN_TEST (marks_survive_growth);
+  RUN_TEST (for_each_marked);
+  RUN_TEST (for_each_marked_sparse);
+  RUN_TEST (value_entries);
+  RUN_TEST (packed_leaves);
+  RUN_TEST (range_entries);
+  RUN_TEST (range_split);
+  RUN_TEST (node_cache);
+  RUN_TEST (reserve);
+  RUN_TEST (cursor);
+  RUN_TEST (store_batch);
+  RUN_TEST (erase_range);
+  RUN_TEST (alloc);
+  RUN_TEST (alloc_cyclic);
+  RUN_TEST (ida);
+  RUN_TEST (reverse);
+  RUN_TEST (eager_prune);
+  RUN_TEST (serialize);
+  RUN_TEST (parallel_for_each);
+  RUN_TEST (declare);
+  RUN_TEST (concurrent_readers);
+  RUN_TEST (concurrent_packed);
 
-  printf ("success\n");
+  fprintf (stderr, "\n=== Results ===\n");
+  fprintf (stderr, "Passed: %d/%d\n", pass_count, test_count);
 
-  return 0;
+  return (pass_count == test_count) ? 0 : 1;
 }
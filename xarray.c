@@ -19,13 +19,24 @@
  */
 
 #include "xarray.h"
+#include "rcu.h"
 #include <assert.h>
 #include <errno.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Lockless readers only see nodes published with rcu_assign_pointer, and
+   load the counters and mark bitmaps that the writer updates in place
+   with these.  Writers are serialized by the caller.  */
+#define xa_read(p) __atomic_load_n (&(p), __ATOMIC_RELAXED)
+#define xa_write(p, v) __atomic_store_n (&(p), (v), __ATOMIC_RELAXED)
 
 static inline uint8_t __attribute_pure__
 xa_slot_index (uint8_t shift, unsigned long index)
@@ -41,17 +52,112 @@ xa_max_index (uint8_t levels)
   return ((1lu << (XA_BITS * (levels))) - 1lu);
 }
 
+static inline size_t
+xa_node_size (unsigned int packed)
+{
+  if (!packed)
+    return sizeof (struct xa_node);
+  return offsetof (struct xa_node, xa_slots) + sizeof (unsigned long)
+         + XA_SLOT_MAX * packed;
+}
+
+static inline unsigned int
+xa_cache_class (unsigned int packed)
+{
+  return packed == 4 ? 3 : packed;
+}
+
+static void *
+xa_mem_alloc (const struct xarray *xa, size_t size)
+{
+  if (xa->xa_allocator)
+    return xa->xa_allocator->alloc (size, xa->xa_allocator->priv);
+  return malloc (size);
+}
+
+static void
+xa_mem_free (const struct xarray *xa, void *ptr, size_t size)
+{
+  if (xa->xa_allocator)
+    xa->xa_allocator->free (ptr, size, xa->xa_allocator->priv);
+  else
+    free (ptr);
+}
+
 static struct xa_node *
-xa_alloc_node (struct xarray *xa)
+xa_cache_pop (struct xarray *xa, unsigned int packed)
 {
-  struct xa_node *node = malloc (sizeof (*node));
+  struct xa_node **head = &xa->xa_cache[xa_cache_class (packed)];
+  struct xa_node *node = *head;
+
   if (!node)
     return NULL;
-  memset (node, 0, sizeof (*node));
+  *head = node->xa_free_next;
+  xa->xa_stats.xs_cached--;
+  xa->xa_stats.xs_reused++;
+  if (packed == 0 && xa->xa_reserved)
+    xa->xa_reserved--;
+  return node;
+}
+
+/* Allocates a node.  A nonzero packed allocates a packed leaf.  If the
+   allocator fails, a full node from the cache can hold a packed leaf.  */
+static struct xa_node *
+xa_alloc_node (struct xarray *xa, unsigned int packed)
+{
+  unsigned int alloc_packed = packed;
+  struct xa_node *node = xa_cache_pop (xa, packed);
+
+  if (!node)
+    node = xa_mem_alloc (xa, xa_node_size (packed));
+  if (!node && packed)
+    {
+      node = xa_cache_pop (xa, 0);
+      alloc_packed = 0;
+    }
+  if (!node)
+    return errno = ENOMEM, NULL;
+  memset (node, 0, xa_node_size (packed));
+  node->xa_packed = packed;
+  node->xa_alloc_packed = alloc_packed;
   xa->xa_node_num++;
+  xa->xa_stats.xs_allocs++;
   return node;
 }
 
+/* Puts a node that no reader can reach into the cache, or frees it. */
+static void
+xa_free_node (struct xarray *xa, struct xa_node *node)
+{
+  unsigned int packed = node->xa_alloc_packed;
+
+  xa->xa_stats.xs_frees++;
+  if (xa->xa_stats.xs_cached < XA_CACHE_MAX
+      || (packed == 0 && xa->xa_stats.xs_cached < xa->xa_reserved))
+    {
+      node->xa_free_next = xa->xa_cache[xa_cache_class (packed)];
+      xa->xa_cache[xa_cache_class (packed)] = node;
+      xa->xa_stats.xs_cached++;
+    }
+  else
+    xa_mem_free (xa, node, xa_node_size (packed));
+}
+
+/* Drops a node unlinked from the tree.  Readers may still be using it,
+   so with XA_FLAGS_RCU it is only freed by the next xa_release.  */
+static void
+xa_retire_node (struct xarray *xa, struct xa_node *node)
+{
+  xa->xa_node_num--;
+  if (xa->xa_flags & XA_FLAGS_RCU)
+    {
+      node->xa_free_next = xa->xa_retired;
+      xa->xa_retired = node;
+    }
+  else
+    xa_free_node (xa, node);
+}
+
 static inline bool
 xa_is_leaf (const struct xa_node *node)
 {
@@ -59,84 +165,456 @@ xa_is_leaf (const struct xa_node *node)
   return node->xa_shift == 0;
 }
 
+/* A slot of an interior node holds either a child node or a multi-index
+   entry that stands for every index below the slot.  Nodes are at least
+   4-byte aligned, value entries have bit 0 set, and pointer entries are
+   told apart by setting bit 1.  */
+#define XA_ENTRY_TAG 2lu
+
+static inline bool
+xa_slot_is_entry (const void *slot)
+{
+  return (uintptr_t)slot & 3;
+}
+
+static inline void *
+xa_slot_entry (const void *slot)
+{
+  if (xa_is_value (slot))
+    return (void *)slot;
+  return (void *)((uintptr_t)slot & ~XA_ENTRY_TAG);
+}
+
+static inline void *
+xa_mk_slot_entry (void *entry)
+{
+  if (!entry || xa_is_value (entry))
+    return entry;
+  return (void *)((uintptr_t)entry | XA_ENTRY_TAG);
+}
+
+/* Returns the bytes per value a packed leaf needs to hold entry, or 0 if
+   entry must be stored in a pointer slot.  */
+static inline unsigned int
+xa_entry_width (const void *entry)
+{
+  unsigned long v;
+
+  if (!entry)
+    return 1;
+  if (!xa_is_value (entry))
+    return 0;
+  v = xa_to_value (entry);
+  return v <= UINT8_MAX ? 1 : v <= UINT16_MAX ? 2 : v <= UINT32_MAX ? 4 : 0;
+}
+
+/* Returns true if a leaf of width have can hold an entry of width need. */
+static inline bool
+xa_width_fits (unsigned int have, unsigned int need)
+{
+  return have == 0 || (need != 0 && need <= have);
+}
+
+static inline unsigned long *
+xa_packed_present (const struct xa_node *node)
+{
+  return (unsigned long *)node->xa_slots;
+}
+
+static inline unsigned char *
+xa_packed_data (const struct xa_node *node)
+{
+  return (unsigned char *)node->xa_slots + sizeof (unsigned long);
+}
+
+static inline unsigned long
+xa_packed_get (const struct xa_node *node, unsigned int offset)
+{
+  unsigned char *data = xa_packed_data (node);
+
+  switch (node->xa_packed)
+    {
+    case 1:
+      return xa_read (((uint8_t *)data)[offset]);
+    case 2:
+      return xa_read (((uint16_t *)data)[offset]);
+    default:
+      return xa_read (((uint32_t *)data)[offset]);
+    }
+}
+
+static inline void
+xa_packed_set (struct xa_node *node, unsigned int offset, unsigned long v)
+{
+  unsigned char *data = xa_packed_data (node);
+
+  switch (node->xa_packed)
+    {
+    case 1:
+      xa_write (((uint8_t *)data)[offset], v);
+      break;
+    case 2:
+      xa_write (((uint16_t *)data)[offset], v);
+      break;
+    default:
+      xa_write (((uint32_t *)data)[offset], v);
+      break;
+    }
+}
+
+/* Returns the entry in a slot of a leaf. */
+static inline void *
+xa_leaf_entry (const struct xa_node *node, unsigned int offset)
+{
+  if (!node->xa_packed)
+    return rcu_dereference (node->xa_slots[offset]);
+
+  /* pairs with the release in xa_leaf_set */
+  if (!(__atomic_load_n (xa_packed_present (node), __ATOMIC_ACQUIRE)
+        & (1lu << offset)))
+    return NULL;
+  return xa_mk_value (xa_packed_get (node, offset));
+}
+
+/* Sets a slot of a leaf, which must be wide enough for item. */
+static inline void
+xa_leaf_set (struct xa_node *node, unsigned int offset, void *item)
+{
+  unsigned long *present;
+
+  if (!node->xa_packed)
+    {
+      rcu_assign_pointer (node->xa_slots[offset], item);
+      return;
+    }
+
+  present = xa_packed_present (node);
+  if (item)
+    {
+      xa_packed_set (node, offset, xa_to_value (item));
+      __atomic_store_n (present, *present | 1lu << offset, __ATOMIC_RELEASE);
+    }
+  else
+    xa_write (*present, *present & ~(1lu << offset));
+}
+
+/* Replaces a leaf with a copy of width packed. */
+static struct xa_node *
+xa_repack (struct xarray *xa, struct xa_node *node, unsigned int packed)
+{
+  struct xa_node *new = xa_alloc_node (xa, packed);
+  unsigned int offset, alloc_packed;
+
+  if (!new)
+    return NULL;
+
+  alloc_packed = new->xa_alloc_packed;
+  memcpy (new, node, offsetof (struct xa_node, xa_slots));
+  new->xa_packed = packed;
+  new->xa_alloc_packed = alloc_packed;
+  for (offset = 0; offset < XA_SLOT_MAX; offset++)
+    {
+      void *entry = xa_leaf_entry (node, offset);
+
+      if (entry)
+        xa_leaf_set (new, offset, entry);
+    }
+
+  if (node->xa_parent)
+    rcu_assign_pointer (node->xa_parent->xa_slots[node->xa_offset], new);
+  else
+    rcu_assign_pointer (xa->xa_slot, new);
+  xa_retire_node (xa, node);
+  return new;
+}
+
+/* Mask of the index bits below the range a node of shift covers. */
+static inline unsigned long __attribute_pure__
+xa_span_mask (unsigned int shift)
+{
+  if ((size_t)shift + XA_BITS >= 8 * sizeof (unsigned long))
+    return XA_INDEX_MAX;
+  return (1lu << (shift + XA_BITS)) - 1lu;
+}
+
+static inline unsigned long __attribute_pure__
+xa_node_span_mask (const struct xa_node *node)
+{
+  return xa_span_mask (node->xa_shift);
+}
+
+/* Returns the mark bits of the slots that lie inside the index space.  The
+   root of a full-height tree has fewer slots than a mark has bits.  */
+static inline unsigned long __attribute_pure__
+xa_node_slot_bits (const struct xa_node *node)
+{
+  unsigned int last = xa_slot_index (node->xa_shift, xa_node_span_mask (node));
+
+  return ~0lu >> (8 * sizeof (unsigned long) - 1 - last);
+}
+
+/* Sets the mark bit of a slot and of every ancestor leading to it. */
+static void
+xa_node_set_mark (struct xa_node *node, unsigned int offset, xa_mark_t mark)
+{
+  while (node && !(node->xa_marks[mark] & (1lu << offset)))
+    {
+      xa_write (node->xa_marks[mark], node->xa_marks[mark] | 1lu << offset);
+      offset = node->xa_offset;
+      node = node->xa_parent;
+    }
+}
+
+/* Clears the mark bit of a slot, and of the ancestors whose subtree no
+   longer holds a marked entry.  */
+static void
+xa_node_clear_mark (struct xa_node *node, unsigned int offset,
+                    xa_mark_t mark)
+{
+  while (node && (node->xa_marks[mark] & (1lu << offset)))
+    {
+      xa_write (node->xa_marks[mark], node->xa_marks[mark] & ~(1lu << offset));
+      if (node->xa_marks[mark])
+        break;
+      offset = node->xa_offset;
+      node = node->xa_parent;
+    }
+}
+
+/* Keeps the free mark of an XA_FLAGS_ALLOC array in step with whether a
+   slot is free. */
+static inline void
+xa_note_free (const struct xarray *xa, struct xa_node *node,
+              unsigned int offset, bool free)
+{
+  if (!(xa->xa_flags & XA_FLAGS_ALLOC))
+    return;
+  if (free)
+    xa_node_set_mark (node, offset, XA_FREE_MARK);
+  else
+    xa_node_clear_mark (node, offset, XA_FREE_MARK);
+}
+
+/* Removes the root while it has only a child at slot 0, so the height
+   is the least that covers the largest index.  */
+static void
+xa_shrink (struct xarray *xa)
+{
+  struct xa_node *node = xa->xa_slot;
+
+  while (node && node->xa_shift != 0 && node->xa_count == 1
+         && node->xa_slots[0] != NULL && !xa_slot_is_entry (node->xa_slots[0]))
+    {
+      struct xa_node *child = node->xa_slots[0];
+
+      rcu_assign_pointer (xa->xa_slot, child);
+      rcu_assign_pointer (child->xa_parent, NULL);
+      xa->xa_levels--;
+      xa_retire_node (xa, node);
+      node = child;
+    }
+}
+
+/* Unlinks node if it is empty, then each ancestor that this leaves
+   empty, and shrinks the tree.  Every modification ends with the tree
+   pruned, so no empty node outlives the store that emptied it.  Returns
+   true if any node was unlinked.  */
+static bool
+xa_prune (struct xarray *xa, struct xa_node *node)
+{
+  struct xa_node *root = xa->xa_slot;
+  bool pruned = false;
+
+  while (node && node->xa_count == 0)
+    {
+      struct xa_node *parent = node->xa_parent;
+
+      if (parent)
+        {
+          rcu_assign_pointer (parent->xa_slots[node->xa_offset], NULL);
+          parent->xa_count--;
+          xa_note_free (xa, parent, node->xa_offset, true);
+        }
+      else
+        {
+          rcu_assign_pointer (xa->xa_slot, NULL);
+          xa->xa_levels = 0;
+        }
+      xa_retire_node (xa, node);
+      pruned = true;
+      node = parent;
+    }
+  xa_shrink (xa);
+  return pruned || xa->xa_slot != root;
+}
+
 static int
-xa_increase_level (struct xarray *xa)
+xa_increase_level (struct xarray *xa, unsigned int packed)
 {
-  struct xa_node *node = xa_alloc_node (xa);
+  struct xa_node *node = xa_alloc_node (xa, xa->xa_levels ? 0 : packed);
   struct xa_node *old_root;
   if (!node)
     return -errno;
 
-  old_root = node->xa_slots[0] = xa->xa_slot;
+  old_root = xa->xa_slot;
+  node->xa_shift = XA_BITS * xa->xa_levels;
+  node->xa_count = old_root != NULL ? 1 : 0;
   if (old_root)
     {
-      old_root->xa_parent = node;
+      xa_mark_t mark;
+
+      node->xa_slots[0] = old_root;
       node->xa_values = old_root->xa_values;
+      for (mark = 0; mark < XA_MAX_MARKS; mark++)
+        if (old_root->xa_marks[mark])
+          node->xa_marks[mark] = 1;
+      rcu_assign_pointer (old_root->xa_parent, node);
     }
-  xa->xa_slot = node;
+  if (xa->xa_flags & XA_FLAGS_ALLOC)
+    node->xa_marks[XA_FREE_MARK]
+        |= (old_root ? ~1lu : ~0lu) & xa_node_slot_bits (node);
+  rcu_assign_pointer (xa->xa_slot, node);
   xa->xa_levels++;
-  node->xa_shift = XA_BITS * (xa->xa_levels - 1);
-  node->xa_count = old_root != NULL ? 1 : 0;
   return 0;
 }
 
-struct xa_node *
-xa_get_leaf_by_index (struct xarray *xa, const unsigned long index)
+/* Allocates the child for slot offset of parent and publishes it.  If the
+   slot holds a multi-index entry, the child is filled with it, so that
+   the entry is split one level down.  A new empty leaf is packed with the
+   given width.  */
+static struct xa_node *
+xa_new_child (struct xarray *xa, struct xa_node *parent, unsigned int offset,
+              unsigned int packed)
 {
-  uint8_t i;
-  void **slot;
-  struct xa_node *xa_parent = NULL;
+  void *slot = parent->xa_slots[offset];
+  void *entry = slot ? xa_slot_entry (slot) : NULL;
+  unsigned int shift = parent->xa_shift - XA_BITS;
+  struct xa_node *node;
+  unsigned int i;
 
-  while ((index != XA_INDEX_MAX ? (index + 1) : index)
-         > xa_max_index (xa->xa_levels))
+  if (entry)
+    packed = xa->xa_flags & XA_FLAGS_PACKED ? xa_entry_width (entry) : 0;
+  node = xa_alloc_node (xa, shift == 0 ? packed : 0);
+  if (node == NULL)
+    return NULL;
+
+  node->xa_parent = parent;
+  node->xa_offset = offset;
+  node->xa_shift = shift;
+  if (entry)
+    {
+      for (i = 0; i < XA_SLOT_MAX; i++)
+        if (shift == 0)
+          xa_leaf_set (node, i, entry);
+        else
+          node->xa_slots[i] = slot;
+      node->xa_count = XA_SLOT_MAX;
+      node->xa_values = 1lu << parent->xa_shift;
+    }
+  else
     {
-      if (xa_increase_level (xa))
-        return NULL;		// errno = ENOMEM
+      if (xa->xa_flags & XA_FLAGS_ALLOC)
+        node->xa_marks[XA_FREE_MARK] = xa_node_slot_bits (node);
+      parent->xa_count++;
     }
+  rcu_assign_pointer (parent->xa_slots[offset], node);
+  return node;
+}
+
+/* Returns the node of the given shift on the path to index, creating the
+   missing nodes and splitting multi-index entries on the way.  On
+   failure, the nodes created so far are pruned again.  */
+static struct xa_node *
+xa_get_node (struct xarray *xa, unsigned long index, unsigned int shift,
+             unsigned int packed)
+{
+  struct xa_node *node;
 
-  slot = &xa->xa_slot;
-  for (i = 0; i < xa->xa_levels; ++i)
+  /* an empty tree starts at the height it needs, not with a chain of
+     empty nodes over index 0 */
+  if (!xa->xa_slot)
     {
-      if (*slot == NULL)
+      xa->xa_levels = 1;
+      while (index > xa_max_index (xa->xa_levels)
+             || (unsigned int)xa->xa_levels * XA_BITS <= shift)
+        xa->xa_levels++;
+      xa->xa_levels--;
+      if (xa_increase_level (xa, packed))
         {
-          struct xa_node *node = *slot = xa_alloc_node (xa);
-          if (node == NULL)
-            return NULL;	// errno = ENOMEM
+          xa->xa_levels = 0;
+          return NULL;		// errno = ENOMEM
+        }
+    }
 
-          assert (xa_parent);
-          node->xa_parent = xa_parent;
-          node->xa_offset = xa_slot_index (xa_parent->xa_shift, index);
-          node->xa_shift = xa_parent->xa_shift - XA_BITS;
-          xa_parent->xa_count++;
+  while (index > xa_max_index (xa->xa_levels)
+         || (unsigned int)xa->xa_levels * XA_BITS <= shift)
+    {
+      if (xa_increase_level (xa, packed))
+        {
+          xa_prune (xa, xa->xa_slot);
+          return NULL;		// errno = ENOMEM
         }
+    }
 
-      xa_parent = *slot;
-      slot = &xa_parent->xa_slots[xa_slot_index (xa_parent->xa_shift, index)];
+  node = xa->xa_slot;
+  while ((unsigned int)node->xa_shift > shift)
+    {
+      unsigned int offset = xa_slot_index (node->xa_shift, index);
+      void *slot = node->xa_slots[offset];
+
+      if (slot == NULL || xa_slot_is_entry (slot))
+        {
+          struct xa_node *child = xa_new_child (xa, node, offset, packed);
+
+          if (child == NULL)
+            {
+              xa_prune (xa, node);
+              return NULL;	// errno = ENOMEM
+            }
+          node = child;
+        }
+      else
+        node = slot;
     }
 
-  return xa_parent;
+  return node;
+}
+
+/* Returns the leaf for index, creating the missing nodes on the way.  A
+   new leaf is packed with the given width.  */
+static struct xa_node *
+xa_get_leaf_by_index (struct xarray *xa, const unsigned long index,
+                      unsigned int packed)
+{
+  return xa_get_node (xa, index, 0, packed);
 }
 
 struct xa_node *
-xa_get_leaf_with_space_by_index (struct xarray *xa, unsigned long *indexp,
-                                 unsigned long last)
+xa_get_node_by_index (struct xarray *xa, unsigned long index)
+{
+  return xa_get_leaf_by_index (xa, index, 0);
+}
+
+static struct xa_node *
+xa_get_leaf_with_space (struct xarray *xa, unsigned long *indexp,
+                        unsigned long last, unsigned int packed)
 {
   struct xa_node *node;
   unsigned long index = *indexp;
 
-  node = xa_get_leaf_by_index (xa, index);
+  node = xa_get_leaf_by_index (xa, index, packed);
 
   while (index <= last)
     {
       if (!node)
         return NULL;
 
-      if (node->xa_slots[index & XA_MASK])
+      if (xa_leaf_entry (node, index & XA_MASK))
         {
           index++;
 
-          if (xa_slot_index (node->xa_shift, index) == 0)
-            node = xa_get_leaf_by_index (xa, index);
+          if (index <= last && xa_slot_index (node->xa_shift, index) == 0)
+            node = xa_get_leaf_by_index (xa, index, packed);
         }
       else
         {
@@ -144,72 +622,127 @@ xa_get_leaf_with_space_by_index (struct xarray *xa, unsigned long *indexp,
           return node;
         }
     }
+  xa_prune (xa, node);
   errno = EBUSY;
   return  NULL;
 }
 
+struct xa_node *
+xa_get_leaf_with_space_by_index (struct xarray *xa, unsigned long *indexp,
+                                 unsigned long last)
+{
+  return xa_get_leaf_with_space (xa, indexp, last, 0);
+}
+
 
 /*
  * Possible error codes:
  *  EINVAL - the index excesses the largest index of the xarray
- *  ENOENT - the specified slot is empty
+ *  ENOENT - the specified slot is empty, or holds a multi-index entry
+ *
+ * The walk starts from a single load of the root, whose shift gives the
+ * height, so it is consistent even if the tree grows or shrinks meanwhile.
  */
 const struct xa_node *
-xa_find_leaf_by_index (const struct xarray *xa, const unsigned long index)
+xa_find_node_by_index (const struct xarray *xa, const unsigned long index)
 {
-  uint8_t i;
-  void *const *slot;
-  const struct xa_node *xa_parent = NULL;
+  const struct xa_node *node = rcu_dereference (xa->xa_slot);
 
-  if (index + 1 > xa_max_index (xa->xa_levels))
+  if (node == NULL)
+    return errno = ENOENT, NULL;
+
+  if (index & ~xa_node_span_mask (node))
     return errno = EINVAL, NULL; /* index excesses the largest index
 				    of the xarray */
 
-  slot = &xa->xa_slot;
-  for (i = 0; i < xa->xa_levels; ++i)
+  while (!xa_is_leaf (node))
     {
-      if (*slot == NULL)
+      node = rcu_dereference (
+          node->xa_slots[xa_slot_index (node->xa_shift, index)]);
+      if (node == NULL || xa_slot_is_entry (node))
         return errno = ENOENT, NULL; /* the slot is empty */
+    }
+
+  return node;
+}
+
+/* Returns the entry for index, and in *nodep the node whose slot holds
+   it: a leaf, or an interior node for a multi-index entry.  *nodep is
+   NULL if the walk ends at an empty interior slot.  */
+static void *
+xa_walk (const struct xarray *xa, unsigned long index,
+         const struct xa_node **nodep)
+{
+  const struct xa_node *node = rcu_dereference (xa->xa_slot);
+
+  *nodep = NULL;
+  if (node == NULL || (index & ~xa_node_span_mask (node)))
+    return NULL;
+
+  while (!xa_is_leaf (node))
+    {
+      void *slot = rcu_dereference (
+          node->xa_slots[xa_slot_index (node->xa_shift, index)]);
 
-      xa_parent = *slot;
-      slot = &xa_parent->xa_slots[xa_slot_index (xa_parent->xa_shift, index)];
+      if (slot == NULL)
+        return NULL;
+      if (xa_slot_is_entry (slot))
+        {
+          *nodep = node;
+          return xa_slot_entry (slot);
+        }
+      node = slot;
     }
 
-  return xa_parent;
+  *nodep = node;
+  return xa_leaf_entry (node, index & XA_MASK);
 }
 
-void *
-xa_store (struct xarray *xa, unsigned long index, void *item)
+/* Stores item in a leaf, which is replaced by a wider one if item does
+   not fit.  */
+static void *
+xa_leaf_store (struct xarray *xa, struct xa_node **nodep,
+               unsigned long index, void *item)
 {
-  struct xa_node *node = xa_get_leaf_by_index (xa, index);
-  void **slot;
+  unsigned int packed
+      = xa->xa_flags & XA_FLAGS_PACKED ? xa_entry_width (item) : 0;
+  struct xa_node *node = *nodep;
   void *old_value;
 
-  if (!node)
-    return item ? XA_FAILED : NULL;
-
-  slot = &node->xa_slots[index & XA_MASK];
+  if (item && !xa_width_fits (node->xa_packed, packed))
+    {
+      node = xa_repack (xa, node, packed);
+      if (!node)
+        return XA_FAILED;
+      *nodep = node;
+    }
 
-  old_value = *slot;
+  old_value = xa_leaf_entry (node, index & XA_MASK);
 
-  *slot = item;
+  xa_leaf_set (node, index & XA_MASK, item);
 
   if (old_value && !item)
     {
+      xa_mark_t mark;
+
+      for (mark = 0; mark < XA_MAX_MARKS; mark++)
+        xa_node_clear_mark (node, index & XA_MASK, mark);
+      xa_note_free (xa, node, index & XA_MASK, true);
       node->xa_count--;
       while (node != 0)
         {
-          node->xa_values--;
+          xa_write (node->xa_values, node->xa_values - 1);
           node = node->xa_parent;
         }
     }
 
   if (!old_value && item)
     {
+      xa_note_free (xa, node, index & XA_MASK, false);
       node->xa_count++;
       while (node != 0)
         {
-          node->xa_values++;
+          xa_write (node->xa_values, node->xa_values + 1);
           node = node->xa_parent;
         }
     }
@@ -217,121 +750,531 @@ xa_store (struct xarray *xa, unsigned long index, void *item)
 }
 
 void *
-xa_load (const struct xarray *xa, unsigned long index)
+xa_store (struct xarray *xa, unsigned long index, void *item)
 {
-  const struct xa_node *node = xa_find_leaf_by_index (xa, index);
+  unsigned int packed
+      = xa->xa_flags & XA_FLAGS_PACKED ? xa_entry_width (item) : 0;
+  const struct xa_node *found;
+  struct xa_node *node;
+  void *old;
 
+  /* erasing an absent index must not build a path to it */
+  if (!item && !xa_walk (xa, index, &found))
+    return NULL;
+  node = xa_get_leaf_by_index (xa, index, packed);
   if (!node)
-    return NULL;		// errno = EINVAL | ENOENT
-  return node->xa_slots[index & XA_MASK];
+    return item ? XA_FAILED : NULL;
+  old = xa_leaf_store (xa, &node, index, item);
+  xa_prune (xa, node);
+  return old;
 }
 
-static void
-xa_free_level (struct xarray *xa, int level, struct xa_node *node)
+void *
+xa_load (const struct xarray *xa, unsigned long index)
 {
-  if (!node)
-    return;
-
-  if (level < xa->xa_levels)
-    {
-      int i;
-      for (i = 0; i < XA_SLOT_MAX; ++i)
-        {
-          xa_free_level (xa, level + 1, node->xa_slots[i]);
-        }
+  const struct xa_node *node;
 
-      free (node);
-    }
+  return xa_walk (xa, index, &node);
 }
 
-void
-xa_destroy (struct xarray *xa)
+unsigned int
+xa_get_order (const struct xarray *xa, unsigned long index)
 {
-  xa_free_level (xa, 0, xa->xa_slot);
-}
+  const struct xa_node *node;
 
-unsigned long
-xa_size (const struct xarray *xa)
-{
-  struct xa_node *root = xa->xa_slot;
-  if (root)
-    {
-      return root->xa_values;
-    }
+  if (xa_walk (xa, index, &node) && !xa_is_leaf (node))
+    return node->xa_shift;
   return 0;
 }
 
+/* Frees a subtree unlinked from the array, after a grace period with
+   XA_FLAGS_RCU.  */
 static void
-xa_release_level (struct xarray *xa, uint8_t level, struct xa_node *node)
+xa_retire_subtree (struct xarray *xa, struct xa_node *node)
 {
-  int i;
+  unsigned int i;
 
-  if (!node)
-    return;
+  if (!xa_is_leaf (node))
+    for (i = 0; i < XA_SLOT_MAX; i++)
+      if (node->xa_slots[i] && !xa_slot_is_entry (node->xa_slots[i]))
+        xa_retire_subtree (xa, node->xa_slots[i]);
+  xa_retire_node (xa, node);
+}
 
-  if (level == xa->xa_levels)
-    return;
+/* Replaces slot offset of an interior node, and whatever subtree it led
+   to, with a multi-index entry or NULL.  */
+static void
+xa_set_slot (struct xarray *xa, struct xa_node *node, unsigned int offset,
+             void *entry)
+{
+  void *old = node->xa_slots[offset];
+  unsigned long span = 1lu << node->xa_shift;
+  unsigned long before = 0, after = entry ? span : 0;
+  xa_mark_t mark;
+
+  if (old)
+    before = xa_slot_is_entry (old) ? span
+                                    : ((struct xa_node *)old)->xa_values;
+
+  rcu_assign_pointer (node->xa_slots[offset], xa_mk_slot_entry (entry));
+  if (old && !xa_slot_is_entry (old))
+    xa_retire_subtree (xa, old);
+
+  for (mark = 0; mark < XA_MAX_MARKS; mark++)
+    xa_node_clear_mark (node, offset, mark);
+  if (!entry)
+    xa_note_free (xa, node, offset, true);
+  if (!old && entry)
+    node->xa_count++;
+  else if (old && !entry)
+    node->xa_count--;
+  for (; node; node = node->xa_parent)
+    xa_write (node->xa_values, node->xa_values - before + after);
+}
+
+/* Returns the largest shift of a node level such that one slot of it
+   covers index and nothing past last.  */
+static unsigned int
+xa_range_shift (unsigned long index, unsigned long last)
+{
+  unsigned int shift = 0;
+
+  while (shift + XA_BITS < 8 * sizeof (unsigned long))
+    {
+      unsigned long mask = (1lu << (shift + XA_BITS)) - 1;
+
+      if ((index & mask) || last - index < mask)
+        break;
+      shift += XA_BITS;
+    }
+  return shift;
+}
+
+int
+xa_store_range (struct xarray *xa, unsigned long first, unsigned long last,
+                void *entry)
+{
+  unsigned long index = first;
+
+  if (first > last || ((uintptr_t)entry & 3) == XA_ENTRY_TAG)
+    return errno = EINVAL, -1;
+  if (!entry)
+    return xa_erase_range (xa, first, last);
+  /* the whole index space would wrap the value counters to 0 */
+  if (first == 0 && last == XA_INDEX_MAX)
+    return errno = EINVAL, -1;
+
+  for (;;)
+    {
+      unsigned int shift = xa_range_shift (index, last);
+      unsigned long size = 1lu << shift;
+
+      if (shift == 0)
+        {
+          xa_mark_t mark;
+
+          if (xa_store (xa, index, entry) == XA_FAILED)
+            return -1;
+          for (mark = 0; mark < XA_MAX_MARKS; mark++)
+            if (!(xa->xa_flags & XA_FLAGS_ALLOC) || mark != XA_FREE_MARK)
+              xa_clear_mark (xa, index, mark);
+        }
+      else
+        {
+          struct xa_node *node = xa_get_node (xa, index, shift, 0);
+
+          if (!node)
+            return -1;
+          xa_set_slot (xa, node, xa_slot_index (shift, index), entry);
+        }
+
+      if (last - index < size)
+        break;
+      index += size;
+    }
+  return 0;
+}
+
+/* Returns the width of a leaf that can hold entries of widths a and b. */
+static inline unsigned int
+xa_width_join (unsigned int a, unsigned int b)
+{
+  if (a == 0 || b == 0)
+    return 0;
+  return a > b ? a : b;
+}
+
+/* Stores items[k] at indices[k], or at first + k if indices is NULL.
+   Each run of indices in one leaf takes one walk, and one update of the
+   counters on the path to the root.  */
+static int
+xa_store_many (struct xarray *xa, const unsigned long *indices,
+               unsigned long first, void *const *items, size_t n)
+{
+  size_t i = 0, j;
 
-  if (level + 1 < xa->xa_levels)
+  while (i < n)
     {
-      for (i = 0; i < XA_SLOT_MAX; ++i)
+      unsigned long index = indices ? indices[i] : first + i;
+      unsigned int packed = 1;
+      struct xa_node *node;
+      long delta = 0;
+
+      for (j = i; j < n; j++)
+        {
+          unsigned long next = indices ? indices[j] : first + j;
+
+          if ((next ^ index) & ~(unsigned long)XA_MASK)
+            break;
+          packed = xa_width_join (packed, xa_entry_width (items[j]));
+        }
+      if (!(xa->xa_flags & XA_FLAGS_PACKED))
+        packed = 0;
+
+      node = xa_get_leaf_by_index (xa, index, packed);
+      if (!node)
+        return -1;
+      if (!xa_width_fits (node->xa_packed, packed))
+        {
+          struct xa_node *new = xa_repack (xa, node, packed);
+
+          if (!new)
+            {
+              xa_prune (xa, node);
+              return -1;
+            }
+          node = new;
+        }
+
+      for (; i < j; i++)
+        {
+          unsigned int offset = (indices ? indices[i] : first + i) & XA_MASK;
+          void *old = xa_leaf_entry (node, offset);
+
+          xa_leaf_set (node, offset, items[i]);
+          if (old && !items[i])
+            {
+              xa_mark_t mark;
+
+              for (mark = 0; mark < XA_MAX_MARKS; mark++)
+                xa_node_clear_mark (node, offset, mark);
+              xa_note_free (xa, node, offset, true);
+              delta--;
+            }
+          else if (!old && items[i])
+            {
+              xa_note_free (xa, node, offset, false);
+              delta++;
+            }
+        }
+
+      node->xa_count += delta;
+      if (delta)
         {
-          xa_release_level (xa, level + 1, node->xa_slots[i]);
+          struct xa_node *p;
+
+          for (p = node; p; p = p->xa_parent)
+            xa_write (p->xa_values, p->xa_values + delta);
         }
+      xa_prune (xa, node);
     }
+  return 0;
+}
+
+int
+xa_store_batch (struct xarray *xa, const unsigned long *indices,
+                void *const *items, size_t n)
+{
+  return xa_store_many (xa, indices, 0, items, n);
+}
+
+int
+xa_store_array (struct xarray *xa, unsigned long first, void *const *items,
+                size_t n)
+{
+  if (n && XA_INDEX_MAX - first < n - 1)
+    return errno = EINVAL, -1;
+  return xa_store_many (xa, NULL, first, items, n);
+}
 
-  if (node->xa_count == 0)
+/* Erases [first, last] below node, whose span starts at base.  Slots
+   wholly inside the range are cleared at once, with the subtrees they
+   lead to, children left empty are unlinked, and the counters of each
+   node are updated once.  Returns the number of values erased.  Sets
+   *nomem if a multi-index entry could not be split.  */
+static unsigned long
+xa_erase_node (struct xarray *xa, struct xa_node *node, unsigned long base,
+               unsigned long first, unsigned long last, bool *nomem)
+{
+  unsigned long span = 1lu << node->xa_shift;
+  unsigned long lo = first > base ? first : base;
+  unsigned long hi = base | xa_node_span_mask (node);
+  unsigned long erased = 0;
+  unsigned int offset, end;
+  xa_mark_t mark;
+
+  if (last < hi)
+    hi = last;
+  end = xa_slot_index (node->xa_shift, hi);
+  for (offset = xa_slot_index (node->xa_shift, lo); offset <= end; offset++)
     {
-      xa->xa_node_num--;
-      if (node->xa_parent)
+      unsigned long start = base | (unsigned long)offset << node->xa_shift;
+      void *slot;
+
+      if (xa_is_leaf (node))
+        {
+          if (!xa_leaf_entry (node, offset))
+            continue;
+          xa_leaf_set (node, offset, NULL);
+          node->xa_count--;
+          erased++;
+        }
+      else if ((slot = node->xa_slots[offset]) == NULL)
+        continue;
+      else if (start >= first && start + (span - 1) <= last)
         {
-          node->xa_parent->xa_slots[node->xa_offset] = NULL;
-          node->xa_parent->xa_count--;
+          erased += xa_slot_is_entry (slot)
+                        ? span
+                        : ((struct xa_node *)slot)->xa_values;
+          rcu_assign_pointer (node->xa_slots[offset], NULL);
+          if (!xa_slot_is_entry (slot))
+            xa_retire_subtree (xa, slot);
+          node->xa_count--;
         }
       else
         {
-          xa->xa_slot = NULL;
+          struct xa_node *child = slot;
+
+          if (xa_slot_is_entry (slot))
+            {
+              child = xa_new_child (xa, node, offset, 0);
+              if (!child)
+                {
+                  *nomem = true;
+                  break;
+                }
+            }
+          erased += xa_erase_node (xa, child, start, first, last, nomem);
+          if (child->xa_count == 0)
+            {
+              rcu_assign_pointer (node->xa_slots[offset], NULL);
+              xa_retire_node (xa, child);
+              node->xa_count--;
+            }
+          else
+            {
+              /* the slot keeps the marks still set below it */
+              for (mark = 0; mark < XA_MAX_MARKS; mark++)
+                if (child->xa_marks[mark])
+                  xa_write (node->xa_marks[mark],
+                            node->xa_marks[mark] | 1lu << offset);
+                else
+                  xa_write (node->xa_marks[mark],
+                            node->xa_marks[mark] & ~(1lu << offset));
+              continue;
+            }
         }
-      free (node);
+
+      for (mark = 0; mark < XA_MAX_MARKS; mark++)
+        xa_write (node->xa_marks[mark],
+                  node->xa_marks[mark] & ~(1lu << offset));
+      if (xa->xa_flags & XA_FLAGS_ALLOC)
+        xa_write (node->xa_marks[XA_FREE_MARK],
+                  node->xa_marks[XA_FREE_MARK] | 1lu << offset);
     }
+
+  xa_write (node->xa_values, node->xa_values - erased);
+  return erased;
 }
 
-void
-xa_release (struct xarray *xa)
+int
+xa_erase_range (struct xarray *xa, unsigned long first, unsigned long last)
 {
   struct xa_node *node = xa->xa_slot;
+  bool nomem = false;
+
+  if (first > last)
+    return errno = EINVAL, -1;
+  if (!node || (first & ~xa_node_span_mask (node)))
+    return 0;
+
+  xa_erase_node (xa, node, 0, first, last, &nomem);
+  xa_prune (xa, node);
+  return nomem ? -1 : 0;
+}
+
+static inline unsigned long
+xa_shr (unsigned long x, unsigned int shift)
+{
+  return shift < 8 * sizeof (unsigned long) ? x >> shift : 0;
+}
+
+/* Counts the nodes of the subtree at base whose span meets
+   [first, last].  */
+static unsigned long
+xa_count_nodes (const struct xa_node *node, unsigned long base,
+                unsigned long first, unsigned long last)
+{
+  unsigned long lo = first > base ? first : base;
+  unsigned long hi = base | xa_node_span_mask (node);
+  unsigned long n = 1;
+  unsigned int offset;
+
+  if (last < hi)
+    hi = last;
+  if (lo > hi)
+    return 0;
+  if (xa_is_leaf (node))
+    return 1;
+
+  for (offset = xa_slot_index (node->xa_shift, lo);
+       offset <= xa_slot_index (node->xa_shift, hi); offset++)
+    {
+      struct xa_node *child = node->xa_slots[offset];
+
+      if (child && !xa_slot_is_entry (child))
+        n += xa_count_nodes (
+            child, base | (unsigned long)offset << node->xa_shift, first,
+            last);
+    }
+  return n;
+}
+
+int
+xa_reserve (struct xarray *xa, unsigned long first, unsigned long last)
+{
+  int levels = xa->xa_levels;
+  unsigned long need = 1; /* a spare for repacking a leaf */
+  unsigned long have = 0;
+  struct xa_node *node;
+  int shift, level;
+
+  if (first > last)
+    return errno = EINVAL, -1;
+
+  while (levels == 0 || last > xa_max_index (levels))
+    levels++;
+
+  /* every node of the final tree that meets the range, less those that
+     already exist */
+  for (shift = (levels - 1) * XA_BITS; shift >= 0; shift -= XA_BITS)
+    need += xa_shr (last, shift + XA_BITS) - xa_shr (first, shift + XA_BITS)
+            + 1;
+  if (xa->xa_slot)
+    need -= xa_count_nodes (xa->xa_slot, 0, first, last);
+
+  /* growing the tree adds a node per level over index 0 */
+  for (level = xa->xa_levels + 1; xa->xa_slot && level < levels; level++)
+    if (first > xa_max_index (level))
+      need++;
+
+  if (need > SIZE_MAX / 2 / sizeof (struct xa_node))
+    return errno = ENOMEM, -1;
+
+  for (node = xa->xa_cache[0]; node; node = node->xa_free_next)
+    have++;
+
+  while (have < need)
+    {
+      node = xa_mem_alloc (xa, sizeof (struct xa_node));
+      if (!node)
+        return errno = ENOMEM, -1;
+      node->xa_alloc_packed = 0;
+      node->xa_free_next = xa->xa_cache[0];
+      xa->xa_cache[0] = node;
+      xa->xa_stats.xs_cached++;
+      have++;
+    }
+  xa->xa_reserved = need;
+  return 0;
+}
+
+static void
+xa_free_level (struct xarray *xa, int level, struct xa_node *node)
+{
   if (!node)
     return;
 
-  while (node->xa_shift != 0 && node->xa_count == 1
-         && node->xa_slots[0] != NULL)
+  if (level < xa->xa_levels)
     {
-      node = node->xa_slots[0];
-      assert (node != xa->xa_slot);
-      free (xa->xa_slot);
-      xa->xa_slot = node;
-      xa->xa_node_num--;
-      xa->xa_levels--;
-      if (node)
+      int i;
+      for (i = 0; i < XA_SLOT_MAX && !xa_is_leaf (node); ++i)
         {
-          node->xa_parent = NULL;
+          if (!xa_slot_is_entry (node->xa_slots[i]))
+            xa_free_level (xa, level + 1, node->xa_slots[i]);
         }
+
+      xa_free_node (xa, node);
+    }
+}
+
+static void
+xa_free_list (struct xarray *xa, struct xa_node *node)
+{
+  while (node)
+    {
+      struct xa_node *next = node->xa_free_next;
+
+      xa_free_node (xa, node);
+      node = next;
     }
+}
+
+void
+xa_destroy (struct xarray *xa)
+{
+  unsigned int i;
 
-  xa_release_level (xa, 0, xa->xa_slot);
+  xa_free_level (xa, 0, xa->xa_slot);
+  xa_free_list (xa, xa->xa_retired);
+  xa->xa_retired = NULL;
+  for (i = 0; i < XA_CACHE_CLASSES; i++)
+    while (xa->xa_cache[i])
+      {
+        struct xa_node *node = xa->xa_cache[i];
+
+        xa->xa_cache[i] = node->xa_free_next;
+        xa_mem_free (xa, node, xa_node_size (node->xa_alloc_packed));
+      }
+  xa->xa_stats.xs_cached = 0;
+  xa->xa_reserved = 0;
+  xa->xa_slot = NULL;
+  xa->xa_node_num = 0;
+  xa->xa_levels = 0;
 }
 
-void *
-xa_find (struct xarray *xa, unsigned long *indexp, unsigned long last)
+unsigned long
+xa_size (const struct xarray *xa)
 {
-  unsigned long index = *indexp;
-  struct xa_node *node = xa->xa_slot;
+  struct xa_node *root = rcu_dereference (xa->xa_slot);
+  if (root)
+    {
+      return xa_read (root->xa_values);
+    }
+  return 0;
+}
 
-  if (!node)
-    return NULL;
+void
+xa_release (struct xarray *xa)
+{
+  struct xa_node *retired = xa->xa_retired;
+
+  /* stores prune as they go, so only the unlinked nodes are left */
+  xa->xa_retired = NULL;
+  if (retired && (xa->xa_flags & XA_FLAGS_RCU))
+    synchronize_rcu ();
+  xa_free_list (xa, retired);
+}
 
-  if (xa_max_index (xa->xa_levels) < last)
-    last = xa_max_index (xa->xa_levels);
+/* Scans from *nodep, whose span holds *indexp, for the first entry in
+   [*indexp, last], and leaves in *nodep the node holding its slot.  With
+   after, a multi-index entry that starts before *indexp is skipped.  */
+static void *
+xa_scan (struct xa_node **nodep, unsigned long *indexp, unsigned long last,
+         bool after)
+{
+  unsigned long first = *indexp, index = first;
+  struct xa_node *node = *nodep;
 
   while (index <= last)
     {
@@ -339,25 +1282,37 @@ xa_find (struct xarray *xa, unsigned long *indexp, unsigned long last)
 
       assert (node);
 
-      slot = node->xa_slots[xa_slot_index (node->xa_shift, index)];
+      if (xa_is_leaf (node))
+        slot = xa_leaf_entry (node, index & XA_MASK);
+      else
+        slot = rcu_dereference (
+            node->xa_slots[xa_slot_index (node->xa_shift, index)]);
+
+      if (slot && after && !xa_is_leaf (node) && xa_slot_is_entry (slot)
+          && (index & ~((1ul << node->xa_shift) - 1)) < first)
+        slot = NULL;
 
       if (slot)
         {
-          if (xa_is_leaf (node))
+          if (xa_is_leaf (node) || xa_slot_is_entry (slot))
             {
               *indexp = index;
-              return slot;
+              *nodep = node;
+              return xa_is_leaf (node) ? slot : xa_slot_entry (slot);
             }
 
           node = slot;
         }
       else
         {
-          index += 1ul << node->xa_shift;
+          /* the start of the next slot */
+          index = (index | ((1ul << node->xa_shift) - 1)) + 1;
+          if (index == 0)
+            break;
 
           while (node && xa_slot_index (node->xa_shift, index) == 0)
             {
-              node = node->xa_parent;
+              node = rcu_dereference (node->xa_parent);
             }
 
           if (!node)
@@ -368,38 +1323,1205 @@ xa_find (struct xarray *xa, unsigned long *indexp, unsigned long last)
   return NULL;
 }
 
+/* Finds the first entry in [*indexp, last].  With after, the search
+   starts past *indexp, and skips a multi-index entry covering *indexp.  */
+static void *
+xa_find_from (struct xarray *xa, unsigned long *indexp, unsigned long last,
+              bool after)
+{
+  unsigned long index = *indexp;
+  struct xa_node *node = rcu_dereference (xa->xa_slot);
+  void *entry;
+
+  if (after)
+    {
+      if (index >= last)
+        return NULL;
+      index++;
+    }
+
+  if (!node || (index & ~xa_node_span_mask (node)))
+    return NULL;
+
+  entry = xa_scan (&node, &index, last, after);
+  if (entry)
+    *indexp = index;
+  return entry;
+}
+
+void *
+xa_find (struct xarray *xa, unsigned long *indexp, unsigned long last)
+{
+  return xa_find_from (xa, indexp, last, false);
+}
+
 void *
 xa_find_after (struct xarray *xa, unsigned long *indexp, unsigned long last)
 {
-  void *ret;
+  return xa_find_from (xa, indexp, last, true);
+}
+
+/* The mirror of xa_scan: finds the last entry in [first, *indexp].  With
+   before, a multi-index entry that ends past *indexp is skipped.  */
+static void *
+xa_scan_back (struct xa_node **nodep, unsigned long *indexp,
+              unsigned long first, bool before)
+{
+  unsigned long start = *indexp, index = start;
+  struct xa_node *node = *nodep;
+
+  while (index >= first)
+    {
+      unsigned long low = (1ul << node->xa_shift) - 1;
+      void *slot;
+
+      if (xa_is_leaf (node))
+        slot = xa_leaf_entry (node, index & XA_MASK);
+      else
+        slot = rcu_dereference (
+            node->xa_slots[xa_slot_index (node->xa_shift, index)]);
+
+      if (slot && before && !xa_is_leaf (node) && xa_slot_is_entry (slot)
+          && (index | low) > start)
+        slot = NULL;
+
+      if (slot)
+        {
+          if (xa_is_leaf (node) || xa_slot_is_entry (slot))
+            {
+              *indexp = index;
+              *nodep = node;
+              return xa_is_leaf (node) ? slot : xa_slot_entry (slot);
+            }
+
+          node = slot;
+        }
+      else
+        {
+          /* the end of the previous slot */
+          if ((index & ~low) == 0)
+            break;
+          index = (index & ~low) - 1;
+
+          while (node && xa_slot_index (node->xa_shift, index) == XA_MASK)
+            node = rcu_dereference (node->xa_parent);
+
+          if (!node)
+            break;
+        }
+    }
+
+  return NULL;
+}
+
+/* Finds the last entry in [first, *indexp].  With before, the search
+   starts below *indexp, and skips a multi-index entry covering it.  */
+static void *
+xa_find_back (struct xarray *xa, unsigned long *indexp, unsigned long first,
+              bool before)
+{
   unsigned long index = *indexp;
+  struct xa_node *node = rcu_dereference (xa->xa_slot);
+  void *entry;
+
+  if (before)
+    {
+      if (index <= first)
+        return NULL;
+      index--;
+    }
 
-  if (index >= last)
+  if (!node || index < first)
     return NULL;
+  if (index > xa_node_span_mask (node))
+    {
+      /* nothing past the root, and no multi-index entry to skip */
+      index = xa_node_span_mask (node);
+      if (index < first)
+        return NULL;
+      before = false;
+    }
 
-  index += 1;
-  ret = xa_find (xa, &index, last);
-  if (ret)
+  entry = xa_scan_back (&node, &index, first, before);
+  if (entry)
     *indexp = index;
-  return ret;
+  return entry;
 }
 
-int
-xa_insert (struct xarray *xa, unsigned long *indexp, void *item,
-           unsigned long last)
+void *
+xa_find_prev (struct xarray *xa, unsigned long *indexp, unsigned long first)
+{
+  return xa_find_back (xa, indexp, first, false);
+}
+
+void *
+xa_find_before (struct xarray *xa, unsigned long *indexp, unsigned long first)
+{
+  return xa_find_back (xa, indexp, first, true);
+}
+
+void *
+xa_find_last (struct xarray *xa, unsigned long *indexp)
+{
+  *indexp = XA_INDEX_MAX;
+  return xa_find_back (xa, indexp, 0, false);
+}
+
+/* Returns the node to resume a walk to index from: the cached node or
+   its nearest ancestor whose span holds index, or else the root.  NULL
+   if the tree does not reach index.  */
+static struct xa_node *
+xas_start (const struct xa_state *xas, unsigned long index)
 {
-  struct xa_node *node = xa_get_leaf_with_space_by_index (xa, indexp, last);
+  struct xa_node *node = xas->xas_node;
+
+  while (node && ((index ^ xas->xas_index) & ~xa_node_span_mask (node)))
+    node = rcu_dereference (node->xa_parent);
   if (!node)
-    return -1;
+    {
+      node = rcu_dereference (xas->xas_xa->xa_slot);
+      if (node && (index & ~xa_node_span_mask (node)))
+        node = NULL;
+    }
+  return node;
+}
 
-  node->xa_slots[(*indexp) & XA_MASK] = item;
-  node->xa_count++;
-  while (node)
+/* Moves the cursor to index, walking down from node. */
+static void *
+xas_descend (struct xa_state *xas, struct xa_node *node, unsigned long index)
+{
+  xas->xas_index = index;
+  xas->xas_node = node;
+  if (!node)
+    return NULL;
+
+  while (!xa_is_leaf (node))
     {
-      node->xa_values++;
-      node = node->xa_parent;
+      void *slot = rcu_dereference (
+          node->xa_slots[xa_slot_index (node->xa_shift, index)]);
+
+      if (slot == NULL || xa_slot_is_entry (slot))
+        {
+          xas->xas_node = node;
+          return slot ? xa_slot_entry (slot) : NULL;
+        }
+      node = slot;
     }
-  return 0;
+
+  xas->xas_node = node;
+  return xa_leaf_entry (node, index & XA_MASK);
+}
+
+void *
+xas_load (struct xa_state *xas)
+{
+  return xas_descend (xas, xas_start (xas, xas->xas_index), xas->xas_index);
+}
+
+void *
+xas_next (struct xa_state *xas)
+{
+  unsigned long index = xas->xas_index + 1;
+
+  return xas_descend (xas, xas_start (xas, index), index);
+}
+
+void *
+xas_prev (struct xa_state *xas)
+{
+  unsigned long index = xas->xas_index - 1;
+
+  return xas_descend (xas, xas_start (xas, index), index);
+}
+
+/* Scans forward from index for xas_find and xas_find_after. */
+static void *
+xas_scan (struct xa_state *xas, unsigned long index, unsigned long last,
+          bool after)
+{
+  struct xa_node *node = xas_start (xas, index);
+  void *entry = NULL;
+
+  if (node && index <= last)
+    entry = xa_scan (&node, &index, last, after);
+  if (!entry)
+    {
+      xas->xas_node = NULL;
+      return NULL;
+    }
+  xas->xas_index = index;
+  xas->xas_node = node;
+  return entry;
+}
+
+void *
+xas_find (struct xa_state *xas, unsigned long last)
+{
+  return xas_scan (xas, xas->xas_index, last, false);
+}
+
+void *
+xas_find_after (struct xa_state *xas, unsigned long last)
+{
+  if (xas->xas_index >= last)
+    return NULL;
+  return xas_scan (xas, xas->xas_index + 1, last, true);
+}
+
+void *
+xas_store (struct xa_state *xas, void *item)
+{
+  struct xarray *xa = xas->xas_xa;
+  struct xa_node *node = xas->xas_node;
+  void *old;
+
+  if (!node || !xa_is_leaf (node))
+    {
+      unsigned int packed
+          = xa->xa_flags & XA_FLAGS_PACKED ? xa_entry_width (item) : 0;
+
+      node = xa_get_leaf_by_index (xa, xas->xas_index, packed);
+      if (!node)
+        return item ? XA_FAILED : NULL;
+    }
+
+  old = xa_leaf_store (xa, &node, xas->xas_index, item);
+  xas->xas_node = xa_prune (xa, node) ? NULL : node;
+  return old;
+}
+
+/* Finds the first free index in [*indexp, last] of an XA_FLAGS_ALLOC
+   array, following the free mark down the tree.  Indices beyond the
+   tree are free.  */
+static bool
+xa_find_free (const struct xarray *xa, unsigned long *indexp,
+              unsigned long last)
+{
+  unsigned long index = *indexp;
+  struct xa_node *node = xa->xa_slot;
+
+  if (!node || (index & ~xa_node_span_mask (node)))
+    return index <= last;
+
+  while (index <= last)
+    {
+      unsigned int offset = xa_slot_index (node->xa_shift, index);
+      unsigned long bits = node->xa_marks[XA_FREE_MARK] >> offset;
+
+      if (bits)
+        {
+          unsigned int next = offset + __builtin_ctzl (bits);
+          void *slot;
+
+          if (next != offset)
+            index = (index & ~xa_node_span_mask (node))
+                    | ((unsigned long)next << node->xa_shift);
+          if (index > last)
+            return false;
+
+          if (xa_is_leaf (node) || (slot = node->xa_slots[next]) == NULL)
+            {
+              *indexp = index;
+              return true;
+            }
+          assert (!xa_slot_is_entry (slot));
+          node = slot;
+          continue;
+        }
+
+      /* nothing free in the rest of this node */
+      index = (index | xa_node_span_mask (node)) + 1;
+      if (index == 0)
+        return false;
+
+      while (node && xa_slot_index (node->xa_shift, index) == 0)
+        node = node->xa_parent;
+
+      /* past the root */
+      if (!node)
+        {
+          *indexp = index;
+          return index <= last;
+        }
+    }
+  return false;
+}
+
+int
+xa_alloc (struct xarray *xa, unsigned long *idp, void *entry,
+          unsigned long min, unsigned long max)
+{
+  unsigned long index = min;
+
+  assert (xa->xa_flags & XA_FLAGS_ALLOC);
+  if (!entry || min > max)
+    return errno = EINVAL, -1;
+  if (!xa_find_free (xa, &index, max))
+    return errno = EBUSY, -1;
+  if (xa_store (xa, index, entry) == XA_FAILED)
+    return -1;
+  *idp = index;
+  return 0;
+}
+
+int
+xa_alloc_cyclic (struct xarray *xa, unsigned long *idp, void *entry,
+                 unsigned long min, unsigned long max, unsigned long *next)
+{
+  unsigned long start = *next < min || *next > max ? min : *next;
+
+  if (xa_alloc (xa, idp, entry, start, max) == 0
+      || (errno == EBUSY && start > min
+          && xa_alloc (xa, idp, entry, min, start - 1) == 0))
+    {
+      *next = *idp + 1;
+      return 0;
+    }
+  return -1;
+}
+
+int
+xa_insert (struct xarray *xa, unsigned long *indexp, void *item,
+           unsigned long last)
+{
+  unsigned int packed
+      = xa->xa_flags & XA_FLAGS_PACKED ? xa_entry_width (item) : 0;
+  struct xa_node *node = xa_get_leaf_with_space (xa, indexp, last, packed);
+  if (!node)
+    return -1;
+
+  if (!xa_width_fits (node->xa_packed, packed))
+    {
+      struct xa_node *new = xa_repack (xa, node, packed);
+
+      if (!new)
+        {
+          xa_prune (xa, node);
+          return -1;
+        }
+      node = new;
+    }
+
+  xa_leaf_set (node, (*indexp) & XA_MASK, item);
+  xa_note_free (xa, node, (*indexp) & XA_MASK, false);
+  node->xa_count++;
+  while (node)
+    {
+      xa_write (node->xa_values, node->xa_values + 1);
+      node = node->xa_parent;
+    }
+  return 0;
+}
+
+void
+xa_set_mark (struct xarray *xa, unsigned long index, xa_mark_t mark)
+{
+  const struct xa_node *found;
+  struct xa_node *node;
+
+  assert (mark < XA_MAX_MARKS);
+  assert (!(xa->xa_flags & XA_FLAGS_ALLOC) || mark != XA_FREE_MARK);
+  if (!xa_walk (xa, index, &found))
+    return;
+
+  /* marks are kept per index, so a multi-index entry is split first */
+  node = (struct xa_node *)found;
+  if (!xa_is_leaf (node))
+    {
+      node = xa_get_leaf_by_index (xa, index, 0);
+      if (!node)
+        return;
+    }
+  xa_node_set_mark (node, index & XA_MASK, mark);
+}
+
+void
+xa_clear_mark (struct xarray *xa, unsigned long index, xa_mark_t mark)
+{
+  const struct xa_node *node;
+
+  assert (mark < XA_MAX_MARKS);
+  assert (!(xa->xa_flags & XA_FLAGS_ALLOC) || mark != XA_FREE_MARK);
+  xa_walk (xa, index, &node);
+  if (node && xa_is_leaf (node))
+    xa_node_clear_mark ((struct xa_node *)node, index & XA_MASK, mark);
+}
+
+bool
+xa_get_mark (const struct xarray *xa, unsigned long index, xa_mark_t mark)
+{
+  const struct xa_node *node;
+
+  assert (mark < XA_MAX_MARKS);
+  xa_walk (xa, index, &node);
+  return node
+         && (xa_read (node->xa_marks[mark])
+             & (1lu << xa_slot_index (node->xa_shift, index)));
+}
+
+/* Like xa_find_from, for entries with the mark. */
+static void *
+xa_find_marked_from (struct xarray *xa, unsigned long *indexp,
+                     unsigned long last, xa_mark_t mark, bool after)
+{
+  unsigned long index = *indexp;
+  struct xa_node *node = rcu_dereference (xa->xa_slot);
+
+  assert (mark < XA_MAX_MARKS);
+  if (after)
+    {
+      if (index >= last)
+        return NULL;
+      index++;
+    }
+
+  if (!node)
+    return NULL;
+
+  if (xa_node_span_mask (node) < last)
+    last = xa_node_span_mask (node);
+
+  while (index <= last)
+    {
+      unsigned int offset = xa_slot_index (node->xa_shift, index);
+      unsigned long bits = xa_read (node->xa_marks[mark]) >> offset;
+      void *slot;
+
+      if (bits)
+        {
+          unsigned int next = offset + __builtin_ctzl (bits);
+
+          /* skipping ahead lands on the start of the marked slot */
+          if (next != offset)
+            index = (index & ~xa_node_span_mask (node))
+                    | ((unsigned long)next << node->xa_shift);
+          if (index > last)
+            break;
+
+          if (xa_is_leaf (node))
+            slot = xa_leaf_entry (node, next);
+          else
+            slot = rcu_dereference (node->xa_slots[next]);
+          if (slot && after && !xa_is_leaf (node) && xa_slot_is_entry (slot)
+              && (index & ~((1ul << node->xa_shift) - 1)) <= *indexp)
+            slot = NULL;
+          if (slot)
+            {
+              if (xa_is_leaf (node))
+                {
+                  *indexp = index;
+                  return slot;
+                }
+              if (xa_slot_is_entry (slot))
+                {
+                  *indexp = index;
+                  return xa_slot_entry (slot);
+                }
+              node = slot;
+              continue;
+            }
+
+          /* erased while we looked: move on to the next slot */
+          index = (index | ((1ul << node->xa_shift) - 1)) + 1;
+        }
+      else
+        {
+          /* nothing marked in the rest of this node */
+          index = (index | xa_node_span_mask (node)) + 1;
+        }
+
+      if (index == 0)
+        break;
+
+      while (node && xa_slot_index (node->xa_shift, index) == 0)
+        node = rcu_dereference (node->xa_parent);
+
+      if (!node)
+        break;
+    }
+
+  return NULL;
+}
+
+void *
+xa_find_marked (struct xarray *xa, unsigned long *indexp, unsigned long last,
+                xa_mark_t mark)
+{
+  return xa_find_marked_from (xa, indexp, last, mark, false);
+}
+
+void *
+xa_find_after_marked (struct xarray *xa, unsigned long *indexp,
+                      unsigned long last, xa_mark_t mark)
+{
+  return xa_find_marked_from (xa, indexp, last, mark, true);
+}
+
+/* A part of the range of xa_parallel_for_each: a subtree, or a
+   multi-index entry, clipped to [xu_first, xu_last].  */
+struct xa_unit
+{
+  struct xa_node *xu_node;
+  void *xu_entry;
+  unsigned long xu_first;
+  unsigned long xu_last;
+};
+
+/* units per thread, so that a thread that gets a dense part does not hold
+   up the others */
+#define XA_UNITS_PER_THREAD 8
+
+/* accumulators of two threads never share a line of this size */
+#define XA_CACHE_LINE 64
+
+struct xa_parallel_job
+{
+  const struct xarray *pj_xa;
+  const struct xa_parallel *pj_par;
+  struct xa_unit *pj_units;
+  size_t pj_nunits;
+  size_t pj_next; /* next unit to take */
+};
+
+struct xa_parallel_worker
+{
+  struct xa_parallel_job *pw_job;
+  void *pw_acc;
+  pthread_t pw_thread;
+};
+
+/* Splits the range into the subtrees and entries below the top levels of
+   the tree, a level at a time, until there are at least want of them.
+   Returns the number of units, or -1 if out of memory.  */
+static long
+xa_parallel_split (const struct xarray *xa, unsigned long first,
+                   unsigned long last, size_t want, struct xa_unit **unitsp)
+{
+  struct xa_node *root = xa->xa_slot;
+  struct xa_unit *units, *next;
+  size_t n = 0, k, m;
+  bool split = true;
+
+  if (!root || (first & ~xa_node_span_mask (root)))
+    return *unitsp = NULL, 0;
+  units = malloc (sizeof (*units));
+  if (!units)
+    return -1;
+  units[n++] = (struct xa_unit){ root, NULL, first,
+                                 last < xa_node_span_mask (root)
+                                     ? last
+                                     : xa_node_span_mask (root) };
+
+  while (n < want && split)
+    {
+      next = malloc (n * XA_SLOT_MAX * sizeof (*next));
+      if (!next)
+        {
+          free (units);
+          return -1;
+        }
+      split = false;
+      for (k = m = 0; k < n; k++)
+        {
+          struct xa_node *node = units[k].xu_node;
+          unsigned int offset, end;
+
+          if (!node || xa_is_leaf (node))
+            {
+              next[m++] = units[k];
+              continue;
+            }
+          split = true;
+          offset = xa_slot_index (node->xa_shift, units[k].xu_first);
+          end = xa_slot_index (node->xa_shift, units[k].xu_last);
+          for (; offset <= end; offset++)
+            {
+              void *slot = rcu_dereference (node->xa_slots[offset]);
+              unsigned long lo = (units[k].xu_first & ~xa_node_span_mask (node))
+                                 | (unsigned long)offset << node->xa_shift;
+              unsigned long hi = lo + ((1lu << node->xa_shift) - 1);
+
+              if (!slot)
+                continue;
+              next[m] = (struct xa_unit){ NULL, NULL,
+                                          lo > units[k].xu_first
+                                              ? lo
+                                              : units[k].xu_first,
+                                          hi < units[k].xu_last
+                                              ? hi
+                                              : units[k].xu_last };
+              if (xa_slot_is_entry (slot))
+                next[m].xu_entry = xa_slot_entry (slot);
+              else
+                next[m].xu_node = slot;
+              m++;
+            }
+        }
+      free (units);
+      units = next;
+      n = m;
+    }
+  *unitsp = units;
+  return n;
+}
+
+static void *
+xa_parallel_work (void *arg)
+{
+  struct xa_parallel_worker *w = arg;
+  struct xa_parallel_job *job = w->pw_job;
+  const struct xa_parallel *par = job->pj_par;
+  size_t k;
+
+  rcu_read_lock ();
+  while ((k = __atomic_fetch_add (&job->pj_next, 1, __ATOMIC_RELAXED))
+         < job->pj_nunits)
+    {
+      const struct xa_unit *unit = &job->pj_units[k];
+      struct xa_state xas = { (struct xarray *)job->pj_xa, unit->xu_first,
+                              unit->xu_node };
+      void *entry;
+
+      if (unit->xu_entry)
+        {
+          par->fn (unit->xu_first, unit->xu_entry, w->pw_acc, par->priv);
+          continue;
+        }
+      xas_for_each (&xas, entry, unit->xu_last)
+        par->fn (xas.xas_index, entry, w->pw_acc, par->priv);
+    }
+  rcu_read_unlock ();
+  return NULL;
+}
+
+int
+xa_parallel_for_each (const struct xarray *xa, unsigned long first,
+                      unsigned long last, unsigned int nthreads,
+                      const struct xa_parallel *par)
+{
+  struct xa_parallel_job job = { xa, par, NULL, 0, 0 };
+  struct xa_parallel_worker *workers;
+  size_t acc_size, i, started;
+  unsigned char *accs;
+  long n;
+
+  if (first > last)
+    return errno = EINVAL, -1;
+  if (nthreads == 0)
+    {
+      long cpus = sysconf (_SC_NPROCESSORS_ONLN);
+
+      nthreads = cpus > 0 ? cpus : 1;
+    }
+
+  /* keep the accumulators of two threads off one cache line */
+  acc_size = (par->acc_size + XA_CACHE_LINE - 1)
+             & ~(size_t)(XA_CACHE_LINE - 1);
+  if (acc_size && nthreads > SIZE_MAX / acc_size)
+    return errno = ENOMEM, -1;
+  workers = calloc (nthreads, sizeof (*workers));
+  accs = aligned_alloc (XA_CACHE_LINE,
+                        acc_size ? nthreads * acc_size : XA_CACHE_LINE);
+  if (accs)
+    memset (accs, 0, nthreads * acc_size);
+  if (!workers || !accs)
+    {
+      free (workers);
+      free (accs);
+      return errno = ENOMEM, -1;
+    }
+
+  /* the units stay valid until every worker is done with them */
+  rcu_read_lock ();
+  n = xa_parallel_split (xa, first, last,
+                         (size_t)nthreads * XA_UNITS_PER_THREAD, &job.pj_units);
+  if (n < 0)
+    {
+      rcu_read_unlock ();
+      free (workers);
+      free (accs);
+      return errno = ENOMEM, -1;
+    }
+  job.pj_nunits = n;
+  if ((size_t)nthreads > job.pj_nunits)
+    nthreads = job.pj_nunits ? job.pj_nunits : 1;
+
+  for (i = 0; i < nthreads; i++)
+    {
+      workers[i].pw_job = &job;
+      workers[i].pw_acc = accs + i * acc_size;
+    }
+
+  /* the calling thread is worker 0; if a thread cannot be started, the
+     others take its share */
+  for (started = 1; started < nthreads; started++)
+    if (pthread_create (&workers[started].pw_thread, NULL, xa_parallel_work,
+                        &workers[started]))
+      break;
+  xa_parallel_work (&workers[0]);
+  for (i = 1; i < started; i++)
+    pthread_join (workers[i].pw_thread, NULL);
+  rcu_read_unlock ();
+
+  if (par->reduce)
+    for (i = 0; i < started; i++)
+      par->reduce (workers[i].pw_acc, par->priv);
+
+  free (job.pj_units);
+  free (workers);
+  free (accs);
+  return 0;
+}
+
+/* An image written by xa_serialize is a header followed by the nodes in
+   breadth-first order, so that the top levels share a few pages.  A node
+   refers to its children by their byte offset in the image, which keeps
+   it valid wherever it is mapped.  Leaves are packed whenever their
+   values fit, whether or not the array had XA_FLAGS_PACKED.  */
+
+#define XA_IMAGE_MAGIC "XARRAY1"
+
+/* tells an image written with another byte order */
+#define XA_IMAGE_ORDER 0x01020304u
+
+struct xa_image_header
+{
+  char xh_magic[8];
+  uint32_t xh_order;
+  uint8_t xh_bits;    /* XA_BITS */
+  uint8_t xh_word;    /* sizeof (unsigned long) */
+  uint16_t xh_pad;
+  uint64_t xh_size;   /* bytes in the image */
+  uint64_t xh_root;   /* offset of the root, or 0 if empty */
+  uint64_t xh_values; /* xa_size */
+};
+
+struct xa_image_node
+{
+  uint8_t xn_shift;
+  uint8_t xn_packed; /* as xa_packed */
+  uint8_t xn_pad[sizeof (unsigned long) - 2];
+
+  /* An interior node holds the offsets of its children and its
+     multi-index entries, tagged as in memory.  A leaf holds its entries,
+     or is laid out as a packed leaf.  */
+  unsigned long xn_slots[];
+};
+
+static inline size_t
+xa_image_node_size (unsigned int packed)
+{
+  size_t size = packed ? sizeof (unsigned long) + XA_SLOT_MAX * packed
+                       : XA_SLOT_MAX * sizeof (unsigned long);
+
+  size = (size + sizeof (unsigned long) - 1) & ~(sizeof (unsigned long) - 1);
+  return offsetof (struct xa_image_node, xn_slots) + size;
+}
+
+/* Returns the width the image of a node is packed with, or -1 if the
+   node holds an entry that is not a value.  */
+static int
+xa_image_width (const struct xa_node *node)
+{
+  unsigned int offset, packed = 1;
+
+  if (!xa_is_leaf (node))
+    return 0;
+  for (offset = 0; offset < XA_SLOT_MAX; offset++)
+    {
+      void *entry = xa_leaf_entry (node, offset);
+
+      if (entry && !xa_is_value (entry))
+        return errno = EINVAL, -1;
+      packed = xa_width_join (packed, xa_entry_width (entry));
+    }
+  return packed;
+}
+
+/* Buffers the nodes of an image on their way to its file. */
+struct xa_image_writer
+{
+  int xw_fd;
+  off_t xw_pos;
+  size_t xw_len;
+  unsigned char xw_buf[1 << 16];
+};
+
+static int
+xa_image_write (int fd, const void *buf, size_t len, off_t pos)
+{
+  while (len)
+    {
+      ssize_t n = pwrite (fd, buf, len, pos);
+
+      if (n < 0 && errno == EINTR)
+        continue;
+      if (n < 0)
+        return -1;
+      buf = (const char *)buf + n;
+      len -= n;
+      pos += n;
+    }
+  return 0;
+}
+
+static int
+xa_image_flush (struct xa_image_writer *w)
+{
+  if (xa_image_write (w->xw_fd, w->xw_buf, w->xw_len, w->xw_pos))
+    return -1;
+  w->xw_pos += w->xw_len;
+  w->xw_len = 0;
+  return 0;
+}
+
+/* Builds the image of node in buf.  Its children are placed from *next
+   on and queued.  Returns the size of the image, or 0 with errno set.  */
+static size_t
+xa_image_node (const struct xa_node *node, struct xa_image_node *buf,
+               unsigned long *next, const struct xa_node **queue,
+               long *tail)
+{
+  int packed = xa_image_width (node);
+  unsigned int offset;
+  size_t size;
+
+  if (packed < 0)
+    return 0;
+  size = xa_image_node_size (packed);
+  memset (buf, 0, size);
+  buf->xn_shift = node->xa_shift;
+  buf->xn_packed = packed;
+
+  for (offset = 0; offset < XA_SLOT_MAX; offset++)
+    {
+      void *slot = xa_is_leaf (node) ? xa_leaf_entry (node, offset)
+                                     : node->xa_slots[offset];
+      unsigned char *data = (unsigned char *)&buf->xn_slots[1];
+      unsigned long v = xa_to_value (slot);
+      int width;
+
+      if (!slot)
+        continue;
+      if (packed)
+        {
+          buf->xn_slots[0] |= 1lu << offset;
+          if (packed == 1)
+            ((uint8_t *)data)[offset] = v;
+          else if (packed == 2)
+            ((uint16_t *)data)[offset] = v;
+          else
+            ((uint32_t *)data)[offset] = v;
+        }
+      else if (xa_is_leaf (node))
+        buf->xn_slots[offset] = (unsigned long)slot;
+      else if (xa_slot_is_entry (slot))
+        {
+          if (!xa_is_value (slot))
+            return errno = EINVAL, 0;
+          buf->xn_slots[offset] = (unsigned long)slot;
+        }
+      else
+        {
+          width = xa_image_width (slot);
+          if (width < 0)
+            return 0;
+          buf->xn_slots[offset] = *next;
+          *next += xa_image_node_size (width);
+          queue[(*tail)++] = slot;
+        }
+    }
+  return size;
+}
+
+int
+xa_serialize (const struct xarray *xa, int fd)
+{
+  const struct xa_node *root = xa->xa_slot;
+  struct xa_image_header hdr = { .xh_magic = XA_IMAGE_MAGIC,
+                                 .xh_order = XA_IMAGE_ORDER,
+                                 .xh_bits = XA_BITS,
+                                 .xh_word = sizeof (unsigned long) };
+  const struct xa_node **queue;
+  struct xa_image_writer *w;
+  unsigned long next = sizeof (hdr);
+  long head = 0, tail = 0;
+  int width, ret = -1;
+
+  queue = malloc ((xa->xa_node_num + 1) * sizeof (*queue));
+  w = malloc (sizeof (*w));
+  if (!queue || !w)
+    {
+      errno = ENOMEM;
+      goto out;
+    }
+  w->xw_fd = fd;
+  w->xw_pos = next;
+  w->xw_len = 0;
+
+  if (root)
+    {
+      width = xa_image_width (root);
+      if (width < 0)
+        goto out;
+      hdr.xh_root = next;
+      hdr.xh_values = root->xa_values;
+      next += xa_image_node_size (width);
+      queue[tail++] = root;
+    }
+
+  while (head < tail)
+    {
+      struct xa_image_node *buf;
+      size_t size;
+
+      if (sizeof (w->xw_buf) - w->xw_len < xa_image_node_size (0)
+          && xa_image_flush (w))
+        goto out;
+      buf = (struct xa_image_node *)(w->xw_buf + w->xw_len);
+      size = xa_image_node (queue[head++], buf, &next, queue, &tail);
+      if (!size)
+        goto out;
+      w->xw_len += size;
+    }
+  if (xa_image_flush (w))
+    goto out;
+
+  hdr.xh_size = next;
+  ret = xa_image_write (fd, &hdr, sizeof (hdr), 0);
+out:
+  free (queue);
+  free (w);
+  return ret;
+}
+
+/* Returns the node at offset of a mapped image, or NULL if offset does
+   not lead to a node of the given shift inside the image.  Lookups check
+   every node they visit, so a damaged image cannot make them read
+   outside the mapping.  */
+static inline const struct xa_image_node *
+xa_image_node_at (const struct xa_map *map, unsigned long offset,
+                  unsigned int shift)
+{
+  /* the smallest a node of this shift can be */
+  size_t size = xa_image_node_size (shift ? 0 : 1);
+  const struct xa_image_node *node;
+  unsigned int packed;
+
+  if (offset < sizeof (struct xa_image_header)
+      || offset % sizeof (unsigned long) || map->xm_size < size
+      || offset > map->xm_size - size)
+    return NULL;
+  node = (const struct xa_image_node *)(map->xm_base + offset);
+  if (node->xn_shift != shift)
+    return NULL;
+  if (shift)
+    return node;
+
+  packed = node->xn_packed;
+  if (packed > 4 || (packed & (packed - 1))
+      || map->xm_size - offset < xa_image_node_size (packed))
+    return NULL;
+  return node;
+}
+
+/* The root was checked by xa_map_readonly. */
+static inline const struct xa_image_node *
+xa_image_root (const struct xa_map *map)
+{
+  if (!map->xm_root)
+    return NULL;
+  return (const struct xa_image_node *)(map->xm_base + map->xm_root);
+}
+
+static inline void *
+xa_image_leaf_entry (const struct xa_image_node *node, unsigned int offset)
+{
+  const unsigned char *data = (const unsigned char *)&node->xn_slots[1];
+
+  if (!node->xn_packed)
+    return (void *)node->xn_slots[offset];
+  if (!(node->xn_slots[0] & (1lu << offset)))
+    return NULL;
+  switch (node->xn_packed)
+    {
+    case 1:
+      return xa_mk_value (((const uint8_t *)data)[offset]);
+    case 2:
+      return xa_mk_value (((const uint16_t *)data)[offset]);
+    default:
+      return xa_mk_value (((const uint32_t *)data)[offset]);
+    }
+}
+
+int
+xa_map_readonly (struct xa_map *map, int fd)
+{
+  struct xa_image_header hdr;
+  struct stat st;
+  void *base;
+
+  if (fstat (fd, &st))
+    return -1;
+  if ((size_t)st.st_size < sizeof (hdr))
+    return errno = EINVAL, -1;
+  base = mmap (NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  if (base == MAP_FAILED)
+    return -1;
+
+  memcpy (&hdr, base, sizeof (hdr));
+  if (memcmp (hdr.xh_magic, XA_IMAGE_MAGIC, sizeof (hdr.xh_magic))
+      || hdr.xh_order != XA_IMAGE_ORDER || hdr.xh_bits != XA_BITS
+      || hdr.xh_word != sizeof (unsigned long)
+      || hdr.xh_size < sizeof (hdr) || hdr.xh_size > (uint64_t)st.st_size)
+    {
+      munmap (base, st.st_size);
+      return errno = EINVAL, -1;
+    }
+
+  map->xm_base = base;
+  map->xm_size = hdr.xh_size;
+  map->xm_mapped = st.st_size;
+  map->xm_root = hdr.xh_root;
+  map->xm_values = hdr.xh_values;
+  if (hdr.xh_root)
+    {
+      unsigned int shift = 0;
+
+      if (hdr.xh_root < hdr.xh_size)
+        shift = map->xm_base[hdr.xh_root];
+      if (hdr.xh_root >= hdr.xh_size || shift % XA_BITS
+          || shift >= 8 * sizeof (unsigned long)
+          || !xa_image_node_at (map, hdr.xh_root, shift))
+        {
+          munmap (base, st.st_size);
+          return errno = EINVAL, -1;
+        }
+    }
+  return 0;
+}
+
+void
+xa_unmap (struct xa_map *map)
+{
+  if (map->xm_base)
+    munmap ((void *)map->xm_base, map->xm_mapped);
+  map->xm_base = NULL;
+}
+
+void *
+xa_map_load (const struct xa_map *map, unsigned long index)
+{
+  const struct xa_image_node *node = xa_image_root (map);
+  unsigned int shift;
+
+  if (!node || (index & ~xa_span_mask (node->xn_shift)))
+    return NULL;
+
+  /* the shift of each level is known before its node is read, so the
+     slot can be loaded without waiting for the node's header */
+  for (shift = node->xn_shift; shift != 0; shift -= XA_BITS)
+    {
+      unsigned long slot = node->xn_slots[xa_slot_index (shift, index)];
+
+      if (slot == 0)
+        return NULL;
+      if (xa_slot_is_entry ((void *)slot))
+        return xa_slot_entry ((void *)slot);
+      node = xa_image_node_at (map, slot, shift - XA_BITS);
+      if (!node)
+        return NULL;
+    }
+  return xa_image_leaf_entry (node, index & XA_MASK);
+}
+
+/* Scans the subtree of node, whose span starts at base, for the first
+   entry in [*indexp, last], like xa_scan.  */
+static void *
+xa_image_scan (const struct xa_map *map, const struct xa_image_node *node,
+               unsigned long base, unsigned long *indexp, unsigned long last,
+               bool after)
+{
+  unsigned int shift = node->xn_shift;
+  unsigned long start = *indexp > base ? *indexp : base;
+  unsigned int offset = xa_slot_index (shift, start);
+  unsigned int end = xa_slot_index (shift, base | xa_span_mask (shift));
+
+  for (; offset <= end; offset++)
+    {
+      unsigned long lo = base | (unsigned long)offset << shift;
+      const struct xa_image_node *child;
+      unsigned long slot;
+      void *entry;
+
+      if (lo > last)
+        break;
+      if (shift == 0)
+        {
+          entry = xa_image_leaf_entry (node, offset);
+          if (entry)
+            {
+              *indexp = lo;
+              return entry;
+            }
+          continue;
+        }
+
+      slot = node->xn_slots[offset];
+      if (slot == 0)
+        continue;
+      if (xa_slot_is_entry ((void *)slot))
+        {
+          /* a multi-index entry that starts before the scan was already
+             visited */
+          if (after && lo < *indexp)
+            continue;
+          *indexp = lo > *indexp ? lo : *indexp;
+          return xa_slot_entry ((void *)slot);
+        }
+      child = xa_image_node_at (map, slot, shift - XA_BITS);
+      if (child
+          && (entry = xa_image_scan (map, child, lo, indexp, last, after)))
+        return entry;
+    }
+  return NULL;
+}
+
+static void *
+xa_map_find_from (const struct xa_map *map, unsigned long *indexp,
+                  unsigned long last, bool after)
+{
+  const struct xa_image_node *root = xa_image_root (map);
+  unsigned long index = *indexp;
+  void *entry;
+
+  if (after)
+    {
+      if (index >= last)
+        return NULL;
+      index++;
+    }
+  if (!root || (index & ~xa_span_mask (root->xn_shift)))
+    return NULL;
+
+  entry = xa_image_scan (map, root, 0, &index, last, after);
+  if (entry)
+    *indexp = index;
+  return entry;
+}
+
+void *
+xa_map_find (const struct xa_map *map, unsigned long *indexp,
+             unsigned long last)
+{
+  return xa_map_find_from (map, indexp, last, false);
+}
+
+void *
+xa_map_find_after (const struct xa_map *map, unsigned long *indexp,
+                   unsigned long last)
+{
+  return xa_map_find_from (map, indexp, last, true);
 }
 
 int
@@ -21,10 +21,47 @@
 #ifndef XARRAY_H
 #define XARRAY_H
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdlib.h>
 
-/* A sparse array implemented as a radix tree */
+/* Allocates and frees the memory of nodes.  alloc returns NULL on
+   failure.  */
+struct xa_allocator
+{
+  void *(*alloc) (size_t size, void *priv);
+  void (*free) (void *ptr, size_t size, void *priv);
+  void *priv;
+};
+
+/* Node allocation counters of an xarray. */
+struct xa_stats
+{
+  unsigned long xs_allocs; /* nodes allocated */
+  unsigned long xs_reused; /* allocations served by the cache */
+  unsigned long xs_frees;  /* nodes freed */
+  unsigned long xs_cached; /* nodes in the cache */
+};
+
+/* the full size and the three packed leaf sizes */
+#define XA_CACHE_CLASSES 4
+
+/* free nodes kept in the cache beyond those reserved */
+#define XA_CACHE_MAX 64
+
+/* A sparse array implemented as a radix tree
+
+   Lookups (xa_load, xa_find, xa_get_mark, xa_size and the iterators) can
+   run concurrently with one writer if they are inside rcu_read_lock.
+   Modifications must be serialized by the caller, e.g. with a mutex.
+   Nodes and entries are published with release stores, so a reader sees
+   an entry's contents as they were when it was stored.  An array that is
+   read locklessly must be created with XA_FLAGS_RCU, so that the nodes a
+   store unlinks are only freed by xa_release after a grace period.
+
+   Freed nodes are kept in a per-array cache and reused by later
+   allocations, so churn does not go back to the allocator.  */
 struct xarray
 {
   /* pointer to the root node */
@@ -35,8 +72,33 @@ struct xarray
 
   /* depth of the tree */
   int8_t xa_levels;
+
+  unsigned int xa_flags;
+
+  /* unlinked nodes, freed by xa_release */
+  struct xa_node *xa_retired;
+
+  /* allocator for nodes, or NULL for malloc */
+  const struct xa_allocator *xa_allocator;
+
+  /* free nodes by allocation size, see XA_CACHE_MAX */
+  struct xa_node *xa_cache[XA_CACHE_CLASSES];
+
+  /* nodes the cache keeps for xa_reserve */
+  unsigned long xa_reserved;
+
+  struct xa_stats xa_stats;
 };
 
+/* nodes are freed after an RCU grace period */
+#define XA_FLAGS_RCU 0x1U
+
+/* leaves that hold only small value entries are packed */
+#define XA_FLAGS_PACKED 0x2U
+
+/* free indices are tracked for xa_alloc, in XA_MARK_0 */
+#define XA_FLAGS_ALLOC 0x4U
+
 /* bits of key used in each level */
 #define XA_BITS (sizeof (void *) == 8 ? 6 : 4)
 
@@ -49,13 +111,38 @@ struct xarray
 /* maximum allowed sparse array index */
 #define XA_INDEX_MAX ((unsigned long)-1)
 
+/* Marks tag entries so that they can be iterated over without visiting
+   the unmarked ones.  */
+typedef unsigned int xa_mark_t;
+
+#define XA_MARK_0 0U
+#define XA_MARK_1 1U
+#define XA_MARK_2 2U
+
+/* number of marks */
+#define XA_MAX_MARKS 3
+
+/* In an array with XA_FLAGS_ALLOC, this mark is set on the free slots
+   instead, so that xa_alloc can skip full subtrees.  Users cannot set or
+   clear it.  */
+#define XA_FREE_MARK XA_MARK_0
+
 struct xa_node
 {
   int8_t xa_shift;
   int8_t xa_offset;
   int8_t xa_count;         /* non null xa_slots */
+  uint8_t xa_packed;       /* bytes per value in a packed leaf, or 0 */
+  uint8_t xa_alloc_packed; /* xa_packed the memory was sized for */
   unsigned long xa_values; /* values in subtree */
+  /* bit i is set if slot i holds, or leads to, an entry with the mark */
+  unsigned long xa_marks[XA_MAX_MARKS];
   struct xa_node *xa_parent;
+  struct xa_node *xa_free_next; /* unlinked nodes awaiting freeing */
+
+  /* A packed leaf is allocated shorter and keeps a bitmap of the present
+     slots here, followed by XA_SLOT_MAX unsigned values of xa_packed
+     bytes each.  */
   void *xa_slots[XA_SLOT_MAX];
 };
 
@@ -64,23 +151,74 @@ struct xa_node
 #define XA_FAILED ((void *)-1)
 
 /* Statically initializes an xarray. */
-#define XA_INIT                                                               \
+#define XA_INIT_FLAGS(flags)                                                  \
   {                                                                           \
-    NULL, 0, 0                                                                \
+    .xa_flags = (flags)                                                       \
   }
 
+#define XA_INIT XA_INIT_FLAGS (0)
+
 /* Initializes an xarray. */
+static inline void
+xa_init_flags (struct xarray *xa, unsigned int flags)
+{
+  *xa = (struct xarray)XA_INIT_FLAGS (flags);
+}
+
 static inline void
 xa_init (struct xarray *xa)
 {
-  xa->xa_slot = NULL;
-  xa->xa_node_num = 0;
-  xa->xa_levels = 0;
+  xa_init_flags (xa, 0);
+}
+
+/* Value entries hold an integer in [0, LONG_MAX] in place of a pointer.
+   Pointers stored in an xarray must be at least 2-byte aligned.  In an
+   array with XA_FLAGS_PACKED, a leaf whose entries are all values below
+   2^32 stores them in 1, 2 or 4 bytes each.  */
+static inline void *
+xa_mk_value (unsigned long v)
+{
+  return (void *)((v << 1) | 1);
+}
+
+static inline unsigned long
+xa_to_value (const void *entry)
+{
+  return (unsigned long)entry >> 1;
 }
 
-/* Destroys an xarray. */
+static inline bool
+xa_is_value (const void *entry)
+{
+  return (unsigned long)entry & 1;
+}
+
+/* Destroys an xarray and frees its node cache.  There must be no
+   concurrent readers.  */
 void xa_destroy (struct xarray *xa);
 
+/* Sets the allocator for the nodes of an empty xarray.  allocator must
+   outlive the array.  */
+static inline void
+xa_set_allocator (struct xarray *xa, const struct xa_allocator *allocator)
+{
+  xa->xa_allocator = allocator;
+}
+
+/* Fills the node cache with every node that storing entries at all of
+   [first, last] could need, so that such stores cannot fail with ENOMEM
+   while the reserve lasts.  Each call replaces the previous reserve.
+   Stores that widen a packed leaf in an array with XA_FLAGS_RCU are not
+   covered.  Returns 0, or -1 with errno set.  */
+int xa_reserve (struct xarray *xa, unsigned long first, unsigned long last);
+
+/* Gets the node allocation counters. */
+static inline void
+xa_get_stats (const struct xarray *xa, struct xa_stats *stats)
+{
+  *stats = xa->xa_stats;
+}
+
 /* Stores a value to the xarray at given index.
    Returns XA_FAILED if the operations failes. */
 void *xa_store (struct xarray *xa, unsigned long index, void *item);
@@ -97,10 +235,51 @@ xa_erase (struct xarray *xa, unsigned long index)
 /* Loads a value from the xarray. */
 void *xa_load (const struct xarray *xa, unsigned long index);
 
-/* Returns the total number of values stored in the xarray. */
+/* Stores entry at every index in [first, last], or erases them if entry is
+   NULL.  Each aligned block of 2^(k * XA_BITS) indices in the range takes
+   a single slot of an interior node, so a large range costs a few slots
+   per level, loads resolve it without walking down to a leaf, and the
+   iterators visit it once per slot.  Storing to, or marking, one index
+   inside such a slot splits it, and the other indices keep the entry.
+   The stored indices lose their marks.  Pointer entries must
+   be 4-byte aligned.  The range cannot be the whole index space, whose
+   size does not fit in the counters.  Returns 0, or -1 with errno set;
+   on failure a part of the range may have been stored.  */
+int xa_store_range (struct xarray *xa, unsigned long first,
+                    unsigned long last, void *entry);
+
+/* Erases every entry in [first, last].  Subtrees inside the range are
+   dropped whole, and the counters of each node are updated once.
+   Returns 0, or -1 with errno set if a multi-index entry that the range
+   only partly covers could not be split.  */
+int xa_erase_range (struct xarray *xa, unsigned long first,
+                    unsigned long last);
+
+/* Stores items[k] at indices[k] for k < n.  Sorted indices are stored a
+   leaf at a time: one walk from the root, and one update of the counters
+   above, for each run of indices in the same leaf.  Returns 0, or -1
+   with errno set; on failure a part of the items may have been stored.  */
+int xa_store_batch (struct xarray *xa, const unsigned long *indices,
+                    void *const *items, size_t n);
+
+/* Stores items[k] at first + k for k < n, a leaf at a time.  This is
+   the bulk load path for a sorted array.  */
+int xa_store_array (struct xarray *xa, unsigned long first,
+                    void *const *items, size_t n);
+
+/* Returns log2 of the number of indices covered by the slot holding the
+   entry at index: nonzero for part of a range from xa_store_range.  */
+unsigned int xa_get_order (const struct xarray *xa, unsigned long index);
+
+/* Returns the total number of values stored in the xarray.  A
+   multi-index entry counts once per index.  An array that holds every
+   index, filled by parts, wraps the count to 0.  */
 unsigned long xa_size (const struct xarray *xa);
 
-/* Releases unneeded memory */
+/* Frees the nodes that stores have unlinked from an array created with
+   XA_FLAGS_RCU, after waiting for a grace period.  Must not be called
+   inside rcu_read_lock.  Without XA_FLAGS_RCU, stores free nodes at once
+   and this does nothing.  */
 void xa_release (struct xarray *xa);
 
 struct xa_node *xa_get_node_by_index (struct xarray *xa, unsigned long index);
@@ -115,9 +294,48 @@ void *xa_find (struct xarray *xa, unsigned long *indexp, unsigned long last);
 void *xa_find_after (struct xarray *xa, unsigned long *indexp,
                      unsigned long last);
 
+/* The mirrors of xa_find and xa_find_after: find the last entry in
+   [first, *indexp], or below *indexp.  */
+void *xa_find_prev (struct xarray *xa, unsigned long *indexp,
+                    unsigned long first);
+
+void *xa_find_before (struct xarray *xa, unsigned long *indexp,
+                      unsigned long first);
+
+/* Returns the entry with the highest index, and the index in *indexp.
+   The walk goes down the last non-empty slot of each level.  */
+void *xa_find_last (struct xarray *xa, unsigned long *indexp);
+
 int xa_insert (struct xarray *xa, unsigned long *indexp, void *item,
                unsigned long last);
 
+/* Sets a mark on the entry at index.  Does nothing if there is no entry. */
+void xa_set_mark (struct xarray *xa, unsigned long index, xa_mark_t mark);
+
+/* Clears a mark on the entry at index. */
+void xa_clear_mark (struct xarray *xa, unsigned long index, xa_mark_t mark);
+
+/* Returns true if the entry at index has the mark. */
+bool xa_get_mark (const struct xarray *xa, unsigned long index,
+                  xa_mark_t mark);
+
+/* Returns true if any entry has the mark. */
+static inline bool
+xa_marked (const struct xarray *xa, xa_mark_t mark)
+{
+  const struct xa_node *root = xa->xa_slot;
+
+  return root && root->xa_marks[mark];
+}
+
+/* Like xa_find and xa_find_after, but skip entries without the mark.
+   Subtrees without marked entries are skipped as a whole.  */
+void *xa_find_marked (struct xarray *xa, unsigned long *indexp,
+                      unsigned long last, xa_mark_t mark);
+
+void *xa_find_after_marked (struct xarray *xa, unsigned long *indexp,
+                            unsigned long last, xa_mark_t mark);
+
 #define xa_for_each_range(xa, index, value, start, end)                       \
   for ((index) = (start), (value) = xa_find ((xa), &(index), (end));          \
        (value) != NULL; (value) = xa_find_after ((xa), &(index), (end)))
@@ -125,4 +343,457 @@ int xa_insert (struct xarray *xa, unsigned long *indexp, void *item,
 #define xa_for_each(xa, index, value)                                         \
   xa_for_each_range (xa, index, value, 0, XA_INDEX_MAX)
 
+/* Iterates from end down to start. */
+#define xa_for_each_range_reverse(xa, index, value, start, end)               \
+  for ((index) = (end), (value) = xa_find_prev ((xa), &(index), (start));     \
+       (value) != NULL; (value) = xa_find_before ((xa), &(index), (start)))
+
+#define xa_for_each_reverse(xa, index, value)                                 \
+  xa_for_each_range_reverse (xa, index, value, 0, XA_INDEX_MAX)
+
+#define xa_for_each_marked_range(xa, index, value, start, end, mark)         \
+  for ((index) = (start),                                                     \
+      (value) = xa_find_marked ((xa), &(index), (end), (mark));               \
+       (value) != NULL;                                                       \
+       (value) = xa_find_after_marked ((xa), &(index), (end), (mark)))
+
+#define xa_for_each_marked(xa, index, value, mark)                            \
+  xa_for_each_marked_range (xa, index, value, 0, XA_INDEX_MAX, mark)
+
+/* Stores entry at the lowest free index in [min, max] of an array with
+   XA_FLAGS_ALLOC, and returns the index in *idp.  The free mark leads
+   the search down the tree, so it costs O(log n).  Returns 0, or -1 with
+   errno set to EBUSY if the range is full.  */
+int xa_alloc (struct xarray *xa, unsigned long *idp, void *entry,
+              unsigned long min, unsigned long max);
+
+/* Like xa_alloc, but searches from *next and wraps around to min, then
+   moves *next past the allocated index.  Indices are not reused until
+   the range wraps.  */
+int xa_alloc_cyclic (struct xarray *xa, unsigned long *idp, void *entry,
+                     unsigned long min, unsigned long max,
+                     unsigned long *next);
+
+/* An ID allocator without entries.  IDs are held by packed value
+   entries, a byte each.  */
+struct ida
+{
+  struct xarray ida_xa;
+};
+
+#define IDA_INIT                                                              \
+  {                                                                           \
+    XA_INIT_FLAGS (XA_FLAGS_ALLOC | XA_FLAGS_PACKED)                          \
+  }
+
+static inline void
+ida_init (struct ida *ida)
+{
+  xa_init_flags (&ida->ida_xa, XA_FLAGS_ALLOC | XA_FLAGS_PACKED);
+}
+
+/* Allocates the lowest free ID in [min, max]. */
+static inline int
+ida_alloc_range (struct ida *ida, unsigned long *idp, unsigned long min,
+                 unsigned long max)
+{
+  return xa_alloc (&ida->ida_xa, idp, xa_mk_value (0), min, max);
+}
+
+static inline void
+ida_free (struct ida *ida, unsigned long id)
+{
+  xa_erase (&ida->ida_xa, id);
+}
+
+static inline void
+ida_destroy (struct ida *ida)
+{
+  xa_destroy (&ida->ida_xa);
+}
+
+/* A cursor into an xarray.  It keeps the node that holds the slot of its
+   index, so that loads, stores and steps to nearby indices resume from
+   there instead of walking down from the root, and a dense scan costs
+   amortized O(1) per entry.  Readers use a cursor inside rcu_read_lock.
+   A cursor only stays valid while the array is modified through it;
+   after any other store, or xa_release, move it with xas_set.  */
+struct xa_state
+{
+  struct xarray *xas_xa;
+  unsigned long xas_index;
+  struct xa_node *xas_node; /* node holding the slot, or NULL */
+};
+
+#define XA_STATE(name, xa, index)                                             \
+  struct xa_state name = { (xa), (index), NULL }
+
+/* Moves the cursor to index. */
+static inline void
+xas_set (struct xa_state *xas, unsigned long index)
+{
+  xas->xas_index = index;
+  xas->xas_node = NULL;
+}
+
+/* Returns the entry at the cursor. */
+void *xas_load (struct xa_state *xas);
+
+/* Stores item at the cursor, like xa_store. */
+void *xas_store (struct xa_state *xas, void *item);
+
+/* Moves the cursor one index up or down, and returns the entry there. */
+void *xas_next (struct xa_state *xas);
+void *xas_prev (struct xa_state *xas);
+
+/* Like xa_find and xa_find_after, starting from the cursor and leaving it
+   at the entry found.  The cursor is not moved if there is none.  */
+void *xas_find (struct xa_state *xas, unsigned long last);
+
+void *xas_find_after (struct xa_state *xas, unsigned long last);
+
+#define xas_for_each(xas, entry, last)                                        \
+  for ((entry) = xas_find ((xas), (last)); (entry) != NULL;                   \
+       (entry) = xas_find_after ((xas), (last)))
+
+/* Callbacks of xa_parallel_for_each.  Each thread gets its own
+   accumulator of acc_size bytes, zero-filled, which fn updates for every
+   entry the thread visits.  Once all threads are done, reduce folds each
+   accumulator into priv, one at a time, in a fixed thread order.  reduce
+   may be NULL.  */
+struct xa_parallel
+{
+  void (*fn) (unsigned long index, void *entry, void *acc, void *priv);
+  void (*reduce) (void *acc, void *priv);
+  size_t acc_size;
+  void *priv;
+};
+
+/* Calls fn for every entry in [first, last], like xa_for_each_range,
+   from nthreads threads, or one per CPU if nthreads is 0.  The range is
+   cut into the subtrees below the top levels of the tree, several per
+   thread, and the threads take them in turn, so a dense part does not
+   hold up the others.  Within a subtree the entries are visited in
+   order; across subtrees the order is unspecified.  No locks are taken,
+   so the array must not be modified meanwhile, unless it has
+   XA_FLAGS_RCU, in which case a concurrent writer is seen as by
+   xa_for_each.  Returns 0, or -1 with errno set.  */
+int xa_parallel_for_each (const struct xarray *xa, unsigned long first,
+                          unsigned long last, unsigned int nthreads,
+                          const struct xa_parallel *par);
+
+/* A read-only xarray mapped from an image written by xa_serialize.
+   Lookups read the mapped pages directly, so only the pages on their
+   paths are loaded from the file.  The image holds no marks.  */
+struct xa_map
+{
+  const unsigned char *xm_base;
+  size_t xm_size;          /* bytes in the image */
+  size_t xm_mapped;        /* bytes mapped */
+  unsigned long xm_root;   /* offset of the root, or 0 */
+  unsigned long xm_values; /* xa_size of the array */
+};
+
+/* Writes an image of an xarray to fd from offset 0.  Only value entries
+   can be saved; if the array holds a pointer, this fails with EINVAL.
+   The image can only be mapped by a build with the same word size, byte
+   order and XA_BITS.  Returns 0, or -1 with errno set; on failure the
+   file holds no valid image.  */
+int xa_serialize (const struct xarray *xa, int fd);
+
+/* Maps the image in fd read-only.  Returns 0, or -1 with errno set. */
+int xa_map_readonly (struct xa_map *map, int fd);
+
+void xa_unmap (struct xa_map *map);
+
+/* Like xa_load, xa_find and xa_find_after, on a mapped image. */
+void *xa_map_load (const struct xa_map *map, unsigned long index);
+
+void *xa_map_find (const struct xa_map *map, unsigned long *indexp,
+                   unsigned long last);
+
+void *xa_map_find_after (const struct xa_map *map, unsigned long *indexp,
+                         unsigned long last);
+
+static inline unsigned long
+xa_map_size (const struct xa_map *map)
+{
+  return map->xm_values;
+}
+
+#define xa_map_for_each(map, index, value)                                    \
+  for ((index) = 0, (value) = xa_map_find ((map), &(index), XA_INDEX_MAX);    \
+       (value) != NULL;                                                       \
+       (value) = xa_map_find_after ((map), &(index), XA_INDEX_MAX))
+
+/* Declares a plain sparse array, struct name, with 2^bits slots per node
+   and indices of the unsigned type index_t, both fixed at compile time.
+   It has none of the xarray extras (marks, ranges, value packing, RCU
+   readers), so its nodes carry an 8-byte header instead of the xa_node
+   bookkeeping.  A small fanout saves memory on sparse indices at the cost
+   of more levels; a 32-bit index_t caps the height, e.g. at six levels
+   for bits 6.  Entries are any non-NULL pointers.  The generated functions
+   are:
+
+     void name_init (struct name *xa);
+     void *name_load (const struct name *xa, index_t index);
+     void *name_store (struct name *xa, index_t index, void *entry);
+     void *name_erase (struct name *xa, index_t index);
+     void *name_find (const struct name *xa, index_t *indexp, index_t last);
+     void *name_find_after (const struct name *xa, index_t *indexp,
+                            index_t last);
+     void name_destroy (struct name *xa);
+     size_t name_memory (const struct name *xa);
+
+   name_store returns the old entry, or XA_FAILED when a node cannot be
+   allocated, and frees nodes left empty.  name_memory returns the bytes
+   held in nodes.  bits may be at most 8.  */
+#define XA_DECLARE(name, index_t, bits)					\
+  struct name##_node							\
+  {									\
+    uint8_t shift;							\
+    uint16_t count;							\
+    void *slots[1u << (bits)];						\
+  };									\
+									\
+  struct name								\
+  {									\
+    struct name##_node *root;						\
+    size_t nodes;							\
+  };									\
+									\
+  static inline void							\
+  name##_init (struct name *xa)						\
+  {									\
+    xa->root = NULL;							\
+    xa->nodes = 0;							\
+  }									\
+									\
+  static inline index_t							\
+  name##_span_mask (unsigned int shift)					\
+  {									\
+    if (shift + (bits) >= 8 * sizeof (index_t))				\
+      return (index_t)-1;						\
+    return ((index_t)1 << (shift + (bits))) - 1;			\
+  }									\
+									\
+  static inline unsigned int						\
+  name##_offset (unsigned int shift, index_t index)			\
+  {									\
+    return (index >> shift) & ((1u << (bits)) - 1);			\
+  }									\
+									\
+  static inline void *							\
+  name##_load (const struct name *xa, index_t index)			\
+  {									\
+    const struct name##_node *node = xa->root;				\
+									\
+    if (node == NULL || (index & ~name##_span_mask (node->shift)))	\
+      return NULL;							\
+    while (node->shift)							\
+      {									\
+	node = node->slots[name##_offset (node->shift, index)];		\
+	if (node == NULL)						\
+	  return NULL;							\
+      }									\
+    return node->slots[name##_offset (0, index)];			\
+  }									\
+									\
+  static inline struct name##_node *					\
+  name##_new_node (struct name *xa, unsigned int shift)			\
+  {									\
+    struct name##_node *node = calloc (1, sizeof (*node));		\
+									\
+    if (node != NULL)							\
+      {									\
+	node->shift = shift;						\
+	xa->nodes++;							\
+      }									\
+    return node;							\
+  }									\
+									\
+  /* Drops root levels that only lead to slot 0. */			\
+  static inline void							\
+  name##_shrink (struct name *xa)					\
+  {									\
+    struct name##_node *node;						\
+									\
+    while ((node = xa->root)->shift && node->count == 1 && node->slots[0]) \
+      {									\
+	xa->root = node->slots[0];					\
+	free (node);							\
+	xa->nodes--;							\
+      }									\
+  }									\
+									\
+  /* Frees the empty nodes at the end of path, then shrinks the root. */ \
+  static inline void							\
+  name##_prune (struct name *xa, struct name##_node **path, int depth,	\
+		index_t index)						\
+  {									\
+    struct name##_node *node;						\
+									\
+    while (depth >= 0 && path[depth]->count == 0)			\
+      {									\
+	free (path[depth]);						\
+	xa->nodes--;							\
+	if (depth-- == 0)						\
+	  {								\
+	    xa->root = NULL;						\
+	    return;							\
+	  }								\
+	node = path[depth];						\
+	node->slots[name##_offset (node->shift, index)] = NULL;		\
+	node->count--;							\
+      }									\
+    name##_shrink (xa);							\
+  }									\
+									\
+  static inline void *							\
+  name##_store (struct name *xa, index_t index, void *entry)		\
+  {									\
+    struct name##_node *path[8 * sizeof (index_t) / (bits) + 1];	\
+    struct name##_node *node;						\
+    unsigned int shift = 0;						\
+    int depth = 0;							\
+    void **slot;							\
+    void *old;								\
+									\
+    if (entry == NULL && name##_load (xa, index) == NULL)		\
+      return NULL;							\
+    if (xa->root == NULL)						\
+      {									\
+	while (index & ~name##_span_mask (shift))			\
+	  shift += (bits);						\
+	if ((xa->root = name##_new_node (xa, shift)) == NULL)		\
+	  return XA_FAILED;						\
+      }									\
+    while (index & ~name##_span_mask (xa->root->shift))			\
+      {									\
+	node = name##_new_node (xa, xa->root->shift + (bits));		\
+	if (node == NULL)						\
+	  {								\
+	    name##_shrink (xa);						\
+	    return XA_FAILED;						\
+	  }								\
+	node->slots[0] = xa->root;					\
+	node->count = 1;						\
+	xa->root = node;						\
+      }									\
+    for (node = xa->root;; node = *slot)				\
+      {									\
+	path[depth] = node;						\
+	slot = &node->slots[name##_offset (node->shift, index)];	\
+	if (node->shift == 0)						\
+	  break;							\
+	if (*slot == NULL)						\
+	  {								\
+	    if ((*slot = name##_new_node (xa, node->shift - (bits))) == NULL) \
+	      {								\
+		name##_prune (xa, path, depth, index);			\
+		return XA_FAILED;					\
+	      }								\
+	    node->count++;						\
+	  }								\
+	depth++;							\
+      }									\
+    old = *slot;							\
+    *slot = entry;							\
+    node->count += (entry != NULL) - (old != NULL);			\
+    if (entry == NULL)							\
+      name##_prune (xa, path, depth, index);				\
+    return old;								\
+  }									\
+									\
+  static inline void *							\
+  name##_erase (struct name *xa, index_t index)				\
+  {									\
+    return name##_store (xa, index, NULL);				\
+  }									\
+									\
+  static inline void *							\
+  name##_scan (const struct name##_node *node, index_t base,		\
+	       index_t *indexp, index_t last)				\
+  {									\
+    unsigned int off = 0, end;						\
+    void *entry;							\
+									\
+    if (*indexp > base)							\
+      off = name##_offset (node->shift, *indexp);			\
+    end = name##_offset (node->shift, base | name##_span_mask (node->shift)); \
+    for (; off <= end; off++)						\
+      {									\
+	index_t at = base | (index_t)off << node->shift;		\
+									\
+	if (at > last)							\
+	  break;							\
+	if (node->slots[off] == NULL)					\
+	  continue;							\
+	if (node->shift == 0)						\
+	  {								\
+	    *indexp = at;						\
+	    return node->slots[off];					\
+	  }								\
+	entry = name##_scan (node->slots[off], at, indexp, last);	\
+	if (entry != NULL)						\
+	  return entry;							\
+      }									\
+    return NULL;							\
+  }									\
+									\
+  static inline void *							\
+  name##_find (const struct name *xa, index_t *indexp, index_t last)	\
+  {									\
+    index_t index = *indexp;						\
+    void *entry;							\
+									\
+    if (xa->root == NULL || index > last				\
+	|| (index & ~name##_span_mask (xa->root->shift)))		\
+      return NULL;							\
+    entry = name##_scan (xa->root, 0, &index, last);			\
+    if (entry != NULL)							\
+      *indexp = index;							\
+    return entry;							\
+  }									\
+									\
+  static inline void *							\
+  name##_find_after (const struct name *xa, index_t *indexp, index_t last) \
+  {									\
+    index_t index = *indexp + 1;					\
+    void *entry;							\
+									\
+    if (*indexp >= last)						\
+      return NULL;							\
+    entry = name##_find (xa, &index, last);				\
+    if (entry != NULL)							\
+      *indexp = index;							\
+    return entry;							\
+  }									\
+									\
+  static inline void							\
+  name##_free (struct name##_node *node)				\
+  {									\
+    unsigned int i;							\
+									\
+    for (i = 0; node->shift && i < (1u << (bits)); i++)			\
+      if (node->slots[i] != NULL)					\
+	name##_free (node->slots[i]);					\
+    free (node);							\
+  }									\
+									\
+  static inline void							\
+  name##_destroy (struct name *xa)					\
+  {									\
+    if (xa->root != NULL)						\
+      name##_free (xa->root);						\
+    name##_init (xa);							\
+  }									\
+									\
+  static inline size_t							\
+  name##_memory (const struct name *xa)					\
+  {									\
+    return xa->nodes * sizeof (struct name##_node);			\
+  }
+
+
 #endif // XARRAY_H